@@ -5,3 +5,8 @@
 
 COMPONENT_ADD_INCLUDEDIRS := welink/include port/include
 COMPONENT_SRCDIRS := port
+
+# assert()和abort()先输出异步日志队列，见esp_welink_log.c中的__wrap_abort
+ifdef CONFIG_WELINK_LOG_FLUSH_ON_ABORT
+COMPONENT_ADD_LDFLAGS := -l$(COMPONENT_NAME) -Wl,--wrap=abort
+endif
@@ -28,7 +28,9 @@
 #include "freertos/queue.h"
 
 #include "nvs_flash.h"
+#include "esp_welink_boot.h"
 #include "esp_welink_log.h"
+#include "esp_welink_sched.h"
 #include "txd_wifi.h"
 #include "txd_welink.h"
 
@@ -36,12 +38,24 @@ xQueueHandle welink_task_queue = NULL;
 
 void app_main() 
 {
+    // 记录从上电到上线各阶段的耗时，上线后打印并上报
+    esp_welink_boot_mark(ESP_WELINK_BOOT_APP_MAIN);
+    esp_welink_boot_config_t boot_config = ESP_WELINK_BOOT_CONFIG_DEFAULT();
+    boot_config.property_id = CONFIG_WELINK_BOOT_PROPERTY_ID;
+    boot_config.report = esp_welink_sched_report;
+    esp_welink_boot_init(&boot_config);
+
+#ifdef CONFIG_WELINK_LOG_SINK
+    esp_welink_log_sink_start(1, 1024*3);
+#endif
+
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK( ret );
+    esp_welink_boot_mark(ESP_WELINK_BOOT_NVS_INIT);
 
     welink_task_queue = xQueueCreate(10, sizeof(uint8_t));
     xTaskCreate(esp_welink_handler, "esp_welink_task", 1024*16, NULL, configMAX_PRIORITIES - 3, NULL);
@@ -29,21 +29,30 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 
-#include "esp_ota_ops.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_err.h"
+#define WELINK_LOG_MODULE WELINK_LOG_MODULE_DATAPOINT
 #include "esp_welink_log.h"
-#include "netdb.h"
-#include "lwip/inet.h"
+#include "esp_welink_boot.h"
+#include "esp_welink_chunk.h"
+#include "esp_welink_clock.h"
+#include "esp_welink_cookie.h"
+#include "esp_welink_dedup.h"
+#include "esp_welink_dispatch.h"
+#include "esp_welink_loop.h"
+#include "esp_welink_sched.h"
+#include "esp_welink_sf.h"
+#include "esp_welink_shadow.h"
+#include "esp_welink_status.h"
 
 #include "txd_sdk.h"
 #include "txd_stdapi.h"
 #include "txd_baseapi.h"
 #include "txd_error.h"
-#include "txd_ota.h"
 #include "txd_stdtypes.h"
 #include "txd_thread.h"
+#include "txd_welink_ota.h"
 
 static const char* TAG = "txd_welink";
 
@@ -51,427 +60,137 @@ static const char* TAG = "txd_welink";
 #define TEST_LICENSE   CONFIG_WELINK_LICENSE
 #define TEST_PID       CONFIG_WELINK_PID
 
+#define WELINK_COOKIE_CLASS_ACK     0       // 发送时延统计的分类：命令ACK
+#define WELINK_COOKIE_TIMEOUT_MS    30000   // 超过该时间没有回调的消息计为丢失
+#define WELINK_TELEMETRY_PERIOD_MS  60000   // 周期上报的间隔
+
 static const uint8_t fw_version[]     = "v1.0.0";
 static const uint8_t CLIENT_PUB_KEY[] = {0x02, 0x63, 0x16, 0xD4, 0xE3, 0x7B, 0xFE, 0x2B, 0xD1, 0x72, 0x99, 0xAF, 0x86, 0x26, 0xC2, 0xF1, 0xCC, 0x50, 0xF4, 0xCF, 0x3E, 0x54, 0x58, 0x5D, 0x08};
 static const uint8_t AUTH_KEY[]       = {0x1F, 0xBF, 0xE8, 0x30, 0xA6, 0x94, 0xA3, 0xCB, 0xEA, 0xE8, 0xB8, 0xF0, 0x28, 0xD4, 0x1C, 0x9C};
-static uint8_t g_ota_url[512] = {0};
 
 extern xQueueHandle welink_task_queue;
 
-/*****************************OTA************************************/
-xQueueHandle welink_ota_queue = NULL;
-
-typedef struct {
-    uint32_t status_code;
-    uint8_t  *body;
-    uint32_t body_len;
-} http_response_result_t;
-
-static int32_t txd_http_download(const uint8_t *url, const uint8_t *file_type, const uint8_t *file_key);
-static void get_host_from_url(const uint8_t *url, uint8_t *host, uint32_t host_size, uint8_t *path);
-static bool parse_http_response(const uint8_t *response, uint32_t response_len, http_response_result_t *result);
-
-void get_host_from_url(const uint8_t *url, uint8_t *host, uint32_t host_size, uint8_t *path) {
-    uint32_t i, url_len, s, t;
-    url_len = txd_strlen((char *)url);
-
-    s = 0;
-    for (i = 0; i < url_len; ++i) {
-        if (url[i] == '/') {
-            s = i + 2;
-            break;
-        }
-    }
-
-    t = url_len;
-    for (i = s; i < url_len; ++i) {
-        if (url[i] == '/') {
-            t = i;
-            break;
-        }
-    }
+/****************************消息回调*********************************/
+void welink_send_msg_cb(int32_t err_code, uint32_t cookie)
+{
+    WELINK_LOGI("%s - err_code[%d] cookie[%d]", __func__, err_code, cookie);
 
-    // host: url[s,t)
-    if (s && t && (t-s) < host_size) {
-        txd_memcpy(host, url + s, t - s);
-        host[t-s] = '\0';
+    if (err_code == err_success) {
+        esp_welink_boot_mark(ESP_WELINK_BOOT_FIRST_REPORT);
     }
-
-    // path: ulr[t,end]
-    txd_memcpy(path, url + t, url_len - t);
 }
 
-bool parse_http_response(const uint8_t *response, uint32_t response_len, http_response_result_t *result) {
-    uint32_t i, p, q, m;
-    uint8_t status[4] = {0};
-    uint32_t content_length = 0;
-    bool ret = false;
-    const uint8_t *content_length_buf1 = (uint8_t *)("CONTENT-LENGTH");
-    const uint8_t *content_length_buf2 = (uint8_t *)("Content-Length");
-    const uint32_t content_length_buf_len = txd_strlen((char *)content_length_buf1);
-
-    // status code
-    i = p = q = m = 0;
-    for (; i < response_len; ++i) {
-        if (' ' == response[i]) {
-            ++m;
-            if (1 == m) {
-                p = i;
-            } else if (2 == m) {
-                q = i;
-                break;
-            }
-        }
-    }
-    if (!p || !q || q-p != 4) {
-        return false;
-    }
+// ACK的发送结果：只有welink_ack_datapoint提交过的cookie才交给时延统计，统计从提交到SDK回调的端到端时延和错误率
+static void welink_ack_send_cb(int32_t err_code, uint32_t cookie)
+{
+    esp_welink_cookie_complete(err_code, cookie);
+    welink_send_msg_cb(err_code, cookie);
+}
 
-    txd_memcpy(status, response+p+1, 3);
-
-    // Content-Length
-    p = q = 0;
-    for (i = 0; i < response_len; ++i) {
-        if (response[i] == '\r' && response[i+1] == '\n') {
-            q = i;
-
-            if (!txd_memcmp(response+p, content_length_buf1, content_length_buf_len) ||
-                    !txd_memcmp(response+p, content_length_buf2, content_length_buf_len)) {
-                int j1 = p+content_length_buf_len, j2 = q-1;
-                while ( j1 < q && (*(response+j1) == ':' || *(response+j1) == ' ') ) ++j1;
-                while ( j2 > j1 && *(response+j2) == ' ') --j2;
-                // [j1,j2]
-                uint8_t len_buf[12] = {0};
-                txd_memcpy(len_buf, response+j1, j2-j1+1);
-                content_length = atoi((char *)len_buf);
-                ret = true;
-            }
-            p = i+2;
-        }
-        if (response[i] == '\r' && response[i+1] == '\n' &&
-                response[i+2] == '\r' && response[i+3] == '\n') {
-            p = i+4;
-            break;
-        }
-    }
+// ACK经调度器的高优先级通道发送，不会被周期上报挤占，也不会收到err_msg_send_too_frequently
+static int32_t welink_ack_datapoint(txd_datapoint_t* datapoint, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    int32_t ret = esp_welink_sched_ack(datapoint, pCb, pCookie);
 
-    if (ret) {
-        result->status_code = atoi((char *)status);
-        result->body = response + p;
-        result->body_len = content_length;
+    if (ret == err_success && pCb == welink_ack_send_cb) {
+        esp_welink_cookie_submit(*pCookie, WELINK_COOKIE_CLASS_ACK);
     }
 
-    return ret && (response_len >= p + content_length);  // 期望值是 response_len == p + content_length
+    return ret;
 }
 
-int32_t txd_http_download(const uint8_t *url, const uint8_t *file_type, const uint8_t *file_key) 
+#if CONFIG_WELINK_TELEMETRY_PROPERTY_ID
+// 周期上报空闲内存，开启存储转发时离线期间的上报写入flash，上线后按序重放
+static void welink_telemetry_report(void* arg)
 {
-    uint32_t timeout_ms = 5000;
-    uint32_t request_len = 0;
-    http_response_result_t rsp_result = {0};
-    txd_socket_handler_t *sock = NULL;
+    uint8_t value[16] = {0};
+    txd_datapoint_t datapoint = {0};
+    uint32_t cookie = 0;
     int32_t ret = 0;
-    int32_t result_ret = 0;
-    uint8_t *ip = NULL;
-    esp_err_t err;
-    esp_ota_handle_t update_handle = 0 ;
-    struct hostent *h = NULL;
-    const esp_partition_t *update_partition = NULL;
-    const esp_partition_t *configured = esp_ota_get_boot_partition();
-    const esp_partition_t *running = esp_ota_get_running_partition();
-    uint8_t *request  = NULL;
-    uint8_t *hostname = NULL;
-    uint8_t *pathname = NULL;
-    uint8_t *response = NULL;
-
-    if (configured != running) {
-        WELINK_LOGI("Configured OTA boot partition at offset 0x%08x, but running from offset 0x%08x",configured->address, running->address);
-        WELINK_LOGI("(This can happen if either the OTA boot data or preferred boot image become corrupted somehow.)");
-    }
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    assert(update_partition != NULL);
-    WELINK_LOGI("Running partition type %d subtype %d (offset 0x%08x)",running->type, running->subtype, running->address);
-    WELINK_LOGI("Writing to partition subtype %d at offset 0x%x",update_partition->subtype, update_partition->address);
-
-    hostname = (uint8_t *)txd_malloc(255 * sizeof(uint8_t));
-    pathname = (uint8_t *)txd_malloc(512 * sizeof(uint8_t));
-
-    if ((hostname == NULL) || (pathname == NULL)) {
-        WELINK_LOGE("txd_http_download --- malloc failed\n");
-        goto end;
-    }
-
-    txd_memset(hostname, 0x0, 255);
-    txd_memset(pathname, 0x0, 512);
-
-    get_host_from_url(url, hostname, sizeof(hostname), pathname);
-    h = gethostbyname((char *)hostname);
-    if (!h) {
-        result_ret = -1;
-        goto end;
-    }
-    ip = (uint8_t *)inet_ntoa(*((struct in_addr *)h->h_addr));
-    if (!ip) {
-        result_ret = -1;
-        goto end;
-    }
-
-    request  = (uint8_t *)txd_malloc(512 * sizeof(uint8_t));
-
-    if (request == NULL) {
-        WELINK_LOGE("txd_http_download --- malloc failed\n");
-        goto end;
-    }
-
-    txd_memset(request,  0x0, 512);
-
-    snprintf((char *)request, sizeof(request), "GET %s HTTP/1.1\r\nHost:%s\r\nAccept: */*\r\nContent-Type: application/x-www-form-urlencoded\r\n\r\n", pathname, hostname);
-    request_len = txd_strlen((char *)request);
-
-    if (hostname) {
-        txd_free(hostname);
-    }
 
-    if (pathname) {
-        txd_free(pathname);
-    }
-
-    WELINK_LOGI("txd_http_download --- ip[%s]\n", ip);
-    WELINK_LOGI("txd_http_download --- request[%s]\n", request);
-    // connect server
-    sock = txd_tcp_socket_create();
-    if (!sock) {
-        WELINK_LOGE("txd_http_download --- txd_tcp_socket_create failed\n");
-        result_ret = -1;
-        goto end;
-    }
-    ret = txd_tcp_connect(sock, ip, 80, timeout_ms);
-    if (ret != 0) {
-        WELINK_LOGE("txd_http_download --- txd_tcp_connect failed: err[%d]\n", ret);
-        result_ret = -1;
-        goto end;
-    }
-
-    // send request
-    ret = txd_tcp_send(sock, request, request_len, timeout_ms);
-    if (ret != request_len) {
-        WELINK_LOGE("txd_http_download --- txd_tcp_send failed: request_len[%d] ret[%d]\n", request_len, ret);
-        result_ret = -1;
-        goto end;
-    }
-
-    if (request) {
-        txd_free(request);
-    }
+    datapoint.property_id = CONFIG_WELINK_TELEMETRY_PROPERTY_ID;
+    datapoint.property_value = value;
+    datapoint.property_value_len = snprintf((char*)value, sizeof(value), "%u", esp_get_free_heap_size());
 
-    response = (uint8_t *)txd_malloc(1024 * sizeof(uint8_t));
+#ifdef CONFIG_WELINK_STORE_FORWARD
+    ret = esp_welink_sf_report(&datapoint, 1, welink_send_msg_cb, &cookie);
+#else
+    ret = esp_welink_sched_report(&datapoint, 1, welink_send_msg_cb, &cookie);
+#endif
 
-    if (response == NULL) {
-        WELINK_LOGE("txd_http_download --- malloc failed\n");
-        goto end;
+    if (ret != err_success) {
+        WELINK_LOGW("%s - report err, errcode[%d]", __func__, ret);
     }
-
-    txd_memset(response, 0x0, 1024);
-
-    // receive
-    {
-        uint32_t idx = 0, temp = 0, lastTime = 0;
-
-        // read header
-        // 检查status_code来判断是否已接收完header
-        while (0 == rsp_result.status_code) {
-            ret = txd_tcp_recv(sock, response+idx, sizeof(response)-idx, timeout_ms);
-            if (0 ==ret) {
-                WELINK_LOGI("rsp_result.status_code == 0\n");
-                continue;
-            }
-            else if (ret < 0) {
-                WELINK_LOGE("txd_http_download --- txd_tcp_recv failed: ret[%d]\n", ret);
-                result_ret = -1;
-                goto end;
-            }
-            idx += ret;
-            txd_memset(&rsp_result, 0, sizeof(rsp_result));
-            parse_http_response(response, idx, &rsp_result);
-        }
-
-        if (0 == rsp_result.body_len) {
-            WELINK_LOGE("txd_http_download --- rsp_result.body_len[0]\n");
-            result_ret = -1;
-            goto end;
-        }
-
-        err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
-        if (err != ESP_OK) {
-            while (1) {
-                WELINK_LOGE("esp_ota_begin failed, error=%d", err);
-                vTaskDelay(3000);
-            }
-        }
-        WELINK_LOGI("esp_ota_begin succeeded");
-
-        // read body
-        temp = idx - (rsp_result.body - response);  // response中除header外可能还有部分body数据，temp就是这部分数据的长度
-        err = esp_ota_write( update_handle, (const void *)rsp_result.body, temp);
-        if (err != ESP_OK) {
-            WELINK_LOGE("txd_http_download --- txd_file_write failed: temp[%d] ret[%d]\n", temp, ret);
-            result_ret = -1;
-            goto end;
-        }
-
-        idx = temp;
-        while (idx < rsp_result.body_len) {
-            ret = txd_tcp_recv(sock, response, sizeof(response), timeout_ms);
-            if (0 == ret) {
-                continue;
-            }
-            else if (ret < 0) {
-                WELINK_LOGE("txd_http_download --- txd_tcp_recv failed: ret[%d]\n", ret);
-                result_ret = -1;
-                goto end;
-            }
-            idx += ret;
-
-            //此处回复下载进度，每3秒发一次
-            if (txd_time_get_sysclock() > lastTime + 3000) {
-                WELINK_LOGI("txd_http_download -- idx[%d] total[%d]\n", idx, rsp_result.body_len);
-                txd_ack_download_progress(0, (uint8_t *)(""), idx, rsp_result.body_len);
-                lastTime = txd_time_get_sysclock();
-            }
-
-            err = esp_ota_write( update_handle, (const void *)response, ret);
-            if (err != ESP_OK) {
-                WELINK_LOGE("txd_http_download --- txd_file_write failed: ret[%d]\n", ret);
-                result_ret = -1;
-                goto end;
-            }
-        }
-
-        // 回复下载完毕
-        txd_ack_download_progress(0, (uint8_t *)(""), idx, rsp_result.body_len);
-
-        WELINK_LOGI("Total Write binary data length : %d", idx);
-
-        if (esp_ota_end(update_handle) != ESP_OK) {
-            while (1) {
-                WELINK_LOGE("esp_ota_end failed, error=%d", err);
-                vTaskDelay(3000);
-            }
-        }
-        err = esp_ota_set_boot_partition(update_partition);
-        if (err != ESP_OK) {
-            while (1) {
-                WELINK_LOGE("esp_ota_boot partition, error=%d", err);
-                vTaskDelay(3000);
-            }
-        }
-        WELINK_LOGI("Prepare to restart system!");
-        
-        if (response) {
-            txd_free(response);
-        }
-
-        vTaskDelay(200);
-        esp_restart();
-    }
-
-end:
-    if (sock) {
-        txd_tcp_disconnect(sock);
-        txd_tcp_socket_destroy(sock);
-    }
-
-    if (request) {
-        txd_free(request);
-    }
-
-    if (hostname) {
-        txd_free(hostname);
-    }
-
-    if (pathname) {
-        txd_free(pathname);
-    }
-
-    if (response) {
-        txd_free(response);
-    }
-
-    WELINK_LOGI("txd_http_download: result_ret[%d] status_code[%d] body_len[%d]\n", result_ret, rsp_result.status_code, rsp_result.body_len);
-    return result_ret;
 }
+#endif
 
-void welink_ota_handler(void* arg)
+#if CONFIG_WELINK_LOG_LEVEL_PROPERTY_ID
+// 保留属性：远程修改各模块的日志级别，ACK中带回当前生效的级别
+static int32_t welink_log_level_handler(txd_uint64_t u64SenderId, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
 {
-    uint8_t msg;
-
-    for (;;) {
-        if (pdTRUE == xQueueReceive(welink_ota_queue, &msg, (portTickType)portMAX_DELAY)) {
-            WELINK_LOGI("%s:- %s" , __func__,(char *)g_ota_url);
-            txd_http_download((uint8_t *)(g_ota_url),NULL,(uint8_t *)("/fatfs/test_file"));
-        }
-    }
-}
+    static char log_level[64];
+    int32_t ret = esp_welink_log_set_level_str((const char *)datapoint->property_value, datapoint->property_value_len);
 
-bool device_on_new_pkg_come(txd_ota_info_t* pOtaInfo)
-{
-    uint8_t msg = 0;
+    ack->property_value = (uint8_t *)log_level;
+    ack->property_value_len = esp_welink_log_get_level_str(log_level, sizeof(log_level));
 
-    if ((pOtaInfo->target_version == NULL) || (pOtaInfo->md5 == NULL) || (pOtaInfo->url == NULL)) {
-        WELINK_LOGE("%s - parameter error!", __func__);
-        return false;
-    }
-
-    WELINK_LOGI("***device_on_new_pkg_come: pkg_size[%d] target_version[%s] md5[%s] url[%s]\n", pOtaInfo->pkg_size, pOtaInfo->target_version, pOtaInfo->md5, pOtaInfo->url);
-    // 不能在这个函数里面下载OTA固件，因为该函数是从SDK回调出来的，所以会阻塞SDK线程，导致不能收发消息
-
-    txd_memcpy(g_ota_url, (char*)pOtaInfo->url, sizeof(g_ota_url));
-
-    if (xQueueSend(welink_ota_queue, &msg, 10 / portTICK_RATE_MS) != pdTRUE) {
-        WELINK_LOGE("%s xQueue send failed", __func__);
-        return false;
-    }
-    return true;
+    return ret;
 }
+#endif
 
-/****************************消息回调*********************************/
-void welink_send_msg_cb(int32_t err_code, uint32_t cookie)
+#if CONFIG_WELINK_CHUNK_PROPERTY_ID
+// 保留属性上分片下发的长命令，重组完成并校验通过后回调
+static void welink_chunk_receive_cb(txd_uint64_t u64SenderId, const uint8_t* data, uint32_t len)
 {
-    WELINK_LOGI("%s - err_code[%d] cookie[%d]", __func__, err_code, cookie);
+    WELINK_LOGI("%s - len[%d] data[%.*s]", __func__, len, (int)len, data);
 }
+#endif
 
-void welink_receive_datapoint_msg(txd_uint64_t u64SenderId, txd_datapoint_t* datapoint)
+// 分发表中没有的属性：打印后原样ACK，属性值直接引用SDK的缓冲区，不再拷贝；
+// 取值记入设备影子，应用读取属性时不需要等待网络
+static int32_t welink_datapoint_default(txd_uint64_t u64SenderId, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
 {
-    txd_datapoint_t datapointAck = {0};
-    uint32_t cookie = 0;
-    uint8_t *buf = (uint8_t *)txd_malloc(1024 * sizeof(uint8_t));
     uint8_t bufSenderId[30] = {0};
 
-    if (buf != NULL) {
-        txd_memcpy(buf, datapoint->property_value, datapoint->property_value_len);
-        txd_uint64_to_str(&u64SenderId, bufSenderId);
+    txd_uint64_to_str(&u64SenderId, bufSenderId);
 
-        WELINK_LOGI("%s - u64SenderId[%s] property_id[%d] property_value_len[%d] property_value[%s] seq[%d]", __func__,
-                bufSenderId, datapoint->property_id, datapoint->property_value_len, buf, datapoint->seq);
-                
-        txd_free(buf);
-    }
+    WELINK_LOGI("%s - u64SenderId[%s] property_id[%d] property_value_len[%d] property_value[%.*s] seq[%d]", __func__,
+            bufSenderId, datapoint->property_id, datapoint->property_value_len,
+            (int)datapoint->property_value_len, datapoint->property_value, datapoint->seq);
 
-    datapointAck.property_id = datapoint->property_id;
-    datapointAck.seq = datapoint->seq;
-    datapointAck.property_value = datapoint->property_value;
-    datapointAck.property_value_len = datapoint->property_value_len;
-    datapointAck.ret_code = 0;
+    esp_welink_shadow_apply(datapoint);
 
-    txd_report_datapoints(&datapointAck, 1, welink_send_msg_cb, &cookie);
+    return 0;
 }
 
+// 按property_id升序排列；耗时的处理函数使用ESP_WELINK_DISPATCH_DEFERRED，在worker任务中执行
+static const esp_welink_dispatch_entry_t s_datapoint_table[] = {
+#if CONFIG_WELINK_CHUNK_PROPERTY_ID && CONFIG_WELINK_CHUNK_PROPERTY_ID < CONFIG_WELINK_LOG_LEVEL_PROPERTY_ID
+    ESP_WELINK_DISPATCH_ENTRY(CONFIG_WELINK_CHUNK_PROPERTY_ID, esp_welink_chunk_receive, ESP_WELINK_DISPATCH_INLINE),
+#endif
+#if CONFIG_WELINK_LOG_LEVEL_PROPERTY_ID
+    ESP_WELINK_DISPATCH_ENTRY(CONFIG_WELINK_LOG_LEVEL_PROPERTY_ID, welink_log_level_handler, ESP_WELINK_DISPATCH_INLINE),
+#endif
+#if CONFIG_WELINK_CHUNK_PROPERTY_ID && CONFIG_WELINK_CHUNK_PROPERTY_ID > CONFIG_WELINK_LOG_LEVEL_PROPERTY_ID
+    ESP_WELINK_DISPATCH_ENTRY(CONFIG_WELINK_CHUNK_PROPERTY_ID, esp_welink_chunk_receive, ESP_WELINK_DISPATCH_INLINE),
+#endif
+};
+
 /****************************状态回调*********************************/
 // 在线状态回调函数，status为1表示在线，为0表示离线（未上线）
 void welink_online_status_cb(int32_t status)
 {
+    // 更新连接状态，等待上线的应用任务会被立即唤醒
+    esp_welink_status_update(status);
+    esp_welink_sf_set_online(status);
+
     if (1 == status) {
-        // 测试：
+        esp_welink_boot_mark(ESP_WELINK_BOOT_ONLINE);
+
+        // 上报离线期间变化过的属性，包括重启前未确认的
+        esp_welink_shadow_report(false);
+        // 登录后SDK才有服务器时间，立即校准一次
+        esp_welink_clock_sync();
     } else {
         WELINK_LOGE("%s - status[%d]", __func__ , status);
     }
@@ -510,6 +229,7 @@ void esp_welink_handler(void* arg)
     for (;;) {
         if (pdTRUE == xQueueReceive(welink_task_queue, &msg, (portTickType)portMAX_DELAY)) {
 
+            esp_welink_boot_mark(ESP_WELINK_BOOT_TASK_START);
             WELINK_LOGE("%s - %s", info.device_serial_number, info.device_license);
 
             // 初始化设备信息
@@ -520,30 +240,105 @@ void esp_welink_handler(void* arg)
                 vTaskDelete(NULL);
             }
 
-            // 初始化接收datapoint消息的回调函数
-            txd_init_datapoint(welink_receive_datapoint_msg);
+            esp_welink_boot_mark(ESP_WELINK_BOOT_DEVICE_INFO);
+
+#ifndef CONFIG_WELINK_SDK_EVENT_LOOP
+            // 调度器的发送在定时器回调中进行，事件循环模式下由循环驱动定时器
+            txd_timer_service_start(configMAX_PRIORITIES - 3, 1024 * 4);
+#endif
+            esp_welink_cookie_init(WELINK_COOKIE_TIMEOUT_MS);
+
+            // 上报和ACK共用每秒5次的发送配额，由调度器统一限速
+            if (esp_welink_sched_init(NULL) != 0) {
+                WELINK_LOGE("%s - sched init err", __func__);
+                vTaskDelete(NULL);
+            }
+
+#ifdef CONFIG_WELINK_STORE_FORWARD
+            // 离线期间的上报写入flash，上线后经调度器按序重放
+            esp_welink_sf_config_t sf_config = ESP_WELINK_SF_CONFIG_DEFAULT();
+            sf_config.report = esp_welink_sched_report;
+
+            if (esp_welink_sf_init(&sf_config) != 0) {
+                WELINK_LOGE("%s - store-and-forward init err", __func__);
+            }
+#endif
+
+            // 设备影子只上报变化过的属性，从NVS快照恢复上次的取值
+            esp_welink_shadow_config_t shadow_config = ESP_WELINK_SHADOW_CONFIG_DEFAULT();
+            shadow_config.report = esp_welink_sched_report;
+
+            if (esp_welink_shadow_init(&shadow_config) != 0) {
+                WELINK_LOGE("%s - shadow init err", __func__);
+            }
+
+            // 毫秒级的墙上时钟，重启后从NVS中保存的时间和漂移继续
+            if (esp_welink_clock_init(NULL) != 0) {
+                WELINK_LOGE("%s - clock init err", __func__);
+            }
+
+#if CONFIG_WELINK_CHUNK_PROPERTY_ID
+            // 超过一次上报长度的数据分片发送，与其它上报共用调度器的发送配额
+            esp_welink_chunk_config_t chunk_config = ESP_WELINK_CHUNK_CONFIG_DEFAULT();
+            chunk_config.property_id = CONFIG_WELINK_CHUNK_PROPERTY_ID;
+            chunk_config.report = esp_welink_sched_report;
+            chunk_config.rx_cb = welink_chunk_receive_cb;
+
+            if (esp_welink_chunk_init(&chunk_config) != 0) {
+                WELINK_LOGE("%s - chunk init err", __func__);
+            }
+#endif
+
+            // 初始化接收datapoint消息的回调函数，按property_id分发到处理函数
+            esp_welink_dispatch_config_t dispatch_config = ESP_WELINK_DISPATCH_CONFIG_DEFAULT();
+            dispatch_config.table = s_datapoint_table;
+            dispatch_config.table_count = sizeof(s_datapoint_table) / sizeof(s_datapoint_table[0]);
+            dispatch_config.default_handler = welink_datapoint_default;
+            dispatch_config.ack = welink_ack_datapoint;
+            dispatch_config.ack_cb = welink_ack_send_cb;
+            dispatch_config.pool_size = 0;  // 示例中没有耗时的处理函数，不创建worker任务
+
+            // 服务器重传的命令直接回复缓存的ACK，执行器不会重复动作
+            esp_welink_dedup_init();
+
+            if (esp_welink_dispatch_init(&dispatch_config) != 0) {
+                WELINK_LOGE("%s - dispatch init err", __func__);
+                vTaskDelete(NULL);
+            }
+
+            txd_init_datapoint(esp_welink_dispatch);
 
             // 初始化设备通知，包含上线状态，SDK无法处理的错误等
+            esp_welink_status_init();
             txd_device_notify_t notify = {0};
             notify.on_online_status = welink_online_status_cb;
             notify.on_err_notify = welink_err_notify_cb;
             txd_init_notify(&notify);
 
             //OTA
-            txd_ota_notify_t ota_notify = {0};
-            ota_notify.on_new_pkg_come = device_on_new_pkg_come;
-            txd_init_ota(&ota_notify, fw_version);
+            welink_ota_init(fw_version);
 
-            welink_ota_queue = xQueueCreate(10, sizeof(uint8_t));
-            xTaskCreate(welink_ota_handler, "welink_ota_task", 1024*6, NULL, configMAX_PRIORITIES - 3, NULL);
+#if CONFIG_WELINK_TELEMETRY_PROPERTY_ID
+            txd_timer_handler_t* telemetry_timer = txd_timer_create(welink_telemetry_report, NULL);
+
+            if (telemetry_timer == NULL
+                    || txd_timer_start(telemetry_timer, WELINK_TELEMETRY_PERIOD_MS, WELINK_TELEMETRY_PERIOD_MS, 1000) != 0) {
+                WELINK_LOGE("%s - telemetry timer err", __func__);
+            }
+#endif
 
             // 如果开启了多线程宏(_TXD_THREAD_), 那么内部会启动一个独立线程去执行相关逻辑，SDK线程将伴随整个进程生命周期
             printf("%s - %d - free heap size = %d\r\n", __func__, __LINE__, esp_get_free_heap_size());
+#ifdef CONFIG_WELINK_SDK_EVENT_LOOP
+            // 单线程模式：SDK在本任务的事件循环中运行，按expect_sleep_ms和socket事件调度，不再需要独立的SDK线程
+            esp_welink_loop_run();
+#else
             ret = txd_sdk_run(&expect_sleep_ms);
 
             if (ret != err_success) {
                 WELINK_LOGE("%s - sdk run err, errcode[%d]", __func__, ret);
             }
+#endif
 
             vTaskDelete(NULL);
         }
@@ -29,7 +29,9 @@
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 
+#define WELINK_LOG_MODULE WELINK_LOG_MODULE_WIFI
 #include "esp_welink_log.h"
+#include "esp_welink_boot.h"
 #include "txd_welink.h"
 
 #include "lwip/err.h"
@@ -67,15 +69,22 @@ static esp_err_t event_handler(void* ctx, system_event_t* event)
     switch (event->event_id) {
         case SYSTEM_EVENT_STA_START:
             WELINK_LOGI("SYSTEM_EVENT_STA_START");
+            esp_welink_boot_mark(ESP_WELINK_BOOT_WIFI_START);
             wifi_connection();
             break;
 
+        case SYSTEM_EVENT_STA_CONNECTED:
+            WELINK_LOGI("SYSTEM_EVENT_STA_CONNECTED");
+            esp_welink_boot_mark(ESP_WELINK_BOOT_WIFI_CONNECTED);
+            break;
+
         case SYSTEM_EVENT_SCAN_DONE:
             WELINK_LOGI("SYSTEM_EVENT_SCAN_DONE");
             break;
 
         case SYSTEM_EVENT_STA_GOT_IP:
             WELINK_LOGI("Got IPv4[%s]", ip4addr_ntoa(&event->event_info.got_ip.ip_info.ip));
+            esp_welink_boot_mark(ESP_WELINK_BOOT_GOT_IP);
 
             uint8_t msg = 0;
 
@@ -0,0 +1,512 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_agg.h"
+#include "esp_welink_batch.h"
+#include "esp_welink_json.h"
+#include "esp_welink_log.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_agg";
+
+typedef struct {
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    int64_t sum;
+} agg_pane_t;
+
+typedef struct {
+    esp_welink_agg_stream_config_t config;
+    uint32_t slide_ms;
+    uint32_t panes;                     // 窗口中的pane个数，环中另有一个正在累计的pane
+    uint32_t current;
+    uint32_t pane_start;                // 当前pane的开始时间
+    uint32_t window_count;              // 环中的样本数，为0时不需要定时器
+    uint64_t sketch_scale;              // 2^32 * 桶数 / 区间长度，计算桶序号时用乘法代替除法
+    agg_pane_t* pane;                   // panes + 1
+    uint16_t* hist;                     // (panes + 1) * WELINK_AGG_SKETCH_BUCKETS，不统计百分位时为NULL
+} agg_stream_t;
+
+static struct {
+    esp_welink_agg_config_t config;
+    agg_stream_t* streams;
+    uint32_t count;
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_agg_stats_t stats;
+} s_agg;
+
+#define AGG_HIST(stream, index) ((stream)->hist + (index) * WELINK_AGG_SKETCH_BUCKETS)
+
+static int32_t agg_percentile(const agg_stream_t* stream, const uint32_t* hist, const esp_welink_agg_summary_t* summary,
+                              uint32_t percent)
+{
+    int64_t range = (int64_t)stream->config.sketch_hi - stream->config.sketch_lo + 1;
+    uint32_t rank = (summary->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    int64_t value = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < WELINK_AGG_SKETCH_BUCKETS; i++) {
+        if (seen + hist[i] < rank) {
+            seen += hist[i];
+            continue;
+        }
+
+        // 桶内按均匀分布插值，取第rank个样本所在位置的中点
+        value = stream->config.sketch_lo
+                + range * (2 * (int64_t)i * hist[i] + 2 * (rank - seen) - 1) / (2 * WELINK_AGG_SKETCH_BUCKETS * (int64_t)hist[i]);
+        break;
+    }
+
+    // 区间外的样本都记在两端的桶中，结果不会超出窗口的实际范围
+    if (i == WELINK_AGG_SKETCH_BUCKETS || value > summary->max) {
+        return summary->max;
+    }
+
+    return (value < summary->min) ? summary->min : (int32_t)value;
+}
+
+// 调用前需持有mutex，合并环中除skip以外的pane，按从新到旧的顺序取last
+static void agg_merge(const agg_stream_t* stream, uint32_t skip, esp_welink_agg_summary_t* summary)
+{
+    const agg_pane_t* pane = NULL;
+    uint32_t hist[WELINK_AGG_SKETCH_BUCKETS];
+    uint32_t slots = stream->panes + 1;
+    uint32_t index = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    int64_t sum = 0;
+
+    memset(summary, 0, sizeof(esp_welink_agg_summary_t));
+    memset(hist, 0, sizeof(hist));
+
+    for (i = 0, index = (skip + slots - 1) % slots; i < stream->panes; i++, index = (index + slots - 1) % slots) {
+        pane = &stream->pane[index];
+
+        if (pane->count == 0) {
+            continue;
+        }
+
+        if (summary->count == 0) {
+            summary->min = pane->min;
+            summary->max = pane->max;
+            summary->last = pane->last;
+        }
+
+        summary->min = (pane->min < summary->min) ? pane->min : summary->min;
+        summary->max = (pane->max > summary->max) ? pane->max : summary->max;
+        summary->count += pane->count;
+        sum += pane->sum;
+
+        for (j = 0; stream->hist != NULL && j < WELINK_AGG_SKETCH_BUCKETS; j++) {
+            hist[j] += AGG_HIST(stream, index)[j];
+        }
+    }
+
+    if (summary->count == 0) {
+        return;
+    }
+
+    summary->mean = (int32_t)((sum + ((sum < 0) ? -1 : 1) * (int64_t)(summary->count / 2)) / (int64_t)summary->count);
+    summary->p50 = summary->p90 = summary->p99 = stream->config.sketch_lo;
+
+    if (stream->hist != NULL) {
+        summary->p50 = agg_percentile(stream, hist, summary, 50);
+        summary->p90 = agg_percentile(stream, hist, summary, 90);
+        summary->p99 = agg_percentile(stream, hist, summary, 99);
+    }
+}
+
+// 调用前需持有mutex，关闭到期的pane，返回true表示summary为最新一个窗口的统计
+static bool agg_rotate(agg_stream_t* stream, uint32_t now, esp_welink_agg_summary_t* summary)
+{
+    uint32_t slides = (now - stream->pane_start) / stream->slide_ms;
+    uint32_t i = 0;
+
+    // 间隔超过整个环时清空一遍就够了
+    for (i = 0; i < slides && i <= stream->panes; i++) {
+        stream->current = (stream->current + 1) % (stream->panes + 1);
+        stream->window_count -= stream->pane[stream->current].count;
+        memset(&stream->pane[stream->current], 0, sizeof(agg_pane_t));
+
+        if (stream->hist != NULL) {
+            memset(AGG_HIST(stream, stream->current), 0, sizeof(uint16_t) * WELINK_AGG_SKETCH_BUCKETS);
+        }
+    }
+
+    stream->pane_start += slides * stream->slide_ms;
+
+    if (stream->window_count == 0) {
+        return false;
+    }
+
+    agg_merge(stream, stream->current, summary);
+
+    return summary->count != 0;
+}
+
+// 调用前需持有mutex，定时器设置为最早一个有样本的流的pane结束时间
+static void agg_schedule(uint32_t now)
+{
+    agg_stream_t* stream = NULL;
+    uint32_t wait = TXD_TIMER_WAIT_FOREVER;
+    uint32_t elapsed = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < s_agg.count; i++) {
+        stream = &s_agg.streams[i];
+
+        if (stream->window_count == 0) {
+            continue;
+        }
+
+        elapsed = now - stream->pane_start;
+        elapsed = (elapsed < stream->slide_ms) ? stream->slide_ms - elapsed : 0;
+        wait = (elapsed < wait) ? elapsed : wait;
+    }
+
+    if (wait == TXD_TIMER_WAIT_FOREVER) {
+        txd_timer_stop(s_agg.timer);
+    } else {
+        txd_timer_start(s_agg.timer, wait, 0, 0);
+    }
+}
+
+// 不持有mutex时调用，发送函数（批量发送器）有自己的锁
+static void agg_emit(const agg_stream_t* stream, const esp_welink_agg_summary_t* summary)
+{
+    esp_welink_json_writer_t writer;
+    char value[WELINK_AGG_MAX_VALUE];
+    uint32_t stats = stream->config.stats;
+    uint8_t decimals = stream->config.decimals;
+    int32_t len = 0;
+    int32_t ret = -1;
+
+    esp_welink_json_writer_init(&writer, value, sizeof(value));
+    esp_welink_json_write_object_begin(&writer, NULL);
+
+    if (stats & ESP_WELINK_AGG_COUNT) {
+        esp_welink_json_write_int(&writer, "count", summary->count);
+    }
+
+    if (stats & ESP_WELINK_AGG_MIN) {
+        esp_welink_json_write_fixed(&writer, "min", summary->min, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_MAX) {
+        esp_welink_json_write_fixed(&writer, "max", summary->max, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_MEAN) {
+        esp_welink_json_write_fixed(&writer, "mean", summary->mean, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_LAST) {
+        esp_welink_json_write_fixed(&writer, "last", summary->last, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_P50) {
+        esp_welink_json_write_fixed(&writer, "p50", summary->p50, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_P90) {
+        esp_welink_json_write_fixed(&writer, "p90", summary->p90, decimals);
+    }
+
+    if (stats & ESP_WELINK_AGG_P99) {
+        esp_welink_json_write_fixed(&writer, "p99", summary->p99, decimals);
+    }
+
+    esp_welink_json_write_object_end(&writer);
+    len = esp_welink_json_writer_finish(&writer);
+
+    if (len > 0) {
+        ret = s_agg.config.emit(stream->config.property_id, (const uint8_t*)value, len);
+    }
+
+    txd_mutex_lock(s_agg.mutex);
+
+    if (ret == 0) {
+        s_agg.stats.windows++;
+    } else {
+        s_agg.stats.emit_errors++;
+    }
+
+    txd_mutex_unlock(s_agg.mutex);
+
+    if (ret != 0) {
+        WELINK_LOGW("emit property_id %d fail", stream->config.property_id);
+    }
+}
+
+static void agg_timer_cb(void* arg)
+{
+    esp_welink_agg_summary_t summary;
+    agg_stream_t* stream = NULL;
+    uint32_t now = 0;
+    bool emit = false;
+    uint32_t i = 0;
+
+    for (i = 0; i < s_agg.count; i++) {
+        stream = &s_agg.streams[i];
+        now = txd_time_get_sysclock();
+
+        // 定时器按最早到期的流设置，其他流的pane还没有结束，不能提前发出窗口
+        txd_mutex_lock(s_agg.mutex);
+        emit = stream->window_count != 0 && now - stream->pane_start >= stream->slide_ms
+               && agg_rotate(stream, now, &summary);
+        txd_mutex_unlock(s_agg.mutex);
+
+        if (emit) {
+            agg_emit(stream, &summary);
+        }
+    }
+
+    txd_mutex_lock(s_agg.mutex);
+    agg_schedule(txd_time_get_sysclock());
+    txd_mutex_unlock(s_agg.mutex);
+}
+
+int32_t esp_welink_agg_init(const esp_welink_agg_config_t* config)
+{
+    esp_welink_agg_config_t config_default = ESP_WELINK_AGG_CONFIG_DEFAULT();
+
+    if (s_agg.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->max_streams == 0, -1, "invalid aggregation config");
+
+    memset(&s_agg, 0, sizeof(s_agg));
+    s_agg.config = *config;
+    s_agg.config.emit = config->emit ? config->emit : esp_welink_batch_update;
+
+    s_agg.streams = (agg_stream_t*)txd_malloc(sizeof(agg_stream_t) * config->max_streams);
+    WELINK_ERROR_GOTO(s_agg.streams == NULL, end, "malloc fail");
+
+    s_agg.timer = txd_timer_create(agg_timer_cb, NULL);
+    WELINK_ERROR_GOTO(s_agg.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_agg.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_agg.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_agg.timer != NULL) {
+        txd_timer_destroy(s_agg.timer);
+    }
+
+    txd_free(s_agg.streams);
+    memset(&s_agg, 0, sizeof(s_agg));
+
+    return -1;
+}
+
+int32_t esp_welink_agg_deinit(void)
+{
+    uint32_t i = 0;
+
+    if (s_agg.mutex == NULL) {
+        return -1;
+    }
+
+    txd_timer_destroy(s_agg.timer);
+    txd_mutex_destroy(s_agg.mutex);
+
+    for (i = 0; i < s_agg.count; i++) {
+        txd_free(s_agg.streams[i].pane);
+        txd_free(s_agg.streams[i].hist);
+    }
+
+    txd_free(s_agg.streams);
+    memset(&s_agg, 0, sizeof(s_agg));
+
+    return 0;
+}
+
+int32_t esp_welink_agg_add_stream(const esp_welink_agg_stream_config_t* config)
+{
+    agg_stream_t* stream = NULL;
+    uint32_t slide_ms = 0;
+    uint32_t slots = 0;
+    int32_t index = -1;
+
+    if (s_agg.mutex == NULL || config == NULL || config->window_ms == 0) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    slide_ms = config->slide_ms ? config->slide_ms : config->window_ms;
+    WELINK_ERROR_CHECK(config->window_ms % slide_ms != 0 || config->window_ms / slide_ms > WELINK_AGG_MAX_PANES
+                       || ((config->stats & ESP_WELINK_AGG_PERCENTILES) && config->sketch_hi <= config->sketch_lo),
+                       -1, "invalid stream config");
+
+    txd_mutex_lock(s_agg.mutex);
+
+    if (s_agg.count == s_agg.config.max_streams) {
+        txd_mutex_unlock(s_agg.mutex);
+        WELINK_LOGE("too many streams");
+        return -1;
+    }
+
+    stream = &s_agg.streams[s_agg.count];
+    memset(stream, 0, sizeof(agg_stream_t));
+    stream->config = *config;
+    stream->slide_ms = slide_ms;
+    stream->panes = config->window_ms / slide_ms;
+    stream->pane_start = txd_time_get_sysclock();
+    slots = stream->panes + 1;
+
+    stream->pane = (agg_pane_t*)txd_malloc(sizeof(agg_pane_t) * slots);
+    WELINK_ERROR_GOTO(stream->pane == NULL, end, "malloc fail");
+    memset(stream->pane, 0, sizeof(agg_pane_t) * slots);
+
+    if (config->stats & ESP_WELINK_AGG_PERCENTILES) {
+        stream->sketch_scale = ((uint64_t)WELINK_AGG_SKETCH_BUCKETS << 32)
+                               / (uint64_t)((int64_t)config->sketch_hi - config->sketch_lo + 1);
+        stream->hist = (uint16_t*)txd_malloc(sizeof(uint16_t) * WELINK_AGG_SKETCH_BUCKETS * slots);
+        WELINK_ERROR_GOTO(stream->hist == NULL, end, "malloc fail");
+        memset(stream->hist, 0, sizeof(uint16_t) * WELINK_AGG_SKETCH_BUCKETS * slots);
+    }
+
+    index = s_agg.count++;
+
+end:
+
+    if (index < 0) {
+        txd_free(stream->pane);
+        txd_free(stream->hist);
+    }
+
+    txd_mutex_unlock(s_agg.mutex);
+
+    return index;
+}
+
+int32_t esp_welink_agg_sample(int32_t stream_index, int32_t value)
+{
+    esp_welink_agg_summary_t summary;
+    agg_stream_t* stream = NULL;
+    agg_pane_t* pane = NULL;
+    uint16_t* bucket = NULL;
+    uint32_t now = txd_time_get_sysclock();
+    bool emit = false;
+
+    if (s_agg.mutex == NULL || stream_index < 0 || (uint32_t)stream_index >= s_agg.count) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    stream = &s_agg.streams[stream_index];
+
+    txd_mutex_lock(s_agg.mutex);
+
+    if (now - stream->pane_start >= stream->slide_ms) {
+        emit = agg_rotate(stream, now, &summary);
+    }
+
+    pane = &stream->pane[stream->current];
+
+    if (pane->count == 0 || value < pane->min) {
+        pane->min = value;
+    }
+
+    if (pane->count == 0 || value > pane->max) {
+        pane->max = value;
+    }
+
+    pane->count++;
+    pane->sum += value;
+    pane->last = value;
+    s_agg.stats.samples++;
+
+    if (stream->hist != NULL) {
+        bucket = AGG_HIST(stream, stream->current);
+
+        if (value >= stream->config.sketch_hi) {
+            bucket += WELINK_AGG_SKETCH_BUCKETS - 1;
+        } else if (value > stream->config.sketch_lo) {
+            bucket += ((uint64_t)(uint32_t)(value - stream->config.sketch_lo) * stream->sketch_scale) >> 32;
+        }
+
+        // 计数饱和，不会回绕成很小的值
+        if (*bucket != 0xFFFF) {
+            (*bucket)++;
+        }
+    }
+
+    // 流从空闲变为有样本时才需要重新设置定时器
+    if (++stream->window_count == 1) {
+        agg_schedule(now);
+    }
+
+    txd_mutex_unlock(s_agg.mutex);
+
+    if (emit) {
+        agg_emit(stream, &summary);
+    }
+
+    return 0;
+}
+
+int32_t esp_welink_agg_get(int32_t stream_index, esp_welink_agg_summary_t* summary)
+{
+    agg_stream_t* stream = NULL;
+
+    if (s_agg.mutex == NULL || stream_index < 0 || (uint32_t)stream_index >= s_agg.count || summary == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    stream = &s_agg.streams[stream_index];
+
+    txd_mutex_lock(s_agg.mutex);
+    agg_merge(stream, (stream->current + 1) % (stream->panes + 1), summary);
+    txd_mutex_unlock(s_agg.mutex);
+
+    return 0;
+}
+
+int32_t esp_welink_agg_get_stats(esp_welink_agg_stats_t* stats)
+{
+    if (s_agg.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_agg.mutex);
+    memcpy(stats, &s_agg.stats, sizeof(esp_welink_agg_stats_t));
+    txd_mutex_unlock(s_agg.mutex);
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "esp_welink_base64.h"
+
+static const char s_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+uint32_t esp_welink_base64_encode(uint8_t* out, const uint8_t* in, uint32_t len)
+{
+    uint8_t* p = out;
+    uint32_t v = 0;
+
+    for (; len >= 3; len -= 3, in += 3) {
+        v = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        *p++ = s_base64_chars[v >> 18];
+        *p++ = s_base64_chars[(v >> 12) & 0x3F];
+        *p++ = s_base64_chars[(v >> 6) & 0x3F];
+        *p++ = s_base64_chars[v & 0x3F];
+    }
+
+    if (len != 0) {
+        v = ((uint32_t)in[0] << 16) | ((len == 2) ? ((uint32_t)in[1] << 8) : 0);
+        *p++ = s_base64_chars[v >> 18];
+        *p++ = s_base64_chars[(v >> 12) & 0x3F];
+        *p++ = (len == 2) ? s_base64_chars[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+
+    return p - out;
+}
+
+static int32_t base64_value(uint8_t c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    } else if (c == '+') {
+        return 62;
+    } else if (c == '/') {
+        return 63;
+    }
+
+    return -1;
+}
+
+int32_t esp_welink_base64_decode(uint8_t* out, uint32_t size, const uint8_t* in, uint32_t len)
+{
+    int32_t v[4] = {0};
+    uint32_t count = 0;
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    if (len % 4 != 0) {
+        return -1;
+    }
+
+    for (; len != 0; len -= 4, in += 4) {
+        // 只有最后一组可以带'='，一个'='表示2字节，两个表示1字节
+        n = (len == 4 && in[3] == '=') ? ((in[2] == '=') ? 1 : 2) : 3;
+
+        if (count + n > size) {
+            return -1;
+        }
+
+        for (i = 0; i < 4; i++) {
+            v[i] = (i <= n) ? base64_value(in[i]) : 0;
+
+            if (v[i] < 0) {
+                return -1;
+            }
+        }
+
+        out[count++] = (v[0] << 2) | (v[1] >> 4);
+
+        if (n > 1) {
+            out[count++] = (v[1] << 4) | (v[2] >> 2);
+        }
+
+        if (n > 2) {
+            out[count++] = (v[2] << 6) | v[3];
+        }
+    }
+
+    return count;
+}
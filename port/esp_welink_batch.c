@@ -0,0 +1,419 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_batch.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_batch";
+
+typedef struct {
+    uint32_t property_id;
+    uint32_t value_len;
+    uint32_t version;           // 每次更新加1，发送成功后只释放版本未变的条目
+    uint32_t sent_version;
+    uint16_t bin;               // 装箱时分配到的消息序号
+    bool used;
+    bool staged;                // 已拷贝到当前发送的消息中
+} batch_entry_t;
+
+static struct {
+    esp_welink_batch_config_t config;
+    batch_entry_t* entries;
+    uint8_t* values;            // max_entries * max_value_len
+    uint16_t* order;            // 装箱时按长度从大到小排列的条目下标
+    uint32_t* bin_free;         // 每条消息剩余的字节数
+    txd_datapoint_t* datapoints;
+    uint8_t staging[WELINK_BATCH_MAX_BYTES];
+    uint32_t pending;
+    uint32_t pending_bytes;
+    uint32_t first_ms;          // 最早一个待发送更新的时间
+    uint32_t last_ms;           // 最近一次更新的时间
+    uint32_t version;
+    txd_mutex_handler_t* mutex;         // 保护条目和统计
+    txd_mutex_handler_t* flush_mutex;   // 串行化发送，保护staging和datapoints
+    txd_timer_handler_t* timer;
+    esp_welink_batch_stats_t stats;
+} s_batch;
+
+#define BATCH_VALUE(index) (s_batch.values + (index) * s_batch.config.max_value_len)
+
+// 调用前需持有mutex：根据最早更新的截止时间和空闲时间重新设置定时器
+static void batch_schedule(uint32_t now)
+{
+    uint32_t due = 0;
+    uint32_t elapsed = 0;
+
+    if (s_batch.pending == 0) {
+        txd_timer_stop(s_batch.timer);
+        return;
+    }
+
+    elapsed = now - s_batch.first_ms;
+    due = (elapsed < s_batch.config.max_delay_ms) ? s_batch.config.max_delay_ms - elapsed : 0;
+
+    if (s_batch.config.idle_ms != 0) {
+        elapsed = now - s_batch.last_ms;
+        elapsed = (elapsed < s_batch.config.idle_ms) ? s_batch.config.idle_ms - elapsed : 0;
+        due = (elapsed < due) ? elapsed : due;
+    }
+
+    txd_timer_start(s_batch.timer, due, 0, 0);
+}
+
+// 调用前需持有mutex：首次适应递减装箱，返回需要的消息个数
+static uint32_t batch_pack()
+{
+    batch_entry_t* entries = s_batch.entries;
+    uint32_t count = 0;
+    uint32_t bins = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint16_t index = 0;
+
+    for (i = 0; i < s_batch.config.max_entries; i++) {
+        if (!entries[i].used) {
+            continue;
+        }
+
+        // 插入排序，条目个数很少
+        for (j = count; j > 0 && entries[s_batch.order[j - 1]].value_len < entries[i].value_len; j--) {
+            s_batch.order[j] = s_batch.order[j - 1];
+        }
+
+        s_batch.order[j] = i;
+        count++;
+    }
+
+    for (i = 0; i < count; i++) {
+        index = s_batch.order[i];
+
+        for (j = 0; j < bins && s_batch.bin_free[j] < entries[index].value_len; j++);
+
+        if (j == bins) {
+            s_batch.bin_free[bins++] = WELINK_BATCH_MAX_BYTES;
+        }
+
+        s_batch.bin_free[j] -= entries[index].value_len;
+        entries[index].bin = j;
+    }
+
+    return bins;
+}
+
+// 发送一条消息，调用前需持有flush_mutex，返回0表示成功或没有需要发送的数据
+static int32_t batch_send_bin(uint32_t bin)
+{
+    batch_entry_t* entries = s_batch.entries;
+    esp_welink_report_t send = s_batch.config.send ? s_batch.config.send : txd_report_datapoints;
+    uint32_t cookie = 0;
+    uint32_t count = 0;
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+    int32_t ret = 0;
+
+    // 拷贝到staging后释放mutex再发送，发送期间应用仍可以更新属性
+    txd_mutex_lock(s_batch.mutex);
+
+    for (i = 0; i < s_batch.config.max_entries; i++) {
+        entries[i].staged = false;
+
+        // 装箱后条目可能被更新得更长，放不下的留到下一次
+        if (!entries[i].used || entries[i].bin != bin || bytes + entries[i].value_len > WELINK_BATCH_MAX_BYTES) {
+            continue;
+        }
+
+        memcpy(s_batch.staging + bytes, BATCH_VALUE(i), entries[i].value_len);
+        s_batch.datapoints[count].property_id = entries[i].property_id;
+        s_batch.datapoints[count].property_value = s_batch.staging + bytes;
+        s_batch.datapoints[count].property_value_len = entries[i].value_len;
+        s_batch.datapoints[count].seq = 0;
+        s_batch.datapoints[count].ret_code = 0;
+        entries[i].staged = true;
+        entries[i].sent_version = entries[i].version;
+        bytes += entries[i].value_len;
+        count++;
+    }
+
+    txd_mutex_unlock(s_batch.mutex);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    ret = send(s_batch.datapoints, count, s_batch.config.send_cb, &cookie);
+
+    txd_mutex_lock(s_batch.mutex);
+
+    if (ret == err_success) {
+        for (i = 0; i < s_batch.config.max_entries; i++) {
+            if (entries[i].used && entries[i].staged && entries[i].sent_version == entries[i].version) {
+                entries[i].used = false;
+                s_batch.pending--;
+                s_batch.pending_bytes -= entries[i].value_len;
+            }
+        }
+
+        s_batch.stats.messages++;
+        s_batch.stats.datapoints += count;
+        s_batch.stats.bytes += bytes;
+    } else {
+        s_batch.stats.send_errors++;
+    }
+
+    txd_mutex_unlock(s_batch.mutex);
+
+    if (ret != err_success) {
+        WELINK_LOGW("send %d datapoints fail, ret: 0x%x", count, ret);
+        return -1;
+    }
+
+    // 让SDK尽快把消息写到socket，不必等到下一次txd_sdk_run超时
+    esp_welink_socket_wakeup();
+
+    return 0;
+}
+
+// max_messages为0表示全部发送；counter为触发原因对应的统计项
+static int32_t batch_flush(uint32_t max_messages, uint32_t* counter)
+{
+    uint32_t bins = 0;
+    uint32_t i = 0;
+    int32_t ret = 0;
+
+    txd_mutex_lock(s_batch.flush_mutex);
+
+    txd_mutex_lock(s_batch.mutex);
+    (*counter)++;
+    bins = batch_pack();
+    txd_mutex_unlock(s_batch.mutex);
+
+    if (max_messages != 0 && bins > max_messages) {
+        bins = max_messages;
+    }
+
+    for (i = 0; i < bins && ret == 0; i++) {
+        ret = batch_send_bin(i);
+    }
+
+    if (ret == 0) {
+        ret = i;
+    }
+
+    txd_mutex_lock(s_batch.mutex);
+
+    if (ret < 0 && s_batch.pending != 0) {
+        txd_timer_start(s_batch.timer, WELINK_BATCH_RETRY_MS, 0, 0);
+    } else {
+        batch_schedule(txd_time_get_sysclock());
+    }
+
+    txd_mutex_unlock(s_batch.mutex);
+    txd_mutex_unlock(s_batch.flush_mutex);
+
+    return ret;
+}
+
+static void batch_timer_cb(void* arg)
+{
+    uint32_t* counter = &s_batch.stats.flush_idle;
+
+    txd_mutex_lock(s_batch.mutex);
+
+    if (txd_time_get_sysclock() - s_batch.first_ms >= s_batch.config.max_delay_ms) {
+        counter = &s_batch.stats.flush_deadline;
+    }
+
+    txd_mutex_unlock(s_batch.mutex);
+
+    batch_flush(0, counter);
+}
+
+int32_t esp_welink_batch_init(const esp_welink_batch_config_t* config)
+{
+    esp_welink_batch_config_t config_default = ESP_WELINK_BATCH_CONFIG_DEFAULT();
+    uint32_t max_entries = 0;
+
+    if (s_batch.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->max_entries == 0 || config->max_entries > 0xFFFF || config->max_value_len == 0
+                       || config->max_value_len > WELINK_BATCH_MAX_BYTES, -1, "invalid batch config");
+
+    memset(&s_batch, 0, sizeof(s_batch));
+    s_batch.config = *config;
+    max_entries = config->max_entries;
+
+    s_batch.entries = (batch_entry_t*)txd_malloc(sizeof(batch_entry_t) * max_entries);
+    s_batch.values = (uint8_t*)txd_malloc(config->max_value_len * max_entries);
+    s_batch.order = (uint16_t*)txd_malloc(sizeof(uint16_t) * max_entries);
+    s_batch.bin_free = (uint32_t*)txd_malloc(sizeof(uint32_t) * max_entries);
+    s_batch.datapoints = (txd_datapoint_t*)txd_malloc(sizeof(txd_datapoint_t) * max_entries);
+    WELINK_ERROR_GOTO(s_batch.entries == NULL || s_batch.values == NULL || s_batch.order == NULL
+                      || s_batch.bin_free == NULL || s_batch.datapoints == NULL, end, "malloc fail");
+    memset(s_batch.entries, 0, sizeof(batch_entry_t) * max_entries);
+
+    s_batch.flush_mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_batch.flush_mutex == NULL, end, "create mutex fail");
+
+    s_batch.timer = txd_timer_create(batch_timer_cb, NULL);
+    WELINK_ERROR_GOTO(s_batch.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_batch.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_batch.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_batch.timer != NULL) {
+        txd_timer_destroy(s_batch.timer);
+    }
+
+    if (s_batch.flush_mutex != NULL) {
+        txd_mutex_destroy(s_batch.flush_mutex);
+    }
+
+    txd_free(s_batch.entries);
+    txd_free(s_batch.values);
+    txd_free(s_batch.order);
+    txd_free(s_batch.bin_free);
+    txd_free(s_batch.datapoints);
+    memset(&s_batch, 0, sizeof(s_batch));
+
+    return -1;
+}
+
+int32_t esp_welink_batch_update(uint32_t property_id, const uint8_t* value, uint32_t value_len)
+{
+    batch_entry_t* entry = NULL;
+    uint32_t now = 0;
+    uint32_t i = 0;
+    bool full = false;
+
+    if (s_batch.mutex == NULL || (value == NULL && value_len != 0) || value_len > s_batch.config.max_value_len) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_batch.mutex);
+
+    for (i = 0; i < s_batch.config.max_entries; i++) {
+        if (s_batch.entries[i].used && s_batch.entries[i].property_id == property_id) {
+            entry = &s_batch.entries[i];
+            s_batch.pending_bytes -= entry->value_len;
+            s_batch.stats.coalesced++;
+            break;
+        }
+
+        if (entry == NULL && !s_batch.entries[i].used) {
+            entry = &s_batch.entries[i];
+        }
+    }
+
+    if (entry == NULL) {
+        s_batch.stats.dropped++;
+        txd_mutex_unlock(s_batch.mutex);
+        WELINK_LOGW("batch pool full, property_id: %d dropped", property_id);
+        return -1;
+    }
+
+    now = txd_time_get_sysclock();
+
+    if (!entry->used) {
+        entry->used = true;
+        entry->property_id = property_id;
+
+        if (s_batch.pending++ == 0) {
+            s_batch.first_ms = now;
+        }
+    }
+
+    memcpy(BATCH_VALUE(entry - s_batch.entries), value, value_len);
+    entry->value_len = value_len;
+    entry->version = ++s_batch.version;
+    s_batch.pending_bytes += value_len;
+    s_batch.last_ms = now;
+    s_batch.stats.updates++;
+
+    // 待发送的数据已经够一条消息，或者池已满，立即发送最满的一条
+    full = (s_batch.pending_bytes >= WELINK_BATCH_MAX_BYTES) || (s_batch.pending == s_batch.config.max_entries);
+
+    if (!full) {
+        batch_schedule(now);
+    }
+
+    txd_mutex_unlock(s_batch.mutex);
+
+    if (full) {
+        batch_flush(1, &s_batch.stats.flush_size);
+    }
+
+    return 0;
+}
+
+int32_t esp_welink_batch_flush(void)
+{
+    if (s_batch.mutex == NULL) {
+        return -1;
+    }
+
+    return batch_flush(0, &s_batch.stats.flush_manual);
+}
+
+uint32_t esp_welink_batch_pending(void)
+{
+    uint32_t pending = 0;
+
+    if (s_batch.mutex == NULL) {
+        return 0;
+    }
+
+    txd_mutex_lock(s_batch.mutex);
+    pending = s_batch.pending;
+    txd_mutex_unlock(s_batch.mutex);
+
+    return pending;
+}
+
+int32_t esp_welink_batch_get_stats(esp_welink_batch_stats_t* stats)
+{
+    if (s_batch.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_batch.mutex);
+    memcpy(stats, &s_batch.stats, sizeof(esp_welink_batch_stats_t));
+    txd_mutex_unlock(s_batch.mutex);
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "esp_welink_boot.h"
+#include "esp_welink_json.h"
+#include "esp_welink_log.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_boot";
+
+#define BOOT_MAGIC      0x31544257  // "WBT1"
+#define BOOT_NVS_KEY    "boots"
+#define BOOT_MAX_VALUE  320
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // 最近一次启动的序号
+    uint32_t count;
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];  // 按时间从早到晚
+} boot_history_t;
+
+/*
+ * 打点只原子地写一次数组元素，不加锁，可以在初始化之前、任意任务中调用；
+ * 完成后的保存、打印和上报都在定时器回调中进行，不占用事件回调和SDK线程的时间
+ */
+static struct {
+    esp_welink_boot_config_t config;
+    esp_welink_boot_record_t current;   // 本次启动的打点，完成时复制出记录
+    bool completed;
+    txd_timer_handler_t* timer;
+} s_boot;
+
+static const char* s_phase_names[ESP_WELINK_BOOT_PHASE_MAX] = {
+    "app_main",
+    "nvs_init",
+    "wifi_start",
+    "wifi_connected",
+    "got_ip",
+    "task_start",
+    "device_info",
+    "dns",
+    "tcp_connect",
+    "online",
+    "first_report",
+};
+
+static int32_t boot_load(boot_history_t* history)
+{
+    nvs_handle handle;
+    size_t len = sizeof(boot_history_t);
+
+    memset(history, 0, sizeof(boot_history_t));
+
+    if (nvs_open(s_boot.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        WELINK_LOGE("nvs open fail");
+        return -1;
+    }
+
+    // 没有历史记录或者记录无效时从空的历史开始
+    if (nvs_get_blob(handle, BOOT_NVS_KEY, history, &len) != ESP_OK || len != sizeof(boot_history_t)
+        || history->magic != BOOT_MAGIC || history->count > WELINK_BOOT_MAX_HISTORY) {
+        memset(history, 0, sizeof(boot_history_t));
+    }
+
+    nvs_close(handle);
+
+    return 0;
+}
+
+// 其他任务可能同时在打点，逐个原子地读取
+static void boot_read(esp_welink_boot_record_t* record)
+{
+    uint32_t i = 0;
+
+    memset(record, 0, sizeof(esp_welink_boot_record_t));
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        record->us[i] = __atomic_load_n(&s_boot.current.us[i], __ATOMIC_ACQUIRE);
+    }
+}
+
+// 把本次启动追加到历史记录中，只保留最近history次
+static void boot_save(esp_welink_boot_record_t* record)
+{
+    boot_history_t* history = (boot_history_t*)txd_malloc(sizeof(boot_history_t));
+    nvs_handle handle;
+
+    WELINK_ERROR_GOTO(history == NULL, end, "malloc fail");
+    WELINK_ERROR_GOTO(boot_load(history) != 0, end, "load boot history fail");
+
+    record->boot = history->seq + 1;
+
+    if (history->count >= s_boot.config.history) {
+        memmove(history->records, history->records + history->count - s_boot.config.history + 1,
+                sizeof(esp_welink_boot_record_t) * (s_boot.config.history - 1));
+        history->count = s_boot.config.history - 1;
+    }
+
+    history->magic = BOOT_MAGIC;
+    history->seq = record->boot;
+    history->records[history->count++] = *record;
+
+    WELINK_ERROR_GOTO(nvs_open(s_boot.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK, end, "nvs open fail");
+
+    if (nvs_set_blob(handle, BOOT_NVS_KEY, history, sizeof(boot_history_t)) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+        WELINK_LOGE("write boot history fail");
+    }
+
+    nvs_close(handle);
+
+end:
+    txd_free(history);
+}
+
+static void boot_report(const esp_welink_boot_record_t* record)
+{
+    esp_welink_report_t report = s_boot.config.report ? s_boot.config.report : txd_report_datapoints;
+    esp_welink_json_writer_t writer;
+    txd_datapoint_t datapoint = {0};
+    char value[BOOT_MAX_VALUE];
+    uint32_t cookie = 0;
+    uint32_t i = 0;
+    int32_t len = 0;
+    int32_t ret = 0;
+
+    esp_welink_json_writer_init(&writer, value, sizeof(value));
+    esp_welink_json_write_object_begin(&writer, NULL);
+    esp_welink_json_write_int(&writer, "boot", record->boot);
+
+    // 单位为毫秒，保留一位小数
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        if (record->us[i] != 0) {
+            esp_welink_json_write_fixed(&writer, s_phase_names[i], record->us[i] / 100, 1);
+        }
+    }
+
+    esp_welink_json_write_object_end(&writer);
+    len = esp_welink_json_writer_finish(&writer);
+
+    if (len < 0) {
+        WELINK_LOGE("boot record too long");
+        return;
+    }
+
+    datapoint.property_id = s_boot.config.property_id;
+    datapoint.property_value = (uint8_t*)value;
+    datapoint.property_value_len = len;
+    ret = report(&datapoint, 1, NULL, &cookie);
+
+    if (ret != err_success) {
+        WELINK_LOGW("report boot record fail, ret: 0x%x", ret);
+        return;
+    }
+
+    esp_welink_socket_wakeup();
+}
+
+static void boot_complete(void* arg)
+{
+    esp_welink_boot_record_t record;
+
+    if (__atomic_exchange_n(&s_boot.completed, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    // 之后的打点不再生效，保存、打印和上报的是同一份记录
+    boot_read(&record);
+    boot_save(&record);
+    esp_welink_boot_dump();
+
+    if (s_boot.config.property_id != 0) {
+        boot_report(&record);
+    }
+}
+
+int32_t esp_welink_boot_init(const esp_welink_boot_config_t* config)
+{
+    esp_welink_boot_config_t config_default = ESP_WELINK_BOOT_CONFIG_DEFAULT();
+
+    if (s_boot.timer != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->history == 0 || config->history > WELINK_BOOT_MAX_HISTORY || config->nvs_namespace == NULL,
+                       -1, "invalid boot config");
+
+    // 只设置配置，保留初始化之前的打点
+    s_boot.config = *config;
+
+    // 定时器最后创建，作为初始化完成的标志
+    s_boot.timer = txd_timer_create(boot_complete, NULL);
+    WELINK_ERROR_CHECK(s_boot.timer == NULL, -1, "create timer fail");
+
+    if (__atomic_load_n(&s_boot.current.us[ESP_WELINK_BOOT_FIRST_REPORT], __ATOMIC_ACQUIRE) != 0) {
+        txd_timer_start(s_boot.timer, 0, 0, 0);
+    } else if (__atomic_load_n(&s_boot.current.us[ESP_WELINK_BOOT_ONLINE], __ATOMIC_ACQUIRE) != 0) {
+        txd_timer_start(s_boot.timer, s_boot.config.complete_timeout_ms, 0, 0);
+    }
+
+    return 0;
+}
+
+void esp_welink_boot_deinit(void)
+{
+    if (s_boot.timer != NULL) {
+        txd_timer_destroy(s_boot.timer);
+    }
+
+    memset(&s_boot, 0, sizeof(s_boot));
+}
+
+void esp_welink_boot_mark(esp_welink_boot_phase_t phase)
+{
+    int64_t us = 0;
+    uint32_t unset = 0;
+
+    if ((uint32_t)phase >= ESP_WELINK_BOOT_PHASE_MAX || __atomic_load_n(&s_boot.completed, __ATOMIC_ACQUIRE)
+        || __atomic_load_n(&s_boot.current.us[phase], __ATOMIC_RELAXED) != 0) {
+        return;
+    }
+
+    // 0表示没有到达该阶段，超过32位的时间记为最大值
+    us = esp_timer_get_time();
+
+    // 几个任务同时打同一个阶段时只有一个生效
+    if (!__atomic_compare_exchange_n(&s_boot.current.us[phase], &unset,
+                                     (us <= 0) ? 1 : (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us,
+                                     false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    if (s_boot.timer == NULL) {
+        return;
+    }
+
+    if (phase == ESP_WELINK_BOOT_FIRST_REPORT) {
+        txd_timer_start(s_boot.timer, 0, 0, 0);
+    } else if (phase == ESP_WELINK_BOOT_ONLINE
+               && __atomic_load_n(&s_boot.current.us[ESP_WELINK_BOOT_FIRST_REPORT], __ATOMIC_ACQUIRE) == 0) {
+        txd_timer_start(s_boot.timer, s_boot.config.complete_timeout_ms, 0, 0);
+    }
+}
+
+int32_t esp_welink_boot_get_current(esp_welink_boot_record_t* record)
+{
+    if (record == NULL) {
+        return -1;
+    }
+
+    boot_read(record);
+
+    return __atomic_load_n(&s_boot.completed, __ATOMIC_ACQUIRE) ? 1 : 0;
+}
+
+const char* esp_welink_boot_phase_name(esp_welink_boot_phase_t phase)
+{
+    return ((uint32_t)phase < ESP_WELINK_BOOT_PHASE_MAX) ? s_phase_names[phase] : "unknown";
+}
+
+int32_t esp_welink_boot_get_history(esp_welink_boot_record_t* records, uint32_t max_count)
+{
+    boot_history_t* history = NULL;
+    uint32_t count = 0;
+
+    if (s_boot.timer == NULL || records == NULL) {
+        return -1;
+    }
+
+    history = (boot_history_t*)txd_malloc(sizeof(boot_history_t));
+
+    if (history == NULL || boot_load(history) != 0) {
+        txd_free(history);
+        return -1;
+    }
+
+    // 只返回最近的max_count次
+    count = (history->count < max_count) ? history->count : max_count;
+    memcpy(records, history->records + history->count - count, sizeof(esp_welink_boot_record_t) * count);
+    txd_free(history);
+
+    return count;
+}
+
+void esp_welink_boot_dump(void)
+{
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+    esp_welink_boot_record_t current;   // 本次启动的打点，完成时复制出记录
+    uint32_t prev = 0;
+    uint32_t delta = 0;
+    uint32_t i = 0;
+    int32_t j = 0;
+    int32_t count = 0;
+
+    boot_read(&current);
+    printf("%-16s %10s %10s  (ms since start)\n", "phase", "at", "delta");
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        if (current.us[i] == 0) {
+            printf("%-16s %10s %10s\n", s_phase_names[i], "-", "-");
+            continue;
+        }
+
+        // 阶段不一定按顺序到达，时间早于上一个阶段时差值记为0
+        delta = (current.us[i] > prev) ? current.us[i] - prev : 0;
+        printf("%-16s %8u.%u %8u.%u\n", s_phase_names[i], current.us[i] / 1000, current.us[i] / 100 % 10,
+               delta / 1000, delta / 100 % 10);
+        prev = (current.us[i] > prev) ? current.us[i] : prev;
+    }
+
+    count = esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY);
+
+    if (count <= 0) {
+        return;
+    }
+
+    printf("%-16s", "boot");
+
+    for (j = 0; j < count; j++) {
+        printf(" %8u", records[j].boot);
+    }
+
+    printf("  (ms since start)\n");
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        printf("%-16s", s_phase_names[i]);
+
+        for (j = 0; j < count; j++) {
+            if (records[j].us[i] == 0) {
+                printf(" %8s", "-");
+            } else {
+                printf(" %8u", records[j].us[i] / 1000);
+            }
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,574 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_base64.h"
+#include "esp_welink_chunk.h"
+#include "esp_welink_log.h"
+#include "esp_welink_prop.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_chunk";
+
+#define CHUNK_IDLE          0       // 未发送，或需要重发
+#define CHUNK_SENDING       1       // 正在调用发送函数，还没有拿到cookie
+#define CHUNK_INFLIGHT      2       // 等待发送结果
+#define CHUNK_DONE          3
+
+#if WELINK_CHUNK_MAX_CHUNKS > 64
+#error "WELINK_CHUNK_MAX_CHUNKS must not exceed 64, received chunks are tracked in a uint64_t"
+#endif
+
+#if WELINK_CHUNK_MAX_WINDOW > WELINK_STASH_SIZE
+#error "WELINK_CHUNK_MAX_WINDOW must not exceed WELINK_STASH_SIZE, every chunk in flight may complete early"
+#endif
+
+typedef struct {
+    uint8_t state;
+    uint8_t retries;
+    uint32_t cookie;
+    uint32_t sent_ms;
+} chunk_tx_t;
+
+static struct {
+    esp_welink_chunk_config_t config;
+    // 发送端，同一时刻只有一个传输
+    bool active;
+    bool failed;
+    uint16_t id;
+    const uint8_t* data;
+    uint32_t len;
+    uint32_t crc;
+    uint32_t size;                      // 除最后一片外每片的字节数
+    uint32_t count;
+    uint32_t done;
+    uint32_t inflight;
+    uint32_t next_ms;                   // 下一次允许发送的时间
+    esp_welink_chunk_done_cb_t done_cb;
+    void* done_arg;
+    chunk_tx_t chunks[WELINK_CHUNK_MAX_CHUNKS];
+    esp_welink_stash_t stash;           // 发送函数返回cookie之前就到达的结果
+    uint8_t frame[WELINK_CHUNK_MAX_FRAME];
+    // 接收端
+    uint8_t* rx_buf;
+    txd_uint64_t rx_sender;
+    uint32_t rx_id;
+    uint32_t rx_count;
+    uint32_t rx_len;
+    uint32_t rx_crc;
+    uint32_t rx_received;
+    uint64_t rx_bitmap;
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_chunk_stats_t stats;
+} s_chunk;
+
+static const char s_hex_chars[] = "0123456789abcdef";
+
+static uint32_t chunk_crc32(const uint8_t* data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t i = 0;
+
+    // 与zlib.crc32相同，便于服务端校验
+    while (len--) {
+        crc ^= *data++;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+static int32_t chunk_parse_dec(const uint8_t** text, const uint8_t* end, uint32_t* value)
+{
+    const uint8_t* p = *text;
+
+    *value = 0;
+
+    while (p < end && *p >= '0' && *p <= '9' && p - *text < 9) {
+        *value = *value * 10 + (*p++ - '0');
+    }
+
+    if (p == *text || p == end || *p != ':') {
+        return -1;
+    }
+
+    *text = p + 1;
+
+    return 0;
+}
+
+static int32_t chunk_parse_hex(const uint8_t** text, const uint8_t* end, uint32_t* value)
+{
+    const uint8_t* p = *text;
+    uint8_t c = 0;
+
+    *value = 0;
+
+    for (; p < end && p - *text < 8; p++) {
+        c = *p | 0x20;
+
+        if (*p >= '0' && *p <= '9') {
+            *value = (*value << 4) | (*p - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *value = (*value << 4) | (c - 'a' + 10);
+        } else {
+            break;
+        }
+    }
+
+    if (p == *text || p == end || *p != ':') {
+        return -1;
+    }
+
+    *text = p + 1;
+
+    return 0;
+}
+
+// 调用前需持有mutex，生成第index片的数据点取值
+static uint32_t chunk_frame(uint32_t index)
+{
+    uint8_t* p = s_chunk.frame;
+    uint32_t offset = index * s_chunk.size;
+    uint32_t len = (index == s_chunk.count - 1) ? s_chunk.len - offset : s_chunk.size;
+    int32_t i = 0;
+
+    p += esp_welink_prop_encode_int(p, s_chunk.id);
+    *p++ = ':';
+    p += esp_welink_prop_encode_int(p, index);
+    *p++ = ':';
+    p += esp_welink_prop_encode_int(p, s_chunk.count);
+    *p++ = ':';
+    p += esp_welink_prop_encode_int(p, s_chunk.len);
+    *p++ = ':';
+
+    for (i = 28; i >= 0; i -= 4) {
+        *p++ = s_hex_chars[(s_chunk.crc >> i) & 0xF];
+    }
+
+    *p++ = ':';
+    p += esp_welink_base64_encode(p, s_chunk.data + offset, len);
+
+    return p - s_chunk.frame;
+}
+
+// 调用前需持有mutex，分片发送失败或超时后放回待发送状态
+static void chunk_retry(uint32_t index)
+{
+    chunk_tx_t* chunk = &s_chunk.chunks[index];
+
+    chunk->state = CHUNK_IDLE;
+    s_chunk.stats.tx_resent++;
+
+    if (++chunk->retries > s_chunk.config.max_retries) {
+        WELINK_LOGW("transfer %d chunk %d failed %d times", s_chunk.id, index, chunk->retries);
+        s_chunk.failed = true;
+    }
+}
+
+// 调用前需持有mutex，处理一个发送结果，找不到对应的分片时返回false
+static bool chunk_complete(uint32_t cookie, int32_t err_code)
+{
+    chunk_tx_t* chunk = NULL;
+    uint32_t i = 0;
+
+    for (i = 0; i < s_chunk.count; i++) {
+        chunk = &s_chunk.chunks[i];
+
+        if (chunk->state != CHUNK_INFLIGHT || chunk->cookie != cookie) {
+            continue;
+        }
+
+        s_chunk.inflight--;
+
+        if (err_code == err_success) {
+            chunk->state = CHUNK_DONE;
+            s_chunk.done++;
+            s_chunk.stats.tx_chunks++;
+        } else {
+            WELINK_LOGW("transfer %d chunk %d fail: 0x%x", s_chunk.id, i, err_code);
+            chunk_retry(i);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static void chunk_send_cb(int32_t err_code, uint32_t cookie)
+{
+    txd_mutex_lock(s_chunk.mutex);
+
+    // 发送函数可能在返回cookie之前就回调，先记下结果，拿到cookie后再处理
+    if (s_chunk.active && !chunk_complete(cookie, err_code)) {
+        esp_welink_stash_put(&s_chunk.stash, cookie, err_code, txd_time_get_sysclock());
+    }
+
+    txd_timer_start(s_chunk.timer, 0, 0, 0);
+
+    txd_mutex_unlock(s_chunk.mutex);
+}
+
+// 在定时器回调中发送，每次最多发送一片，窗口未满且到了发送间隔时立即再次处理
+static void chunk_pump(void* arg)
+{
+    txd_datapoint_t datapoint = {0};
+    esp_welink_chunk_done_cb_t done_cb = NULL;
+    chunk_tx_t* chunk = NULL;
+    void* done_arg = NULL;
+    uint32_t wait = TXD_TIMER_WAIT_FOREVER;
+    uint32_t now = txd_time_get_sysclock();
+    uint32_t index = 0;
+    uint32_t cookie = 0;
+    uint32_t id = 0;
+    int32_t err_code = 0;
+    int32_t ret = 0;
+    uint32_t i = 0;
+
+    txd_mutex_lock(s_chunk.mutex);
+
+    if (!s_chunk.active) {
+        txd_mutex_unlock(s_chunk.mutex);
+        return;
+    }
+
+    for (i = 0; i < s_chunk.count; i++) {
+        chunk = &s_chunk.chunks[i];
+
+        if (chunk->state == CHUNK_INFLIGHT && now - chunk->sent_ms >= s_chunk.config.ack_timeout_ms) {
+            WELINK_LOGW("transfer %d chunk %d timeout, cookie: %d", s_chunk.id, i, chunk->cookie);
+            s_chunk.inflight--;
+            chunk_retry(i);
+        }
+    }
+
+    if (s_chunk.failed || s_chunk.done == s_chunk.count) {
+        s_chunk.active = false;
+        done_cb = s_chunk.done_cb;
+        done_arg = s_chunk.done_arg;
+        id = s_chunk.id;
+        ret = s_chunk.failed ? -1 : 0;
+
+        if (s_chunk.failed) {
+            s_chunk.stats.tx_failed++;
+        } else {
+            s_chunk.stats.tx_transfers++;
+        }
+
+        txd_mutex_unlock(s_chunk.mutex);
+
+        if (done_cb != NULL) {
+            done_cb(id, ret, done_arg);
+        }
+
+        return;
+    }
+
+    for (i = 0, index = s_chunk.count; i < s_chunk.count; i++) {
+        chunk = &s_chunk.chunks[i];
+
+        if (chunk->state == CHUNK_INFLIGHT && s_chunk.config.ack_timeout_ms - (now - chunk->sent_ms) < wait) {
+            wait = s_chunk.config.ack_timeout_ms - (now - chunk->sent_ms);
+        } else if (chunk->state == CHUNK_IDLE && index == s_chunk.count) {
+            index = i;
+        }
+    }
+
+    // 优先发送序号小的分片，重发的分片也按序号排队
+    if (index == s_chunk.count || s_chunk.inflight >= s_chunk.config.window || (int32_t)(s_chunk.next_ms - now) > 0) {
+        if (index != s_chunk.count && s_chunk.inflight < s_chunk.config.window && s_chunk.next_ms - now < wait) {
+            wait = s_chunk.next_ms - now;
+        }
+
+        if (wait != TXD_TIMER_WAIT_FOREVER) {
+            txd_timer_start(s_chunk.timer, wait, 0, 0);
+        }
+
+        txd_mutex_unlock(s_chunk.mutex);
+        return;
+    }
+
+    chunk = &s_chunk.chunks[index];
+    chunk->state = CHUNK_SENDING;
+    s_chunk.inflight++;
+    s_chunk.next_ms = now + s_chunk.config.interval_ms;
+    datapoint.property_id = s_chunk.config.property_id;
+    datapoint.property_value = s_chunk.frame;
+    datapoint.property_value_len = chunk_frame(index);
+
+    txd_mutex_unlock(s_chunk.mutex);
+
+    // 发送时不持有mutex，SDK可能在发送函数中直接调用结果回调；frame只在定时器回调中使用
+    ret = s_chunk.config.report(&datapoint, 1, chunk_send_cb, &cookie);
+
+    txd_mutex_lock(s_chunk.mutex);
+
+    if (ret == err_success) {
+        chunk->state = CHUNK_INFLIGHT;
+        chunk->cookie = cookie;
+        chunk->sent_ms = txd_time_get_sysclock();
+
+        if (esp_welink_stash_take(&s_chunk.stash, cookie, &err_code, NULL)) {
+            chunk_complete(cookie, err_code);
+        }
+    } else {
+        // 发送过快或SDK缓存已满时不算重试，等下一个发送间隔；其它错误按重试处理并退避一个超时时间
+        chunk->state = CHUNK_IDLE;
+        s_chunk.inflight--;
+
+        if (ret == err_msg_send_too_frequently || ret == err_msg_cache_failed) {
+            s_chunk.stats.tx_throttled++;
+        } else {
+            WELINK_LOGW("transfer %d chunk %d send fail: 0x%x", s_chunk.id, index, ret);
+            s_chunk.next_ms = now + s_chunk.config.ack_timeout_ms;
+            chunk_retry(index);
+        }
+    }
+
+    txd_timer_start(s_chunk.timer, 0, 0, 0);
+
+    txd_mutex_unlock(s_chunk.mutex);
+
+    if (ret == err_success) {
+        esp_welink_socket_wakeup();
+    }
+}
+
+int32_t esp_welink_chunk_init(const esp_welink_chunk_config_t* config)
+{
+    esp_welink_chunk_config_t config_default = ESP_WELINK_CHUNK_CONFIG_DEFAULT();
+
+    if (s_chunk.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    memset(&s_chunk, 0, sizeof(s_chunk));
+    s_chunk.config = *config;
+    s_chunk.config.report = config->report ? config->report : txd_report_datapoints;
+
+    WELINK_ERROR_GOTO(config->chunk_size == 0
+                      || WELINK_CHUNK_MAX_HEADER + ESP_WELINK_BASE64_LEN(config->chunk_size) > WELINK_CHUNK_MAX_FRAME
+                      || config->window == 0 || config->window > WELINK_CHUNK_MAX_WINDOW
+                      || config->ack_timeout_ms == 0, end, "invalid chunk config");
+
+    if (config->rx_max_len != 0) {
+        s_chunk.rx_buf = (uint8_t*)txd_malloc(config->rx_max_len);
+        WELINK_ERROR_GOTO(s_chunk.rx_buf == NULL, end, "malloc fail");
+    }
+
+    s_chunk.timer = txd_timer_create(chunk_pump, NULL);
+    WELINK_ERROR_GOTO(s_chunk.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_chunk.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_chunk.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_chunk.timer != NULL) {
+        txd_timer_destroy(s_chunk.timer);
+    }
+
+    txd_free(s_chunk.rx_buf);
+    memset(&s_chunk, 0, sizeof(s_chunk));
+
+    return -1;
+}
+
+int32_t esp_welink_chunk_send(const uint8_t* data, uint32_t len, esp_welink_chunk_done_cb_t done_cb, void* arg)
+{
+    uint32_t crc = 0;
+    int32_t id = 0;
+
+    if (s_chunk.mutex == NULL || data == NULL || len == 0
+            || len > WELINK_CHUNK_MAX_CHUNKS * s_chunk.config.chunk_size) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    // CRC在锁外计算，长数据也不会阻塞正在进行的发送结果回调
+    crc = chunk_crc32(data, len);
+
+    txd_mutex_lock(s_chunk.mutex);
+
+    if (s_chunk.active) {
+        txd_mutex_unlock(s_chunk.mutex);
+        WELINK_LOGW("transfer %d is running", s_chunk.id);
+        return -1;
+    }
+
+    // 分片数按chunk_size计算，再把数据平均分到各片，接收端根据len和count就能算出每片的位置
+    s_chunk.active = true;
+    s_chunk.failed = false;
+    s_chunk.id++;
+    s_chunk.data = data;
+    s_chunk.len = len;
+    s_chunk.crc = crc;
+    s_chunk.count = (len + s_chunk.config.chunk_size - 1) / s_chunk.config.chunk_size;
+    s_chunk.size = (len + s_chunk.count - 1) / s_chunk.count;
+    s_chunk.done = 0;
+    s_chunk.inflight = 0;
+    s_chunk.done_cb = done_cb;
+    s_chunk.done_arg = arg;
+    memset(s_chunk.chunks, 0, sizeof(s_chunk.chunks));
+    memset(&s_chunk.stash, 0, sizeof(s_chunk.stash));
+    id = s_chunk.id;
+    txd_timer_start(s_chunk.timer, 0, 0, 0);
+
+    txd_mutex_unlock(s_chunk.mutex);
+
+    return id;
+}
+
+int32_t esp_welink_chunk_receive(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    const uint8_t* p = NULL;
+    const uint8_t* end = NULL;
+    uint32_t field[4] = {0};    // id, seq, count, len
+    uint32_t crc = 0;
+    uint32_t size = 0;
+    uint32_t offset = 0;
+    uint32_t i = 0;
+    int32_t ret = 0;
+    bool complete = false;
+
+    if (s_chunk.mutex == NULL || s_chunk.rx_buf == NULL || datapoint == NULL || datapoint->property_value == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return ESP_WELINK_CHUNK_RET_INVALID;
+    }
+
+    p = datapoint->property_value;
+    end = p + datapoint->property_value_len;
+
+    for (i = 0; i < 4 && ret == 0; i++) {
+        ret = chunk_parse_dec(&p, end, &field[i]);
+    }
+
+    if (ret != 0 || chunk_parse_hex(&p, end, &crc) != 0
+            || field[2] == 0 || field[2] > WELINK_CHUNK_MAX_CHUNKS || field[1] >= field[2] || field[3] < field[2]) {
+        WELINK_LOGW("invalid chunk: %.*s", (int)(p - datapoint->property_value), datapoint->property_value);
+        txd_mutex_lock(s_chunk.mutex);
+        s_chunk.stats.rx_errors++;
+        txd_mutex_unlock(s_chunk.mutex);
+        return ESP_WELINK_CHUNK_RET_INVALID;
+    }
+
+    // ack只带回分片头，发送端据此确认收到了哪一片
+    if (ack != NULL) {
+        ack->property_value = datapoint->property_value;
+        ack->property_value_len = p - datapoint->property_value;
+    }
+
+    txd_mutex_lock(s_chunk.mutex);
+
+    s_chunk.stats.rx_chunks++;
+
+    if (field[3] > s_chunk.config.rx_max_len) {
+        WELINK_LOGW("chunked buffer too large: %d", field[3]);
+        s_chunk.stats.rx_errors++;
+        txd_mutex_unlock(s_chunk.mutex);
+        return ESP_WELINK_CHUNK_RET_TOO_LARGE;
+    }
+
+    // 任何一个头部字段变化都视为新的传输，丢弃未完成的数据
+    if (field[0] != s_chunk.rx_id || field[2] != s_chunk.rx_count || field[3] != s_chunk.rx_len || crc != s_chunk.rx_crc
+            || memcmp(&sender_id, &s_chunk.rx_sender, sizeof(txd_uint64_t)) != 0) {
+        s_chunk.rx_sender = sender_id;
+        s_chunk.rx_id = field[0];
+        s_chunk.rx_count = field[2];
+        s_chunk.rx_len = field[3];
+        s_chunk.rx_crc = crc;
+        s_chunk.rx_received = 0;
+        s_chunk.rx_bitmap = 0;
+    }
+
+    if (s_chunk.rx_bitmap & (1ULL << field[1])) {
+        s_chunk.stats.rx_duplicates++;
+        txd_mutex_unlock(s_chunk.mutex);
+        return 0;
+    }
+
+    size = (field[3] + field[2] - 1) / field[2];
+    offset = field[1] * size;
+
+    // 每片的长度由头部决定，base64的长度必须正好对应
+    size = (field[1] == field[2] - 1) ? field[3] - offset : size;
+
+    if (offset >= field[3] || end - p != ESP_WELINK_BASE64_LEN(size)
+            || esp_welink_base64_decode(s_chunk.rx_buf + offset, size, p, end - p) != (int32_t)size) {
+        WELINK_LOGW("invalid chunk %d of transfer %d", field[1], field[0]);
+        s_chunk.stats.rx_errors++;
+        txd_mutex_unlock(s_chunk.mutex);
+        return ESP_WELINK_CHUNK_RET_INVALID;
+    }
+
+    s_chunk.rx_bitmap |= 1ULL << field[1];
+
+    if (++s_chunk.rx_received == s_chunk.rx_count) {
+        if (chunk_crc32(s_chunk.rx_buf, s_chunk.rx_len) != s_chunk.rx_crc) {
+            WELINK_LOGW("transfer %d crc error", field[0]);
+            s_chunk.stats.rx_errors++;
+            s_chunk.rx_received = 0;
+            s_chunk.rx_bitmap = 0;
+            ret = ESP_WELINK_CHUNK_RET_CRC;
+        } else {
+            s_chunk.stats.rx_transfers++;
+            complete = true;
+        }
+    }
+
+    txd_mutex_unlock(s_chunk.mutex);
+
+    // 接收端只在一个线程中调用，回调期间rx_buf不会被改写
+    if (complete && s_chunk.config.rx_cb != NULL) {
+        s_chunk.config.rx_cb(sender_id, s_chunk.rx_buf, s_chunk.rx_len);
+    }
+
+    return ret;
+}
+
+int32_t esp_welink_chunk_get_stats(esp_welink_chunk_stats_t* stats)
+{
+    if (s_chunk.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_chunk.mutex);
+    memcpy(stats, &s_chunk.stats, sizeof(esp_welink_chunk_stats_t));
+    txd_mutex_unlock(s_chunk.mutex);
+
+    return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "esp_welink_clock.h"
+#include "esp_welink_log.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_sdk.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_clock";
+
+#define CLOCK_MAGIC         0x314B4357  // "WCK1"
+#define CLOCK_NVS_KEY       "clock"
+#define CLOCK_HUNT_MS       1500        // 等待秒数变化的最长时间
+/*
+ * SDK登录或心跳时把服务器时间的整数秒设为当前时间，此后用本地时钟累加，
+ * 所以SDK的秒数变化时真实时间已经过了这一秒的[0, 1)秒，平均多出半秒
+ */
+#define CLOCK_EDGE_BIAS_MS  500
+#define CLOCK_SLOPE_SAMPLES 8           // 漂移未知时，至少这么多采样才用拟合的斜率求锚点
+
+typedef struct {
+    int64_t mono_ms;
+    int64_t wall_ms;
+} clock_sample_t;
+
+typedef struct {
+    uint32_t magic;
+    int32_t drift_ppb;
+    uint64_t wall_ms;
+} clock_snapshot_t;
+
+static struct {
+    esp_welink_clock_config_t config;
+    esp_welink_clock_state_t state;
+    // 时钟模型：wall = anchor_wall + elapsed + elapsed * drift_ppb / 1e9，elapsed = mono - anchor_mono
+    int64_t anchor_mono;
+    int64_t anchor_wall;
+    int32_t drift_ppb;
+    bool drift_known;                   // 已经估计过漂移或者从NVS读到了漂移
+    uint64_t last_ms;                   // 上一次返回的时间，保证不回退
+    clock_sample_t samples[WELINK_CLOCK_MAX_SAMPLES];
+    uint32_t sample_next;
+    uint32_t sample_count;
+    // 等待服务器时间的秒数变化
+    bool hunting;
+    uint32_t hunt_sec;
+    int64_t hunt_prev;
+    int64_t hunt_deadline;
+    int64_t saved_mono;
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_clock_stats_t stats;
+} s_clock;
+
+static int64_t clock_mono_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+// 调用前需持有mutex
+static int64_t clock_wall_at(int64_t mono)
+{
+    int64_t elapsed = mono - s_clock.anchor_mono;
+
+    return s_clock.anchor_wall + elapsed + elapsed * s_clock.drift_ppb / 1000000000LL;
+}
+
+/*
+ * 调用前需持有mutex：用最小二乘拟合 offset = wall - mono 随mono的变化，斜率即晶振的漂移，
+ * 每个采样相差不到一秒的相位在拟合中被平均掉。采样跨度不够长时沿用已有的漂移，只平均偏移
+ */
+static void clock_fit(void)
+{
+    const clock_sample_t* base = &s_clock.samples[(s_clock.sample_next + WELINK_CLOCK_MAX_SAMPLES - s_clock.sample_count)
+                                                  % WELINK_CLOCK_MAX_SAMPLES];
+    const clock_sample_t* last = &s_clock.samples[(s_clock.sample_next + WELINK_CLOCK_MAX_SAMPLES - 1)
+                                                  % WELINK_CLOCK_MAX_SAMPLES];
+    const clock_sample_t* sample = NULL;
+    double n = s_clock.sample_count;
+    double sx = 0;
+    double sy = 0;
+    double sxx = 0;
+    double sxy = 0;
+    double x = 0;
+    double y = 0;
+    double slope = s_clock.drift_ppb / 1e9;
+    double limit = s_clock.config.max_drift_ppm / 1e6;
+    uint32_t i = 0;
+
+    for (i = 0; i < s_clock.sample_count; i++) {
+        sample = &s_clock.samples[(base - s_clock.samples + i) % WELINK_CLOCK_MAX_SAMPLES];
+        x = (double)(sample->mono_ms - base->mono_ms);
+        y = (double)((sample->wall_ms - sample->mono_ms) - (base->wall_ms - base->mono_ms));
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    if (s_clock.sample_count > 1 && last->mono_ms - base->mono_ms >= s_clock.config.min_drift_span_ms) {
+        slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        slope = (slope > limit) ? limit : (slope < -limit) ? -limit : slope;
+        s_clock.drift_ppb = (int32_t)(slope * 1e9);
+        s_clock.drift_known = true;
+    } else if (!s_clock.drift_known && s_clock.sample_count >= CLOCK_SLOPE_SAMPLES) {
+        // 跨度还不够估计漂移，但斜率为0时直线取的是平均值，会落后漂移 * 跨度 / 2，锚点仍按拟合的斜率求
+        slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        slope = (slope > limit) ? limit : (slope < -limit) ? -limit : slope;
+    }
+
+    // 直线在最后一个采样处的取值作为新的锚点
+    x = (double)(last->mono_ms - base->mono_ms);
+    y = (sy - slope * sx) / n + slope * x;
+    s_clock.anchor_mono = last->mono_ms;
+    s_clock.anchor_wall = last->mono_ms + (base->wall_ms - base->mono_ms) + (int64_t)(y >= 0 ? y + 0.5 : y - 0.5);
+}
+
+// 调用前需持有mutex
+static void clock_add_sample(int64_t mono, int64_t wall)
+{
+    int64_t error = wall - clock_wall_at(mono);
+
+    s_clock.stats.samples++;
+    s_clock.stats.last_error_ms = (int32_t)((error > INT32_MAX) ? INT32_MAX : (error < INT32_MIN) ? INT32_MIN : error);
+
+    // 第一次采样、重启后的估计时间或者服务器时间被调整过，丢弃之前的采样
+    if (s_clock.state != ESP_WELINK_CLOCK_SYNCED || error > s_clock.config.step_ms || error < -(int64_t)s_clock.config.step_ms) {
+        if (s_clock.state == ESP_WELINK_CLOCK_SYNCED) {
+            WELINK_LOGW("step %d ms", s_clock.stats.last_error_ms);
+        }
+
+        s_clock.sample_count = 0;
+        s_clock.stats.steps++;
+
+        // 向后跳变时放弃不回退的保证，否则时钟会停很久
+        if (error < 0) {
+            s_clock.last_ms = 0;
+        }
+    }
+
+    s_clock.samples[s_clock.sample_next].mono_ms = mono;
+    s_clock.samples[s_clock.sample_next].wall_ms = wall;
+    s_clock.sample_next = (s_clock.sample_next + 1) % WELINK_CLOCK_MAX_SAMPLES;
+
+    if (s_clock.sample_count < WELINK_CLOCK_MAX_SAMPLES) {
+        s_clock.sample_count++;
+    }
+
+    s_clock.state = ESP_WELINK_CLOCK_SYNCED;
+    clock_fit();
+}
+
+// 调用前需持有mutex
+static int32_t clock_start_hunt(void)
+{
+    uint32_t sec = txd_get_server_time();
+
+    if (sec == 0) {
+        s_clock.stats.misses++;
+        txd_timer_start(s_clock.timer, (s_clock.state == ESP_WELINK_CLOCK_SYNCED) ? s_clock.config.sync_interval_ms
+                        : WELINK_CLOCK_RETRY_MS, 0, 0);
+        return -1;
+    }
+
+    s_clock.hunting = true;
+    s_clock.hunt_sec = sec;
+    s_clock.hunt_prev = clock_mono_ms();
+    s_clock.hunt_deadline = s_clock.hunt_prev + CLOCK_HUNT_MS;
+    txd_timer_start(s_clock.timer, s_clock.config.poll_ms, s_clock.config.poll_ms, 0);
+
+    return 0;
+}
+
+// 调用前需持有mutex：轮询服务器时间，返回true表示本次采样结束
+static bool clock_hunt(void)
+{
+    uint32_t sec = txd_get_server_time();
+    int64_t now = clock_mono_ms();
+
+    if (sec == s_clock.hunt_sec && sec != 0 && now < s_clock.hunt_deadline) {
+        s_clock.hunt_prev = now;
+        return false;
+    }
+
+    if (sec != 0 && sec == s_clock.hunt_sec + 1) {
+        // 秒数在上一次和这一次轮询之间变化，取中点
+        clock_add_sample((s_clock.hunt_prev + now) / 2, (int64_t)sec * 1000 + CLOCK_EDGE_BIAS_MS);
+        return true;
+    }
+
+    if (sec != 0 && now < s_clock.hunt_deadline) {
+        // SDK在轮询期间校时，秒数跳变不是边沿，重新等待
+        s_clock.hunt_sec = sec;
+        s_clock.hunt_prev = now;
+        return false;
+    }
+
+    s_clock.stats.misses++;
+    return true;
+}
+
+static void clock_timer_cb(void* arg)
+{
+    bool save = false;
+
+    txd_mutex_lock(s_clock.mutex);
+
+    if (!s_clock.hunting) {
+        clock_start_hunt();
+    } else if (clock_hunt()) {
+        s_clock.hunting = false;
+        txd_timer_start(s_clock.timer, (s_clock.state == ESP_WELINK_CLOCK_SYNCED) ? s_clock.config.sync_interval_ms
+                        : WELINK_CLOCK_RETRY_MS, 0, 0);
+        save = s_clock.state == ESP_WELINK_CLOCK_SYNCED && s_clock.config.save_interval_ms != 0
+               && clock_mono_ms() - s_clock.saved_mono >= s_clock.config.save_interval_ms;
+    }
+
+    txd_mutex_unlock(s_clock.mutex);
+
+    if (save) {
+        esp_welink_clock_save();
+    }
+}
+
+static void clock_load(void)
+{
+    clock_snapshot_t snapshot;
+    nvs_handle handle;
+    size_t len = sizeof(snapshot);
+
+    if (nvs_open(s_clock.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        WELINK_LOGE("nvs open fail");
+        return;
+    }
+
+    if (nvs_get_blob(handle, CLOCK_NVS_KEY, &snapshot, &len) != ESP_OK || len != sizeof(snapshot)
+        || snapshot.magic != CLOCK_MAGIC || snapshot.drift_ppb > (int32_t)s_clock.config.max_drift_ppm * 1000
+        || snapshot.drift_ppb < -(int32_t)s_clock.config.max_drift_ppm * 1000) {
+        WELINK_LOGI("no saved clock");
+    } else {
+        // 关机期间的时间无从得知，从保存时的时间继续
+        s_clock.anchor_mono = clock_mono_ms();
+        s_clock.anchor_wall = snapshot.wall_ms;
+        s_clock.drift_ppb = snapshot.drift_ppb;
+        s_clock.drift_known = true;
+        s_clock.state = ESP_WELINK_CLOCK_ESTIMATED;
+        WELINK_LOGI("load clock, drift: %d ppb", snapshot.drift_ppb);
+    }
+
+    nvs_close(handle);
+}
+
+int32_t esp_welink_clock_init(const esp_welink_clock_config_t* config)
+{
+    esp_welink_clock_config_t config_default = ESP_WELINK_CLOCK_CONFIG_DEFAULT();
+
+    if (s_clock.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->sync_interval_ms == 0 || config->poll_ms == 0 || config->poll_ms >= CLOCK_HUNT_MS
+                       || config->max_drift_ppm == 0 || config->max_drift_ppm > 100000
+                       || (config->save_interval_ms != 0 && config->nvs_namespace == NULL),
+                       -1, "invalid clock config");
+
+    memset(&s_clock, 0, sizeof(s_clock));
+    s_clock.config = *config;
+
+    if (config->save_interval_ms != 0) {
+        clock_load();
+    }
+
+    s_clock.timer = txd_timer_create(clock_timer_cb, NULL);
+    WELINK_ERROR_GOTO(s_clock.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_clock.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_clock.mutex == NULL, end, "create mutex fail");
+
+    txd_timer_start(s_clock.timer, 0, 0, 0);
+
+    return 0;
+
+end:
+
+    if (s_clock.timer != NULL) {
+        txd_timer_destroy(s_clock.timer);
+    }
+
+    memset(&s_clock, 0, sizeof(s_clock));
+
+    return -1;
+}
+
+int32_t esp_welink_clock_deinit(void)
+{
+    if (s_clock.mutex == NULL) {
+        return -1;
+    }
+
+    txd_timer_destroy(s_clock.timer);
+    txd_mutex_destroy(s_clock.mutex);
+    memset(&s_clock, 0, sizeof(s_clock));
+
+    return 0;
+}
+
+int32_t esp_welink_clock_sync(void)
+{
+    int32_t ret = 0;
+
+    if (s_clock.mutex == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_clock.mutex);
+
+    if (!s_clock.hunting) {
+        ret = clock_start_hunt();
+    }
+
+    txd_mutex_unlock(s_clock.mutex);
+
+    return ret;
+}
+
+uint64_t esp_welink_clock_now_ms(void)
+{
+    uint64_t now = 0;
+
+    if (s_clock.mutex == NULL) {
+        return 0;
+    }
+
+    txd_mutex_lock(s_clock.mutex);
+
+    if (s_clock.state != ESP_WELINK_CLOCK_NONE) {
+        now = clock_wall_at(clock_mono_ms());
+
+        // 向前校正后停住，直到赶上上一次返回的时间
+        if (now < s_clock.last_ms) {
+            now = s_clock.last_ms;
+        }
+
+        s_clock.last_ms = now;
+    }
+
+    txd_mutex_unlock(s_clock.mutex);
+
+    return now;
+}
+
+esp_welink_clock_state_t esp_welink_clock_get_state(void)
+{
+    return (s_clock.mutex == NULL) ? ESP_WELINK_CLOCK_NONE : s_clock.state;
+}
+
+int32_t esp_welink_clock_save(void)
+{
+    clock_snapshot_t snapshot;
+    nvs_handle handle;
+    int32_t ret = -1;
+
+    if (s_clock.mutex == NULL || s_clock.config.nvs_namespace == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_clock.mutex);
+
+    if (s_clock.state == ESP_WELINK_CLOCK_NONE) {
+        txd_mutex_unlock(s_clock.mutex);
+        return -1;
+    }
+
+    snapshot.magic = CLOCK_MAGIC;
+    snapshot.drift_ppb = s_clock.drift_ppb;
+    s_clock.saved_mono = clock_mono_ms();
+    snapshot.wall_ms = clock_wall_at(s_clock.saved_mono);
+
+    txd_mutex_unlock(s_clock.mutex);
+
+    if (nvs_open(s_clock.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        WELINK_LOGE("nvs open fail");
+    } else {
+        if (nvs_set_blob(handle, CLOCK_NVS_KEY, &snapshot, sizeof(snapshot)) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+            WELINK_LOGE("write clock fail");
+        } else {
+            ret = 0;
+        }
+
+        nvs_close(handle);
+    }
+
+    if (ret == 0) {
+        txd_mutex_lock(s_clock.mutex);
+        s_clock.stats.saves++;
+        txd_mutex_unlock(s_clock.mutex);
+    }
+
+    return ret;
+}
+
+int32_t esp_welink_clock_get_stats(esp_welink_clock_stats_t* stats)
+{
+    if (s_clock.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_clock.mutex);
+    memcpy(stats, &s_clock.stats, sizeof(esp_welink_clock_stats_t));
+    stats->state = s_clock.state;
+    stats->fit_samples = s_clock.sample_count;
+    stats->drift_ppb = s_clock.drift_ppb;
+    txd_mutex_unlock(s_clock.mutex);
+
+    return 0;
+}
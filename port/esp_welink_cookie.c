@@ -0,0 +1,324 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_cookie.h"
+#include "esp_welink_report.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_cookie";
+
+#define COOKIE_MASK         (WELINK_COOKIE_SLOTS - 1)
+#define COOKIE_HIGH_WATER   (WELINK_COOKIE_SLOTS * 3 / 4)   // 超过后先清理超时的条目，保证探测链不会太长
+
+#if (WELINK_COOKIE_SLOTS & COOKIE_MASK) != 0
+#error "WELINK_COOKIE_SLOTS must be a power of two"
+#endif
+
+typedef struct {
+    bool used;
+    uint8_t cls;
+    uint32_t cookie;
+    uint32_t submit_ms;
+} cookie_slot_t;
+
+static struct {
+    cookie_slot_t slots[WELINK_COOKIE_SLOTS];
+    uint32_t count;
+    esp_welink_stash_t stash;       // 在submit之前就到达的完成结果
+    uint32_t timeout_ms;
+    esp_welink_cookie_stats_t stats[WELINK_COOKIE_CLASSES];
+    txd_mutex_handler_t* mutex;
+} s_cookie;
+
+static uint32_t cookie_hash(uint32_t cookie)
+{
+    // Fibonacci散列，连续的cookie会分散到不同的槽
+    return (cookie * 2654435761u) >> (32 - __builtin_ctz(WELINK_COOKIE_SLOTS));
+}
+
+// 调用前需持有mutex，返回槽下标，找不到返回-1
+static int32_t cookie_find(uint32_t cookie)
+{
+    uint32_t i = cookie_hash(cookie);
+    uint32_t n = 0;
+
+    for (n = 0; n < WELINK_COOKIE_SLOTS && s_cookie.slots[i].used; n++, i = (i + 1) & COOKIE_MASK) {
+        if (s_cookie.slots[i].cookie == cookie) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// 调用前需持有mutex：删除后把探测链上后面的条目前移（backward shift），不需要墓碑标记
+static void cookie_remove(uint32_t index)
+{
+    uint32_t next = (index + 1) & COOKIE_MASK;
+    uint32_t home = 0;
+
+    s_cookie.slots[index].used = false;
+    s_cookie.stats[s_cookie.slots[index].cls].pending--;
+    s_cookie.count--;
+
+    for (; s_cookie.slots[next].used; next = (next + 1) & COOKIE_MASK) {
+        home = cookie_hash(s_cookie.slots[next].cookie);
+
+        // home在(index, next]之间时该条目不能前移
+        if (((next - home) & COOKIE_MASK) < ((next - index) & COOKIE_MASK)) {
+            continue;
+        }
+
+        s_cookie.slots[index] = s_cookie.slots[next];
+        s_cookie.slots[next].used = false;
+        index = next;
+    }
+}
+
+// 调用前需持有mutex
+static void cookie_record(uint32_t cls, int32_t err_code, uint32_t latency_ms)
+{
+    esp_welink_cookie_stats_t* stats = &s_cookie.stats[cls];
+    uint32_t bucket = 31 - __builtin_clz(latency_ms | 1);
+
+    if (err_code != err_success) {
+        stats->errors++;
+        stats->last_error = err_code;
+        return;
+    }
+
+    if (stats->completed == 0 || latency_ms < stats->min_ms) {
+        stats->min_ms = latency_ms;
+    }
+
+    if (latency_ms > stats->max_ms) {
+        stats->max_ms = latency_ms;
+    }
+
+    stats->completed++;
+    stats->sum_ms += latency_ms;
+    stats->hist[(bucket < WELINK_COOKIE_BUCKETS) ? bucket : WELINK_COOKIE_BUCKETS - 1]++;
+}
+
+// 调用前需持有mutex
+static uint32_t cookie_expire(uint32_t now)
+{
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    // 删除会前移后面的条目，所以删除后重新检查当前槽
+    for (i = 0; i < WELINK_COOKIE_SLOTS; ) {
+        if (s_cookie.slots[i].used && now - s_cookie.slots[i].submit_ms > s_cookie.timeout_ms) {
+            s_cookie.stats[s_cookie.slots[i].cls].lost++;
+            cookie_remove(i);
+            count++;
+        } else {
+            i++;
+        }
+    }
+
+    return count;
+}
+
+int32_t esp_welink_cookie_init(uint32_t timeout_ms)
+{
+    if (s_cookie.mutex != NULL) {
+        return 0;
+    }
+
+    WELINK_ERROR_CHECK(timeout_ms == 0, -1, "invalid timeout");
+
+    memset(&s_cookie, 0, sizeof(s_cookie));
+    s_cookie.timeout_ms = timeout_ms;
+
+    s_cookie.mutex = txd_mutex_create();
+    WELINK_ERROR_CHECK(s_cookie.mutex == NULL, -1, "create mutex fail");
+
+    return 0;
+}
+
+int32_t esp_welink_cookie_submit(uint32_t cookie, uint32_t cls)
+{
+    cookie_slot_t* slot = NULL;
+    int32_t err_code = 0;
+    uint32_t now = 0;
+    uint32_t i = 0;
+
+    if (s_cookie.mutex == NULL || cls >= WELINK_COOKIE_CLASSES) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_cookie.mutex);
+
+    now = txd_time_get_sysclock();
+    s_cookie.stats[cls].submitted++;
+
+    // 完成结果已经先到达，不知道发送的时刻，只计数，不计入时延
+    if (esp_welink_stash_take(&s_cookie.stash, cookie, &err_code, NULL)) {
+        if (err_code == err_success) {
+            s_cookie.stats[cls].unmeasured++;
+        } else {
+            cookie_record(cls, err_code, 0);
+        }
+
+        txd_mutex_unlock(s_cookie.mutex);
+        return 0;
+    }
+
+    if (s_cookie.count >= COOKIE_HIGH_WATER) {
+        cookie_expire(now);
+    }
+
+    if (s_cookie.count >= COOKIE_HIGH_WATER || cookie_find(cookie) >= 0) {
+        s_cookie.stats[cls].untracked++;
+        txd_mutex_unlock(s_cookie.mutex);
+        return -1;
+    }
+
+    for (i = cookie_hash(cookie); s_cookie.slots[i].used; i = (i + 1) & COOKIE_MASK);
+
+    slot = &s_cookie.slots[i];
+    slot->used = true;
+    slot->cls = cls;
+    slot->cookie = cookie;
+    slot->submit_ms = now;
+    s_cookie.count++;
+    s_cookie.stats[cls].pending++;
+
+    txd_mutex_unlock(s_cookie.mutex);
+
+    return 0;
+}
+
+void esp_welink_cookie_complete(int32_t err_code, uint32_t cookie)
+{
+    int32_t index = 0;
+    uint32_t now = 0;
+
+    if (s_cookie.mutex == NULL) {
+        return;
+    }
+
+    txd_mutex_lock(s_cookie.mutex);
+
+    now = txd_time_get_sysclock();
+    index = cookie_find(cookie);
+
+    if (index >= 0) {
+        cookie_record(s_cookie.slots[index].cls, err_code, now - s_cookie.slots[index].submit_ms);
+        cookie_remove(index);
+    } else {
+        // 发送函数返回后应用才会submit，完成可能先到，暂存结果
+        esp_welink_stash_put(&s_cookie.stash, cookie, err_code, now);
+    }
+
+    txd_mutex_unlock(s_cookie.mutex);
+}
+
+uint32_t esp_welink_cookie_expire(void)
+{
+    uint32_t count = 0;
+
+    if (s_cookie.mutex == NULL) {
+        return 0;
+    }
+
+    txd_mutex_lock(s_cookie.mutex);
+    count = cookie_expire(txd_time_get_sysclock());
+    txd_mutex_unlock(s_cookie.mutex);
+
+    return count;
+}
+
+int32_t esp_welink_cookie_get_stats(uint32_t cls, esp_welink_cookie_stats_t* stats)
+{
+    if (s_cookie.mutex == NULL || cls >= WELINK_COOKIE_CLASSES || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_cookie.mutex);
+    cookie_expire(txd_time_get_sysclock());
+    memcpy(stats, &s_cookie.stats[cls], sizeof(esp_welink_cookie_stats_t));
+    txd_mutex_unlock(s_cookie.mutex);
+
+    return 0;
+}
+
+uint32_t esp_welink_cookie_percentile(const esp_welink_cookie_stats_t* stats, uint32_t percent)
+{
+    uint64_t rank = 0;
+    uint64_t seen = 0;
+    uint32_t i = 0;
+
+    if (stats == NULL || stats->completed == 0 || percent == 0 || percent > 100) {
+        return 0;
+    }
+
+    rank = ((uint64_t)stats->completed * percent + 99) / 100;
+
+    for (i = 0; i < WELINK_COOKIE_BUCKETS; i++) {
+        seen += stats->hist[i];
+
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    // 最后一个桶没有上界，用最大值
+    if (i >= WELINK_COOKIE_BUCKETS - 1) {
+        return stats->max_ms;
+    }
+
+    return ((2u << i) - 1 < stats->max_ms) ? (2u << i) - 1 : stats->max_ms;
+}
+
+void esp_welink_cookie_reset(void)
+{
+    uint32_t pending[WELINK_COOKIE_CLASSES];
+    uint32_t i = 0;
+
+    if (s_cookie.mutex == NULL) {
+        return;
+    }
+
+    txd_mutex_lock(s_cookie.mutex);
+
+    for (i = 0; i < WELINK_COOKIE_CLASSES; i++) {
+        pending[i] = s_cookie.stats[i].pending;
+    }
+
+    memset(s_cookie.stats, 0, sizeof(s_cookie.stats));
+
+    for (i = 0; i < WELINK_COOKIE_CLASSES; i++) {
+        s_cookie.stats[i].pending = pending[i];
+    }
+
+    txd_mutex_unlock(s_cookie.mutex);
+}
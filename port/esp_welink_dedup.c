@@ -0,0 +1,256 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_dedup.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_dedup";
+
+#if (WELINK_DEDUP_SETS & (WELINK_DEDUP_SETS - 1)) != 0
+#error "WELINK_DEDUP_SETS must be a power of two"
+#endif
+
+#if WELINK_DEDUP_ACK_BYTES > 255
+#error "WELINK_DEDUP_ACK_BYTES must fit in the uint8_t value_len"
+#endif
+
+typedef enum {
+    DEDUP_FREE,
+    DEDUP_IN_PROGRESS,                  // 已插入，处理函数还没有返回
+    DEDUP_DONE,                         // ACK已缓存
+} dedup_state_t;
+
+typedef struct {
+    txd_uint64_t sender_id;
+    uint32_t property_id;
+    uint32_t seq;
+    uint32_t insert_ms;
+    uint32_t stamp;                     // 最近一次访问的序号，同一组内最小的最先被替换
+    int32_t ret_code;
+    uint8_t state;
+    uint8_t echo;                       // ACK带回的是收到的属性值，重放时直接引用重传数据点的属性值
+    uint8_t value_len;
+    uint8_t value[WELINK_DEDUP_ACK_BYTES];
+} dedup_entry_t;
+
+static struct {
+    dedup_entry_t sets[WELINK_DEDUP_SETS][WELINK_DEDUP_WAYS];
+    uint32_t clock;
+    esp_welink_dedup_stats_t stats;
+    txd_mutex_handler_t* mutex;
+} s_dedup;
+
+static dedup_entry_t* dedup_set(const txd_uint64_t* sender_id, const txd_datapoint_t* datapoint)
+{
+    uint32_t low = 0;
+    uint32_t high = 0;
+    uint32_t hash = 0;
+
+    memcpy(&low, sender_id->buf, sizeof(low));
+    memcpy(&high, sender_id->buf + sizeof(low), sizeof(high));
+
+    // 各字段混合后做Fibonacci散列，取高位作为组号
+    hash = low ^ ((high << 7) | (high >> 25)) ^ (datapoint->property_id * 0x9E3779B1u) ^ datapoint->seq;
+
+    return s_dedup.sets[(hash * 2654435761u) >> (32 - __builtin_ctz(WELINK_DEDUP_SETS))];
+}
+
+static inline bool dedup_live(const dedup_entry_t* entry, uint32_t now)
+{
+    return entry->state != DEDUP_FREE && now - entry->insert_ms < WELINK_DEDUP_TTL_MS;
+}
+
+// 调用前需持有mutex，找不到返回NULL
+static dedup_entry_t* dedup_find(dedup_entry_t* set, const txd_uint64_t* sender_id, const txd_datapoint_t* datapoint, uint32_t now)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < WELINK_DEDUP_WAYS; i++) {
+        if (set[i].seq == datapoint->seq && set[i].property_id == datapoint->property_id
+                && memcmp(&set[i].sender_id, sender_id, sizeof(txd_uint64_t)) == 0 && dedup_live(&set[i], now)) {
+            return &set[i];
+        }
+    }
+
+    return NULL;
+}
+
+// 调用前需持有mutex，优先使用空闲或过期的条目，否则替换组内最久未访问的条目
+static dedup_entry_t* dedup_victim(dedup_entry_t* set, uint32_t now)
+{
+    dedup_entry_t* victim = &set[0];
+    uint32_t i = 0;
+
+    for (i = 0; i < WELINK_DEDUP_WAYS; i++) {
+        if (!dedup_live(&set[i], now)) {
+            return &set[i];
+        }
+
+        if ((int32_t)(set[i].stamp - victim->stamp) < 0) {
+            victim = &set[i];
+        }
+    }
+
+    s_dedup.stats.evictions++;
+
+    return victim;
+}
+
+esp_welink_dedup_result_t esp_welink_dedup_check(txd_uint64_t sender_id, const txd_datapoint_t* datapoint,
+                                                 txd_datapoint_t* ack, uint8_t* ack_value)
+{
+    esp_welink_dedup_result_t result = ESP_WELINK_DEDUP_NEW;
+    dedup_entry_t* set = NULL;
+    dedup_entry_t* entry = NULL;
+    uint32_t now = 0;
+
+    if (s_dedup.mutex == NULL || datapoint == NULL || ack == NULL || ack_value == NULL) {
+        return ESP_WELINK_DEDUP_NEW;
+    }
+
+    set = dedup_set(&sender_id, datapoint);
+    now = txd_time_get_sysclock();
+
+    txd_mutex_lock(s_dedup.mutex);
+
+    s_dedup.stats.lookups++;
+    entry = dedup_find(set, &sender_id, datapoint, now);
+
+    if (entry == NULL) {
+        entry = dedup_victim(set, now);
+        entry->sender_id = sender_id;
+        entry->property_id = datapoint->property_id;
+        entry->seq = datapoint->seq;
+        entry->insert_ms = now;
+        entry->state = DEDUP_IN_PROGRESS;
+    } else if (entry->state == DEDUP_IN_PROGRESS) {
+        s_dedup.stats.in_progress++;
+        result = ESP_WELINK_DEDUP_IN_PROGRESS;
+    } else {
+        s_dedup.stats.replays++;
+        result = ESP_WELINK_DEDUP_REPLAY;
+        ack->property_id = datapoint->property_id;
+        ack->seq = datapoint->seq;
+        ack->ret_code = entry->ret_code;
+
+        // 缓存的值拷贝出来再发送，发送时条目可能已被替换
+        if (entry->echo) {
+            ack->property_value = datapoint->property_value;
+            ack->property_value_len = datapoint->property_value_len;
+        } else {
+            memcpy(ack_value, entry->value, entry->value_len);
+            ack->property_value = ack_value;
+            ack->property_value_len = entry->value_len;
+        }
+    }
+
+    entry->stamp = ++s_dedup.clock;
+
+    txd_mutex_unlock(s_dedup.mutex);
+
+    if (result != ESP_WELINK_DEDUP_NEW) {
+        WELINK_LOGI("duplicate, property_id: %d seq: %d result: %d", datapoint->property_id, datapoint->seq, result);
+    }
+
+    return result;
+}
+
+void esp_welink_dedup_complete(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, const txd_datapoint_t* ack)
+{
+    dedup_entry_t* entry = NULL;
+    bool echo = false;
+
+    if (s_dedup.mutex == NULL || datapoint == NULL) {
+        return;
+    }
+
+    txd_mutex_lock(s_dedup.mutex);
+
+    // 处理期间条目可能已被替换，找不到时不再缓存
+    entry = dedup_find(dedup_set(&sender_id, datapoint), &sender_id, datapoint, txd_time_get_sysclock());
+
+    if (entry == NULL) {
+        txd_mutex_unlock(s_dedup.mutex);
+        return;
+    }
+
+    echo = (ack != NULL) && (ack->property_value == datapoint->property_value)
+           && (ack->property_value_len == datapoint->property_value_len);
+
+    // 放不下的ACK不缓存，删除条目，重传时重新执行处理函数，而不是回复一个空值的ACK
+    if ((ack != NULL) && !echo && (ack->property_value_len > WELINK_DEDUP_ACK_BYTES)) {
+        WELINK_LOGW("ack of %d bytes not cached, property_id: %d", ack->property_value_len, datapoint->property_id);
+        s_dedup.stats.uncached_acks++;
+        ack = NULL;
+    }
+
+    if (ack == NULL) {
+        entry->state = DEDUP_FREE;
+        txd_mutex_unlock(s_dedup.mutex);
+        return;
+    }
+
+    entry->state = DEDUP_DONE;
+    entry->ret_code = ack->ret_code;
+    entry->echo = echo;
+    entry->value_len = echo ? 0 : (uint8_t)ack->property_value_len;
+
+    if (entry->value_len != 0) {
+        memcpy(entry->value, ack->property_value, entry->value_len);
+    }
+
+    txd_mutex_unlock(s_dedup.mutex);
+}
+
+int32_t esp_welink_dedup_init(void)
+{
+    if (s_dedup.mutex != NULL) {
+        return 0;
+    }
+
+    memset(&s_dedup, 0, sizeof(s_dedup));
+
+    // mutex最后创建，作为初始化完成的标志
+    s_dedup.mutex = txd_mutex_create();
+    WELINK_ERROR_CHECK(s_dedup.mutex == NULL, -1, "create mutex fail");
+
+    return 0;
+}
+
+int32_t esp_welink_dedup_get_stats(esp_welink_dedup_stats_t* stats)
+{
+    if (s_dedup.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_dedup.mutex);
+    memcpy(stats, &s_dedup.stats, sizeof(esp_welink_dedup_stats_t));
+    txd_mutex_unlock(s_dedup.mutex);
+
+    return 0;
+}
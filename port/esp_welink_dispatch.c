@@ -0,0 +1,315 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_dedup.h"
+#include "esp_welink_dispatch.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+
+static const char* TAG = "esp_welink_dispatch";
+
+typedef struct {
+    txd_uint64_t sender_id;
+    txd_datapoint_t datapoint;          // property_value指向本槽位后面的属性值缓冲区
+    esp_welink_dispatch_handler_t handler;
+} dispatch_slot_t;
+
+static struct {
+    esp_welink_dispatch_config_t config;
+    uint8_t* pool;                      // pool_size个槽位，每个槽位后面跟max_value_len字节的属性值
+    uint32_t slot_size;
+    xQueueHandle free_queue;            // 空闲槽位的下标
+    xQueueHandle work_queue;            // 等待worker处理的槽位下标
+    TaskHandle_t worker;
+    esp_welink_dispatch_stats_t stats;
+} s_dispatch;
+
+#if CONFIG_TARGET_PLATFORM_ESP8266
+#define DISPATCH_LOCK()     portENTER_CRITICAL()
+#define DISPATCH_UNLOCK()   portEXIT_CRITICAL()
+#elif defined(_x86_)
+static bool s_dispatch_lock = false;
+#define DISPATCH_LOCK()     while (__atomic_test_and_set(&s_dispatch_lock, __ATOMIC_ACQUIRE))
+#define DISPATCH_UNLOCK()   __atomic_clear(&s_dispatch_lock, __ATOMIC_RELEASE)
+#else
+static portMUX_TYPE s_dispatch_mux = portMUX_INITIALIZER_UNLOCKED;
+#define DISPATCH_LOCK()     portENTER_CRITICAL(&s_dispatch_mux)
+#define DISPATCH_UNLOCK()   portEXIT_CRITICAL(&s_dispatch_mux)
+#endif
+
+#define DISPATCH_COUNT(field) do { DISPATCH_LOCK(); s_dispatch.stats.field++; DISPATCH_UNLOCK(); } while (0)
+
+static inline dispatch_slot_t* dispatch_slot(uint32_t index)
+{
+    return (dispatch_slot_t*)(s_dispatch.pool + index * s_dispatch.slot_size);
+}
+
+// 表按property_id升序排列，二分查找，找不到返回NULL
+static const esp_welink_dispatch_entry_t* dispatch_lookup(uint32_t property_id)
+{
+    const esp_welink_dispatch_entry_t* table = s_dispatch.config.table;
+    uint32_t low = 0;
+    uint32_t high = s_dispatch.config.table_count;
+    uint32_t mid = 0;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (table[mid].property_id < property_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return (low < s_dispatch.config.table_count && table[low].property_id == property_id) ? &table[low] : NULL;
+}
+
+static void dispatch_ack(const txd_datapoint_t* datapoint, int32_t ret_code, txd_datapoint_t* ack)
+{
+    uint32_t cookie = 0;
+
+    ack->ret_code = ret_code;
+
+    if (s_dispatch.config.ack(ack, s_dispatch.config.ack_cb, &cookie) != err_success) {
+        WELINK_LOGW("ack fail, property_id: %d seq: %d", datapoint->property_id, datapoint->seq);
+        DISPATCH_COUNT(ack_failed);
+    }
+}
+
+static inline void dispatch_ack_init(const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    ack->property_id = datapoint->property_id;
+    ack->property_value = datapoint->property_value;
+    ack->property_value_len = datapoint->property_value_len;
+    ack->seq = datapoint->seq;
+    ack->ret_code = 0;
+}
+
+static void dispatch_worker(void* arg)
+{
+    dispatch_slot_t* slot = NULL;
+    txd_datapoint_t ack;
+    uint32_t index = 0;
+
+    for (;;) {
+        if (xQueueReceive(s_dispatch.work_queue, &index, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        slot = dispatch_slot(index);
+        dispatch_ack_init(&slot->datapoint, &ack);
+        dispatch_ack(&slot->datapoint, slot->handler(slot->sender_id, &slot->datapoint, &ack), &ack);
+        esp_welink_dedup_complete(slot->sender_id, &slot->datapoint, &ack);
+        DISPATCH_COUNT(deferred_runs);
+
+        xQueueSend(s_dispatch.free_queue, &index, 0);
+    }
+}
+
+// 拷贝到空闲槽位交给worker，返回false表示没有空闲槽位或属性值放不下
+static bool dispatch_defer(txd_uint64_t sender_id, const txd_datapoint_t* datapoint,
+                           esp_welink_dispatch_handler_t handler)
+{
+    dispatch_slot_t* slot = NULL;
+    uint32_t index = 0;
+    uint32_t queued = 0;
+
+    if (s_dispatch.work_queue == NULL || datapoint->property_value_len > s_dispatch.config.max_value_len
+            || xQueueReceive(s_dispatch.free_queue, &index, 0) != pdTRUE) {
+        return false;
+    }
+
+    slot = dispatch_slot(index);
+    slot->sender_id = sender_id;
+    slot->datapoint = *datapoint;
+    slot->datapoint.property_value = (uint8_t*)(slot + 1);
+    slot->handler = handler;
+
+    if (datapoint->property_value_len != 0) {
+        memcpy(slot->datapoint.property_value, datapoint->property_value, datapoint->property_value_len);
+    }
+
+    xQueueSend(s_dispatch.work_queue, &index, 0);
+    queued = s_dispatch.config.pool_size - uxQueueMessagesWaiting(s_dispatch.free_queue);
+
+    DISPATCH_LOCK();
+
+    if (queued > s_dispatch.stats.max_queued) {
+        s_dispatch.stats.max_queued = queued;
+    }
+
+    DISPATCH_UNLOCK();
+
+    return true;
+}
+
+void esp_welink_dispatch(txd_uint64_t u64SenderId, txd_datapoint_t* datapoint)
+{
+    const esp_welink_dispatch_entry_t* entry = NULL;
+    esp_welink_dispatch_handler_t handler = NULL;
+    txd_datapoint_t ack;
+    uint8_t ack_value[WELINK_DEDUP_ACK_BYTES];
+
+    TXD_TRACE_SCOPE(esp_welink_dispatch);
+
+    if (s_dispatch.config.ack == NULL || datapoint == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return;
+    }
+
+    DISPATCH_COUNT(received);
+
+    // 服务器重传的数据点不再执行处理函数，直接回复缓存的ACK
+    switch (esp_welink_dedup_check(u64SenderId, datapoint, &ack, ack_value)) {
+        case ESP_WELINK_DEDUP_REPLAY:
+            dispatch_ack(datapoint, ack.ret_code, &ack);
+            return;
+
+        case ESP_WELINK_DEDUP_IN_PROGRESS:
+            return;
+
+        default:
+            break;
+    }
+
+    entry = dispatch_lookup(datapoint->property_id);
+    handler = entry ? entry->handler : __atomic_load_n(&s_dispatch.config.default_handler, __ATOMIC_ACQUIRE);
+    dispatch_ack_init(datapoint, &ack);
+
+    if (handler == NULL) {
+        WELINK_LOGW("no handler, property_id: %d", datapoint->property_id);
+        DISPATCH_COUNT(unknown);
+        dispatch_ack(datapoint, ESP_WELINK_DISPATCH_RET_UNKNOWN, &ack);
+        esp_welink_dedup_complete(u64SenderId, datapoint, &ack);
+        return;
+    }
+
+    if (entry != NULL && entry->mode == ESP_WELINK_DISPATCH_DEFERRED) {
+        if (!dispatch_defer(u64SenderId, datapoint, handler)) {
+            WELINK_LOGW("worker busy, property_id: %d", datapoint->property_id);
+            DISPATCH_COUNT(busy);
+            dispatch_ack(datapoint, ESP_WELINK_DISPATCH_RET_BUSY, &ack);
+            // 不缓存忙的结果，重传时再尝试执行
+            esp_welink_dedup_complete(u64SenderId, datapoint, NULL);
+        }
+
+        return;
+    }
+
+    DISPATCH_COUNT(inline_runs);
+    dispatch_ack(datapoint, handler(u64SenderId, datapoint, &ack), &ack);
+    esp_welink_dedup_complete(u64SenderId, datapoint, &ack);
+}
+
+int32_t esp_welink_dispatch_init(const esp_welink_dispatch_config_t* config)
+{
+    uint32_t i = 0;
+
+    if (s_dispatch.config.ack != NULL) {
+        return 0;
+    }
+
+    WELINK_ERROR_CHECK(config == NULL || (config->table == NULL && config->table_count != 0), -1, "the parameter is incorrect");
+
+    // 表需要在编译时就排好序，这里只做检查，不拷贝也不排序
+    for (i = 0; i < config->table_count; i++) {
+        WELINK_ERROR_CHECK(config->table[i].handler == NULL, -1, "entry %d has no handler", i);
+        WELINK_ERROR_CHECK(i != 0 && config->table[i].property_id <= config->table[i - 1].property_id,
+                           -1, "table not sorted at entry %d, property_id: %d", i, config->table[i].property_id);
+    }
+
+    memset(&s_dispatch, 0, sizeof(s_dispatch));
+    s_dispatch.config = *config;
+
+    if (config->pool_size != 0) {
+        s_dispatch.slot_size = (sizeof(dispatch_slot_t) + config->max_value_len + 3) & ~3;
+        s_dispatch.pool = (uint8_t*)txd_malloc(s_dispatch.slot_size * config->pool_size);
+        WELINK_ERROR_GOTO(s_dispatch.pool == NULL, end, "malloc fail");
+
+        s_dispatch.free_queue = xQueueCreate(config->pool_size, sizeof(uint32_t));
+        s_dispatch.work_queue = xQueueCreate(config->pool_size, sizeof(uint32_t));
+        WELINK_ERROR_GOTO(s_dispatch.free_queue == NULL || s_dispatch.work_queue == NULL, end, "create queue fail");
+
+        for (i = 0; i < config->pool_size; i++) {
+            xQueueSend(s_dispatch.free_queue, &i, 0);
+        }
+
+        WELINK_ERROR_GOTO(xTaskCreate(dispatch_worker, "welink_dispatch", config->worker_stack_size / sizeof(portSTACK_TYPE),
+                                      NULL, config->worker_priority, &s_dispatch.worker) != pdTRUE,
+                          end, "thread create fail");
+    }
+
+    // ack函数最后设置，作为初始化完成的标志
+    s_dispatch.config.ack = config->ack ? config->ack : txd_ack_datapoint;
+
+    return 0;
+
+end:
+
+    if (s_dispatch.free_queue != NULL) {
+        vQueueDelete(s_dispatch.free_queue);
+    }
+
+    if (s_dispatch.work_queue != NULL) {
+        vQueueDelete(s_dispatch.work_queue);
+    }
+
+    txd_free(s_dispatch.pool);
+    memset(&s_dispatch, 0, sizeof(s_dispatch));
+
+    return -1;
+}
+
+int32_t esp_welink_dispatch_set_default_handler(esp_welink_dispatch_handler_t handler)
+{
+    if (s_dispatch.config.ack == NULL) {
+        return -1;
+    }
+
+    // 收包路径不加锁，原子地替换
+    __atomic_store_n(&s_dispatch.config.default_handler, handler, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int32_t esp_welink_dispatch_get_stats(esp_welink_dispatch_stats_t* stats)
+{
+    if (s_dispatch.config.ack == NULL || stats == NULL) {
+        return -1;
+    }
+
+    DISPATCH_LOCK();
+    memcpy(stats, &s_dispatch.stats, sizeof(esp_welink_dispatch_stats_t));
+    DISPATCH_UNLOCK();
+
+    return 0;
+}
@@ -0,0 +1,557 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_gw.h"
+#include "esp_welink_log.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_gw";
+
+#define GW_ADDR_LEN     16      // 地址上报为16位十六进制
+
+// 队列元素，后面紧跟max_value_len字节的值
+typedef struct {
+    uint16_t local_id;
+    uint16_t value_len;
+} gw_item_t;
+
+typedef struct {
+    uint64_t addr;
+    txd_ringbuf_handler_t* tx;
+    txd_ringbuf_handler_t* rx;
+    uint8_t* tx_item;           // 生产者写入队列前的拷贝缓冲
+    uint8_t* rx_item;           // esp_welink_gw_poll读出队列的拷贝缓冲
+    uint8_t* head;              // 已从发送队列取出、等待额度的报告
+    bool used;
+    bool has_head;
+    uint32_t deficit;           // 本轮剩余的额度（字节）
+    esp_welink_gw_notify_t notify;
+    void* arg;
+    uint32_t sent;
+    uint32_t bytes;
+    uint32_t dropped;
+    uint32_t received;
+} gw_device_t;
+
+static struct {
+    esp_welink_gw_config_t config;
+    gw_device_t* devices;
+    uint32_t item_size;
+    uint32_t cursor;            // 轮询到的子设备
+    bool fresh;                 // cursor指向的子设备还没有领取本轮的额度
+    bool armed;                 // 定时器已启动
+    uint32_t queued;            // 各队列中还没有放进消息的报告个数
+    // 当前消息，发送失败时原样重发
+    txd_datapoint_t datapoints[WELINK_GW_MAX_DATAPOINTS];
+    uint16_t staged_slot[WELINK_GW_MAX_DATAPOINTS];
+    uint32_t staged_count;
+    uint32_t staged_bytes;
+    uint8_t staging[WELINK_GW_MAX_BYTES];
+    uint8_t* rx_staging;        // SDK线程写入接收队列前的拷贝缓冲
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_gw_stats_t stats;
+} s_gw;
+
+#define GW_ITEM(buf)        ((gw_item_t*)(buf))
+#define GW_ITEM_VALUE(buf)  ((buf) + sizeof(gw_item_t))
+
+static bool gw_valid_handle(int32_t handle)
+{
+    return s_gw.mutex != NULL && handle >= 0 && (uint32_t)handle < s_gw.config.max_devices
+           && s_gw.devices[handle].used;
+}
+
+static void gw_arm(void)
+{
+    if (!__atomic_exchange_n(&s_gw.armed, true, __ATOMIC_ACQ_REL)) {
+        txd_timer_start(s_gw.timer, s_gw.config.interval_ms, 0, 0);
+    }
+}
+
+// 生产者：拷贝到子设备自己的缓冲后写入队列，不加锁
+static int32_t gw_enqueue(gw_device_t* dev, uint32_t local_id, const uint8_t* value, uint32_t value_len)
+{
+    GW_ITEM(dev->tx_item)->local_id = local_id;
+    GW_ITEM(dev->tx_item)->value_len = value_len;
+    memcpy(GW_ITEM_VALUE(dev->tx_item), value, value_len);
+
+    if (txd_ringbuf_push(dev->tx, dev->tx_item) != 0) {
+        dev->dropped++;
+        __atomic_fetch_add(&s_gw.stats.queue_full, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    __atomic_fetch_add(&s_gw.stats.reports, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_gw.queued, 1, __ATOMIC_RELEASE);
+    gw_arm();
+
+    return 0;
+}
+
+// 调用前需持有mutex：取出子设备的下一个报告，返回false表示没有待发送的报告
+static bool gw_head(gw_device_t* dev)
+{
+    if (!dev->has_head && dev->used) {
+        dev->has_head = (txd_ringbuf_pop(dev->tx, dev->head, 1) == 1);
+    }
+
+    return dev->has_head;
+}
+
+/*
+ * 调用前需持有mutex：按差额轮询（DRR）从各子设备的队列中取报告填满一条消息。
+ * 轮到一个有报告的子设备时它领取quantum字节的额度，报告的值长度不超过剩余额度就放进消息；
+ * 额度不够时轮到下一个子设备，队列空了额度清零。消息满时cursor停在当前子设备，
+ * 下一条消息从它剩余的额度继续，所以各子设备按字节数平分带宽，与报告的频率无关。
+ */
+static void gw_fill(void)
+{
+    gw_device_t* dev = NULL;
+    gw_item_t* item = NULL;
+    uint32_t idle = 0;      // 连续遇到的没有报告的子设备个数，一整圈都没有时结束
+
+    while (idle < s_gw.config.max_devices && s_gw.staged_count < WELINK_GW_MAX_DATAPOINTS) {
+        dev = &s_gw.devices[s_gw.cursor];
+
+        if (!gw_head(dev)) {
+            dev->deficit = 0;
+            s_gw.fresh = true;
+            s_gw.cursor = (s_gw.cursor + 1) % s_gw.config.max_devices;
+            idle++;
+            continue;
+        }
+
+        idle = 0;
+        item = GW_ITEM(dev->head);
+
+        if (s_gw.fresh) {
+            dev->deficit += s_gw.config.quantum;
+            s_gw.fresh = false;
+        }
+
+        if (item->value_len > dev->deficit) {
+            s_gw.fresh = true;
+            s_gw.cursor = (s_gw.cursor + 1) % s_gw.config.max_devices;
+            continue;
+        }
+
+        if (s_gw.staged_bytes + item->value_len > WELINK_GW_MAX_BYTES) {
+            break;
+        }
+
+        memcpy(s_gw.staging + s_gw.staged_bytes, GW_ITEM_VALUE(dev->head), item->value_len);
+        s_gw.datapoints[s_gw.staged_count].property_id = s_gw.config.base_id
+                                                         + (s_gw.cursor << s_gw.config.id_bits) + item->local_id;
+        s_gw.datapoints[s_gw.staged_count].property_value = s_gw.staging + s_gw.staged_bytes;
+        s_gw.datapoints[s_gw.staged_count].property_value_len = item->value_len;
+        s_gw.datapoints[s_gw.staged_count].seq = 0;
+        s_gw.datapoints[s_gw.staged_count].ret_code = 0;
+        s_gw.staged_slot[s_gw.staged_count++] = s_gw.cursor;
+        s_gw.staged_bytes += item->value_len;
+        dev->deficit -= item->value_len;
+        dev->has_head = false;
+        __atomic_fetch_sub(&s_gw.queued, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void gw_pump(void* arg)
+{
+    esp_welink_report_t report = s_gw.config.report ? s_gw.config.report : txd_report_datapoints;
+    gw_device_t* dev = NULL;
+    uint32_t cookie = 0;
+    uint32_t i = 0;
+    int32_t ret = err_success;
+
+    // 只有定时器回调会修改当前消息，发送时不持有mutex
+    txd_mutex_lock(s_gw.mutex);
+
+    if (s_gw.staged_count == 0) {
+        gw_fill();
+    }
+
+    txd_mutex_unlock(s_gw.mutex);
+
+    if (s_gw.staged_count != 0) {
+        ret = report(s_gw.datapoints, s_gw.staged_count, s_gw.config.send_cb, &cookie);
+
+        txd_mutex_lock(s_gw.mutex);
+
+        if (ret == err_success) {
+            for (i = 0; i < s_gw.staged_count; i++) {
+                dev = &s_gw.devices[s_gw.staged_slot[i]];
+                dev->sent++;
+                dev->bytes += s_gw.datapoints[i].property_value_len;
+            }
+
+            s_gw.stats.messages++;
+            s_gw.stats.datapoints += s_gw.staged_count;
+            s_gw.stats.bytes += s_gw.staged_bytes;
+            s_gw.staged_count = 0;
+            s_gw.staged_bytes = 0;
+        } else {
+            s_gw.stats.send_errors++;
+        }
+
+        txd_mutex_unlock(s_gw.mutex);
+
+        if (ret == err_success) {
+            // 让SDK尽快把消息写到socket，不必等到下一次txd_sdk_run超时
+            esp_welink_socket_wakeup();
+        } else {
+            WELINK_LOGW("send %d datapoints fail, ret: 0x%x", s_gw.staged_count, ret);
+        }
+    }
+
+    if (s_gw.staged_count != 0 || __atomic_load_n(&s_gw.queued, __ATOMIC_ACQUIRE) != 0) {
+        txd_timer_start(s_gw.timer, s_gw.config.interval_ms, 0, 0);
+        return;
+    }
+
+    // 先清除标志再检查一次，生产者在两次检查之间写入的报告不会漏掉
+    __atomic_store_n(&s_gw.armed, false, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&s_gw.queued, __ATOMIC_ACQUIRE) != 0) {
+        gw_arm();
+    }
+}
+
+int32_t esp_welink_gw_init(const esp_welink_gw_config_t* config)
+{
+    esp_welink_gw_config_t config_default = ESP_WELINK_GW_CONFIG_DEFAULT();
+
+    if (s_gw.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->id_bits == 0 || config->id_bits > 16 || config->max_devices == 0
+                       || config->max_devices > 0xFFFF || config->base_id + ((uint64_t)config->max_devices << config->id_bits) > 0x100000000ULL
+                       || config->max_value_len < GW_ADDR_LEN || config->max_value_len > WELINK_GW_MAX_BYTES
+                       || config->tx_queue_len == 0 || config->rx_queue_len == 0
+                       || config->quantum < config->max_value_len || config->interval_ms == 0,
+                       -1, "invalid gateway config");
+
+    memset(&s_gw, 0, sizeof(s_gw));
+    s_gw.config = *config;
+    s_gw.item_size = sizeof(gw_item_t) + config->max_value_len;
+    s_gw.fresh = true;
+
+    s_gw.devices = (gw_device_t*)txd_malloc(sizeof(gw_device_t) * config->max_devices);
+    s_gw.rx_staging = (uint8_t*)txd_malloc(s_gw.item_size);
+    WELINK_ERROR_GOTO(s_gw.devices == NULL || s_gw.rx_staging == NULL, end, "malloc fail");
+    memset(s_gw.devices, 0, sizeof(gw_device_t) * config->max_devices);
+
+    s_gw.timer = txd_timer_create(gw_pump, NULL);
+    WELINK_ERROR_GOTO(s_gw.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_gw.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_gw.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_gw.timer != NULL) {
+        txd_timer_destroy(s_gw.timer);
+    }
+
+    txd_free(s_gw.devices);
+    txd_free(s_gw.rx_staging);
+    memset(&s_gw, 0, sizeof(s_gw));
+
+    return -1;
+}
+
+// 调用前需持有mutex
+static void gw_release(gw_device_t* dev)
+{
+    if (dev->tx != NULL) {
+        txd_ringbuf_destroy(dev->tx);
+    }
+
+    if (dev->rx != NULL) {
+        txd_ringbuf_destroy(dev->rx);
+    }
+
+    txd_free(dev->tx_item);
+    memset(dev, 0, sizeof(gw_device_t));
+}
+
+int32_t esp_welink_gw_add(uint64_t addr, int32_t slot, esp_welink_gw_notify_t notify, void* arg)
+{
+    gw_device_t* dev = NULL;
+    uint8_t text[GW_ADDR_LEN];
+    uint32_t i = 0;
+
+    if (s_gw.mutex == NULL || slot < WELINK_GW_SLOT_ANY || slot >= (int32_t)s_gw.config.max_devices) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_gw.mutex);
+
+    for (i = 0; i < s_gw.config.max_devices; i++) {
+        if (s_gw.devices[i].used && s_gw.devices[i].addr == addr) {
+            txd_mutex_unlock(s_gw.mutex);
+            WELINK_LOGE("sub-device already added, slot: %d", i);
+            return -1;
+        }
+
+        if (slot == WELINK_GW_SLOT_ANY && !s_gw.devices[i].used) {
+            slot = i;
+        }
+    }
+
+    if (slot == WELINK_GW_SLOT_ANY || s_gw.devices[slot].used) {
+        txd_mutex_unlock(s_gw.mutex);
+        WELINK_LOGE("no free slot");
+        return -1;
+    }
+
+    dev = &s_gw.devices[slot];
+    dev->tx = txd_ringbuf_create(s_gw.item_size, s_gw.config.tx_queue_len);
+    dev->rx = txd_ringbuf_create(s_gw.item_size, s_gw.config.rx_queue_len);
+    dev->tx_item = (uint8_t*)txd_malloc(s_gw.item_size * 3);
+
+    if (dev->tx == NULL || dev->rx == NULL || dev->tx_item == NULL) {
+        gw_release(dev);
+        txd_mutex_unlock(s_gw.mutex);
+        WELINK_LOGE("malloc fail");
+        return -1;
+    }
+
+    dev->rx_item = dev->tx_item + s_gw.item_size;
+    dev->head = dev->rx_item + s_gw.item_size;
+    dev->addr = addr;
+    dev->notify = notify;
+    dev->arg = arg;
+    dev->used = true;
+    s_gw.stats.devices++;
+
+    txd_mutex_unlock(s_gw.mutex);
+
+    // 地址作为第一个报告，云端据此建立槽位与子设备的映射
+    for (i = 0; i < GW_ADDR_LEN; i++) {
+        text[i] = "0123456789abcdef"[(addr >> (60 - i * 4)) & 0xF];
+    }
+
+    gw_enqueue(dev, WELINK_GW_ADDR_PROPERTY, text, GW_ADDR_LEN);
+    WELINK_LOGI("sub-device %08x%08x added, slot: %d", (uint32_t)(addr >> 32), (uint32_t)addr, slot);
+
+    return slot;
+}
+
+int32_t esp_welink_gw_remove(int32_t handle)
+{
+    gw_device_t* dev = NULL;
+
+    if (!gw_valid_handle(handle)) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_gw.mutex);
+
+    dev = &s_gw.devices[handle];
+    __atomic_fetch_sub(&s_gw.queued, txd_ringbuf_count(dev->tx) + (dev->has_head ? 1 : 0), __ATOMIC_RELAXED);
+    gw_release(dev);
+
+    if (s_gw.cursor == (uint32_t)handle) {
+        s_gw.fresh = true;
+    }
+
+    s_gw.stats.devices--;
+
+    txd_mutex_unlock(s_gw.mutex);
+
+    return 0;
+}
+
+int32_t esp_welink_gw_find(uint64_t addr)
+{
+    int32_t handle = -1;
+    uint32_t i = 0;
+
+    if (s_gw.mutex == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_gw.mutex);
+
+    for (i = 0; i < s_gw.config.max_devices && handle < 0; i++) {
+        if (s_gw.devices[i].used && s_gw.devices[i].addr == addr) {
+            handle = i;
+        }
+    }
+
+    txd_mutex_unlock(s_gw.mutex);
+
+    return handle;
+}
+
+int32_t esp_welink_gw_report(int32_t handle, uint32_t local_id, const uint8_t* value, uint32_t value_len)
+{
+    if (!gw_valid_handle(handle) || local_id == WELINK_GW_ADDR_PROPERTY || local_id >= (1U << s_gw.config.id_bits)
+        || (value == NULL && value_len != 0) || value_len > s_gw.config.max_value_len) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    return gw_enqueue(&s_gw.devices[handle], local_id, value, value_len);
+}
+
+int32_t esp_welink_gw_poll(int32_t handle, uint32_t* local_id, uint8_t* value, uint32_t* value_len)
+{
+    gw_device_t* dev = NULL;
+    gw_item_t* item = NULL;
+
+    if (!gw_valid_handle(handle) || local_id == NULL || value == NULL || value_len == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    dev = &s_gw.devices[handle];
+
+    if (txd_ringbuf_pop(dev->rx, dev->rx_item, 1) == 0) {
+        return 0;
+    }
+
+    item = GW_ITEM(dev->rx_item);
+
+    if (item->value_len > *value_len) {
+        WELINK_LOGW("buffer too small, property %d of slot %d dropped", item->local_id, handle);
+        return -1;
+    }
+
+    *local_id = item->local_id;
+    *value_len = item->value_len;
+    memcpy(value, GW_ITEM_VALUE(dev->rx_item), item->value_len);
+
+    return 1;
+}
+
+int32_t esp_welink_gw_receive(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    esp_welink_gw_notify_t notify = NULL;
+    gw_device_t* dev = NULL;
+    void* arg = NULL;
+    uint32_t offset = 0;
+    uint32_t slot = 0;
+    uint32_t local_id = 0;
+    int32_t ret = ESP_WELINK_GW_RET_UNKNOWN;
+
+    if (s_gw.mutex == NULL || datapoint == NULL) {
+        return ESP_WELINK_GW_RET_UNKNOWN;
+    }
+
+    offset = datapoint->property_id - s_gw.config.base_id;
+    slot = offset >> s_gw.config.id_bits;
+    local_id = offset & ((1U << s_gw.config.id_bits) - 1);
+
+    txd_mutex_lock(s_gw.mutex);
+
+    s_gw.stats.received++;
+
+    if (datapoint->property_id < s_gw.config.base_id || slot >= s_gw.config.max_devices
+        || !s_gw.devices[slot].used || local_id == WELINK_GW_ADDR_PROPERTY) {
+        s_gw.stats.rx_unknown++;
+        goto unlock;
+    }
+
+    dev = &s_gw.devices[slot];
+    ret = ESP_WELINK_GW_RET_BUSY;
+
+    if (datapoint->property_value_len > s_gw.config.max_value_len) {
+        s_gw.stats.rx_busy++;
+        goto unlock;
+    }
+
+    GW_ITEM(s_gw.rx_staging)->local_id = local_id;
+    GW_ITEM(s_gw.rx_staging)->value_len = datapoint->property_value_len;
+    memcpy(GW_ITEM_VALUE(s_gw.rx_staging), datapoint->property_value, datapoint->property_value_len);
+
+    if (txd_ringbuf_push(dev->rx, s_gw.rx_staging) != 0) {
+        s_gw.stats.rx_busy++;
+        goto unlock;
+    }
+
+    dev->received++;
+    notify = dev->notify;
+    arg = dev->arg;
+    ret = 0;
+
+unlock:
+    txd_mutex_unlock(s_gw.mutex);
+
+    if (ret != 0) {
+        WELINK_LOGW("property_id: %d not queued, ret: %d", datapoint->property_id, ret);
+    } else if (notify != NULL) {
+        notify(slot, arg);
+    }
+
+    return ret;
+}
+
+int32_t esp_welink_gw_get_stats(esp_welink_gw_stats_t* stats)
+{
+    if (s_gw.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_gw.mutex);
+    memcpy(stats, &s_gw.stats, sizeof(esp_welink_gw_stats_t));
+    txd_mutex_unlock(s_gw.mutex);
+
+    return 0;
+}
+
+int32_t esp_welink_gw_get_device_stats(int32_t handle, esp_welink_gw_device_stats_t* stats)
+{
+    gw_device_t* dev = NULL;
+
+    if (!gw_valid_handle(handle) || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_gw.mutex);
+
+    dev = &s_gw.devices[handle];
+    stats->addr = dev->addr;
+    stats->queued = txd_ringbuf_count(dev->tx) + (dev->has_head ? 1 : 0);
+    stats->sent = dev->sent;
+    stats->bytes = dev->bytes;
+    stats->dropped = dev->dropped;
+    stats->received = dev->received;
+
+    txd_mutex_unlock(s_gw.mutex);
+
+    return 0;
+}
@@ -0,0 +1,659 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_json.h"
+#include "esp_welink_prop.h"
+
+typedef enum {
+    JSON_VALUE,                         // 需要一个值
+    JSON_VALUE_OR_END,                  // 数组的第一个元素或']'
+    JSON_KEY,                           // ','之后的键
+    JSON_KEY_OR_END,                    // 对象的第一个键或'}'
+    JSON_COLON,
+    JSON_COMMA_OR_END,
+    JSON_DONE,                          // 顶层的值已结束，后面只能是空白
+} json_state_t;
+
+static inline bool json_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool json_is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline int32_t json_hex(char c)
+{
+    if (json_is_digit(c)) {
+        return c - '0';
+    }
+
+    c |= 0x20;
+
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// 从'"'之后开始检查字符串，返回结束引号的位置
+static int32_t json_scan_string(const char* js, uint32_t len, uint32_t pos)
+{
+    uint32_t i = 0;
+
+    for (; pos < len; pos++) {
+        if (js[pos] == '"') {
+            return pos;
+        }
+
+        if ((uint8_t)js[pos] < 0x20) {
+            return ESP_WELINK_JSON_ERR_INVALID;
+        }
+
+        if (js[pos] != '\\') {
+            continue;
+        }
+
+        if (++pos == len) {
+            break;
+        }
+
+        if (js[pos] == 'u') {
+            for (i = 0; i < 4; i++) {
+                if (++pos == len) {
+                    return ESP_WELINK_JSON_ERR_PARTIAL;
+                }
+
+                if (json_hex(js[pos]) < 0) {
+                    return ESP_WELINK_JSON_ERR_INVALID;
+                }
+            }
+        } else if (strchr("\"\\/bfnrt", js[pos]) == NULL || js[pos] == '\0') {
+            return ESP_WELINK_JSON_ERR_INVALID;
+        }
+    }
+
+    return ESP_WELINK_JSON_ERR_PARTIAL;
+}
+
+// 检查数字或true/false/null，返回其后第一个字符的位置
+static int32_t json_scan_primitive(const char* js, uint32_t len, uint32_t pos)
+{
+    static const char* const literals[] = { "true", "false", "null" };
+    uint32_t start = pos;
+    uint32_t i = 0;
+    uint32_t n = 0;
+
+    if (js[pos] == 't' || js[pos] == 'f' || js[pos] == 'n') {
+        for (i = 0; i < 3; i++) {
+            if (literals[i][0] == js[pos]) {
+                n = strlen(literals[i]);
+
+                if (len - pos < n) {
+                    return (memcmp(js + pos, literals[i], len - pos) == 0) ? ESP_WELINK_JSON_ERR_PARTIAL : ESP_WELINK_JSON_ERR_INVALID;
+                }
+
+                pos = (memcmp(js + pos, literals[i], n) == 0) ? pos + n : start;
+                break;
+            }
+        }
+
+        return (pos == start) ? ESP_WELINK_JSON_ERR_INVALID : (int32_t)pos;
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (pos < len && js[pos] == '-') {
+        pos++;
+    }
+
+    if (pos < len && js[pos] == '0') {
+        pos++;
+    } else if (pos < len && json_is_digit(js[pos])) {
+        while (pos < len && json_is_digit(js[pos])) {
+            pos++;
+        }
+    } else {
+        return (pos == len) ? ESP_WELINK_JSON_ERR_PARTIAL : ESP_WELINK_JSON_ERR_INVALID;
+    }
+
+    if (pos < len && js[pos] == '.') {
+        if (++pos == len) {
+            return ESP_WELINK_JSON_ERR_PARTIAL;
+        }
+
+        if (!json_is_digit(js[pos])) {
+            return ESP_WELINK_JSON_ERR_INVALID;
+        }
+
+        while (pos < len && json_is_digit(js[pos])) {
+            pos++;
+        }
+    }
+
+    if (pos < len && (js[pos] == 'e' || js[pos] == 'E')) {
+        if (++pos < len && (js[pos] == '+' || js[pos] == '-')) {
+            pos++;
+        }
+
+        if (pos == len) {
+            return ESP_WELINK_JSON_ERR_PARTIAL;
+        }
+
+        if (!json_is_digit(js[pos])) {
+            return ESP_WELINK_JSON_ERR_INVALID;
+        }
+
+        while (pos < len && json_is_digit(js[pos])) {
+            pos++;
+        }
+    }
+
+    return pos;
+}
+
+int32_t esp_welink_json_parse(const char* js, uint32_t len, esp_welink_json_token_t* tokens, uint32_t max_tokens)
+{
+    esp_welink_json_token_t* token = NULL;
+    json_state_t state = JSON_VALUE;
+    int32_t container = -1;             // 当前所在的对象或数组
+    int32_t count = 0;
+    int32_t end = 0;
+    uint32_t pos = 0;
+    char c = 0;
+
+    if (js == NULL || tokens == NULL || len > ESP_WELINK_JSON_MAX_LEN) {
+        return ESP_WELINK_JSON_ERR_INVALID;
+    }
+
+    // parent是int16_t
+    max_tokens = (max_tokens > INT16_MAX) ? INT16_MAX : max_tokens;
+
+    for (pos = 0; pos < len; pos++) {
+        c = js[pos];
+
+        if (json_is_space(c)) {
+            continue;
+        }
+
+        switch (state) {
+            case JSON_VALUE:
+            case JSON_VALUE_OR_END:
+                if (c == ']' && state == JSON_VALUE_OR_END) {
+                    goto close;
+                }
+
+                if ((uint32_t)count == max_tokens) {
+                    return ESP_WELINK_JSON_ERR_NOMEM;
+                }
+
+                // 对象中的值挂在刚解析的键下面，键总是最后一个token
+                token = &tokens[count];
+                token->parent = (container >= 0 && tokens[container].type == ESP_WELINK_JSON_OBJECT) ? count - 1 : container;
+                token->start = pos;
+                token->size = 0;
+
+                if (container >= 0 && tokens[container].type == ESP_WELINK_JSON_ARRAY) {
+                    tokens[container].size++;
+                }
+
+                if (c == '{' || c == '[') {
+                    token->type = (c == '{') ? ESP_WELINK_JSON_OBJECT : ESP_WELINK_JSON_ARRAY;
+                    container = count++;
+                    state = (c == '{') ? JSON_KEY_OR_END : JSON_VALUE_OR_END;
+                    continue;
+                }
+
+                if (c == '"') {
+                    end = json_scan_string(js, len, pos + 1);
+                    token->type = ESP_WELINK_JSON_STRING;
+                    token->start = pos + 1;
+                    pos = end;
+                } else {
+                    end = json_scan_primitive(js, len, pos);
+                    token->type = ESP_WELINK_JSON_PRIMITIVE;
+                    pos = end - 1;
+                }
+
+                if (end < 0) {
+                    return end;
+                }
+
+                token->end = end;
+                count++;
+                state = (container < 0) ? JSON_DONE : JSON_COMMA_OR_END;
+                continue;
+
+            case JSON_KEY:
+            case JSON_KEY_OR_END:
+                if (c == '}' && state == JSON_KEY_OR_END) {
+                    goto close;
+                }
+
+                if (c != '"') {
+                    return ESP_WELINK_JSON_ERR_INVALID;
+                }
+
+                if ((uint32_t)count == max_tokens) {
+                    return ESP_WELINK_JSON_ERR_NOMEM;
+                }
+
+                end = json_scan_string(js, len, pos + 1);
+
+                if (end < 0) {
+                    return end;
+                }
+
+                token = &tokens[count++];
+                token->type = ESP_WELINK_JSON_STRING;
+                token->start = pos + 1;
+                token->end = end;
+                token->size = 1;
+                token->parent = container;
+                tokens[container].size++;
+                pos = end;
+                state = JSON_COLON;
+                continue;
+
+            case JSON_COLON:
+                if (c != ':') {
+                    return ESP_WELINK_JSON_ERR_INVALID;
+                }
+
+                state = JSON_VALUE;
+                continue;
+
+            case JSON_COMMA_OR_END:
+                if (c == ',') {
+                    state = (tokens[container].type == ESP_WELINK_JSON_OBJECT) ? JSON_KEY : JSON_VALUE;
+                    continue;
+                }
+
+                if (c == '}' || c == ']') {
+                    goto close;
+                }
+
+                return ESP_WELINK_JSON_ERR_INVALID;
+
+            default:
+                return ESP_WELINK_JSON_ERR_INVALID;
+        }
+
+close:
+
+        if ((c == '}') != (tokens[container].type == ESP_WELINK_JSON_OBJECT)) {
+            return ESP_WELINK_JSON_ERR_INVALID;
+        }
+
+        tokens[container].end = pos + 1;
+        container = tokens[container].parent;
+
+        // 值的parent是键，回到键所在的对象
+        if (container >= 0 && tokens[container].type == ESP_WELINK_JSON_STRING) {
+            container = tokens[container].parent;
+        }
+
+        state = (container < 0) ? JSON_DONE : JSON_COMMA_OR_END;
+    }
+
+    return (state == JSON_DONE) ? count : ESP_WELINK_JSON_ERR_PARTIAL;
+}
+
+int32_t esp_welink_json_next(const esp_welink_json_token_t* tokens, int32_t count, int32_t index)
+{
+    int32_t next = index + 1;
+
+    // 子token都在父token的范围之内
+    while (next < count && tokens[next].start < tokens[index].end) {
+        next++;
+    }
+
+    return next;
+}
+
+int32_t esp_welink_json_find(const char* js, const esp_welink_json_token_t* tokens, int32_t count,
+                             int32_t object, const char* key)
+{
+    int32_t i = 0;
+    uint32_t n = 0;
+
+    if (js == NULL || tokens == NULL || key == NULL || object < 0 || object >= count
+            || tokens[object].type != ESP_WELINK_JSON_OBJECT) {
+        return -1;
+    }
+
+    for (i = object + 1, n = 0; n < tokens[object].size && i + 1 < count; n++) {
+        if (esp_welink_json_eq(js, &tokens[i], key)) {
+            return i + 1;
+        }
+
+        i = esp_welink_json_next(tokens, count, i + 1);
+    }
+
+    return -1;
+}
+
+int32_t esp_welink_json_array_get(const esp_welink_json_token_t* tokens, int32_t count, int32_t array, uint32_t index)
+{
+    int32_t i = 0;
+    uint32_t n = 0;
+
+    if (tokens == NULL || array < 0 || array >= count || tokens[array].type != ESP_WELINK_JSON_ARRAY
+            || index >= tokens[array].size) {
+        return -1;
+    }
+
+    for (i = array + 1, n = 0; n < index; n++) {
+        i = esp_welink_json_next(tokens, count, i);
+    }
+
+    return (i < count) ? i : -1;
+}
+
+bool esp_welink_json_eq(const char* js, const esp_welink_json_token_t* token, const char* str)
+{
+    uint32_t len = strlen(str);
+
+    return token->type == ESP_WELINK_JSON_STRING && (uint32_t)(token->end - token->start) == len
+           && memcmp(js + token->start, str, len) == 0;
+}
+
+int32_t esp_welink_json_get_int(const char* js, const esp_welink_json_token_t* token, int32_t* value)
+{
+    esp_welink_prop_schema_t schema = { .type = ESP_WELINK_PROP_INT, .min = INT32_MIN, .max = INT32_MAX };
+
+    if (token->type != ESP_WELINK_JSON_PRIMITIVE) {
+        return -1;
+    }
+
+    return esp_welink_prop_decode(&schema, (const uint8_t*)js + token->start, token->end - token->start, value);
+}
+
+int32_t esp_welink_json_get_bool(const char* js, const esp_welink_json_token_t* token, bool* value)
+{
+    if (token->type != ESP_WELINK_JSON_PRIMITIVE || (js[token->start] != 't' && js[token->start] != 'f')) {
+        return -1;
+    }
+
+    *value = (js[token->start] == 't');
+
+    return 0;
+}
+
+// 把码点按UTF-8写入out，返回字节数
+static uint32_t json_utf8(uint32_t cp, char* out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+
+    if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+
+    if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+static uint32_t json_u4(const char* p)
+{
+    return (json_hex(p[0]) << 12) | (json_hex(p[1]) << 8) | (json_hex(p[2]) << 4) | json_hex(p[3]);
+}
+
+int32_t esp_welink_json_get_string(const char* js, const esp_welink_json_token_t* token, char* out, uint32_t size)
+{
+    const char* p = NULL;
+    const char* end = NULL;
+    char utf8[4];
+    uint32_t len = 0;
+    uint32_t n = 0;
+    uint32_t cp = 0;
+
+    if (token->type != ESP_WELINK_JSON_STRING || out == NULL || size == 0) {
+        return -1;
+    }
+
+    // 解析时已检查过转义的格式，这里不再检查
+    for (p = js + token->start, end = js + token->end; p < end; len += n) {
+        if (*p != '\\') {
+            utf8[0] = *p++;
+            n = 1;
+        } else if (p[1] != 'u') {
+            // 表中两两一组：转义字符，解码结果
+            utf8[0] = strchr("\"\"\\\\//b\bf\fn\nr\rt\t", p[1])[1];
+            p += 2;
+            n = 1;
+        } else {
+            cp = json_u4(p + 2);
+            p += 6;
+
+            // 代理对合成一个码点，落单的代理按原值写出
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                uint32_t low = json_u4(p + 2);
+
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+
+            n = json_utf8(cp, utf8);
+        }
+
+        if (len + n >= size) {
+            return -1;
+        }
+
+        memcpy(out + len, utf8, n);
+    }
+
+    out[len] = '\0';
+
+    return len;
+}
+
+static void json_put(esp_welink_json_writer_t* writer, const char* data, uint32_t len)
+{
+    if (writer->error || writer->size - writer->len < len) {
+        writer->error = true;
+        return;
+    }
+
+    memcpy(writer->buf + writer->len, data, len);
+    writer->len += len;
+}
+
+static void json_put_string(esp_welink_json_writer_t* writer, const char* str, uint32_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char* run = str;
+    const char* end = str + len;
+    char esc[6] = { '\\', 'u', '0', '0' };
+    uint8_t c = 0;
+
+    json_put(writer, "\"", 1);
+
+    // 不需要转义的连续字符一次拷贝
+    for (; str < end; str++) {
+        c = (uint8_t)*str;
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        json_put(writer, run, str - run);
+        run = str + 1;
+
+        if (c == '"' || c == '\\') {
+            esc[1] = c;
+            json_put(writer, esc, 2);
+        } else if (c == '\n' || c == '\r' || c == '\t') {
+            esc[1] = (c == '\n') ? 'n' : (c == '\r') ? 'r' : 't';
+            json_put(writer, esc, 2);
+        } else {
+            esc[1] = 'u';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xF];
+            json_put(writer, esc, 6);
+        }
+    }
+
+    json_put(writer, run, end - run);
+    json_put(writer, "\"", 1);
+}
+
+// 写值之前的逗号和键
+static void json_put_key(esp_welink_json_writer_t* writer, const char* key)
+{
+    uint32_t bit = 0;
+
+    if (writer->depth >= ESP_WELINK_JSON_WRITER_DEPTH) {
+        writer->error = true;
+        return;
+    }
+
+    bit = 1u << writer->depth;
+
+    if (writer->has_items & bit) {
+        json_put(writer, ",", 1);
+    }
+
+    writer->has_items |= bit;
+
+    if (key != NULL) {
+        json_put_string(writer, key, strlen(key));
+        json_put(writer, ":", 1);
+    }
+}
+
+void esp_welink_json_writer_init(esp_welink_json_writer_t* writer, char* buf, uint32_t size)
+{
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+    writer->depth = 0;
+    writer->has_items = 0;
+    writer->error = (buf == NULL);
+}
+
+static void json_begin(esp_welink_json_writer_t* writer, const char* key, char c)
+{
+    json_put_key(writer, key);
+    json_put(writer, &c, 1);
+
+    if (++writer->depth < ESP_WELINK_JSON_WRITER_DEPTH) {
+        writer->has_items &= ~(1u << writer->depth);
+    }
+}
+
+static void json_end(esp_welink_json_writer_t* writer, char c)
+{
+    if (writer->depth == 0) {
+        writer->error = true;
+        return;
+    }
+
+    writer->depth--;
+    json_put(writer, &c, 1);
+}
+
+void esp_welink_json_write_object_begin(esp_welink_json_writer_t* writer, const char* key)
+{
+    json_begin(writer, key, '{');
+}
+
+void esp_welink_json_write_object_end(esp_welink_json_writer_t* writer)
+{
+    json_end(writer, '}');
+}
+
+void esp_welink_json_write_array_begin(esp_welink_json_writer_t* writer, const char* key)
+{
+    json_begin(writer, key, '[');
+}
+
+void esp_welink_json_write_array_end(esp_welink_json_writer_t* writer)
+{
+    json_end(writer, ']');
+}
+
+void esp_welink_json_write_string(esp_welink_json_writer_t* writer, const char* key, const char* value, uint32_t len)
+{
+    json_put_key(writer, key);
+    json_put_string(writer, value, len);
+}
+
+void esp_welink_json_write_int(esp_welink_json_writer_t* writer, const char* key, int32_t value)
+{
+    uint8_t text[ESP_WELINK_PROP_MAX_CHARS];
+
+    json_put_key(writer, key);
+    json_put(writer, (const char*)text, esp_welink_prop_encode_int(text, value));
+}
+
+void esp_welink_json_write_fixed(esp_welink_json_writer_t* writer, const char* key, int32_t value, uint8_t decimals)
+{
+    uint8_t text[ESP_WELINK_PROP_MAX_CHARS];
+
+    json_put_key(writer, key);
+    json_put(writer, (const char*)text, esp_welink_prop_encode_fixed(text, value, decimals));
+}
+
+void esp_welink_json_write_bool(esp_welink_json_writer_t* writer, const char* key, bool value)
+{
+    json_put_key(writer, key);
+    json_put(writer, value ? "true" : "false", value ? 4 : 5);
+}
+
+void esp_welink_json_write_null(esp_welink_json_writer_t* writer, const char* key)
+{
+    json_put_key(writer, key);
+    json_put(writer, "null", 4);
+}
+
+int32_t esp_welink_json_writer_finish(esp_welink_json_writer_t* writer)
+{
+    if (writer->error || writer->depth != 0) {
+        return -1;
+    }
+
+    if (writer->len < writer->size) {
+        writer->buf[writer->len] = '\0';
+    }
+
+    return writer->len;
+}
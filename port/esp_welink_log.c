@@ -0,0 +1,524 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "esp_system.h"
+#include "esp_welink_log.h"
+#include "txd_stdtypes.h"
+#include "txd_baseapi.h"
+
+static const char* TAG = "esp_welink_log";
+
+uint8_t g_welink_log_level[WELINK_LOG_MODULE_MAX] = {
+    [0 ... WELINK_LOG_MODULE_MAX - 1] = WELINK_LOG_DEFAULT_LEVEL,
+};
+
+// 与WELINK_log_module_t顺序一致
+static const char* const s_log_module_name[WELINK_LOG_MODULE_MAX] = {
+    "baseapi", "thread", "wifi", "ota", "datapoint",
+};
+
+static const char s_log_level_char[] = "nfewidv";
+
+/*
+ * 异步日志：有界多生产者环形队列（Vyukov），每个槽带一个序号，
+ * 生产者通过CAS抢占enqueue_pos后在槽内格式化，写完后发布序号；
+ * 同一时刻只有一个消费者（排空任务或esp_welink_log_flush）按序号顺序输出。
+ */
+#define LOG_SINK_MASK     (WELINK_LOG_SINK_LINES - 1)
+#define LOG_SINK_POLL_MS  20
+#define LOG_SLOT_BINARY   0x80000000    // 槽中保存的是二进制日志记录，输出时再转成十六进制
+#define LOG_RECORD_MAX    ((2 + WELINK_LOG_RECORD_MAX_ARGS) * 4)
+
+#if (WELINK_LOG_SINK_LINES & LOG_SINK_MASK) != 0
+#error "WELINK_LOG_SINK_LINES must be a power of two"
+#endif
+
+#if WELINK_LOG_SINK_LINE_SIZE < LOG_RECORD_MAX
+#error "WELINK_LOG_SINK_LINE_SIZE is too small for a binary log record"
+#endif
+
+typedef struct {
+    uint32_t seq;
+    uint32_t len;
+    char data[WELINK_LOG_SINK_LINE_SIZE];
+} log_slot_t;
+
+static struct {
+    log_slot_t* slots;
+    uint32_t enqueue_pos;
+    uint32_t dequeue_pos;
+    uint32_t dropped;
+    uint32_t reported_dropped;
+    uint32_t consumer;
+    bool direct;                // 关机后不再经过队列，直接输出
+    vprintf_like_t output;
+    TaskHandle_t task;
+} s_log_sink = {
+    .output = vprintf,
+};
+
+// ESP8266没有原子比较交换指令，用关中断实现；ESP32和主机编译使用GCC原子操作
+static bool log_sink_cas(uint32_t* ptr, uint32_t* expected, uint32_t desired)
+{
+#if CONFIG_TARGET_PLATFORM_ESP8266
+    bool ret = false;
+
+    portENTER_CRITICAL();
+
+    if (*ptr == *expected) {
+        *ptr = desired;
+        ret = true;
+    } else {
+        *expected = *ptr;
+    }
+
+    portEXIT_CRITICAL();
+
+    return ret;
+#else
+    return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#endif
+}
+
+static void log_sink_increase(uint32_t* ptr)
+{
+    uint32_t value = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+    while (!log_sink_cas(ptr, &value, value + 1));
+}
+
+static int log_sink_output(const char* format, ...)
+{
+    int ret = 0;
+    va_list args;
+
+    va_start(args, format);
+    ret = s_log_sink.output(format, args);
+    va_end(args);
+
+    return ret;
+}
+
+// 二进制记录以"#WL:"加十六进制输出，由tools/welink_log_decode.py解码
+static void log_record_print(const uint8_t* record, uint32_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[4 + 2 * LOG_RECORD_MAX + 2];
+    uint32_t i = 0;
+
+    memcpy(line, "#WL:", 4);
+
+    for (i = 0; i < len; i++) {
+        line[4 + 2 * i] = hex[record[i] >> 4];
+        line[5 + 2 * i] = hex[record[i] & 0x0F];
+    }
+
+    line[4 + 2 * len] = '\n';
+    line[5 + 2 * len] = '\0';
+    log_sink_output("%s", line);
+}
+
+static bool log_sink_acquire()
+{
+    uint32_t expected = 0;
+
+    return log_sink_cas(&s_log_sink.consumer, &expected, 1);
+}
+
+static void log_sink_release()
+{
+    __atomic_store_n(&s_log_sink.consumer, 0, __ATOMIC_RELEASE);
+}
+
+// 调用者必须持有消费者标志
+static uint32_t log_sink_drain()
+{
+    uint32_t count = 0;
+    uint32_t pos = 0;
+    uint32_t dropped = 0;
+    log_slot_t* slot = NULL;
+
+    for (;;) {
+        pos = s_log_sink.dequeue_pos;
+        slot = &s_log_sink.slots[pos & LOG_SINK_MASK];
+
+        // 序号不等于pos + 1说明队列为空，或者生产者还在格式化这一行
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+
+        if (slot->len & LOG_SLOT_BINARY) {
+            log_record_print((const uint8_t*)slot->data, slot->len & ~LOG_SLOT_BINARY);
+        } else {
+            log_sink_output("%.*s", slot->len, slot->data);
+        }
+
+        __atomic_store_n(&slot->seq, pos + LOG_SINK_MASK + 1, __ATOMIC_RELEASE);
+        s_log_sink.dequeue_pos = pos + 1;
+        count++;
+    }
+
+    dropped = __atomic_load_n(&s_log_sink.dropped, __ATOMIC_RELAXED);
+
+    if (dropped != s_log_sink.reported_dropped) {
+        log_sink_output("W %s: %u log lines dropped\n", TAG, dropped - s_log_sink.reported_dropped);
+        s_log_sink.reported_dropped = dropped;
+    }
+
+    return count;
+}
+
+static void log_sink_task(void* arg)
+{
+    uint32_t count = 0;
+
+    for (;;) {
+        count = 0;
+
+        if (log_sink_acquire()) {
+            count = log_sink_drain();
+            log_sink_release();
+        }
+
+        if (count == 0) {
+            vTaskDelay(LOG_SINK_POLL_MS / portTICK_RATE_MS);
+        }
+    }
+}
+
+// 关机时排空队列，之后的日志不再入队，直接同步输出
+static void log_sink_shutdown(void)
+{
+    esp_welink_log_flush();
+    s_log_sink.direct = true;
+}
+
+// 抢占一个空槽，队列已满时返回NULL并计入丢弃数
+static log_slot_t* log_sink_reserve(uint32_t* pos)
+{
+    int32_t diff = 0;
+    log_slot_t* slot = NULL;
+
+    *pos = __atomic_load_n(&s_log_sink.enqueue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &s_log_sink.slots[*pos & LOG_SINK_MASK];
+        diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - *pos);
+
+        if (diff == 0) {
+            if (log_sink_cas(&s_log_sink.enqueue_pos, pos, *pos + 1)) {
+                return slot;
+            }
+        } else if (diff < 0) {
+            log_sink_increase(&s_log_sink.dropped);
+            return NULL;
+        } else {
+            *pos = __atomic_load_n(&s_log_sink.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void log_sink_commit(log_slot_t* slot, uint32_t pos)
+{
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+int esp_welink_log_vprintf(const char* format, va_list ap)
+{
+    int len = 0;
+    uint32_t pos = 0;
+    log_slot_t* slot = NULL;
+
+    if ((s_log_sink.task == NULL) || s_log_sink.direct) {
+        return s_log_sink.output(format, ap);
+    }
+
+    slot = log_sink_reserve(&pos);
+
+    if (slot == NULL) {
+        return 0;
+    }
+
+    len = vsnprintf(slot->data, sizeof(slot->data), format, ap);
+
+    if (len < 0) {
+        len = 0;
+    } else if ((uint32_t)len >= sizeof(slot->data)) {
+        len = sizeof(slot->data) - 1;
+        slot->data[len - 1] = '\n';
+    }
+
+    slot->len = len;
+    log_sink_commit(slot, pos);
+
+    return len;
+}
+
+void esp_welink_log_record(uint32_t id, uint32_t nargs, ...)
+{
+    uint32_t i = 0;
+    uint32_t pos = 0;
+    uint32_t record[2 + WELINK_LOG_RECORD_MAX_ARGS];
+    log_slot_t* slot = NULL;
+    va_list args;
+
+    if (nargs > WELINK_LOG_RECORD_MAX_ARGS) {
+        nargs = WELINK_LOG_RECORD_MAX_ARGS;
+    }
+
+    record[0] = id;
+    record[1] = esp_log_timestamp();
+
+    va_start(args, nargs);
+
+    for (i = 0; i < nargs; i++) {
+        record[2 + i] = va_arg(args, uint32_t);
+    }
+
+    va_end(args);
+
+    if ((s_log_sink.task == NULL) || s_log_sink.direct) {
+        log_record_print((const uint8_t*)record, (2 + nargs) * sizeof(uint32_t));
+        return;
+    }
+
+    slot = log_sink_reserve(&pos);
+
+    if (slot == NULL) {
+        return;
+    }
+
+    memcpy(slot->data, record, (2 + nargs) * sizeof(uint32_t));
+    slot->len = ((2 + nargs) * sizeof(uint32_t)) | LOG_SLOT_BINARY;
+    log_sink_commit(slot, pos);
+}
+
+int32_t esp_welink_log_sink_start(uint8_t priority, uint32_t stack_size)
+{
+    uint32_t i = 0;
+
+    if (s_log_sink.task != NULL) {
+        return 0;
+    }
+
+    s_log_sink.slots = (log_slot_t*)txd_malloc(sizeof(log_slot_t) * WELINK_LOG_SINK_LINES);
+    WELINK_ERROR_CHECK(s_log_sink.slots == NULL, -1, "malloc fail");
+
+    for (i = 0; i < WELINK_LOG_SINK_LINES; i++) {
+        s_log_sink.slots[i].seq = i;
+    }
+
+    if (xTaskCreate(log_sink_task, "welink_log_task", stack_size / sizeof(portSTACK_TYPE), NULL, priority, &s_log_sink.task) != pdTRUE) {
+        WELINK_LOGE("thread create fail");
+        txd_free(s_log_sink.slots);
+        s_log_sink.slots = NULL;
+        s_log_sink.task = NULL;
+        return -1;
+    }
+
+    s_log_sink.output = esp_log_set_vprintf(esp_welink_log_vprintf);
+
+    // esp_restart()之前输出队列中剩余的日志
+    if (esp_register_shutdown_handler(log_sink_shutdown) != ESP_OK) {
+        WELINK_LOGW("register shutdown handler fail");
+    }
+
+    return 0;
+}
+
+void esp_welink_log_flush(void)
+{
+    if (s_log_sink.task == NULL) {
+        return;
+    }
+
+    // 不等待，可以在中断、挂起调度器或panic时调用；排空任务正在输出时由它继续输出，只释放自己拿到的标志
+    if (log_sink_acquire()) {
+        log_sink_drain();
+        log_sink_release();
+    }
+}
+
+#ifdef CONFIG_WELINK_LOG_FLUSH_ON_ABORT
+void __real_abort(void) __attribute__((noreturn));
+
+/*
+ * 链接时加上-Wl,--wrap=abort（见component.mk），assert失败和abort()先输出队列中的日志再进入panic；
+ * CPU异常和看门狗直接进入panic处理，没有可以挂接的地方，队列中的日志会丢失
+ */
+void __attribute__((noreturn)) __wrap_abort(void)
+{
+    log_sink_shutdown();
+    __real_abort();
+}
+#endif
+
+uint32_t esp_welink_log_get_dropped(void)
+{
+    return __atomic_load_n(&s_log_sink.dropped, __ATOMIC_RELAXED);
+}
+
+int32_t esp_welink_log_set_level(WELINK_log_module_t module, WELINK_log_level_t level)
+{
+    uint32_t i = 0;
+
+    if (module > WELINK_LOG_MODULE_MAX || level > WELINK_LOG_VERBOSE) {
+        return -1;
+    }
+
+    // 单字节写入，日志宏读取时不需要加锁
+    for (i = 0; i < WELINK_LOG_MODULE_MAX; i++) {
+        if (module == WELINK_LOG_MODULE_MAX || module == i) {
+            __atomic_store_n(&g_welink_log_level[i], (uint8_t)level, __ATOMIC_RELAXED);
+        }
+    }
+
+    return 0;
+}
+
+WELINK_log_level_t esp_welink_log_get_level(WELINK_log_module_t module)
+{
+    if (module >= WELINK_LOG_MODULE_MAX) {
+        return WELINK_LOG_NONE;
+    }
+
+    return (WELINK_log_level_t)__atomic_load_n(&g_welink_log_level[module], __ATOMIC_RELAXED);
+}
+
+static int32_t log_module_parse(const char* name, uint32_t len)
+{
+    uint32_t i = 0;
+
+    if (len == 1 && name[0] == '*') {
+        return WELINK_LOG_MODULE_MAX;
+    }
+
+    for (i = 0; i < WELINK_LOG_MODULE_MAX; i++) {
+        if (strlen(s_log_module_name[i]) == len && strncmp(s_log_module_name[i], name, len) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int32_t log_level_parse(const char* value, uint32_t len)
+{
+    const char* level = NULL;
+
+    if (len != 1) {
+        return -1;
+    }
+
+    if (value[0] >= '0' && value[0] <= '0' + WELINK_LOG_VERBOSE) {
+        return value[0] - '0';
+    }
+
+    level = strchr(s_log_level_char, value[0] | 0x20);
+
+    return (level != NULL && *level != '\0') ? level - s_log_level_char : -1;
+}
+
+int32_t esp_welink_log_set_level_str(const char* config, uint32_t len)
+{
+    uint8_t level[WELINK_LOG_MODULE_MAX] = {0};
+    uint32_t pos = 0;
+    uint32_t end = 0;
+    uint32_t eq = 0;
+    int32_t module = 0;
+    int32_t value = 0;
+    uint32_t i = 0;
+
+    if (config == NULL) {
+        return -1;
+    }
+
+    // 先解析到临时数组，全部合法后再生效，避免只改了一半
+    memcpy(level, g_welink_log_level, sizeof(level));
+
+    for (pos = 0; pos < len; pos = end + 1) {
+        for (end = pos; end < len && config[end] != ',' && config[end] != '\0'; end++);
+
+        for (eq = pos; eq < end && config[eq] != '='; eq++);
+
+        if (end == pos) {
+            continue;
+        }
+
+        module = (eq < end) ? log_module_parse(config + pos, eq - pos) : -1;
+        value = (eq < end) ? log_level_parse(config + eq + 1, end - eq - 1) : -1;
+
+        if (module < 0 || value < 0) {
+            WELINK_LOGW("invalid log level item at %d", pos);
+            return -1;
+        }
+
+        for (i = 0; i < WELINK_LOG_MODULE_MAX; i++) {
+            if (module == WELINK_LOG_MODULE_MAX || (uint32_t)module == i) {
+                level[i] = value;
+            }
+        }
+
+        if (end < len && config[end] == '\0') {
+            break;
+        }
+    }
+
+    for (i = 0; i < WELINK_LOG_MODULE_MAX; i++) {
+        esp_welink_log_set_level(i, level[i]);
+    }
+
+    return 0;
+}
+
+int32_t esp_welink_log_get_level_str(char* buf, uint32_t size)
+{
+    int32_t len = 0;
+    int32_t ret = 0;
+    uint32_t i = 0;
+
+    if (buf == NULL || size == 0) {
+        return 0;
+    }
+
+    buf[0] = '\0';
+
+    for (i = 0; i < WELINK_LOG_MODULE_MAX; i++) {
+        ret = snprintf(buf + len, size - len, "%s%s=%d", i ? "," : "", s_log_module_name[i], esp_welink_log_get_level(i));
+
+        if (ret < 0 || ret >= (int32_t)(size - len)) {
+            break;
+        }
+
+        len += ret;
+    }
+
+    return len;
+}
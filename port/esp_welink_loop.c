@@ -0,0 +1,217 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/errno.h>
+
+#include "esp_timer.h"
+#include "esp_welink_log.h"
+#include "esp_welink_loop.h"
+#include "esp_welink_socket.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+#include "txd_sdk.h"
+
+static const char* TAG = "esp_welink_loop";
+
+typedef struct {
+    int fd;
+    esp_welink_loop_fd_cb_t cb;
+    void* arg;
+} loop_fd_t;
+
+static struct {
+    loop_fd_t fds[WELINK_LOOP_MAX_FDS];
+    uint32_t fd_count;
+    uint32_t sdk_deadline_ms;
+    bool sdk_started;
+    esp_welink_loop_stats_t stats;
+} s_loop;
+
+// 其他任务启动的定时器早于select的超时，唤醒select重新计算超时
+static void loop_timer_wakeup(void)
+{
+    esp_welink_socket_wakeup();
+}
+
+int32_t esp_welink_loop_add_fd(int fd, esp_welink_loop_fd_cb_t cb, void* arg)
+{
+    WELINK_ERROR_CHECK((fd < 0) || (cb == NULL), -1, "the parameter is incorrect");
+    WELINK_ERROR_CHECK(s_loop.fd_count >= WELINK_LOOP_MAX_FDS, -1, "too many fds, max %d", WELINK_LOOP_MAX_FDS);
+
+    s_loop.fds[s_loop.fd_count].fd = fd;
+    s_loop.fds[s_loop.fd_count].cb = cb;
+    s_loop.fds[s_loop.fd_count].arg = arg;
+    s_loop.fd_count++;
+
+    return 0;
+}
+
+int32_t esp_welink_loop_remove_fd(int fd)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < s_loop.fd_count; i++) {
+        if (s_loop.fds[i].fd == fd) {
+            s_loop.fds[i] = s_loop.fds[--s_loop.fd_count];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int32_t esp_welink_loop_run_once(uint32_t max_wait_ms)
+{
+    int32_t ret = err_success;
+    int32_t remain = 0;
+    int32_t count = 0;
+    int maxfd = -1;
+    int conn_fd = -1;
+    int wakeup_fd = -1;
+    int nfds = 0;
+    uint32_t i = 0;
+    uint32_t wait_ms = max_wait_ms;
+    uint32_t timer_ms = 0;
+    uint32_t expect_sleep_ms = 0;
+    uint32_t busy_us = 0;
+    int64_t start_us = 0;
+    bool run_sdk = false;
+    fd_set readfds;
+    struct timeval timeout = {0, 0};
+
+    if (!s_loop.sdk_started) {
+        // SDK在循环中运行时，txd_tcp_recv不能再阻塞，等待统一放在这里的select中
+        esp_welink_socket_set_recv_poll(true);
+        txd_timer_set_wakeup_hook(loop_timer_wakeup);
+        s_loop.sdk_deadline_ms = txd_time_get_sysclock();
+        s_loop.sdk_started = true;
+    }
+
+    remain = (int32_t)(s_loop.sdk_deadline_ms - txd_time_get_sysclock());
+    wait_ms = (remain <= 0) ? 0 : (((uint32_t)remain < wait_ms) ? (uint32_t)remain : wait_ms);
+    timer_ms = txd_timer_next_deadline();
+    wait_ms = (timer_ms < wait_ms) ? timer_ms : wait_ms;
+
+    FD_ZERO(&readfds);
+    esp_welink_socket_get_fds(&conn_fd, &wakeup_fd);
+
+    if (conn_fd >= 0) {
+        FD_SET(conn_fd, &readfds);
+        maxfd = conn_fd;
+    }
+
+    if (wakeup_fd >= 0) {
+        FD_SET(wakeup_fd, &readfds);
+        maxfd = (wakeup_fd > maxfd) ? wakeup_fd : maxfd;
+    }
+
+    for (i = 0; i < s_loop.fd_count; i++) {
+        FD_SET(s_loop.fds[i].fd, &readfds);
+        maxfd = (s_loop.fds[i].fd > maxfd) ? s_loop.fds[i].fd : maxfd;
+    }
+
+    if (maxfd >= 0) {
+        timeout.tv_sec = (wait_ms / 1000);
+        timeout.tv_usec = ((wait_ms % 1000) * 1000);
+        nfds = select(maxfd + 1, &readfds, NULL, NULL, &timeout);
+
+        if (nfds < 0) {
+            if (errno != EINTR) {
+                WELINK_LOGE("select fail, errno %d", errno);
+            }
+
+            FD_ZERO(&readfds);
+        }
+    } else if (wait_ms > 0) {
+        txd_sleep(wait_ms);
+    }
+
+    start_us = esp_timer_get_time();
+
+    if ((wakeup_fd >= 0) && FD_ISSET(wakeup_fd, &readfds)) {
+        esp_welink_socket_wakeup_clear();
+        run_sdk = true;
+    }
+
+    if ((conn_fd >= 0) && FD_ISSET(conn_fd, &readfds)) {
+        run_sdk = true;
+    }
+
+    if ((int32_t)(s_loop.sdk_deadline_ms - txd_time_get_sysclock()) <= 0) {
+        run_sdk = true;
+    }
+
+    if (run_sdk) {
+        ret = txd_sdk_run(&expect_sleep_ms);
+        s_loop.sdk_deadline_ms = txd_time_get_sysclock() + expect_sleep_ms;
+        s_loop.stats.sdk_runs++;
+
+        if (ret != err_success) {
+            WELINK_LOGE("sdk run err, errcode[%d]", ret);
+        }
+    }
+
+    if (txd_timer_next_deadline() == 0) {
+        count = txd_timer_process(NULL);
+        s_loop.stats.timer_events += (count > 0) ? count : 0;
+    }
+
+    // 从后往前遍历：回调中删除fd时，补到空位上的是已经遍历过的最后一项，不会被跳过
+    for (i = s_loop.fd_count; i-- > 0;) {
+        if ((i < s_loop.fd_count) && FD_ISSET(s_loop.fds[i].fd, &readfds)) {
+            FD_CLR(s_loop.fds[i].fd, &readfds);
+            s_loop.fds[i].cb(s_loop.fds[i].fd, s_loop.fds[i].arg);
+            s_loop.stats.fd_events++;
+        }
+    }
+
+    busy_us = (uint32_t)(esp_timer_get_time() - start_us);
+    s_loop.stats.iterations++;
+    s_loop.stats.last_busy_us = busy_us;
+    s_loop.stats.total_busy_us += busy_us;
+
+    if (busy_us > s_loop.stats.max_busy_us) {
+        s_loop.stats.max_busy_us = busy_us;
+    }
+
+    return ret;
+}
+
+void esp_welink_loop_run(void)
+{
+    for (;;) {
+        esp_welink_loop_run_once(TXD_TIMER_WAIT_FOREVER);
+    }
+}
+
+int32_t esp_welink_loop_get_stats(esp_welink_loop_stats_t* stats)
+{
+    WELINK_ERROR_CHECK(stats == NULL, -1, "the parameter is incorrect");
+
+    *stats = s_loop.stats;
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_prop.h"
+
+// 两位一组的数字表，每次除以100输出两位，除法次数减半
+static const char s_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint32_t s_pow10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// 从buf末尾向前写，返回写入的位数，至少写min_digits位（不足补0）
+static uint32_t prop_utoa_reverse(uint8_t* end, uint32_t value, uint32_t min_digits)
+{
+    uint8_t* p = end;
+
+    while (value >= 100) {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--p = s_digit_pairs[pair + 1];
+        *--p = s_digit_pairs[pair];
+    }
+
+    if (value >= 10) {
+        *--p = s_digit_pairs[value * 2 + 1];
+        *--p = s_digit_pairs[value * 2];
+    } else {
+        *--p = '0' + value;
+    }
+
+    while ((uint32_t)(end - p) < min_digits) {
+        *--p = '0';
+    }
+
+    return end - p;
+}
+
+// 先写到临时缓冲区末尾再整体拷贝，避免先数位数
+static uint32_t prop_encode(uint8_t* buf, int32_t value, uint8_t decimals)
+{
+    uint8_t tmp[ESP_WELINK_PROP_MAX_CHARS];
+    uint8_t* end = tmp + sizeof(tmp);
+    uint32_t magnitude = (value < 0) ? 0u - (uint32_t)value : (uint32_t)value;
+    uint32_t len = 0;
+
+    if (decimals != 0) {
+        len = prop_utoa_reverse(end, magnitude % s_pow10[decimals], decimals);
+        tmp[sizeof(tmp) - ++len] = '.';
+        magnitude /= s_pow10[decimals];
+    }
+
+    len += prop_utoa_reverse(end - len, magnitude, 1);
+
+    if (value < 0) {
+        tmp[sizeof(tmp) - ++len] = '-';
+    }
+
+    memcpy(buf, end - len, len);
+
+    return len;
+}
+
+uint32_t esp_welink_prop_encode_int(uint8_t* buf, int32_t value)
+{
+    return prop_encode(buf, value, 0);
+}
+
+uint32_t esp_welink_prop_encode_fixed(uint8_t* buf, int32_t value, uint8_t decimals)
+{
+    return prop_encode(buf, value, (decimals > 9) ? 9 : decimals);
+}
+
+uint32_t esp_welink_prop_encode_bool(uint8_t* buf, int32_t value)
+{
+    if (value) {
+        memcpy(buf, "true", 4);
+        return 4;
+    }
+
+    memcpy(buf, "false", 5);
+    return 5;
+}
+
+static int32_t prop_decode_bool(const uint8_t* text, uint32_t len, int32_t* value)
+{
+    if ((len == 4 && memcmp(text, "true", 4) == 0) || (len == 1 && text[0] == '1')) {
+        *value = 1;
+    } else if ((len == 5 && memcmp(text, "false", 5) == 0) || (len == 1 && text[0] == '0')) {
+        *value = 0;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+// 解析[-]digits[.digits]，小数部分按decimals位补0或截断，结果为value * 10^decimals
+static int32_t prop_decode_number(const uint8_t* text, uint32_t len, uint8_t decimals, int32_t* value)
+{
+    const uint8_t* end = text + len;
+    int64_t result = 0;
+    uint32_t digits = 0;
+    uint32_t fraction = 0;
+    bool negative = false;
+
+    if (text < end && *text == '-') {
+        negative = true;
+        text++;
+    }
+
+    for (; text < end && *text >= '0' && *text <= '9'; text++, digits++) {
+        result = result * 10 + (*text - '0');
+
+        if (result > 0x80000000LL) {
+            return -1;
+        }
+    }
+
+    if (text < end && *text == '.') {
+        text++;
+
+        for (; text < end && *text >= '0' && *text <= '9'; text++, digits++) {
+            if (fraction < decimals) {
+                result = result * 10 + (*text - '0');
+                fraction++;
+            }
+        }
+    }
+
+    if (text != end || digits == 0) {
+        return -1;
+    }
+
+    result *= s_pow10[decimals - fraction];
+    result = negative ? -result : result;
+
+    if (result < INT32_MIN || result > INT32_MAX) {
+        return -1;
+    }
+
+    *value = (int32_t)result;
+
+    return 0;
+}
+
+int32_t esp_welink_prop_decode(const esp_welink_prop_schema_t* prop, const uint8_t* text, uint32_t len, int32_t* value)
+{
+    int32_t result = 0;
+    int32_t ret = 0;
+
+    if (prop == NULL || text == NULL || value == NULL) {
+        return -1;
+    }
+
+    switch (prop->type) {
+        case ESP_WELINK_PROP_BOOL:
+            ret = prop_decode_bool(text, len, &result);
+            break;
+
+        case ESP_WELINK_PROP_FIXED:
+            ret = prop_decode_number(text, len, (prop->decimals > 9) ? 9 : prop->decimals, &result);
+            break;
+
+        default:
+            ret = prop_decode_number(text, len, 0, &result);
+            break;
+    }
+
+    if (ret != 0 || result < prop->min || result > prop->max) {
+        return -1;
+    }
+
+    *value = result;
+
+    return 0;
+}
+
+void esp_welink_prop_batch_init(esp_welink_prop_batch_t* batch, txd_datapoint_t* datapoints, uint32_t max_count,
+                                uint8_t* buf, uint32_t size)
+{
+    batch->datapoints = datapoints;
+    batch->max_count = max_count;
+    batch->count = 0;
+    batch->buf = buf;
+    batch->size = size;
+    batch->used = 0;
+}
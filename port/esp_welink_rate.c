@@ -0,0 +1,387 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_rate.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_rate";
+
+#define RATE_MHZ_PER_HZ     1000000     // 间隔(ms) = 1000000 / 速率(mHz)
+
+typedef struct {
+    bool used;
+    uint32_t min_rate_mhz;
+    uint32_t max_rate_mhz;
+    uint32_t max_inflight;
+    uint32_t last_report_ms;
+    uint32_t recover_until_ms;  // 一个往返时间内只降速一次
+    bool reported;
+    esp_welink_rate_stats_t stats;
+} rate_stream_t;
+
+typedef struct {
+    bool used;
+    int32_t stream;
+    uint32_t cookie;
+    uint32_t sent_ms;
+    on_send_datapoint cb;
+} rate_inflight_t;
+
+static struct {
+    esp_welink_rate_config_t config;
+    rate_stream_t streams[WELINK_RATE_MAX_STREAMS];
+    rate_inflight_t inflight[WELINK_RATE_INFLIGHT];
+    esp_welink_stash_t stash;   // 在发送函数返回前就到达的完成回调
+    uint32_t reporting;         // 正在调用发送函数的数量，只有这期间到达的未知cookie才可能是提前完成
+    txd_mutex_handler_t* mutex;
+} s_rate;
+
+static void rate_set(rate_stream_t* s, uint32_t rate_mhz)
+{
+    rate_mhz = (rate_mhz < s->min_rate_mhz) ? s->min_rate_mhz : rate_mhz;
+    rate_mhz = (rate_mhz > s->max_rate_mhz) ? s->max_rate_mhz : rate_mhz;
+    s->stats.rate_mhz = rate_mhz;
+    s->stats.interval_ms = RATE_MHZ_PER_HZ / rate_mhz;
+}
+
+// 调用前需持有mutex
+static void rate_decrease(rate_stream_t* s, uint32_t now)
+{
+    if ((int32_t)(s->recover_until_ms - now) > 0) {
+        return;
+    }
+
+    rate_set(s, s->stats.rate_mhz / 2);
+    s->stats.decreases++;
+    s->recover_until_ms = now + (s->stats.srtt_ms ? s->stats.srtt_ms : s_rate.config.latency_target_ms);
+}
+
+// 调用前需持有mutex：根据一次完成结果调整速率
+static void rate_on_complete(rate_stream_t* s, int32_t err_code, uint32_t latency_ms, uint32_t now)
+{
+    int32_t delta = 0;
+
+    s->stats.inflight--;
+
+    switch (err_code) {
+        case err_success:
+            s->stats.completed++;
+
+            // 平滑往返时间，权重1/8
+            delta = (int32_t)latency_ms - (int32_t)s->stats.srtt_ms;
+            s->stats.srtt_ms = s->stats.srtt_ms ? s->stats.srtt_ms + delta / 8 : latency_ms;
+
+            if (latency_ms > s_rate.config.latency_target_ms) {
+                rate_decrease(s, now);
+            } else {
+                rate_set(s, s->stats.rate_mhz + s_rate.config.increase_mhz);
+                s->stats.increases++;
+            }
+
+            break;
+
+        case err_msg_sendtimeout:
+            s->stats.timeouts++;
+            rate_decrease(s, now);
+            break;
+
+        case err_msg_cache_failed:
+        case err_msg_send_too_frequently:
+            s->stats.cache_failed++;
+            rate_decrease(s, now);
+            break;
+
+        default:
+            s->stats.errors++;
+            break;
+    }
+}
+
+// 调用前需持有mutex：超时未完成的消息按超时处理，取出的条目由调用者释放mutex后交给rate_expire_notify()
+static uint32_t rate_expire(uint32_t now, rate_inflight_t expired[WELINK_RATE_INFLIGHT])
+{
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < WELINK_RATE_INFLIGHT; i++) {
+        if (s_rate.inflight[i].used && now - s_rate.inflight[i].sent_ms > s_rate.config.inflight_timeout_ms) {
+            s_rate.inflight[i].used = false;
+            rate_on_complete(&s_rate.streams[s_rate.inflight[i].stream], err_msg_sendtimeout, 0, now);
+            expired[count++] = s_rate.inflight[i];
+        }
+    }
+
+    return count;
+}
+
+// 不持有mutex：超时的消息以err_msg_sendtimeout完成，之后到达的真实完成被丢弃，每个回调只调用一次
+static void rate_expire_notify(const rate_inflight_t expired[], uint32_t count)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (expired[i].cb != NULL) {
+            expired[i].cb(err_msg_sendtimeout, expired[i].cookie);
+        }
+    }
+}
+
+static void rate_send_cb(int32_t err_code, uint32_t cookie)
+{
+    rate_inflight_t entry = {0};
+    uint32_t now = txd_time_get_sysclock();
+    uint32_t i = 0;
+
+    txd_mutex_lock(s_rate.mutex);
+
+    for (i = 0; i < WELINK_RATE_INFLIGHT; i++) {
+        if (s_rate.inflight[i].used && s_rate.inflight[i].cookie == cookie) {
+            entry = s_rate.inflight[i];
+            s_rate.inflight[i].used = false;
+            rate_on_complete(&s_rate.streams[entry.stream], err_code, now - entry.sent_ms, now);
+            break;
+        }
+    }
+
+    // 发送函数还没返回cookie，先暂存，登记时再处理；没有正在进行的发送时是已按超时处理的消息，丢弃
+    if (!entry.used && s_rate.reporting == 0) {
+        WELINK_LOGW("late completion, cookie: %d err_code: %d dropped", cookie, err_code);
+    } else if (!entry.used) {
+        esp_welink_stash_put(&s_rate.stash, cookie, err_code, now);
+    }
+
+    txd_mutex_unlock(s_rate.mutex);
+
+    if (entry.cb != NULL) {
+        entry.cb(err_code, cookie);
+    }
+}
+
+static rate_stream_t* rate_stream_get(int32_t stream)
+{
+    if (s_rate.mutex == NULL || stream < 0 || stream >= WELINK_RATE_MAX_STREAMS || !s_rate.streams[stream].used) {
+        return NULL;
+    }
+
+    return &s_rate.streams[stream];
+}
+
+int32_t esp_welink_rate_init(const esp_welink_rate_config_t* config)
+{
+    esp_welink_rate_config_t config_default = ESP_WELINK_RATE_CONFIG_DEFAULT();
+
+    if (s_rate.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->inflight_timeout_ms == 0, -1, "invalid rate config");
+
+    memset(&s_rate, 0, sizeof(s_rate));
+    s_rate.config = *config;
+    s_rate.config.report = config->report ? config->report : txd_report_datapoints;
+
+    s_rate.mutex = txd_mutex_create();
+    WELINK_ERROR_CHECK(s_rate.mutex == NULL, -1, "create mutex fail");
+
+    return 0;
+}
+
+int32_t esp_welink_rate_stream_create(uint32_t min_interval_ms, uint32_t max_interval_ms, uint32_t max_inflight)
+{
+    rate_stream_t* s = NULL;
+    int32_t stream = 0;
+
+    if (s_rate.mutex == NULL || min_interval_ms == 0 || min_interval_ms > max_interval_ms || max_inflight == 0) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_rate.mutex);
+
+    for (stream = 0; stream < WELINK_RATE_MAX_STREAMS && s_rate.streams[stream].used; stream++);
+
+    if (stream == WELINK_RATE_MAX_STREAMS) {
+        txd_mutex_unlock(s_rate.mutex);
+        WELINK_LOGE("no free stream");
+        return -1;
+    }
+
+    s = &s_rate.streams[stream];
+    memset(s, 0, sizeof(rate_stream_t));
+    s->used = true;
+    s->min_rate_mhz = (RATE_MHZ_PER_HZ / max_interval_ms) ? RATE_MHZ_PER_HZ / max_interval_ms : 1;
+    s->max_rate_mhz = RATE_MHZ_PER_HZ / min_interval_ms;
+    s->max_inflight = max_inflight;
+    rate_set(s, s->min_rate_mhz);
+
+    txd_mutex_unlock(s_rate.mutex);
+
+    return stream;
+}
+
+bool esp_welink_rate_ready(int32_t stream)
+{
+    rate_stream_t* s = rate_stream_get(stream);
+    rate_inflight_t expired[WELINK_RATE_INFLIGHT];
+    uint32_t count = 0;
+    uint32_t now = 0;
+    bool ready = false;
+
+    if (s == NULL) {
+        return false;
+    }
+
+    txd_mutex_lock(s_rate.mutex);
+
+    now = txd_time_get_sysclock();
+    count = rate_expire(now, expired);
+    ready = (s->stats.inflight < s->max_inflight) && (!s->reported || now - s->last_report_ms >= s->stats.interval_ms);
+
+    txd_mutex_unlock(s_rate.mutex);
+    rate_expire_notify(expired, count);
+
+    return ready;
+}
+
+uint32_t esp_welink_rate_get_interval(int32_t stream)
+{
+    rate_stream_t* s = rate_stream_get(stream);
+
+    return s ? __atomic_load_n(&s->stats.interval_ms, __ATOMIC_RELAXED) : 0;
+}
+
+int32_t esp_welink_rate_report(int32_t stream, txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                               on_send_datapoint pCb, uint32_t* pCookie)
+{
+    rate_stream_t* s = rate_stream_get(stream);
+    rate_inflight_t* slot = NULL;
+    rate_inflight_t expired[WELINK_RATE_INFLIGHT];
+    uint32_t count = 0;
+    uint32_t cookie = 0;
+    uint32_t now = 0;
+    uint32_t done_ms = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    int32_t err_code = err_success;
+    int32_t ret = 0;
+    bool early = false;
+
+    if (s == NULL) {
+        return err_invalid_param;
+    }
+
+    txd_mutex_lock(s_rate.mutex);
+    s_rate.reporting++;
+    txd_mutex_unlock(s_rate.mutex);
+
+    now = txd_time_get_sysclock();
+    ret = s_rate.config.report(datapoints, datapoints_count, rate_send_cb, &cookie);
+
+    if (pCookie != NULL) {
+        *pCookie = cookie;
+    }
+
+    txd_mutex_lock(s_rate.mutex);
+
+    s_rate.reporting--;
+    s->last_report_ms = now;
+    s->reported = true;
+
+    if (ret != err_success) {
+        // 同步返回的拥塞错误同样降速，其它错误不影响速率
+        s->stats.inflight++;
+        rate_on_complete(s, ret, 0, now);
+        txd_mutex_unlock(s_rate.mutex);
+        return ret;
+    }
+
+    s->stats.sent++;
+    s->stats.inflight++;
+
+    if (esp_welink_stash_take(&s_rate.stash, cookie, &err_code, &done_ms)) {
+        rate_on_complete(s, err_code, done_ms - now, done_ms);
+        early = true;
+    }
+
+    if (!early) {
+        count = rate_expire(now, expired);
+
+        for (i = 0; i < WELINK_RATE_INFLIGHT && s_rate.inflight[i].used; i++);
+
+        // 表满时最早的消息提前按超时处理，让出位置，保证每条消息的回调都会被调用
+        if (i == WELINK_RATE_INFLIGHT) {
+            for (i = 0, j = 1; j < WELINK_RATE_INFLIGHT; j++) {
+                if ((int32_t)(s_rate.inflight[j].sent_ms - s_rate.inflight[i].sent_ms) < 0) {
+                    i = j;
+                }
+            }
+
+            WELINK_LOGW("inflight table full, cookie: %d timed out early", s_rate.inflight[i].cookie);
+            s_rate.inflight[i].used = false;
+            rate_on_complete(&s_rate.streams[s_rate.inflight[i].stream], err_msg_sendtimeout, 0, now);
+            expired[count++] = s_rate.inflight[i];
+        }
+
+        slot = &s_rate.inflight[i];
+        slot->used = true;
+        slot->stream = stream;
+        slot->cookie = cookie;
+        slot->sent_ms = now;
+        slot->cb = pCb;
+    }
+
+    txd_mutex_unlock(s_rate.mutex);
+    rate_expire_notify(expired, count);
+
+    if (early && pCb != NULL) {
+        pCb(err_code, cookie);
+    }
+
+    return ret;
+}
+
+int32_t esp_welink_rate_get_stats(int32_t stream, esp_welink_rate_stats_t* stats)
+{
+    rate_stream_t* s = rate_stream_get(stream);
+    rate_inflight_t expired[WELINK_RATE_INFLIGHT];
+    uint32_t count = 0;
+
+    if (s == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_rate.mutex);
+    count = rate_expire(txd_time_get_sysclock(), expired);
+    memcpy(stats, &s->stats, sizeof(esp_welink_rate_stats_t));
+    txd_mutex_unlock(s_rate.mutex);
+    rate_expire_notify(expired, count);
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stddef.h>
+
+#include "esp_welink_report.h"
+
+void esp_welink_stash_put(esp_welink_stash_t* stash, uint32_t cookie, int32_t err_code, uint32_t done_ms)
+{
+    stash->entries[stash->next].used = true;
+    stash->entries[stash->next].cookie = cookie;
+    stash->entries[stash->next].err_code = err_code;
+    stash->entries[stash->next].done_ms = done_ms;
+    stash->next = (stash->next + 1) % WELINK_STASH_SIZE;
+}
+
+bool esp_welink_stash_take(esp_welink_stash_t* stash, uint32_t cookie, int32_t* err_code, uint32_t* done_ms)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < WELINK_STASH_SIZE; i++) {
+        if (stash->entries[i].used && stash->entries[i].cookie == cookie) {
+            stash->entries[i].used = false;
+            *err_code = stash->entries[i].err_code;
+
+            if (done_ms != NULL) {
+                *done_ms = stash->entries[i].done_ms;
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,464 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_sched.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_sched";
+
+#define SCHED_TOKEN         1000    // 令牌以千分之一为单位累加，避免整数速率下的舍入误差
+#define SCHED_INFLIGHT      16      // 已交给SDK、等待发送结果回调的消息数
+
+typedef struct {
+    txd_datapoint_t* datapoints;    // 与属性值在同一块内存中
+    uint32_t count;
+    uint32_t cookie;
+    on_send_datapoint cb;
+    uint32_t enqueue_ms;
+} sched_item_t;
+
+typedef struct {
+    sched_item_t* items;
+    uint32_t depth;
+    uint32_t head;
+    uint32_t count;
+} sched_lane_t;
+
+typedef struct {
+    bool used;
+    uint32_t sdk_cookie;
+    uint32_t cookie;
+    on_send_datapoint cb;
+    uint32_t sent_ms;
+} sched_inflight_t;
+
+static struct {
+    esp_welink_sched_config_t config;
+    sched_lane_t lanes[ESP_WELINK_SCHED_LANE_MAX];
+    sched_inflight_t inflight[SCHED_INFLIGHT];
+    uint32_t inflight_count;
+    esp_welink_stash_t stash;       // 在发送函数返回前就到达的回调
+    uint32_t tokens;
+    uint32_t refill_ms;
+    uint32_t backoff_ms;
+    uint32_t backoff_until_ms;
+    uint32_t next_cookie;
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_sched_stats_t stats;
+} s_sched;
+
+// 调用前需持有mutex
+static void sched_refill(uint32_t now)
+{
+    uint32_t max = s_sched.config.burst * SCHED_TOKEN;
+    uint32_t elapsed = now - s_sched.refill_ms;
+
+    s_sched.refill_ms = now;
+
+    // 按毫秒累加，elapsed很大时直接填满，避免乘法溢出
+    if (elapsed >= max / s_sched.config.rate + 1 || s_sched.tokens + elapsed * s_sched.config.rate >= max) {
+        s_sched.tokens = max;
+    } else {
+        s_sched.tokens += elapsed * s_sched.config.rate;
+    }
+}
+
+// SDK的发送结果回调，通过SDK cookie找回调度器cookie和应用回调
+static void sched_send_cb(int32_t err_code, uint32_t sdk_cookie)
+{
+    on_send_datapoint cb = NULL;
+    uint32_t cookie = 0;
+    uint32_t i = 0;
+
+    txd_mutex_lock(s_sched.mutex);
+
+    for (i = 0; i < SCHED_INFLIGHT; i++) {
+        if (s_sched.inflight[i].used && s_sched.inflight[i].sdk_cookie == sdk_cookie) {
+            s_sched.inflight[i].used = false;
+            cb = s_sched.inflight[i].cb;
+            cookie = s_sched.inflight[i].cookie;
+
+            // 表满时发送已暂停，让出位置后立即恢复
+            if (s_sched.inflight_count-- == SCHED_INFLIGHT
+                    && s_sched.lanes[ESP_WELINK_SCHED_ACK].count + s_sched.lanes[ESP_WELINK_SCHED_REPORT].count != 0) {
+                txd_timer_start(s_sched.timer, 0, 0, 0);
+            }
+
+            break;
+        }
+    }
+
+    // 发送函数还没返回cookie，先暂存结果，由调度器登记时处理
+    if (cb == NULL) {
+        esp_welink_stash_put(&s_sched.stash, sdk_cookie, err_code, txd_time_get_sysclock());
+    }
+
+    txd_mutex_unlock(s_sched.mutex);
+
+    if (cb != NULL) {
+        cb(err_code, cookie);
+    }
+}
+
+// 调用前需持有mutex，取出超过inflight_timeout_ms没有回调的消息，返回个数，由调用者在释放mutex后以超时完成
+static uint32_t sched_inflight_expire(uint32_t now, sched_inflight_t expired[])
+{
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < SCHED_INFLIGHT; i++) {
+        if (s_sched.inflight[i].used && now - s_sched.inflight[i].sent_ms >= s_sched.config.inflight_timeout_ms) {
+            WELINK_LOGW("no send result, cookie: %d timed out", s_sched.inflight[i].cookie);
+            s_sched.inflight[i].used = false;
+            s_sched.inflight_count--;
+            s_sched.stats.timeouts++;
+            expired[count++] = s_sched.inflight[i];
+        }
+    }
+
+    return count;
+}
+
+// 调用前需持有mutex，返回最早的消息超时前还要等待的时间，没有等待回调的消息时返回0
+static uint32_t sched_inflight_wait(uint32_t now)
+{
+    uint32_t wait = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < SCHED_INFLIGHT; i++) {
+        if (s_sched.inflight[i].used
+                && (wait == 0 || s_sched.config.inflight_timeout_ms - (now - s_sched.inflight[i].sent_ms) < wait)) {
+            wait = s_sched.config.inflight_timeout_ms - (now - s_sched.inflight[i].sent_ms);
+        }
+    }
+
+    return wait;
+}
+
+// 调用前需持有mutex，返回true表示结果已提前到达，由调用者直接回调
+static bool sched_inflight_add(const sched_item_t* item, uint32_t sdk_cookie, uint32_t now, int32_t* err_code)
+{
+    sched_inflight_t* slot = NULL;
+    uint32_t i = 0;
+
+    if (esp_welink_stash_take(&s_sched.stash, sdk_cookie, err_code, NULL)) {
+        return true;
+    }
+
+    // 表满时sched_pump不会发送，这里一定有空位
+    for (i = 0; s_sched.inflight[i].used; i++);
+
+    slot = &s_sched.inflight[i];
+    slot->used = true;
+    slot->sdk_cookie = sdk_cookie;
+    slot->cookie = item->cookie;
+    slot->cb = item->cb;
+    slot->sent_ms = now;
+    s_sched.inflight_count++;
+
+    return false;
+}
+
+// 在定时器回调中发送：先发ack再发report，没有令牌、处于退避期或等待回调的消息已满时按需要的时间重新设置定时器
+static void sched_pump(void* arg)
+{
+    sched_lane_t* lane = NULL;
+    sched_item_t item;
+    sched_inflight_t expired[SCHED_INFLIGHT];
+    uint32_t expired_count = 0;
+    uint32_t lane_id = 0;
+    uint32_t sdk_cookie = 0;
+    uint32_t now = 0;
+    uint32_t wait = 0;
+    uint32_t i = 0;
+    int32_t err_code = 0;
+    int32_t ret = 0;
+    bool complete = false;
+
+    for (;;) {
+        txd_mutex_lock(s_sched.mutex);
+
+        now = txd_time_get_sysclock();
+        sched_refill(now);
+        expired_count = sched_inflight_expire(now, expired);
+
+        if (expired_count != 0) {
+            txd_mutex_unlock(s_sched.mutex);
+
+            // 之后到达的真实结果找不到对应的消息，每个回调只调用一次
+            for (i = 0; i < expired_count; i++) {
+                expired[i].cb(err_msg_sendtimeout, expired[i].cookie);
+            }
+
+            continue;
+        }
+
+        for (lane_id = 0; lane_id < ESP_WELINK_SCHED_LANE_MAX && s_sched.lanes[lane_id].count == 0; lane_id++);
+
+        // 队列为空时等到最早的消息超时，没有回调的消息也会完成
+        if (lane_id == ESP_WELINK_SCHED_LANE_MAX) {
+            wait = sched_inflight_wait(now);
+
+            if (wait != 0) {
+                txd_timer_start(s_sched.timer, wait, 0, 0);
+            }
+
+            txd_mutex_unlock(s_sched.mutex);
+            break;
+        }
+
+        if (s_sched.inflight_count == SCHED_INFLIGHT) {
+            // 背压：等待回调的消息已满，收到回调或最早的消息超时后再发送
+            wait = sched_inflight_wait(now);
+            s_sched.stats.stalled++;
+        } else if ((int32_t)(s_sched.backoff_until_ms - now) > 0) {
+            wait = s_sched.backoff_until_ms - now;
+        } else if (s_sched.tokens < SCHED_TOKEN) {
+            wait = (SCHED_TOKEN - s_sched.tokens + s_sched.config.rate - 1) / s_sched.config.rate;
+        } else {
+            wait = 0;
+        }
+
+        if (wait != 0) {
+            txd_timer_start(s_sched.timer, wait, 0, 0);
+            txd_mutex_unlock(s_sched.mutex);
+            break;
+        }
+
+        lane = &s_sched.lanes[lane_id];
+        item = lane->items[lane->head];
+        s_sched.tokens -= SCHED_TOKEN;
+
+        txd_mutex_unlock(s_sched.mutex);
+
+        // 发送时不持有mutex，SDK可能在发送函数中直接调用结果回调
+        sdk_cookie = 0;
+
+        if (lane_id == ESP_WELINK_SCHED_ACK) {
+            ret = s_sched.config.ack(item.datapoints, item.cb ? sched_send_cb : NULL, &sdk_cookie);
+        } else {
+            ret = s_sched.config.report(item.datapoints, item.count, item.cb ? sched_send_cb : NULL, &sdk_cookie);
+        }
+
+        txd_mutex_lock(s_sched.mutex);
+
+        if (ret == err_msg_send_too_frequently || ret == err_msg_cache_failed) {
+            // 消息留在队首，指数退避后重试
+            s_sched.backoff_ms = s_sched.backoff_ms ? s_sched.backoff_ms * 2 : s_sched.config.backoff_min_ms;
+            s_sched.backoff_ms = (s_sched.backoff_ms > s_sched.config.backoff_max_ms) ? s_sched.config.backoff_max_ms : s_sched.backoff_ms;
+            s_sched.backoff_until_ms = now + s_sched.backoff_ms;
+            s_sched.tokens = 0;
+            s_sched.stats.throttled++;
+            txd_mutex_unlock(s_sched.mutex);
+            continue;
+        }
+
+        lane->head = (lane->head + 1) % lane->depth;
+        lane->count--;
+        s_sched.backoff_ms = 0;
+        complete = false;
+
+        if (ret == err_success) {
+            s_sched.stats.sent[lane_id]++;
+
+            if (now - item.enqueue_ms > s_sched.stats.max_wait_ms[lane_id]) {
+                s_sched.stats.max_wait_ms[lane_id] = now - item.enqueue_ms;
+            }
+
+            if (item.cb != NULL) {
+                complete = sched_inflight_add(&item, sdk_cookie, now, &err_code);
+            }
+        } else {
+            s_sched.stats.failed[lane_id]++;
+            err_code = ret;
+            complete = (item.cb != NULL);
+        }
+
+        txd_mutex_unlock(s_sched.mutex);
+
+        if (ret == err_success) {
+            esp_welink_socket_wakeup();
+        } else {
+            WELINK_LOGW("send fail, lane: %d ret: 0x%x", lane_id, ret);
+        }
+
+        if (complete) {
+            item.cb(err_code, item.cookie);
+        }
+
+        txd_free(item.datapoints);
+    }
+}
+
+static int32_t sched_enqueue(uint32_t lane_id, txd_datapoint_t datapoints[], uint32_t count,
+                             on_send_datapoint cb, uint32_t* cookie)
+{
+    sched_lane_t* lane = &s_sched.lanes[lane_id];
+    sched_item_t* item = NULL;
+    txd_datapoint_t* copy = NULL;
+    uint8_t* value = NULL;
+    uint32_t size = sizeof(txd_datapoint_t) * count;
+    uint32_t i = 0;
+
+    if (s_sched.mutex == NULL || datapoints == NULL || count == 0) {
+        WELINK_LOGE("the parameter is incorrect");
+        return err_invalid_param;
+    }
+
+    for (i = 0; i < count; i++) {
+        size += datapoints[i].property_value_len;
+    }
+
+    // 数据点和属性值拷贝到同一块内存，调用返回后应用可以释放自己的缓冲区
+    copy = (txd_datapoint_t*)txd_malloc(size);
+
+    if (copy == NULL) {
+        WELINK_LOGE("malloc fail");
+        return err_msg_cache_failed;
+    }
+
+    value = (uint8_t*)(copy + count);
+
+    for (i = 0; i < count; i++) {
+        copy[i] = datapoints[i];
+        copy[i].property_value = value;
+        memcpy(value, datapoints[i].property_value, datapoints[i].property_value_len);
+        value += datapoints[i].property_value_len;
+    }
+
+    txd_mutex_lock(s_sched.mutex);
+
+    if (lane->count == lane->depth) {
+        s_sched.stats.full[lane_id]++;
+        txd_mutex_unlock(s_sched.mutex);
+        txd_free(copy);
+        return err_msg_cache_failed;
+    }
+
+    item = &lane->items[(lane->head + lane->count) % lane->depth];
+    item->datapoints = copy;
+    item->count = count;
+    item->cb = cb;
+    item->enqueue_ms = txd_time_get_sysclock();
+    item->cookie = ++s_sched.next_cookie;
+    lane->count++;
+    s_sched.stats.queued[lane_id]++;
+
+    if (cookie != NULL) {
+        *cookie = item->cookie;
+    }
+
+    // 队列原来为空时立即调度一次，否则定时器已经在等令牌或退避
+    if (s_sched.lanes[ESP_WELINK_SCHED_ACK].count + s_sched.lanes[ESP_WELINK_SCHED_REPORT].count == 1
+            || lane_id == ESP_WELINK_SCHED_ACK) {
+        txd_timer_start(s_sched.timer, 0, 0, 0);
+    }
+
+    txd_mutex_unlock(s_sched.mutex);
+
+    return err_success;
+}
+
+int32_t esp_welink_sched_init(const esp_welink_sched_config_t* config)
+{
+    esp_welink_sched_config_t config_default = ESP_WELINK_SCHED_CONFIG_DEFAULT();
+    uint32_t i = 0;
+
+    if (s_sched.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->rate == 0 || config->burst == 0 || config->ack_depth == 0 || config->report_depth == 0
+                       || config->inflight_timeout_ms == 0, -1, "invalid sched config");
+
+    memset(&s_sched, 0, sizeof(s_sched));
+    s_sched.config = *config;
+    s_sched.config.report = config->report ? config->report : txd_report_datapoints;
+    s_sched.config.ack = config->ack ? config->ack : txd_ack_datapoint;
+    s_sched.lanes[ESP_WELINK_SCHED_ACK].depth = config->ack_depth;
+    s_sched.lanes[ESP_WELINK_SCHED_REPORT].depth = config->report_depth;
+    s_sched.tokens = config->burst * SCHED_TOKEN;
+    s_sched.refill_ms = txd_time_get_sysclock();
+
+    for (i = 0; i < ESP_WELINK_SCHED_LANE_MAX; i++) {
+        s_sched.lanes[i].items = (sched_item_t*)txd_malloc(sizeof(sched_item_t) * s_sched.lanes[i].depth);
+        WELINK_ERROR_GOTO(s_sched.lanes[i].items == NULL, end, "malloc fail");
+    }
+
+    s_sched.timer = txd_timer_create(sched_pump, NULL);
+    WELINK_ERROR_GOTO(s_sched.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_sched.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_sched.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_sched.timer != NULL) {
+        txd_timer_destroy(s_sched.timer);
+    }
+
+    for (i = 0; i < ESP_WELINK_SCHED_LANE_MAX; i++) {
+        txd_free(s_sched.lanes[i].items);
+    }
+
+    memset(&s_sched, 0, sizeof(s_sched));
+
+    return -1;
+}
+
+int32_t esp_welink_sched_report(txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                                on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return sched_enqueue(ESP_WELINK_SCHED_REPORT, datapoints, datapoints_count, pCb, pCookie);
+}
+
+int32_t esp_welink_sched_ack(txd_datapoint_t* datapoint, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return sched_enqueue(ESP_WELINK_SCHED_ACK, datapoint, 1, pCb, pCookie);
+}
+
+int32_t esp_welink_sched_get_stats(esp_welink_sched_stats_t* stats)
+{
+    if (s_sched.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_sched.mutex);
+    memcpy(stats, &s_sched.stats, sizeof(esp_welink_sched_stats_t));
+    stats->pending = s_sched.lanes[ESP_WELINK_SCHED_ACK].count + s_sched.lanes[ESP_WELINK_SCHED_REPORT].count;
+    txd_mutex_unlock(s_sched.mutex);
+
+    return 0;
+}
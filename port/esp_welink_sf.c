@@ -0,0 +1,781 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_partition.h"
+
+#include "esp_welink_log.h"
+#include "esp_welink_sf.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_sf";
+
+#define SF_MAGIC            0x31465357  // "WSF1"
+#define SF_STATE_ERASED     0xFFFFFFFF
+#define SF_STATE_PENDING    0xFFFF5346  // 写入时的状态，发送成功后清零，两次写都只把1改成0
+#define SF_STATE_CONSUMED   0x00000000
+#define SF_LATEST           32          // ESP_WELINK_SF_LATEST_ONLY时记录最新值位置的属性个数
+#define SF_ALIGN(len)       (((len) + 3) & ~3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                       // 每打开一个新扇区加1，用于挂载时找出环的首尾
+    uint32_t reserved[2];
+} sf_sector_t;
+
+typedef struct {
+    uint32_t state;
+    uint32_t property_id;
+    uint16_t len;
+    uint16_t crc;                       // property_id和属性值的CRC，挂载时用来识别写了一半的记录
+} sf_record_t;
+
+typedef struct {
+    uint32_t sector;
+    uint32_t offset;
+} sf_pos_t;
+
+typedef struct {
+    sf_pos_t pos;
+    uint32_t seq;                       // 扇区被回收后seq会变化，旧的位置就不再有效
+} sf_ref_t;
+
+typedef struct {
+    uint32_t property_id;
+    sf_ref_t ref;
+} sf_latest_t;
+
+static struct {
+    esp_welink_sf_config_t config;
+    uint32_t sector_count;
+    uint32_t* seqs;
+    uint32_t head;                      // 正在写入的扇区
+    uint32_t write_off;
+    sf_pos_t read;                      // 下一条待重放的记录，它之前的记录都已消费，所在扇区即环的尾
+    sf_latest_t latest[SF_LATEST];
+    uint32_t latest_count;
+    sf_ref_t sent[WELINK_SF_MAX_POINTS];// 正在重放的消息中的记录
+    uint32_t sent_count;
+    sf_pos_t sent_end;
+    uint32_t sent_recycled;
+    uint32_t sent_ms;
+    uint32_t sent_cookie;
+    bool inflight;
+    bool result_valid;
+    uint32_t result_cookie;
+    int32_t result_err;
+    bool online;
+    uint32_t recycled;                  // 回收最旧扇区的次数
+    uint8_t record[sizeof(sf_record_t) + WELINK_SF_MAX_BYTES];
+    uint8_t values[WELINK_SF_MAX_BYTES];
+    txd_datapoint_t points[WELINK_SF_MAX_POINTS];
+    txd_mutex_handler_t* mutex;
+    txd_timer_handler_t* timer;
+    esp_welink_sf_stats_t stats;
+} s_sf;
+
+static int32_t sf_partition_read(void* ctx, uint32_t offset, void* buf, uint32_t len)
+{
+    return (esp_partition_read((const esp_partition_t*)ctx, offset, buf, len) == ESP_OK) ? 0 : -1;
+}
+
+static int32_t sf_partition_write(void* ctx, uint32_t offset, const void* buf, uint32_t len)
+{
+    return (esp_partition_write((const esp_partition_t*)ctx, offset, buf, len) == ESP_OK) ? 0 : -1;
+}
+
+static int32_t sf_partition_erase(void* ctx, uint32_t offset, uint32_t len)
+{
+    return (esp_partition_erase_range((const esp_partition_t*)ctx, offset, len) == ESP_OK) ? 0 : -1;
+}
+
+static uint16_t sf_crc16(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+    uint32_t i = 0;
+
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t sf_record_crc(uint32_t property_id, const uint8_t* value, uint32_t len)
+{
+    return sf_crc16(sf_crc16(0xFFFF, (const uint8_t*)&property_id, sizeof(property_id)), value, len);
+}
+
+static inline uint32_t sf_addr(sf_pos_t pos)
+{
+    return pos.sector * s_sf.config.flash.sector_size + pos.offset;
+}
+
+static inline uint32_t sf_next(uint32_t sector)
+{
+    return (sector + 1) % s_sf.sector_count;
+}
+
+// 读记录头，返回false表示扇区在这里结束（未写入或已损坏）
+static bool sf_read_record(sf_pos_t pos, sf_record_t* rec)
+{
+    rec->state = SF_STATE_ERASED;
+
+    if (pos.offset + sizeof(sf_record_t) > s_sf.config.flash.sector_size
+            || s_sf.config.flash.read(s_sf.config.flash.ctx, sf_addr(pos), rec, sizeof(sf_record_t)) != 0) {
+        return false;
+    }
+
+    return (rec->state == SF_STATE_PENDING || rec->state == SF_STATE_CONSUMED)
+           && rec->len <= WELINK_SF_MAX_BYTES
+           && pos.offset + sizeof(sf_record_t) + SF_ALIGN(rec->len) <= s_sf.config.flash.sector_size;
+}
+
+// 把仍未消费的记录标记为已消费，返回true表示状态确实发生了变化
+static bool sf_consume(const sf_ref_t* ref)
+{
+    uint32_t state = SF_STATE_CONSUMED;
+
+    if (s_sf.seqs[ref->pos.sector] != ref->seq
+            || s_sf.config.flash.read(s_sf.config.flash.ctx, sf_addr(ref->pos), &state, sizeof(state)) != 0
+            || state != SF_STATE_PENDING) {
+        return false;
+    }
+
+    state = SF_STATE_CONSUMED;
+
+    return s_sf.config.flash.write(s_sf.config.flash.ctx, sf_addr(ref->pos), &state, sizeof(state)) == 0;
+}
+
+static sf_latest_t* sf_latest_find(uint32_t property_id)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < s_sf.latest_count; i++) {
+        if (s_sf.latest[i].property_id == property_id) {
+            return &s_sf.latest[i];
+        }
+    }
+
+    return NULL;
+}
+
+// 记录属性的最新值位置，同一属性的旧值被标记为已消费
+static void sf_latest_update(uint32_t property_id, const sf_ref_t* ref)
+{
+    sf_latest_t* latest = sf_latest_find(property_id);
+
+    if (latest == NULL) {
+        // 表满时不再跟踪新的属性，这些属性的每个值都会保留
+        if (s_sf.latest_count == SF_LATEST) {
+            return;
+        }
+
+        latest = &s_sf.latest[s_sf.latest_count++];
+        latest->property_id = property_id;
+    } else if (sf_consume(&latest->ref)) {
+        s_sf.stats.pending--;
+        s_sf.stats.superseded++;
+    }
+
+    latest->ref = *ref;
+}
+
+// 擦除扇区并写入扇区头
+static int32_t sf_open_sector(uint32_t sector, uint32_t seq)
+{
+    sf_sector_t header = { .magic = SF_MAGIC, .seq = seq, .reserved = { 0xFFFFFFFF, 0xFFFFFFFF } };
+    uint32_t addr = sector * s_sf.config.flash.sector_size;
+
+    if (s_sf.config.flash.erase(s_sf.config.flash.ctx, addr, s_sf.config.flash.sector_size) != 0
+            || s_sf.config.flash.write(s_sf.config.flash.ctx, addr, &header, sizeof(header)) != 0) {
+        WELINK_LOGE("open sector %d fail", sector);
+        return -1;
+    }
+
+    s_sf.seqs[sector] = seq;
+
+    return 0;
+}
+
+// 环已满时回收最旧的扇区，其中未发送的记录计为丢弃
+static void sf_drop_oldest(void)
+{
+    sf_record_t rec;
+    sf_pos_t pos = s_sf.read;
+    uint32_t i = 0;
+
+    while (sf_read_record(pos, &rec)) {
+        if (rec.state == SF_STATE_PENDING) {
+            s_sf.stats.pending--;
+            s_sf.stats.dropped++;
+        }
+
+        pos.offset += sizeof(sf_record_t) + SF_ALIGN(rec.len);
+    }
+
+    for (i = 0; i < s_sf.latest_count;) {
+        if (s_sf.latest[i].ref.pos.sector == s_sf.read.sector) {
+            s_sf.latest[i] = s_sf.latest[--s_sf.latest_count];
+        } else {
+            i++;
+        }
+    }
+
+    // 正在重放的消息可能包含被回收的记录，放弃它的结果，剩余记录稍后重发
+    s_sf.inflight = false;
+    s_sf.recycled++;
+    s_sf.read.sector = sf_next(s_sf.read.sector);
+    s_sf.read.offset = sizeof(sf_sector_t);
+}
+
+// 调用前需持有mutex
+static int32_t sf_append_one(const txd_datapoint_t* datapoint)
+{
+    sf_record_t* rec = (sf_record_t*)s_sf.record;
+    sf_ref_t ref;
+    uint32_t size = sizeof(sf_record_t) + SF_ALIGN(datapoint->property_value_len);
+    uint32_t next = 0;
+
+    if (datapoint->property_value_len > WELINK_SF_MAX_BYTES
+            || (datapoint->property_value == NULL && datapoint->property_value_len != 0)) {
+        WELINK_LOGE("invalid datapoint: %d", datapoint->property_id);
+        return -1;
+    }
+
+    if (s_sf.write_off + size > s_sf.config.flash.sector_size) {
+        next = sf_next(s_sf.head);
+
+        if (next == s_sf.read.sector) {
+            if (s_sf.config.policy == ESP_WELINK_SF_DROP_NEWEST) {
+                s_sf.stats.dropped++;
+                return -1;
+            }
+
+            sf_drop_oldest();
+        }
+
+        if (sf_open_sector(next, s_sf.seqs[s_sf.head] + 1) != 0) {
+            return -1;
+        }
+
+        // 读位置停在写满的扇区末尾时直接移到新扇区
+        if (s_sf.read.sector == s_sf.head && s_sf.read.offset >= s_sf.write_off) {
+            s_sf.read.sector = next;
+            s_sf.read.offset = sizeof(sf_sector_t);
+        }
+
+        s_sf.head = next;
+        s_sf.write_off = sizeof(sf_sector_t);
+    }
+
+    memset(s_sf.record, 0xFF, size);
+    rec->state = SF_STATE_PENDING;
+    rec->property_id = datapoint->property_id;
+    rec->len = (uint16_t)datapoint->property_value_len;
+    rec->crc = sf_record_crc(datapoint->property_id, datapoint->property_value, datapoint->property_value_len);
+
+    if (datapoint->property_value_len != 0) {
+        memcpy(rec + 1, datapoint->property_value, datapoint->property_value_len);
+    }
+
+    ref.pos.sector = s_sf.head;
+    ref.pos.offset = s_sf.write_off;
+    ref.seq = s_sf.seqs[s_sf.head];
+
+    // 写失败时跳过这个扇区剩余的空间，避免在写了一半的位置继续追加
+    if (s_sf.config.flash.write(s_sf.config.flash.ctx, sf_addr(ref.pos), s_sf.record, size) != 0) {
+        WELINK_LOGE("write record fail");
+        s_sf.write_off = s_sf.config.flash.sector_size;
+        return -1;
+    }
+
+    s_sf.write_off += size;
+    s_sf.stats.appended++;
+    s_sf.stats.pending++;
+
+    if (s_sf.config.policy == ESP_WELINK_SF_LATEST_ONLY) {
+        sf_latest_update(datapoint->property_id, &ref);
+    }
+
+    return 0;
+}
+
+// 挂载时扫描一个扇区，统计未消费的记录并找到写入位置
+static void sf_scan_sector(uint32_t sector, bool* found_read)
+{
+    sf_record_t rec;
+    sf_ref_t ref;
+    uint32_t size = 0;
+
+    ref.pos.sector = sector;
+    ref.pos.offset = sizeof(sf_sector_t);
+    ref.seq = s_sf.seqs[sector];
+
+    for (;;) {
+        if (!sf_read_record(ref.pos, &rec)) {
+            if (rec.state != SF_STATE_ERASED) {
+                s_sf.stats.corrupted++;
+                ref.pos.offset = s_sf.config.flash.sector_size;
+            }
+
+            break;
+        }
+
+        size = sizeof(sf_record_t) + SF_ALIGN(rec.len);
+
+        if (rec.state == SF_STATE_PENDING) {
+            if (s_sf.config.flash.read(s_sf.config.flash.ctx, sf_addr(ref.pos) + sizeof(sf_record_t), s_sf.values, rec.len) != 0
+                    || sf_record_crc(rec.property_id, s_sf.values, rec.len) != rec.crc) {
+                // 写了一半的记录，标记为已消费后跳过
+                s_sf.stats.corrupted++;
+                sf_consume(&ref);
+            } else {
+                s_sf.stats.pending++;
+
+                if (!*found_read) {
+                    s_sf.read = ref.pos;
+                    *found_read = true;
+                }
+
+                if (s_sf.config.policy == ESP_WELINK_SF_LATEST_ONLY) {
+                    sf_latest_update(rec.property_id, &ref);
+                }
+            }
+        }
+
+        ref.pos.offset += size;
+    }
+
+    if (sector == s_sf.head) {
+        s_sf.write_off = ref.pos.offset;
+    }
+}
+
+static int32_t sf_mount(void)
+{
+    sf_sector_t header;
+    uint32_t sector = 0;
+    uint32_t tail = 0;
+    uint32_t prev = 0;
+    bool found = false;
+    bool found_read = false;
+
+    for (sector = 0; sector < s_sf.sector_count; sector++) {
+        if (s_sf.config.flash.read(s_sf.config.flash.ctx, sector * s_sf.config.flash.sector_size, &header, sizeof(header)) != 0) {
+            WELINK_LOGE("read sector %d fail", sector);
+            return -1;
+        }
+
+        s_sf.seqs[sector] = (header.magic == SF_MAGIC) ? header.seq : 0;
+
+        // seq从1开始，0表示未使用的扇区
+        if (s_sf.seqs[sector] != 0 && (!found || (int32_t)(s_sf.seqs[sector] - s_sf.seqs[s_sf.head]) > 0)) {
+            s_sf.head = sector;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        WELINK_LOGI("format store-and-forward log");
+        s_sf.head = 0;
+        s_sf.write_off = sizeof(sf_sector_t);
+        s_sf.read.sector = 0;
+        s_sf.read.offset = sizeof(sf_sector_t);
+        return sf_open_sector(0, 1);
+    }
+
+    // 从最新的扇区往回找seq连续的扇区，这一段就是上次使用中的环
+    for (tail = s_sf.head; ; tail = prev) {
+        prev = (tail + s_sf.sector_count - 1) % s_sf.sector_count;
+
+        if (prev == s_sf.head || s_sf.seqs[prev] == 0 || s_sf.seqs[prev] != s_sf.seqs[tail] - 1) {
+            break;
+        }
+    }
+
+    for (sector = tail; ; sector = sf_next(sector)) {
+        sf_scan_sector(sector, &found_read);
+
+        if (sector == s_sf.head) {
+            break;
+        }
+    }
+
+    if (!found_read) {
+        s_sf.read.sector = s_sf.head;
+        s_sf.read.offset = s_sf.write_off;
+    }
+
+    WELINK_LOGI("mount, pending: %d corrupted: %d", s_sf.stats.pending, s_sf.stats.corrupted);
+
+    return 0;
+}
+
+// 调用前需持有mutex，从读位置开始取出一条消息的记录，已消费的记录直接跳过
+static uint32_t sf_collect(void)
+{
+    sf_record_t rec;
+    sf_pos_t pos = s_sf.read;
+    uint32_t bytes = 0;
+    uint32_t count = 0;
+
+    while (count < WELINK_SF_MAX_POINTS) {
+        if (pos.sector == s_sf.head && pos.offset >= s_sf.write_off) {
+            break;
+        }
+
+        if (!sf_read_record(pos, &rec)) {
+            if (pos.sector == s_sf.head) {
+                break;
+            }
+
+            pos.sector = sf_next(pos.sector);
+            pos.offset = sizeof(sf_sector_t);
+        } else {
+            if (rec.state == SF_STATE_PENDING) {
+                if (bytes + rec.len > WELINK_SF_MAX_BYTES
+                        || s_sf.config.flash.read(s_sf.config.flash.ctx, sf_addr(pos) + sizeof(sf_record_t),
+                                                  s_sf.values + bytes, rec.len) != 0) {
+                    break;
+                }
+
+                s_sf.points[count].property_id = rec.property_id;
+                s_sf.points[count].property_value = s_sf.values + bytes;
+                s_sf.points[count].property_value_len = rec.len;
+                s_sf.sent[count].pos = pos;
+                s_sf.sent[count].seq = s_sf.seqs[pos.sector];
+                bytes += rec.len;
+                count++;
+            }
+
+            pos.offset += sizeof(sf_record_t) + SF_ALIGN(rec.len);
+        }
+
+        // 还没取到记录时，跳过的部分都已消费，读位置可以直接前移
+        if (count == 0) {
+            s_sf.read = pos;
+        }
+    }
+
+    s_sf.sent_count = count;
+    s_sf.sent_end = pos;
+    s_sf.sent_recycled = s_sf.recycled;
+
+    return count;
+}
+
+static void sf_send_cb(int32_t err_code, uint32_t cookie)
+{
+    txd_mutex_lock(s_sf.mutex);
+
+    // 结果交给定时器处理，标记记录需要写flash，不在SDK线程中进行
+    s_sf.result_valid = true;
+    s_sf.result_cookie = cookie;
+    s_sf.result_err = err_code;
+    txd_timer_start(s_sf.timer, 0, 0, 0);
+
+    txd_mutex_unlock(s_sf.mutex);
+}
+
+// 调用前需持有mutex，处理正在重放的消息，返回下一次需要处理的时间
+static uint32_t sf_complete(uint32_t now)
+{
+    uint32_t i = 0;
+
+    if (s_sf.result_valid && s_sf.result_cookie == s_sf.sent_cookie) {
+        s_sf.result_valid = false;
+        s_sf.inflight = false;
+
+        if (s_sf.result_err != err_success) {
+            WELINK_LOGW("replay fail: 0x%x", s_sf.result_err);
+            s_sf.stats.resent++;
+            return s_sf.config.replay_interval_ms;
+        }
+
+        for (i = 0; i < s_sf.sent_count; i++) {
+            if (sf_consume(&s_sf.sent[i])) {
+                s_sf.stats.pending--;
+                s_sf.stats.replayed++;
+            }
+        }
+
+        // 发送期间回收过扇区时sent_end可能已失效，已消费的记录留给下一次重放跳过
+        if (s_sf.sent_recycled == s_sf.recycled) {
+            s_sf.read = s_sf.sent_end;
+        }
+
+        return s_sf.config.replay_interval_ms;
+    }
+
+    if (now - s_sf.sent_ms >= s_sf.config.ack_timeout_ms) {
+        WELINK_LOGW("replay timeout, cookie: %d", s_sf.sent_cookie);
+        s_sf.inflight = false;
+        s_sf.stats.resent++;
+        return 0;
+    }
+
+    return s_sf.config.ack_timeout_ms - (now - s_sf.sent_ms);
+}
+
+// 在定时器回调中重放，同一时刻只有一条消息在等待发送结果
+static void sf_replay(void* arg)
+{
+    uint32_t cookie = 0;
+    uint32_t count = 0;
+    uint32_t wait = 0;
+    int32_t ret = 0;
+
+    txd_mutex_lock(s_sf.mutex);
+
+    if (s_sf.inflight) {
+        wait = sf_complete(txd_time_get_sysclock());
+
+        if (s_sf.inflight || wait != 0) {
+            txd_timer_start(s_sf.timer, wait, 0, 0);
+            txd_mutex_unlock(s_sf.mutex);
+            return;
+        }
+    }
+
+    count = (s_sf.online && s_sf.stats.pending != 0) ? sf_collect() : 0;
+
+    txd_mutex_unlock(s_sf.mutex);
+
+    if (count == 0) {
+        return;
+    }
+
+    // 发送时不持有mutex，SDK可能在发送函数中直接调用结果回调
+    ret = s_sf.config.report(s_sf.points, count, sf_send_cb, &cookie);
+
+    txd_mutex_lock(s_sf.mutex);
+
+    if (ret == err_success) {
+        s_sf.inflight = true;
+        s_sf.sent_cookie = cookie;
+        s_sf.sent_ms = txd_time_get_sysclock();
+        wait = (s_sf.result_valid && s_sf.result_cookie == cookie) ? 0 : s_sf.config.ack_timeout_ms;
+    } else {
+        WELINK_LOGW("replay send fail: 0x%x", ret);
+        s_sf.stats.resent++;
+        wait = s_sf.config.replay_interval_ms;
+    }
+
+    if (s_sf.online) {
+        txd_timer_start(s_sf.timer, wait, 0, 0);
+    }
+
+    txd_mutex_unlock(s_sf.mutex);
+
+    if (ret == err_success) {
+        esp_welink_socket_wakeup();
+    }
+}
+
+int32_t esp_welink_sf_partition_flash(esp_welink_sf_flash_t* flash, const char* label)
+{
+    const esp_partition_t* partition = NULL;
+
+    WELINK_ERROR_CHECK(flash == NULL || label == NULL, -1, "the parameter is incorrect");
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    WELINK_ERROR_CHECK(partition == NULL, -1, "partition %s not found", label);
+
+    flash->read = sf_partition_read;
+    flash->write = sf_partition_write;
+    flash->erase = sf_partition_erase;
+    flash->ctx = (void*)partition;
+    flash->size = partition->size - partition->size % SPI_FLASH_SEC_SIZE;
+    flash->sector_size = SPI_FLASH_SEC_SIZE;
+
+    return 0;
+}
+
+int32_t esp_welink_sf_init(const esp_welink_sf_config_t* config)
+{
+    esp_welink_sf_config_t config_default = ESP_WELINK_SF_CONFIG_DEFAULT();
+
+    if (s_sf.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    memset(&s_sf, 0, sizeof(s_sf));
+    s_sf.config = *config;
+    s_sf.config.report = config->report ? config->report : txd_report_datapoints;
+
+    if (s_sf.config.flash.read == NULL && esp_welink_sf_partition_flash(&s_sf.config.flash, WELINK_SF_PARTITION_LABEL) != 0) {
+        memset(&s_sf, 0, sizeof(s_sf));
+        return -1;
+    }
+
+    WELINK_ERROR_GOTO(s_sf.config.flash.sector_size < sizeof(sf_sector_t) + sizeof(sf_record_t) + WELINK_SF_MAX_BYTES
+                      || s_sf.config.flash.size / s_sf.config.flash.sector_size < 2
+                      || s_sf.config.replay_interval_ms == 0 || s_sf.config.ack_timeout_ms == 0,
+                      end, "invalid store-and-forward config");
+
+    s_sf.sector_count = s_sf.config.flash.size / s_sf.config.flash.sector_size;
+    s_sf.stats.sector_count = s_sf.sector_count;
+    s_sf.seqs = (uint32_t*)txd_malloc(sizeof(uint32_t) * s_sf.sector_count);
+    WELINK_ERROR_GOTO(s_sf.seqs == NULL, end, "malloc fail");
+
+    WELINK_ERROR_GOTO(sf_mount() != 0, end, "mount fail");
+
+    s_sf.timer = txd_timer_create(sf_replay, NULL);
+    WELINK_ERROR_GOTO(s_sf.timer == NULL, end, "create timer fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_sf.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_sf.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_sf.timer != NULL) {
+        txd_timer_destroy(s_sf.timer);
+    }
+
+    txd_free(s_sf.seqs);
+    memset(&s_sf, 0, sizeof(s_sf));
+
+    return -1;
+}
+
+int32_t esp_welink_sf_deinit(void)
+{
+    if (s_sf.mutex == NULL) {
+        return -1;
+    }
+
+    txd_timer_destroy(s_sf.timer);
+    txd_mutex_destroy(s_sf.mutex);
+    txd_free(s_sf.seqs);
+    memset(&s_sf, 0, sizeof(s_sf));
+
+    return 0;
+}
+
+int32_t esp_welink_sf_append(const txd_datapoint_t datapoints[], uint32_t datapoints_count)
+{
+    int32_t ret = 0;
+    uint32_t i = 0;
+
+    if (s_sf.mutex == NULL || datapoints == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_sf.mutex);
+
+    for (i = 0; i < datapoints_count; i++) {
+        if (sf_append_one(&datapoints[i]) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (s_sf.online && !s_sf.inflight) {
+        txd_timer_start(s_sf.timer, 0, 0, 0);
+    }
+
+    txd_mutex_unlock(s_sf.mutex);
+
+    return ret;
+}
+
+int32_t esp_welink_sf_report(txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                             on_send_datapoint pCb, uint32_t* pCookie)
+{
+    bool direct = false;
+    int32_t ret = 0;
+
+    if (s_sf.mutex == NULL || datapoints == NULL || datapoints_count == 0) {
+        WELINK_LOGE("the parameter is incorrect");
+        return err_invalid_param;
+    }
+
+    // 日志中还有数据时新数据也要进日志，保证上报顺序
+    txd_mutex_lock(s_sf.mutex);
+    direct = s_sf.online && s_sf.stats.pending == 0;
+    txd_mutex_unlock(s_sf.mutex);
+
+    if (direct) {
+        ret = s_sf.config.report(datapoints, datapoints_count, pCb, pCookie);
+
+        if (ret != err_not_connect_succ && ret != err_not_login_succ && ret != err_not_online_succ
+                && ret != err_msg_cache_failed && ret != err_msg_send_too_frequently) {
+            return ret;
+        }
+    }
+
+    if (pCookie != NULL) {
+        *pCookie = 0;
+    }
+
+    return (esp_welink_sf_append(datapoints, datapoints_count) == 0) ? err_success : err_msg_cache_failed;
+}
+
+void esp_welink_sf_set_online(int32_t status)
+{
+    if (s_sf.mutex == NULL) {
+        return;
+    }
+
+    txd_mutex_lock(s_sf.mutex);
+
+    s_sf.online = (status == 1);
+
+    if (s_sf.online) {
+        txd_timer_start(s_sf.timer, 0, 0, 0);
+    } else {
+        // 断线时正在重放的消息多半已丢失，上线后从读位置重新发送
+        s_sf.inflight = false;
+        s_sf.result_valid = false;
+        txd_timer_stop(s_sf.timer);
+    }
+
+    txd_mutex_unlock(s_sf.mutex);
+}
+
+int32_t esp_welink_sf_get_stats(esp_welink_sf_stats_t* stats)
+{
+    if (s_sf.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_sf.mutex);
+    memcpy(stats, &s_sf.stats, sizeof(esp_welink_sf_stats_t));
+    stats->used_sectors = (s_sf.head + s_sf.sector_count - s_sf.read.sector) % s_sf.sector_count + 1;
+    txd_mutex_unlock(s_sf.mutex);
+
+    return 0;
+}
@@ -0,0 +1,651 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "nvs.h"
+
+#include "esp_welink_log.h"
+#include "esp_welink_shadow.h"
+#include "esp_welink_socket.h"
+#include "txd_error.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_shadow";
+
+#define SHADOW_MAGIC        0x31485357  // "WSH1"
+#define SHADOW_NVS_KEY      "shadow"
+#define SHADOW_IDLE         0
+#define SHADOW_SENDING      1           // 正在调用上报函数，还没有拿到cookie
+#define SHADOW_INFLIGHT     2           // 等待发送结果
+
+typedef struct {
+    uint32_t property_id;
+    uint32_t value_len;
+    uint32_t version;                   // desired，取值每次变化加1
+    uint32_t reported_version;          // 服务器确认过的版本
+    uint32_t sent_version;
+    uint32_t sent_cookie;
+    uint32_t sent_ms;
+    uint8_t state;
+    bool selected;                      // 本次esp_welink_shadow_report还要上报
+    bool staged;                        // 已拷贝到当前上报的消息中
+} shadow_entry_t;
+
+// 快照格式：头部之后依次是每个属性的记录和取值
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+} shadow_snapshot_t;
+
+typedef struct {
+    uint32_t property_id;
+    uint32_t version;
+    uint32_t reported_version;
+    uint32_t value_len;
+} shadow_record_t;
+
+static struct {
+    esp_welink_shadow_config_t config;
+    shadow_entry_t* entries;
+    uint8_t* values;                    // max_entries * max_value_len
+    uint32_t count;                     // 属性只增不减，按加入的顺序存放
+    txd_datapoint_t datapoints[WELINK_SHADOW_MAX_POINTS];
+    uint8_t staging[WELINK_SHADOW_MAX_BYTES];
+    esp_welink_stash_t stash;           // 上报函数返回cookie之前就到达的结果
+    bool unsaved;
+    bool save_scheduled;
+    txd_mutex_handler_t* mutex;         // 保护条目和统计
+    txd_mutex_handler_t* report_mutex;  // 串行化上报，保护staging和datapoints
+    txd_timer_handler_t* timer;
+    esp_welink_shadow_stats_t stats;
+} s_shadow;
+
+#define SHADOW_VALUE(index) (s_shadow.values + (index) * s_shadow.config.max_value_len)
+
+// 调用前需持有mutex
+static int32_t shadow_find(uint32_t property_id)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < s_shadow.count; i++) {
+        if (s_shadow.entries[i].property_id == property_id) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// 调用前需持有mutex，找不到时加入新的属性，版本从1开始，未上报
+static int32_t shadow_insert(uint32_t property_id)
+{
+    int32_t index = shadow_find(property_id);
+
+    if (index >= 0 || s_shadow.count == s_shadow.config.max_entries) {
+        return index;
+    }
+
+    index = s_shadow.count++;
+    memset(&s_shadow.entries[index], 0, sizeof(shadow_entry_t));
+    s_shadow.entries[index].property_id = property_id;
+
+    return index;
+}
+
+// 调用前需持有mutex，标记快照需要保存，延迟一段时间写入，期间的多次修改合并为一次
+static void shadow_changed(void)
+{
+    s_shadow.unsaved = true;
+
+    if (s_shadow.timer != NULL && s_shadow.config.snapshot_delay_ms != 0 && !s_shadow.save_scheduled) {
+        s_shadow.save_scheduled = true;
+        txd_timer_start(s_shadow.timer, s_shadow.config.snapshot_delay_ms, 0, 0);
+    }
+}
+
+// 调用前需持有mutex，处理一个发送结果，找不到对应的属性时返回false
+static bool shadow_result(uint32_t cookie, int32_t err_code)
+{
+    shadow_entry_t* entry = NULL;
+    bool found = false;
+    uint32_t i = 0;
+
+    for (i = 0; i < s_shadow.count; i++) {
+        entry = &s_shadow.entries[i];
+
+        if (entry->state != SHADOW_INFLIGHT || entry->sent_cookie != cookie) {
+            continue;
+        }
+
+        entry->state = SHADOW_IDLE;
+        found = true;
+
+        // 发送期间收到命令时reported_version已经更新，不能回退
+        if (err_code == err_success && (int32_t)(entry->sent_version - entry->reported_version) > 0) {
+            entry->reported_version = entry->sent_version;
+            shadow_changed();
+        }
+    }
+
+    if (found && err_code != err_success) {
+        WELINK_LOGW("report fail: 0x%x, cookie: %d", err_code, cookie);
+        s_shadow.stats.send_errors++;
+    }
+
+    return found;
+}
+
+static void shadow_send_cb(int32_t err_code, uint32_t cookie)
+{
+    txd_mutex_lock(s_shadow.mutex);
+
+    // 上报函数可能在返回cookie之前就回调，先记下结果，拿到cookie后再处理
+    if (!shadow_result(cookie, err_code)) {
+        esp_welink_stash_put(&s_shadow.stash, cookie, err_code, txd_time_get_sysclock());
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    if (s_shadow.config.report_cb != NULL) {
+        s_shadow.config.report_cb(err_code, cookie);
+    }
+}
+
+// 选出本次要上报的属性，调用前需持有report_mutex
+static void shadow_select(bool full)
+{
+    shadow_entry_t* entry = NULL;
+    uint32_t now = txd_time_get_sysclock();
+    uint32_t i = 0;
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    for (i = 0; i < s_shadow.count; i++) {
+        entry = &s_shadow.entries[i];
+
+        // 当前版本已在发送中且未超时的不重复上报，full也一样
+        entry->selected = entry->state != SHADOW_SENDING
+                          && !(entry->state == SHADOW_INFLIGHT && entry->sent_version == entry->version
+                               && now - entry->sent_ms < s_shadow.config.ack_timeout_ms)
+                          && (full || entry->version != entry->reported_version);
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+}
+
+// 把选中的属性上报一条消息，调用前需持有report_mutex，返回1表示已发送，0表示选中的属性都已发送
+static int32_t shadow_send_message(void)
+{
+    shadow_entry_t* entry = NULL;
+    uint32_t now = txd_time_get_sysclock();
+    uint32_t cookie = 0;
+    uint32_t count = 0;
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+    int32_t err_code = 0;
+    int32_t ret = 0;
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    for (i = 0; i < s_shadow.count; i++) {
+        entry = &s_shadow.entries[i];
+        entry->staged = false;
+
+        // 放不下的留到下一条消息，同步到达的结果会把属性改回IDLE，不能据此再次选中
+        if (!entry->selected || count == WELINK_SHADOW_MAX_POINTS
+                || bytes + entry->value_len > WELINK_SHADOW_MAX_BYTES) {
+            continue;
+        }
+
+        memcpy(s_shadow.staging + bytes, SHADOW_VALUE(i), entry->value_len);
+        s_shadow.datapoints[count].property_id = entry->property_id;
+        s_shadow.datapoints[count].property_value = s_shadow.staging + bytes;
+        s_shadow.datapoints[count].property_value_len = entry->value_len;
+        s_shadow.datapoints[count].seq = 0;
+        s_shadow.datapoints[count].ret_code = 0;
+        entry->selected = false;
+        entry->staged = true;
+        entry->state = SHADOW_SENDING;
+        entry->sent_version = entry->version;
+        bytes += entry->value_len;
+        count++;
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // 发送时不持有mutex，SDK可能在上报函数中直接调用结果回调
+    ret = s_shadow.config.report(s_shadow.datapoints, count, shadow_send_cb, &cookie);
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    for (i = 0; i < s_shadow.count; i++) {
+        entry = &s_shadow.entries[i];
+
+        if (entry->staged && entry->state == SHADOW_SENDING) {
+            entry->state = (ret == err_success) ? SHADOW_INFLIGHT : SHADOW_IDLE;
+            entry->sent_cookie = cookie;
+            entry->sent_ms = now;
+        }
+    }
+
+    if (ret == err_success) {
+        if (esp_welink_stash_take(&s_shadow.stash, cookie, &err_code, NULL)) {
+            shadow_result(cookie, err_code);
+        }
+
+        s_shadow.stats.messages++;
+        s_shadow.stats.datapoints += count;
+    } else {
+        s_shadow.stats.send_errors++;
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    if (ret != err_success) {
+        WELINK_LOGW("report %d datapoints fail, ret: 0x%x", count, ret);
+        return -1;
+    }
+
+    esp_welink_socket_wakeup();
+
+    return 1;
+}
+
+static void shadow_load(void)
+{
+    shadow_snapshot_t* snapshot = NULL;
+    shadow_record_t record;
+    shadow_entry_t* entry = NULL;
+    nvs_handle handle;
+    size_t len = 0;
+    size_t offset = sizeof(shadow_snapshot_t);
+    uint32_t i = 0;
+    bool valid = false;
+
+    if (nvs_open(s_shadow.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        WELINK_LOGE("nvs open fail");
+        return;
+    }
+
+    if (nvs_get_blob(handle, SHADOW_NVS_KEY, NULL, &len) != ESP_OK || len < sizeof(shadow_snapshot_t)) {
+        WELINK_LOGI("no snapshot");
+        goto end;
+    }
+
+    snapshot = (shadow_snapshot_t*)txd_malloc(len);
+    WELINK_ERROR_GOTO(snapshot == NULL, end, "malloc fail");
+    WELINK_ERROR_GOTO(nvs_get_blob(handle, SHADOW_NVS_KEY, snapshot, &len) != ESP_OK, end, "read snapshot fail");
+    WELINK_ERROR_GOTO(snapshot->magic != SHADOW_MAGIC || snapshot->count > s_shadow.config.max_entries,
+                      end, "invalid snapshot");
+
+    // 记录不一定对齐，逐条拷贝出来再检查
+    for (i = 0; i < snapshot->count; i++) {
+        WELINK_ERROR_GOTO(offset + sizeof(shadow_record_t) > len, end, "truncated snapshot");
+        memcpy(&record, (uint8_t*)snapshot + offset, sizeof(shadow_record_t));
+        offset += sizeof(shadow_record_t);
+
+        WELINK_ERROR_GOTO(record.value_len > s_shadow.config.max_value_len || offset + record.value_len > len
+                          || shadow_find(record.property_id) >= 0, end, "invalid snapshot record");
+
+        entry = &s_shadow.entries[shadow_insert(record.property_id)];
+        entry->version = record.version;
+        entry->reported_version = record.reported_version;
+        entry->value_len = record.value_len;
+        memcpy(SHADOW_VALUE(s_shadow.count - 1), (uint8_t*)snapshot + offset, record.value_len);
+        offset += record.value_len;
+    }
+
+    WELINK_LOGI("load %d properties", s_shadow.count);
+    valid = true;
+
+end:
+
+    // 快照不完整时丢弃全部内容，不使用只恢复了一部分的状态
+    if (!valid) {
+        s_shadow.count = 0;
+    }
+
+    txd_free(snapshot);
+    nvs_close(handle);
+}
+
+static void shadow_timer_cb(void* arg)
+{
+    esp_welink_shadow_save();
+}
+
+int32_t esp_welink_shadow_init(const esp_welink_shadow_config_t* config)
+{
+    esp_welink_shadow_config_t config_default = ESP_WELINK_SHADOW_CONFIG_DEFAULT();
+    uint32_t max_entries = 0;
+
+    if (s_shadow.mutex != NULL) {
+        return 0;
+    }
+
+    config = config ? config : &config_default;
+    WELINK_ERROR_CHECK(config->max_entries == 0 || config->max_value_len == 0
+                       || config->max_value_len > WELINK_SHADOW_MAX_BYTES || config->ack_timeout_ms == 0,
+                       -1, "invalid shadow config");
+
+    memset(&s_shadow, 0, sizeof(s_shadow));
+    s_shadow.config = *config;
+    s_shadow.config.report = config->report ? config->report : txd_report_datapoints;
+    max_entries = config->max_entries;
+
+    s_shadow.entries = (shadow_entry_t*)txd_malloc(sizeof(shadow_entry_t) * max_entries);
+    s_shadow.values = (uint8_t*)txd_malloc(config->max_value_len * max_entries);
+    WELINK_ERROR_GOTO(s_shadow.entries == NULL || s_shadow.values == NULL, end, "malloc fail");
+
+    if (config->nvs_namespace != NULL) {
+        shadow_load();
+
+        s_shadow.timer = txd_timer_create(shadow_timer_cb, NULL);
+        WELINK_ERROR_GOTO(s_shadow.timer == NULL, end, "create timer fail");
+    }
+
+    s_shadow.report_mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_shadow.report_mutex == NULL, end, "create mutex fail");
+
+    // mutex最后创建，作为初始化完成的标志
+    s_shadow.mutex = txd_mutex_create();
+    WELINK_ERROR_GOTO(s_shadow.mutex == NULL, end, "create mutex fail");
+
+    return 0;
+
+end:
+
+    if (s_shadow.timer != NULL) {
+        txd_timer_destroy(s_shadow.timer);
+    }
+
+    if (s_shadow.report_mutex != NULL) {
+        txd_mutex_destroy(s_shadow.report_mutex);
+    }
+
+    txd_free(s_shadow.entries);
+    txd_free(s_shadow.values);
+    memset(&s_shadow, 0, sizeof(s_shadow));
+
+    return -1;
+}
+
+int32_t esp_welink_shadow_deinit(void)
+{
+    if (s_shadow.mutex == NULL) {
+        return -1;
+    }
+
+    if (s_shadow.timer != NULL) {
+        txd_timer_destroy(s_shadow.timer);
+    }
+
+    txd_mutex_destroy(s_shadow.report_mutex);
+    txd_mutex_destroy(s_shadow.mutex);
+    txd_free(s_shadow.entries);
+    txd_free(s_shadow.values);
+    memset(&s_shadow, 0, sizeof(s_shadow));
+
+    return 0;
+}
+
+// command为true时取值来自服务器，直接视为已上报
+static int32_t shadow_update(uint32_t property_id, const uint8_t* value, uint32_t value_len, bool command)
+{
+    shadow_entry_t* entry = NULL;
+    int32_t index = 0;
+    int32_t ret = 0;
+
+    if (s_shadow.mutex == NULL || (value == NULL && value_len != 0) || value_len > s_shadow.config.max_value_len) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    index = shadow_insert(property_id);
+
+    if (index < 0) {
+        txd_mutex_unlock(s_shadow.mutex);
+        WELINK_LOGW("shadow full, property_id: %d", property_id);
+        return -1;
+    }
+
+    entry = &s_shadow.entries[index];
+
+    if (entry->version != 0 && entry->value_len == value_len && memcmp(SHADOW_VALUE(index), value, value_len) == 0) {
+        ret = 1;
+    } else {
+        memcpy(SHADOW_VALUE(index), value, value_len);
+        entry->value_len = value_len;
+        entry->version++;
+    }
+
+    if (command) {
+        s_shadow.stats.commands++;
+
+        if (entry->reported_version != entry->version) {
+            entry->reported_version = entry->version;
+            ret = 0;
+        }
+    } else if (ret == 0) {
+        s_shadow.stats.sets++;
+    } else {
+        s_shadow.stats.unchanged++;
+    }
+
+    if (ret == 0) {
+        shadow_changed();
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    return ret;
+}
+
+int32_t esp_welink_shadow_set(uint32_t property_id, const uint8_t* value, uint32_t value_len)
+{
+    return shadow_update(property_id, value, value_len, false);
+}
+
+int32_t esp_welink_shadow_apply(const txd_datapoint_t* datapoint)
+{
+    if (datapoint == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    return (shadow_update(datapoint->property_id, datapoint->property_value, datapoint->property_value_len, true) < 0) ? -1 : 0;
+}
+
+int32_t esp_welink_shadow_get(uint32_t property_id, uint8_t* value, uint32_t* value_len,
+                              esp_welink_shadow_version_t* version)
+{
+    int32_t index = 0;
+
+    if (s_shadow.mutex == NULL || value_len == NULL || (value == NULL && *value_len != 0)) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    index = shadow_find(property_id);
+
+    if (index < 0 || s_shadow.entries[index].value_len > *value_len) {
+        txd_mutex_unlock(s_shadow.mutex);
+        return -1;
+    }
+
+    *value_len = s_shadow.entries[index].value_len;
+    memcpy(value, SHADOW_VALUE(index), *value_len);
+
+    if (version != NULL) {
+        version->desired = s_shadow.entries[index].version;
+        version->reported = s_shadow.entries[index].reported_version;
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    return 0;
+}
+
+int32_t esp_welink_shadow_report(bool full)
+{
+    int32_t count = 0;
+    int32_t ret = 0;
+
+    if (s_shadow.mutex == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_shadow.report_mutex);
+
+    // 开始时选定属性，每条消息至少带走一个且每个属性只上报一次，所以循环一定会结束
+    shadow_select(full);
+
+    while ((ret = shadow_send_message()) > 0) {
+        count++;
+    }
+
+    txd_mutex_unlock(s_shadow.report_mutex);
+
+    return (ret < 0) ? -1 : count;
+}
+
+int32_t esp_welink_shadow_save(void)
+{
+    shadow_snapshot_t* snapshot = NULL;
+    shadow_record_t record;
+    shadow_entry_t* entry = NULL;
+    nvs_handle handle;
+    uint32_t len = sizeof(shadow_snapshot_t);
+    uint32_t i = 0;
+    int32_t ret = -1;
+
+    if (s_shadow.mutex == NULL || s_shadow.config.nvs_namespace == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    s_shadow.save_scheduled = false;
+
+    if (!s_shadow.unsaved) {
+        txd_mutex_unlock(s_shadow.mutex);
+        return 0;
+    }
+
+    for (i = 0; i < s_shadow.count; i++) {
+        len += sizeof(shadow_record_t) + s_shadow.entries[i].value_len;
+    }
+
+    snapshot = (shadow_snapshot_t*)txd_malloc(len);
+
+    if (snapshot == NULL) {
+        txd_mutex_unlock(s_shadow.mutex);
+        WELINK_LOGE("malloc fail");
+        return -1;
+    }
+
+    // 在mutex中生成快照，写flash时不持有mutex，不阻塞应用读写属性
+    snapshot->magic = SHADOW_MAGIC;
+    snapshot->count = s_shadow.count;
+    len = sizeof(shadow_snapshot_t);
+
+    for (i = 0; i < s_shadow.count; i++) {
+        entry = &s_shadow.entries[i];
+        record.property_id = entry->property_id;
+        record.version = entry->version;
+        record.reported_version = entry->reported_version;
+        record.value_len = entry->value_len;
+        memcpy((uint8_t*)snapshot + len, &record, sizeof(shadow_record_t));
+        len += sizeof(shadow_record_t);
+        memcpy((uint8_t*)snapshot + len, SHADOW_VALUE(i), entry->value_len);
+        len += entry->value_len;
+    }
+
+    s_shadow.unsaved = false;
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    if (nvs_open(s_shadow.config.nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        WELINK_LOGE("nvs open fail");
+    } else {
+        if (nvs_set_blob(handle, SHADOW_NVS_KEY, snapshot, len) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+            WELINK_LOGE("write snapshot fail");
+        } else {
+            ret = 0;
+        }
+
+        nvs_close(handle);
+    }
+
+    txd_free(snapshot);
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    if (ret == 0) {
+        s_shadow.stats.saves++;
+    } else {
+        shadow_changed();
+    }
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    return ret;
+}
+
+int32_t esp_welink_shadow_get_stats(esp_welink_shadow_stats_t* stats)
+{
+    uint32_t i = 0;
+
+    if (s_shadow.mutex == NULL || stats == NULL) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_shadow.mutex);
+
+    s_shadow.stats.entries = s_shadow.count;
+    s_shadow.stats.dirty = 0;
+
+    for (i = 0; i < s_shadow.count; i++) {
+        if (s_shadow.entries[i].version != s_shadow.entries[i].reported_version) {
+            s_shadow.stats.dirty++;
+        }
+    }
+
+    memcpy(stats, &s_shadow.stats, sizeof(esp_welink_shadow_stats_t));
+
+    txd_mutex_unlock(s_shadow.mutex);
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+#include "esp_welink_log.h"
+#include "esp_welink_status.h"
+#include "txd_baseapi.h"
+#include "txd_thread.h"
+
+static const char* TAG = "esp_welink_status";
+
+#define STATUS_ONLINE_BIT   BIT0
+#define STATUS_OFFLINE_BIT  BIT1
+
+static EventGroupHandle_t s_status_event_group = NULL;
+static txd_mutex_handler_t* s_status_mutex = NULL;
+static esp_welink_status_stats_t s_status_stats;
+
+static TickType_t status_ms_to_ticks(uint32_t timeout_ms)
+{
+    if (timeout_ms == portMAX_DELAY) {
+        return portMAX_DELAY;
+    }
+
+    return (timeout_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+}
+
+int32_t esp_welink_status_init(void)
+{
+    if (s_status_event_group != NULL) {
+        return 0;
+    }
+
+    s_status_mutex = txd_mutex_create();
+    WELINK_ERROR_CHECK(s_status_mutex == NULL, -1, "create mutex fail");
+
+    s_status_event_group = xEventGroupCreate();
+
+    if (s_status_event_group == NULL) {
+        WELINK_LOGE("create event group fail");
+        txd_mutex_destroy(s_status_mutex);
+        s_status_mutex = NULL;
+        return -1;
+    }
+
+    memset(&s_status_stats, 0, sizeof(s_status_stats));
+    s_status_stats.last_change_ms = txd_time_get_sysclock();
+    xEventGroupSetBits(s_status_event_group, STATUS_OFFLINE_BIT);
+
+    return 0;
+}
+
+void esp_welink_status_update(int32_t status)
+{
+    uint32_t now = 0;
+    uint32_t elapsed = 0;
+
+    if (s_status_event_group == NULL) {
+        WELINK_LOGE("status is not initialized");
+        return;
+    }
+
+    status = (status == 1) ? 1 : 0;
+    now = txd_time_get_sysclock();
+
+    txd_mutex_lock(s_status_mutex);
+
+    if (status == s_status_stats.online) {
+        txd_mutex_unlock(s_status_mutex);
+        return;
+    }
+
+    elapsed = now - s_status_stats.last_change_ms;
+
+    if (s_status_stats.online) {
+        s_status_stats.online_ms += elapsed;
+    } else {
+        s_status_stats.offline_ms += elapsed;
+    }
+
+    if (status && (s_status_stats.first_online_ms == 0)) {
+        s_status_stats.first_online_ms = now;
+    }
+
+    s_status_stats.online = status;
+    s_status_stats.last_change_ms = now;
+    s_status_stats.transitions++;
+
+    txd_mutex_unlock(s_status_mutex);
+
+    // 先清除旧状态再设置新状态，等待方被唤醒时读到的一定是新状态
+    if (status) {
+        xEventGroupClearBits(s_status_event_group, STATUS_OFFLINE_BIT);
+        xEventGroupSetBits(s_status_event_group, STATUS_ONLINE_BIT);
+    } else {
+        xEventGroupClearBits(s_status_event_group, STATUS_ONLINE_BIT);
+        xEventGroupSetBits(s_status_event_group, STATUS_OFFLINE_BIT);
+    }
+
+    WELINK_LOGI("online status %d, transitions %d", status, s_status_stats.transitions);
+}
+
+int32_t esp_welink_status_wait_online(uint32_t timeout_ms)
+{
+    EventBits_t bits = 0;
+
+    WELINK_ERROR_CHECK(s_status_event_group == NULL, -1, "status is not initialized");
+
+    bits = xEventGroupWaitBits(s_status_event_group, STATUS_ONLINE_BIT, pdFALSE, pdTRUE, status_ms_to_ticks(timeout_ms));
+
+    return (bits & STATUS_ONLINE_BIT) ? 0 : -1;
+}
+
+int32_t esp_welink_status_wait_offline(uint32_t timeout_ms)
+{
+    EventBits_t bits = 0;
+
+    WELINK_ERROR_CHECK(s_status_event_group == NULL, -1, "status is not initialized");
+
+    bits = xEventGroupWaitBits(s_status_event_group, STATUS_OFFLINE_BIT, pdFALSE, pdTRUE, status_ms_to_ticks(timeout_ms));
+
+    return (bits & STATUS_OFFLINE_BIT) ? 0 : -1;
+}
+
+int32_t esp_welink_status_get_stats(esp_welink_status_stats_t* stats)
+{
+    uint32_t elapsed = 0;
+
+    WELINK_ERROR_CHECK(stats == NULL, -1, "the parameter is incorrect");
+    WELINK_ERROR_CHECK(s_status_event_group == NULL, -1, "status is not initialized");
+
+    txd_mutex_lock(s_status_mutex);
+    *stats = s_status_stats;
+    txd_mutex_unlock(s_status_mutex);
+
+    elapsed = txd_time_get_sysclock() - stats->last_change_ms;
+
+    if (stats->online) {
+        stats->online_ms += elapsed;
+    } else {
+        stats->offline_ms += elapsed;
+    }
+
+    return 0;
+}
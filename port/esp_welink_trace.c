@@ -0,0 +1,156 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "esp_welink_log.h"
+
+/*
+ * 每个埋点是一个静态的site，第一次记录时挂到全局链表上；
+ * 统计在临界区中更新，临界区很短（几次比较和加法），不会调用任何可能阻塞的接口，
+ * 所以可以用来统计txd_mutex_lock本身的耗时。
+ */
+static esp_welink_trace_site_t* s_trace_sites = NULL;
+
+#if CONFIG_TARGET_PLATFORM_ESP8266
+#define TRACE_LOCK()    portENTER_CRITICAL()
+#define TRACE_UNLOCK()  portEXIT_CRITICAL()
+#elif defined(_x86_)
+static bool s_trace_lock = false;
+#define TRACE_LOCK()    while (__atomic_test_and_set(&s_trace_lock, __ATOMIC_ACQUIRE))
+#define TRACE_UNLOCK()  __atomic_clear(&s_trace_lock, __ATOMIC_RELEASE)
+#else
+static portMUX_TYPE s_trace_mux = portMUX_INITIALIZER_UNLOCKED;
+#define TRACE_LOCK()    portENTER_CRITICAL(&s_trace_mux)
+#define TRACE_UNLOCK()  portEXIT_CRITICAL(&s_trace_mux)
+#endif
+
+void esp_welink_trace_end(esp_welink_trace_span_t* span)
+{
+    esp_welink_trace_site_t* site = span->site;
+    esp_welink_trace_stats_t* stats = NULL;
+    uint32_t ticks = 0;
+
+    if (site == NULL) {
+        return;
+    }
+
+#ifdef CONFIG_WELINK_TRACE
+    ticks = esp_welink_trace_now() - span->start;
+#endif
+    span->site = NULL;
+    stats = &site->stats;
+
+    TRACE_LOCK();
+
+    if (!site->registered) {
+        site->next = s_trace_sites;
+        s_trace_sites = site;
+        site->registered = true;
+    }
+
+    if (stats->count == 0 || ticks < stats->min) {
+        stats->min = ticks;
+    }
+
+    if (ticks > stats->max) {
+        stats->max = ticks;
+    }
+
+    stats->count++;
+    stats->sum += ticks;
+    stats->hist[31 - __builtin_clz(ticks | 1)]++;
+
+    TRACE_UNLOCK();
+}
+
+uint32_t esp_welink_trace_snapshot(esp_welink_trace_stats_t* stats, uint32_t max_count)
+{
+    esp_welink_trace_site_t* site = NULL;
+    uint32_t count = 0;
+
+    // 逐个site拷贝，每个site内的数据是一致的，不同site之间不保证是同一时刻
+    for (site = __atomic_load_n(&s_trace_sites, __ATOMIC_ACQUIRE); site != NULL; site = site->next, count++) {
+        if (stats != NULL && count < max_count) {
+            TRACE_LOCK();
+            memcpy(&stats[count], &site->stats, sizeof(esp_welink_trace_stats_t));
+            TRACE_UNLOCK();
+        }
+    }
+
+    return count;
+}
+
+void esp_welink_trace_reset(void)
+{
+    esp_welink_trace_site_t* site = NULL;
+    const char* name = NULL;
+
+    for (site = __atomic_load_n(&s_trace_sites, __ATOMIC_ACQUIRE); site != NULL; site = site->next) {
+        TRACE_LOCK();
+        name = site->stats.name;
+        memset(&site->stats, 0, sizeof(esp_welink_trace_stats_t));
+        site->stats.name = name;
+        TRACE_UNLOCK();
+    }
+}
+
+void esp_welink_trace_dump(void)
+{
+    esp_welink_trace_stats_t stats;
+    esp_welink_trace_site_t* site = NULL;
+    uint32_t i = 0;
+
+    printf("%-24s %10s %10s %10s %10s  (us)\n", "site", "count", "min", "avg", "max");
+
+    for (site = __atomic_load_n(&s_trace_sites, __ATOMIC_ACQUIRE); site != NULL; site = site->next) {
+        TRACE_LOCK();
+        memcpy(&stats, &site->stats, sizeof(esp_welink_trace_stats_t));
+        TRACE_UNLOCK();
+
+        if (stats.count == 0) {
+            continue;
+        }
+
+        printf("%-24s %10u %10u %10u %10u\n", stats.name, stats.count,
+               stats.min / WELINK_TRACE_TICKS_PER_US,
+               (uint32_t)(stats.sum / stats.count / WELINK_TRACE_TICKS_PER_US),
+               stats.max / WELINK_TRACE_TICKS_PER_US);
+
+        // 直方图只打印非空的桶，桶的下界换算成微秒
+        printf("    ");
+
+        for (i = 0; i < WELINK_TRACE_BUCKETS; i++) {
+            if (stats.hist[i] != 0) {
+                printf(" >=%uus:%u", (uint32_t)((1ULL << i) / WELINK_TRACE_TICKS_PER_US), stats.hist[i]);
+            }
+        }
+
+        printf("\n");
+    }
+}
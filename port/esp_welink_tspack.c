@@ -0,0 +1,169 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_welink_base64.h"
+#include "esp_welink_tspack.h"
+
+#define TSPACK_NO_WINDOW    0xFF
+
+// 按从高到低的顺序写入value的低nbits位，nbits不超过32
+static void tspack_put(esp_welink_tspack_t* pack, uint32_t value, uint32_t nbits)
+{
+    uint32_t room = 0;
+    uint32_t n = 0;
+
+    while (nbits != 0) {
+        room = 8 - (pack->bits & 7);
+        n = (nbits < room) ? nbits : room;
+        pack->buf[pack->bits >> 3] |= ((value >> (nbits - n)) & ((1U << n) - 1)) << (room - n);
+        pack->bits += n;
+        nbits -= n;
+    }
+}
+
+void esp_welink_tspack_init(esp_welink_tspack_t* pack, uint32_t max_len)
+{
+    max_len = (max_len > WELINK_TSPACK_MAX_LEN) ? WELINK_TSPACK_MAX_LEN : max_len;
+
+    memset(pack, 0, sizeof(esp_welink_tspack_t));
+    pack->capacity = max_len / 4 * 3 * 8;
+    pack->leading = TSPACK_NO_WINDOW;
+}
+
+int32_t esp_welink_tspack_add(esp_welink_tspack_t* pack, uint32_t timestamp_ms, int32_t value)
+{
+    int32_t delta = (int32_t)(timestamp_ms - pack->timestamp);
+    int32_t dod = (int32_t)((uint32_t)delta - (uint32_t)pack->delta);     // 与解码器一样按32位回绕
+    uint32_t x = (uint32_t)value ^ pack->value;
+    uint32_t ts_code = 0;
+    uint32_t ts_bits = 0;
+    uint32_t ts_extra = 0;          // '1111'之后的32位
+    uint32_t leading = 0;
+    uint32_t trailing = 0;
+    uint32_t length = 0;
+    uint32_t need = 0;
+
+    if (pack->count == 0) {
+        if (pack->capacity < WELINK_TSPACK_HEADER_BITS) {
+            return -1;
+        }
+
+        // version和count在finish时填写
+        pack->bits = 8 + 16;
+        tspack_put(pack, timestamp_ms, 32);
+        tspack_put(pack, (uint32_t)value, 32);
+        pack->timestamp = timestamp_ms;
+        pack->value = (uint32_t)value;
+        pack->count = 1;
+        return 0;
+    }
+
+    // 先算出需要的位数，放不下时不修改任何状态
+    if (dod == 0) {
+        ts_bits = 1;
+    } else if (dod >= -63 && dod <= 64) {
+        ts_code = (0x2 << 7) | (dod + 63);
+        ts_bits = 2 + 7;
+    } else if (dod >= -255 && dod <= 256) {
+        ts_code = (0x6 << 9) | (dod + 255);
+        ts_bits = 3 + 9;
+    } else if (dod >= -2047 && dod <= 2048) {
+        ts_code = (0xE << 12) | (dod + 2047);
+        ts_bits = 4 + 12;
+    } else {
+        ts_code = 0xF;
+        ts_bits = 4;
+        ts_extra = 32;
+    }
+
+    need = ts_bits + ts_extra + 1;
+
+    if (x != 0) {
+        leading = __builtin_clz(x);
+        trailing = __builtin_ctz(x);
+
+        // 有效位落在上一个窗口内时沿用窗口，否则写入新的窗口
+        if (pack->leading != TSPACK_NO_WINDOW && leading >= pack->leading && trailing >= pack->trailing) {
+            leading = pack->leading;
+            trailing = pack->trailing;
+            need += 1 + 32 - leading - trailing;
+        } else {
+            length = 32 - leading - trailing;
+            need += 1 + 5 + 5 + length;
+        }
+    }
+
+    if (pack->bits + need > pack->capacity || pack->count == 0xFFFF) {
+        return -1;
+    }
+
+    tspack_put(pack, ts_code, ts_bits);
+
+    if (ts_extra != 0) {
+        tspack_put(pack, (uint32_t)dod, 32);
+    }
+
+    if (x == 0) {
+        tspack_put(pack, 0, 1);
+    } else if (length == 0) {
+        tspack_put(pack, 0x2, 2);
+        tspack_put(pack, x >> trailing, 32 - leading - trailing);
+    } else {
+        tspack_put(pack, 0x3, 2);
+        tspack_put(pack, leading, 5);
+        tspack_put(pack, length - 1, 5);
+        tspack_put(pack, x >> trailing, length);
+        pack->leading = leading;
+        pack->trailing = trailing;
+    }
+
+    pack->timestamp = timestamp_ms;
+    pack->delta = delta;
+    pack->value = (uint32_t)value;
+    pack->count++;
+
+    return 0;
+}
+
+int32_t esp_welink_tspack_finish(esp_welink_tspack_t* pack, char* out, uint32_t size)
+{
+    uint32_t bytes = (pack->bits + 7) / 8;
+
+    if (pack->count == 0 || out == NULL || ESP_WELINK_BASE64_LEN(bytes) > size) {
+        return -1;
+    }
+
+    pack->buf[0] = WELINK_TSPACK_VERSION;
+    pack->buf[1] = pack->count >> 8;
+    pack->buf[2] = pack->count & 0xFF;
+
+    return esp_welink_base64_encode((uint8_t*)out, pack->buf, bytes);
+}
+
+uint32_t esp_welink_tspack_ratio(const esp_welink_tspack_t* pack)
+{
+    return (pack->bits == 0) ? 0 : (uint32_t)((uint64_t)pack->count * 64 * 100 / pack->bits);
+}
@@ -0,0 +1,202 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_AGG_H__
+#define __ESP_WELINK_AGG_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Windowed aggregation of sample streams
+ *
+ * Each stream folds its samples into panes of slide_ms. A window is the last window_ms / slide_ms
+ * panes: a tumbling window has one pane (slide_ms equal to window_ms), a sliding window several.
+ * A sample only updates the open pane, so the work per sample is constant. When a pane closes,
+ * the panes of the window are merged and the summary is emitted as one datapoint, e.g.
+ *
+ *     {"count":100,"min":21.5,"max":23.0,"mean":22.1,"last":22.4,"p90":22.8}
+ *
+ * The emit function defaults to esp_welink_batch_update(), so summaries of several streams are
+ * coalesced and packed into as few reports as possible; call esp_welink_batch_init() first. When several panes closed at once only
+ * the newest window is emitted, the batcher would keep only that one anyway.
+ *
+ * Samples are int32_t in fixed point with the decimals of the stream, like
+ * esp_welink_prop_encode_fixed(). Percentiles come from a histogram of WELINK_AGG_SKETCH_BUCKETS
+ * buckets per pane over [sketch_lo, sketch_hi], interpolated within the bucket, so their error is
+ * at most one bucket width. The memory of a stream is fixed when it is added.
+ *
+ * Windows close on a txd_timer even when no sample arrives, so txd_timer_service_start() or
+ * esp_welink_loop must be running.
+ */
+#define WELINK_AGG_MAX_PANES        16      /*!< Panes per window */
+#define WELINK_AGG_SKETCH_BUCKETS   32      /*!< Histogram buckets per pane for percentiles */
+#define WELINK_AGG_MAX_VALUE        160     /*!< Longest emitted summary */
+
+/**
+ * @brief Statistics of a window, combine with |
+ */
+typedef enum {
+    ESP_WELINK_AGG_COUNT = 1 << 0,
+    ESP_WELINK_AGG_MIN   = 1 << 1,
+    ESP_WELINK_AGG_MAX   = 1 << 2,
+    ESP_WELINK_AGG_MEAN  = 1 << 3,
+    ESP_WELINK_AGG_LAST  = 1 << 4,
+    ESP_WELINK_AGG_P50   = 1 << 5,      /*!< Percentiles need the sketch */
+    ESP_WELINK_AGG_P90   = 1 << 6,
+    ESP_WELINK_AGG_P99   = 1 << 7,
+} esp_welink_agg_stat_t;
+
+#define ESP_WELINK_AGG_BASIC        (ESP_WELINK_AGG_COUNT | ESP_WELINK_AGG_MIN | ESP_WELINK_AGG_MAX \
+                                     | ESP_WELINK_AGG_MEAN | ESP_WELINK_AGG_LAST)
+#define ESP_WELINK_AGG_PERCENTILES  (ESP_WELINK_AGG_P50 | ESP_WELINK_AGG_P90 | ESP_WELINK_AGG_P99)
+
+/**
+ * @brief Emit function, same as esp_welink_batch_update()
+ */
+typedef int32_t (*esp_welink_agg_emit_t)(uint32_t property_id, const uint8_t *value, uint32_t value_len);
+
+/**
+ * @brief Aggregation configuration
+ */
+typedef struct {
+    uint32_t max_streams;           /*!< Number of streams */
+    esp_welink_agg_emit_t emit;     /*!< Emit function, NULL for esp_welink_batch_update */
+} esp_welink_agg_config_t;
+
+#define ESP_WELINK_AGG_CONFIG_DEFAULT() { \
+        .max_streams = 8, \
+        .emit = NULL, \
+    }
+
+/**
+ * @brief Stream configuration
+ */
+typedef struct {
+    uint32_t property_id;           /*!< Property of the summaries */
+    uint32_t window_ms;             /*!< Window length */
+    uint32_t slide_ms;              /*!< Time between two summaries, window_ms must be a multiple, 0 for a tumbling window */
+    uint32_t stats;                 /*!< esp_welink_agg_stat_t flags in the summary */
+    uint8_t decimals;               /*!< Decimals of the samples */
+    int32_t sketch_lo;              /*!< Lowest sample of the percentile sketch, smaller samples count as sketch_lo */
+    int32_t sketch_hi;              /*!< Highest sample of the percentile sketch, larger samples count as sketch_hi */
+} esp_welink_agg_stream_config_t;
+
+#define ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(id) { \
+        .property_id = (id), \
+        .window_ms = 10000, \
+        .slide_ms = 0, \
+        .stats = ESP_WELINK_AGG_BASIC, \
+        .decimals = 0, \
+        .sketch_lo = 0, \
+        .sketch_hi = 0, \
+    }
+
+/**
+ * @brief Summary of a window
+ */
+typedef struct {
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int32_t mean;                   /*!< Rounded to the nearest sample unit */
+    int32_t last;
+    int32_t p50;                    /*!< Percentiles, sketch_lo when the stream has no sketch */
+    int32_t p90;
+    int32_t p99;
+} esp_welink_agg_summary_t;
+
+/**
+ * @brief Aggregation statistics
+ */
+typedef struct {
+    uint32_t samples;       /*!< Samples added */
+    uint32_t windows;       /*!< Summaries emitted */
+    uint32_t emit_errors;   /*!< Summaries rejected by the emit function */
+} esp_welink_agg_stats_t;
+
+/**
+ * @brief  Create the aggregation stage
+ *
+ * @param  config configuration, NULL for ESP_WELINK_AGG_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_agg_init(const esp_welink_agg_config_t *config);
+
+/**
+ * @brief  Delete the aggregation stage with its streams, windows not emitted yet are discarded
+ *
+ * @note   No other function of the module may run during the call
+ *
+ * @return 0 on success, -1 if the stage was not created
+ */
+int32_t esp_welink_agg_deinit(void);
+
+/**
+ * @brief  Add a stream, its first pane starts now
+ *
+ * @param  config stream configuration
+ *
+ * @return stream handle, -1 if the configuration is incorrect or there are max_streams streams
+ */
+int32_t esp_welink_agg_add_stream(const esp_welink_agg_stream_config_t *config);
+
+/**
+ * @brief  Add a sample to a stream
+ *
+ * @param  stream handle returned by esp_welink_agg_add_stream()
+ * @param  value sample in fixed point
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_agg_sample(int32_t stream, int32_t value);
+
+/**
+ * @brief  Summary of the window ending with the open pane, for local reads
+ *
+ * @param  stream handle returned by esp_welink_agg_add_stream()
+ * @param  summary output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_agg_get(int32_t stream, esp_welink_agg_summary_t *summary);
+
+/**
+ * @brief  Get the aggregation statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_agg_get_stats(esp_welink_agg_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_AGG_H__ */
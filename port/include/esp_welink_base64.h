@@ -0,0 +1,62 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_BASE64_H__
+#define __ESP_WELINK_BASE64_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Standard base64 (RFC 4648, with padding), for binary data in datapoint values
+ */
+#define ESP_WELINK_BASE64_LEN(len)  (((len) + 2) / 3 * 4)   /*!< Encoded length of len bytes */
+
+/**
+ * @brief  Encode to base64, out must hold ESP_WELINK_BASE64_LEN(len) bytes, no NUL is written
+ *
+ * @return encoded length
+ */
+uint32_t esp_welink_base64_encode(uint8_t *out, const uint8_t *in, uint32_t len);
+
+/**
+ * @brief  Decode base64
+ *
+ * @param  out output buffer
+ * @param  size size of out
+ * @param  in text, a multiple of 4 characters, '=' only as padding at the end
+ * @param  len length of in
+ *
+ * @return decoded length, -1 if the text is invalid or does not fit in size bytes
+ */
+int32_t esp_welink_base64_decode(uint8_t *out, uint32_t size, const uint8_t *in, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_BASE64_H__ */
@@ -0,0 +1,143 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_BATCH_H__
+#define __ESP_WELINK_BATCH_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Datapoint batcher
+ *
+ * Property updates are kept in a fixed pool until they are sent. A new value of a pending
+ * property replaces the old one (last write wins). A flush packs the pending values into as
+ * few txd_report_datapoints() calls as possible, each carrying at most WELINK_BATCH_MAX_BYTES
+ * of values (first-fit decreasing).
+ *
+ * A flush happens when:
+ *   - size:     the pending values fill one message, only the fullest message is sent
+ *   - deadline: max_delay_ms after the oldest pending update
+ *   - idle:     idle_ms after the last update
+ *   - manual:   esp_welink_batch_flush() is called
+ *
+ * The deadline and idle flushes run on a txd_timer, so txd_timer_service_start() or
+ * esp_welink_loop must be running. Values which fail to send stay pending and are retried
+ * WELINK_BATCH_RETRY_MS later.
+ */
+#define WELINK_BATCH_MAX_BYTES  480
+#define WELINK_BATCH_RETRY_MS   200
+
+/**
+ * @brief Batcher configuration
+ */
+typedef struct {
+    uint32_t max_entries;           /*!< Number of distinct properties that can be pending */
+    uint32_t max_value_len;         /*!< Longest property value, at most WELINK_BATCH_MAX_BYTES */
+    uint32_t max_delay_ms;          /*!< Longest time an update stays pending */
+    uint32_t idle_ms;               /*!< Flush when no update arrived for this long, 0 to disable */
+    esp_welink_report_t send;       /*!< Send function, NULL for txd_report_datapoints, esp_welink_sched_report to share the rate limit */
+    on_send_datapoint send_cb;      /*!< Result callback passed to the send function, may be NULL */
+} esp_welink_batch_config_t;
+
+#define ESP_WELINK_BATCH_CONFIG_DEFAULT() { \
+        .max_entries = 16, \
+        .max_value_len = 64, \
+        .max_delay_ms = 1000, \
+        .idle_ms = 100, \
+        .send = NULL, \
+        .send_cb = NULL, \
+    }
+
+/**
+ * @brief Batcher statistics
+ *
+ * The coalescing ratio is updates / datapoints, the average message fill is
+ * bytes / (messages * WELINK_BATCH_MAX_BYTES).
+ */
+typedef struct {
+    uint32_t updates;           /*!< Accepted esp_welink_batch_update() calls */
+    uint32_t coalesced;         /*!< Updates which replaced a pending value of the same property */
+    uint32_t dropped;           /*!< Updates rejected because the pool was full */
+    uint32_t datapoints;        /*!< Datapoints sent */
+    uint32_t messages;          /*!< Successful send calls */
+    uint32_t bytes;             /*!< Value bytes sent */
+    uint32_t send_errors;       /*!< Failed send calls, the values were kept */
+    uint32_t flush_size;        /*!< Flushes triggered by a full message */
+    uint32_t flush_deadline;    /*!< Flushes triggered by max_delay_ms */
+    uint32_t flush_idle;        /*!< Flushes triggered by idle_ms */
+    uint32_t flush_manual;      /*!< esp_welink_batch_flush() calls */
+} esp_welink_batch_stats_t;
+
+/**
+ * @brief  Create the batcher
+ *
+ * @param  config configuration, NULL for ESP_WELINK_BATCH_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_batch_init(const esp_welink_batch_config_t *config);
+
+/**
+ * @brief  Queue a property value, the value is copied
+ *
+ * @param  property_id property ID
+ * @param  value       property value
+ * @param  value_len   length of value, at most max_value_len
+ *
+ * @return 0 on success, -1 if the value is too long or the pool is full
+ */
+int32_t esp_welink_batch_update(uint32_t property_id, const uint8_t *value, uint32_t value_len);
+
+/**
+ * @brief  Send every pending value now
+ *
+ * @return number of messages sent, -1 if a send failed (the remaining values stay pending)
+ */
+int32_t esp_welink_batch_flush(void);
+
+/**
+ * @brief  Number of pending properties
+ */
+uint32_t esp_welink_batch_pending(void);
+
+/**
+ * @brief  Get the batcher statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_batch_get_stats(esp_welink_batch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_BATCH_H__ */
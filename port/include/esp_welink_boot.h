@@ -0,0 +1,154 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_BOOT_H__
+#define __ESP_WELINK_BOOT_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Boot phase tracer, time to online
+ *
+ * esp_welink_boot_mark() timestamps a milestone with esp_timer_get_time(), i.e. in microseconds
+ * since the application started (the ROM and second stage bootloader are not included). Only the
+ * first mark of a phase in a boot counts, so reconnects later do not move it. Marking is a single
+ * atomic compare-and-swap without a lock, so any task may mark, also while the boot completes, and
+ * it works before esp_welink_boot_init(), e.g. at the top of app_main().
+ *
+ * The boot is complete when ESP_WELINK_BOOT_FIRST_REPORT is marked, or complete_timeout_ms after
+ * ESP_WELINK_BOOT_ONLINE if nothing was sent. The record is then appended to the last
+ * `history` boots kept in NVS, the breakdown is printed on the console and reported as one
+ * datapoint, in milliseconds since start:
+ *
+ *     {"boot":12,"app_main":31.2,"nvs_init":48.9,...,"online":2731.5,"first_report":2802.0}
+ *
+ * Completion runs on a txd_timer, so txd_timer_service_start() or esp_welink_loop must be running.
+ */
+#define WELINK_BOOT_MAX_HISTORY     8       /*!< Boots kept in NVS */
+
+typedef enum {
+    ESP_WELINK_BOOT_APP_MAIN,       /*!< app_main() entered */
+    ESP_WELINK_BOOT_NVS_INIT,       /*!< nvs_flash_init() returned */
+    ESP_WELINK_BOOT_WIFI_START,     /*!< SYSTEM_EVENT_STA_START */
+    ESP_WELINK_BOOT_WIFI_CONNECTED, /*!< SYSTEM_EVENT_STA_CONNECTED, associated with the AP */
+    ESP_WELINK_BOOT_GOT_IP,         /*!< SYSTEM_EVENT_STA_GOT_IP */
+    ESP_WELINK_BOOT_TASK_START,     /*!< The welink task received the start message */
+    ESP_WELINK_BOOT_DEVICE_INFO,    /*!< txd_init_device_info() returned */
+    ESP_WELINK_BOOT_DNS,            /*!< Server name resolved */
+    ESP_WELINK_BOOT_TCP_CONNECT,    /*!< TCP connection established */
+    ESP_WELINK_BOOT_ONLINE,         /*!< on_online_status(1), the login finished */
+    ESP_WELINK_BOOT_FIRST_REPORT,   /*!< First report or ack confirmed by its send callback */
+    ESP_WELINK_BOOT_PHASE_MAX,
+} esp_welink_boot_phase_t;
+
+/**
+ * @brief Tracer configuration
+ */
+typedef struct {
+    uint32_t history;               /*!< Boots kept in NVS, at most WELINK_BOOT_MAX_HISTORY */
+    uint32_t property_id;           /*!< Property of the breakdown datapoint, 0 to not report */
+    uint32_t complete_timeout_ms;   /*!< Complete this long after online when nothing was confirmed */
+    esp_welink_report_t report;     /*!< Report function, NULL for txd_report_datapoints, esp_welink_sched_report to share the rate limit */
+    const char *nvs_namespace;      /*!< NVS namespace of the history */
+} esp_welink_boot_config_t;
+
+#define ESP_WELINK_BOOT_CONFIG_DEFAULT() { \
+        .history = WELINK_BOOT_MAX_HISTORY, \
+        .property_id = 0, \
+        .complete_timeout_ms = 10000, \
+        .report = NULL, \
+        .nvs_namespace = "welink_boot", \
+    }
+
+/**
+ * @brief One boot
+ */
+typedef struct {
+    uint32_t boot;                              /*!< Boot number, counts up from 1 */
+    uint32_t us[ESP_WELINK_BOOT_PHASE_MAX];     /*!< Time of each phase since start, 0 if not reached */
+} esp_welink_boot_record_t;
+
+/**
+ * @brief  Create the tracer
+ *
+ * @param  config configuration, NULL for ESP_WELINK_BOOT_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_boot_init(const esp_welink_boot_config_t *config);
+
+/**
+ * @brief  Delete the tracer and discard the marks, as a restart would, the history in NVS is kept
+ *
+ * @note   No other function of the module may run during the call
+ */
+void esp_welink_boot_deinit(void);
+
+/**
+ * @brief  Mark a phase of the current boot, later marks of the same phase are ignored
+ *
+ * @param  phase phase reached
+ */
+void esp_welink_boot_mark(esp_welink_boot_phase_t phase);
+
+/**
+ * @brief  Get the marks of the current boot, other tasks may mark at the same time
+ *
+ * @param  record output, boot is 0 as the number is assigned when the boot is saved
+ *
+ * @return 1 if the boot is complete and later marks are ignored, 0 if not, -1 on failure
+ */
+int32_t esp_welink_boot_get_current(esp_welink_boot_record_t *record);
+
+/**
+ * @brief  Name of a phase, the key used in the datapoint
+ */
+const char *esp_welink_boot_phase_name(esp_welink_boot_phase_t phase);
+
+/**
+ * @brief  Get the last boots from NVS, the current boot is included once complete
+ *
+ * @param  records output, oldest first
+ * @param  max_count size of records
+ *
+ * @return number of records, -1 on failure
+ */
+int32_t esp_welink_boot_get_history(esp_welink_boot_record_t *records, uint32_t max_count);
+
+/**
+ * @brief  Print the current boot and the history on the console
+ */
+void esp_welink_boot_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_BOOT_H__ */
@@ -0,0 +1,164 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_CHUNK_H__
+#define __ESP_WELINK_CHUNK_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Chunked transfer over datapoints
+ *
+ * A report carries at most 480 bytes, so larger buffers (diagnostic dumps, configuration blobs)
+ * are split into chunks sent on a reserved property. Each chunk is one datapoint of the form
+ *
+ *     <id>:<seq>:<count>:<len>:<crc32>:<base64 payload>
+ *
+ * where len and crc32 describe the whole buffer. All chunks but the last carry ceil(len / count)
+ * bytes, so the receiver can place a chunk without knowing the chunk size of the sender.
+ *
+ * The sender keeps up to `window` chunks in flight and tracks each of them by its cookie. A chunk
+ * whose send callback reports an error, or which gets no callback within ack_timeout_ms, is sent
+ * again; the chunks which were confirmed are not. The sending runs on a txd_timer, so
+ * txd_timer_service_start() or esp_welink_loop must be running.
+ *
+ * The receiver reassembles chunks arriving in any order, with duplicates, and calls rx_cb once
+ * the buffer is complete and its CRC matches. esp_welink_chunk_receive() has the signature of an
+ * esp_welink_dispatch handler.
+ */
+#define WELINK_CHUNK_MAX_CHUNKS     64      /*!< Chunks per transfer */
+#define WELINK_CHUNK_MAX_WINDOW     8       /*!< Largest window */
+#define WELINK_CHUNK_MAX_FRAME      480     /*!< Longest datapoint value, the txd_report_datapoints() limit */
+#define WELINK_CHUNK_MAX_HEADER     28      /*!< Longest "<id>:<seq>:<count>:<len>:<crc32>:" */
+
+#define ESP_WELINK_CHUNK_RET_INVALID    (-10)   /*!< ret_code of a malformed chunk */
+#define ESP_WELINK_CHUNK_RET_TOO_LARGE  (-11)   /*!< ret_code of a chunk of a buffer longer than rx_max_len */
+#define ESP_WELINK_CHUNK_RET_CRC        (-12)   /*!< ret_code of the last chunk when the buffer CRC does not match */
+
+/**
+ * @brief  Called once a transfer started with esp_welink_chunk_send() ended
+ *
+ * @param  id transfer id returned by esp_welink_chunk_send()
+ * @param  result 0 when every chunk was confirmed, -1 when a chunk failed max_retries times
+ * @param  arg argument passed to esp_welink_chunk_send()
+ */
+typedef void (*esp_welink_chunk_done_cb_t)(uint32_t id, int32_t result, void *arg);
+
+/**
+ * @brief  Called with a reassembled buffer, the buffer is only valid during the call
+ */
+typedef void (*esp_welink_chunk_rx_cb_t)(txd_uint64_t sender_id, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Chunked transfer configuration
+ */
+typedef struct {
+    uint32_t property_id;               /*!< Reserved property carrying the chunks */
+    uint32_t chunk_size;                /*!< Bytes per chunk, its base64 form and the header must fit in WELINK_CHUNK_MAX_FRAME */
+    uint32_t window;                    /*!< Chunks in flight, at most WELINK_CHUNK_MAX_WINDOW */
+    uint32_t interval_ms;               /*!< Shortest time between two sends, 200 matches the SDK limit of 5 per second */
+    uint32_t ack_timeout_ms;            /*!< Resend a chunk without send callback after this long */
+    uint32_t max_retries;               /*!< Resends of one chunk before the transfer fails */
+    uint32_t rx_max_len;                /*!< Longest received buffer, 0 disables the receiver */
+    esp_welink_report_t report;         /*!< Report function, NULL for txd_report_datapoints */
+    esp_welink_chunk_rx_cb_t rx_cb;     /*!< Called with each reassembled buffer */
+} esp_welink_chunk_config_t;
+
+#define ESP_WELINK_CHUNK_CONFIG_DEFAULT() { \
+        .property_id = 0, \
+        .chunk_size = 336, \
+        .window = 4, \
+        .interval_ms = 200, \
+        .ack_timeout_ms = 5000, \
+        .max_retries = 5, \
+        .rx_max_len = 2048, \
+        .report = NULL, \
+        .rx_cb = NULL, \
+    }
+
+/**
+ * @brief Chunked transfer statistics
+ */
+typedef struct {
+    uint32_t tx_transfers;      /*!< Transfers completed */
+    uint32_t tx_failed;         /*!< Transfers failed */
+    uint32_t tx_chunks;         /*!< Chunks confirmed */
+    uint32_t tx_resent;         /*!< Chunks sent again after an error or timeout */
+    uint32_t tx_throttled;      /*!< Sends rejected with err_msg_send_too_frequently or err_msg_cache_failed */
+    uint32_t rx_transfers;      /*!< Buffers reassembled */
+    uint32_t rx_chunks;         /*!< Chunks received, including duplicates */
+    uint32_t rx_duplicates;     /*!< Chunks received twice */
+    uint32_t rx_errors;         /*!< Malformed chunks, oversize buffers and CRC errors */
+} esp_welink_chunk_stats_t;
+
+/**
+ * @brief  Create the sender and, when rx_max_len is not 0, the receive buffer
+ *
+ * @param  config configuration
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_chunk_init(const esp_welink_chunk_config_t *config);
+
+/**
+ * @brief  Start sending a buffer, one transfer at a time
+ *
+ * @param  data buffer, not copied, it must stay valid until done_cb is called
+ * @param  len length, at most WELINK_CHUNK_MAX_CHUNKS * chunk_size
+ * @param  done_cb called when the transfer ended, may be NULL
+ * @param  arg argument of done_cb
+ *
+ * @return transfer id, -1 if a transfer is running or the parameters are incorrect
+ */
+int32_t esp_welink_chunk_send(const uint8_t *data, uint32_t len, esp_welink_chunk_done_cb_t done_cb, void *arg);
+
+/**
+ * @brief  Feed a received chunk, signature of an esp_welink_dispatch handler
+ *
+ * @note   Call it from one thread. The ack value is set to the chunk header
+ *
+ * @return 0 or ESP_WELINK_CHUNK_RET_*
+ */
+int32_t esp_welink_chunk_receive(txd_uint64_t sender_id, const txd_datapoint_t *datapoint, txd_datapoint_t *ack);
+
+/**
+ * @brief  Get the chunked transfer statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_chunk_get_stats(esp_welink_chunk_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_CHUNK_H__ */
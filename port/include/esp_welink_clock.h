@@ -0,0 +1,161 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_CLOCK_H__
+#define __ESP_WELINK_CLOCK_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Wall clock disciplined to the server time
+ *
+ * txd_get_server_time() has a resolution of one second, drifts with the local oscillator
+ * between logins and heartbeats and returns 0 before the first login. This component samples it
+ * every sync_interval_ms and when esp_welink_clock_sync() is called (e.g. when the device comes
+ * online), and keeps a millisecond wall clock on top of esp_timer_get_time().
+ *
+ * A sample polls the server time every poll_ms until the second changes, so its timing error is
+ * about poll_ms / 2 instead of a whole second. The last WELINK_CLOCK_MAX_SAMPLES samples are fitted
+ * with a least squares line: the slope is the drift of the oscillator and the intercept the
+ * offset. The fit averages out the sub-second phase of the server time, which changes at every
+ * resync of the SDK. The drift is estimated once the samples span min_drift_span_ms; before
+ * that the slope of the fit only places the clock, which would otherwise lag by half the drift
+ * over the span. A sample further than step_ms from the clock restarts the fit (a step).
+ * Otherwise the clock never goes backwards, it holds until it caught up.
+ *
+ * The drift and the current time are saved to NVS every save_interval_ms. After a reboot the
+ * clock continues from the saved time with the saved drift, so timestamps are available at once
+ * (state ESP_WELINK_CLOCK_ESTIMATED); they run behind by the time the device was off until the
+ * first sample.
+ *
+ * Sampling runs on a txd_timer, so txd_timer_service_start() or esp_welink_loop must be running.
+ */
+#define WELINK_CLOCK_MAX_SAMPLES    48      /*!< Samples in the fit */
+#define WELINK_CLOCK_RETRY_MS       10000   /*!< Time between samples until the first one succeeded */
+
+typedef enum {
+    ESP_WELINK_CLOCK_NONE,          /*!< No time known, esp_welink_clock_now_ms() returns 0 */
+    ESP_WELINK_CLOCK_ESTIMATED,     /*!< Continued from the time saved before the last reboot */
+    ESP_WELINK_CLOCK_SYNCED,        /*!< Disciplined to the server time */
+} esp_welink_clock_state_t;
+
+/**
+ * @brief Clock configuration
+ */
+typedef struct {
+    uint32_t sync_interval_ms;      /*!< Time between two samples */
+    uint32_t poll_ms;               /*!< Polling period while waiting for the server second to change */
+    uint32_t min_drift_span_ms;     /*!< Samples must span this long before the drift is estimated */
+    uint32_t max_drift_ppm;         /*!< Largest drift accepted, a crystal is within a few tens of ppm */
+    uint32_t step_ms;               /*!< A sample this far from the clock restarts the fit */
+    uint32_t save_interval_ms;      /*!< Time between two NVS saves, 0 to never save */
+    const char *nvs_namespace;      /*!< NVS namespace of the saved state */
+} esp_welink_clock_config_t;
+
+#define ESP_WELINK_CLOCK_CONFIG_DEFAULT() { \
+        .sync_interval_ms = 10 * 60 * 1000, \
+        .poll_ms = 10, \
+        .min_drift_span_ms = 4 * 60 * 60 * 1000, \
+        .max_drift_ppm = 500, \
+        .step_ms = 3000, \
+        .save_interval_ms = 10 * 60 * 1000, \
+        .nvs_namespace = "welink_clock", \
+    }
+
+/**
+ * @brief Clock statistics
+ */
+typedef struct {
+    esp_welink_clock_state_t state;
+    uint32_t samples;       /*!< Successful samples */
+    uint32_t misses;        /*!< Samples given up, the device was offline or the second did not change */
+    uint32_t steps;         /*!< Samples which restarted the fit */
+    uint32_t fit_samples;   /*!< Samples in the current fit */
+    int32_t drift_ppb;      /*!< Estimated drift in parts per billion, positive when the oscillator is slow */
+    int32_t last_error_ms;  /*!< Last sample minus the clock before it was applied */
+    uint32_t saves;         /*!< NVS saves */
+} esp_welink_clock_stats_t;
+
+/**
+ * @brief  Create the clock, load the saved state and schedule the first sample
+ *
+ * @param  config configuration, NULL for ESP_WELINK_CLOCK_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_clock_init(const esp_welink_clock_config_t *config);
+
+/**
+ * @brief  Delete the clock, the state saved in NVS is loaded by the next esp_welink_clock_init()
+ *
+ * @note   No other function of the module may run during the call
+ *
+ * @return 0 on success, -1 if the clock was not created
+ */
+int32_t esp_welink_clock_deinit(void);
+
+/**
+ * @brief  Take a sample now, e.g. when the device came online
+ *
+ * @return 0 if sampling started, -1 if the clock is not initialized or the device is not logged in
+ */
+int32_t esp_welink_clock_sync(void);
+
+/**
+ * @brief  Current wall clock time
+ *
+ * @return milliseconds since the Unix epoch, 0 in state ESP_WELINK_CLOCK_NONE
+ */
+uint64_t esp_welink_clock_now_ms(void);
+
+/**
+ * @brief  Current state of the clock
+ */
+esp_welink_clock_state_t esp_welink_clock_get_state(void);
+
+/**
+ * @brief  Save the drift and the current time to NVS now, e.g. before a planned restart
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_clock_save(void);
+
+/**
+ * @brief  Get the clock statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_clock_get_stats(esp_welink_clock_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_CLOCK_H__ */
@@ -0,0 +1,134 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_COOKIE_H__
+#define __ESP_WELINK_COOKIE_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Send completion tracker
+ *
+ * Records the submit time of every cookie returned by txd_report_datapoints(), txd_ack_datapoint()
+ * or esp_welink_sched_*() in a fixed-size open-addressing table. The completion gives the
+ * end-to-end latency, which is aggregated per class (chosen by the application, e.g. one class per
+ * group of properties) into a log2 histogram, together with error counts. Cookies which do not
+ * complete within the timeout are counted as lost.
+ *
+ * Only cookies passed to esp_welink_cookie_submit() should be completed. A completion which arrives
+ * before its submit is kept in a small stash; it is counted when the cookie is submitted, but as
+ * the send time is unknown it gives no latency sample.
+ */
+#define WELINK_COOKIE_SLOTS     64      /*!< Tracked cookies, power of two */
+#define WELINK_COOKIE_CLASSES   4
+#define WELINK_COOKIE_BUCKETS   16      /*!< hist[i] counts latencies in [2^i, 2^(i+1)) ms, hist[0] also counts 0 */
+
+/**
+ * @brief Statistics of one class
+ */
+typedef struct {
+    uint32_t submitted;                     /*!< Tracked cookies */
+    uint32_t completed;                     /*!< Completions with err_success and a latency sample */
+    uint32_t unmeasured;                    /*!< Completions with err_success which came before the submit */
+    uint32_t errors;                        /*!< Completions with an error code */
+    uint32_t lost;                          /*!< Cookies without completion after the timeout */
+    uint32_t untracked;                     /*!< Cookies not tracked because the table was full */
+    int32_t  last_error;                    /*!< Last error code */
+    uint32_t pending;                       /*!< Cookies waiting for completion */
+    uint32_t min_ms;                        /*!< Shortest successful latency */
+    uint32_t max_ms;                        /*!< Longest successful latency */
+    uint64_t sum_ms;                        /*!< Sum of successful latencies */
+    uint32_t hist[WELINK_COOKIE_BUCKETS];   /*!< Successful latency histogram */
+} esp_welink_cookie_stats_t;
+
+/**
+ * @brief  Create the tracker
+ *
+ * @param  timeout_ms a cookie without completion after this long is counted as lost
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_cookie_init(uint32_t timeout_ms);
+
+/**
+ * @brief  Start tracking a cookie
+ *
+ * @param  cookie cookie returned by the send function
+ * @param  cls    class, less than WELINK_COOKIE_CLASSES
+ *
+ * @return 0 on success, -1 if the table is full or the parameters are invalid
+ */
+int32_t esp_welink_cookie_submit(uint32_t cookie, uint32_t cls);
+
+/**
+ * @brief  Record a completion, same signature as on_send_datapoint so it can be called from it
+ *
+ * @param  err_code result of the send
+ * @param  cookie   cookie given to the callback
+ */
+void esp_welink_cookie_complete(int32_t err_code, uint32_t cookie);
+
+/**
+ * @brief  Count cookies older than the timeout as lost and remove them
+ *
+ * @note   Also done by esp_welink_cookie_submit() when the table is nearly full and by esp_welink_cookie_get_stats()
+ *
+ * @return number of cookies expired
+ */
+uint32_t esp_welink_cookie_expire(void);
+
+/**
+ * @brief  Get the statistics of a class
+ *
+ * @param  cls   class
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_cookie_get_stats(uint32_t cls, esp_welink_cookie_stats_t *stats);
+
+/**
+ * @brief  Latency percentile from the histogram, the upper bound of the bucket holding it
+ *
+ * @param  stats   statistics of a class
+ * @param  percent 1 to 100
+ *
+ * @return latency in milliseconds, 0 if there is no sample
+ */
+uint32_t esp_welink_cookie_percentile(const esp_welink_cookie_stats_t *stats, uint32_t percent);
+
+/**
+ * @brief  Clear the statistics of every class, tracked cookies are kept
+ */
+void esp_welink_cookie_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_COOKIE_H__ */
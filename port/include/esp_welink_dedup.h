@@ -0,0 +1,125 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_DEDUP_H__
+#define __ESP_WELINK_DEDUP_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Duplicate datapoint suppression
+ *
+ * The server retransmits a datapoint with the same seq when it did not get the ack in time.
+ * The cache remembers the last (sender, property_id, seq) tuples together with the ack that was
+ * sent, so a retransmission is answered with the cached ack instead of running the handler again.
+ * A retransmission which arrives while the handler is still running is dropped, the handler acks it.
+ *
+ * The cache is set associative: a tuple can only live in one set of WELINK_DEDUP_WAYS entries,
+ * the least recently used entry of the set is replaced. A lookup compares at most
+ * WELINK_DEDUP_WAYS entries, so it can run on the SDK callback thread. Entries older than
+ * WELINK_DEDUP_TTL_MS are ignored, the server may reuse a seq after that.
+ *
+ * esp_welink_dispatch() uses the cache once esp_welink_dedup_init() was called.
+ */
+#define WELINK_DEDUP_SETS       8       /*!< Number of sets, power of two */
+#define WELINK_DEDUP_WAYS       4       /*!< Entries per set */
+#define WELINK_DEDUP_TTL_MS     60000
+
+/**
+ * @brief Longest cached ack value, at most 255
+ *
+ * An ack that echoes the received value is always cached. The tuple of a longer ack is removed,
+ * so a retransmission of that datapoint runs the handler again instead of getting an empty ack.
+ */
+#ifdef CONFIG_WELINK_DEDUP_ACK_BYTES
+#define WELINK_DEDUP_ACK_BYTES  CONFIG_WELINK_DEDUP_ACK_BYTES
+#else
+#define WELINK_DEDUP_ACK_BYTES  48
+#endif
+
+typedef enum {
+    ESP_WELINK_DEDUP_NEW,           /*!< First time seen, run the handler and call esp_welink_dedup_complete() */
+    ESP_WELINK_DEDUP_REPLAY,        /*!< Duplicate, send the ack filled by esp_welink_dedup_check() */
+    ESP_WELINK_DEDUP_IN_PROGRESS,   /*!< Duplicate of a datapoint whose handler did not finish, drop it */
+} esp_welink_dedup_result_t;
+
+/**
+ * @brief Cache statistics
+ */
+typedef struct {
+    uint32_t lookups;           /*!< Datapoints checked */
+    uint32_t replays;           /*!< Duplicates answered with the cached ack */
+    uint32_t in_progress;       /*!< Duplicates dropped because the handler was still running */
+    uint32_t evictions;         /*!< Live entries replaced by a newer tuple */
+    uint32_t uncached_acks;     /*!< Acks too long to cache, a retransmission runs the handler again */
+} esp_welink_dedup_stats_t;
+
+/**
+ * @brief  Create the cache
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_dedup_init(void);
+
+/**
+ * @brief  Look up a received datapoint, a new tuple is inserted as in progress
+ *
+ * @param  sender_id sender of the datapoint
+ * @param  datapoint received datapoint
+ * @param  ack output, the ack to send for ESP_WELINK_DEDUP_REPLAY
+ * @param  ack_value buffer of WELINK_DEDUP_ACK_BYTES for the replayed ack value
+ *
+ * @return ESP_WELINK_DEDUP_NEW when the cache is not initialized
+ */
+esp_welink_dedup_result_t esp_welink_dedup_check(txd_uint64_t sender_id, const txd_datapoint_t *datapoint,
+                                                 txd_datapoint_t *ack, uint8_t *ack_value);
+
+/**
+ * @brief  Store the ack of a datapoint for which esp_welink_dedup_check() returned ESP_WELINK_DEDUP_NEW
+ *
+ * @param  sender_id sender of the datapoint
+ * @param  datapoint received datapoint
+ * @param  ack ack which was sent, NULL to remove the tuple so a retransmission runs the handler again
+ */
+void esp_welink_dedup_complete(txd_uint64_t sender_id, const txd_datapoint_t *datapoint, const txd_datapoint_t *ack);
+
+/**
+ * @brief  Get the cache statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_dedup_get_stats(esp_welink_dedup_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_DEDUP_H__ */
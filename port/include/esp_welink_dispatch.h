@@ -0,0 +1,170 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_DISPATCH_H__
+#define __ESP_WELINK_DISPATCH_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Datapoint dispatcher
+ *
+ * Incoming datapoints are routed to a handler by property_id. The application provides a const
+ * table sorted by property_id, which is looked up with a binary search, so dispatching does not
+ * allocate memory and costs O(log n) comparisons.
+ *
+ * Inline handlers run on the SDK thread with a zero-copy view of the datapoint, the value is only
+ * valid until the handler returns. Deferred handlers run on a worker task: the datapoint is copied
+ * into a slot of a fixed pool and the SDK thread returns at once. When the pool is full or the
+ * value does not fit in a slot, the datapoint is acked with ESP_WELINK_DISPATCH_RET_BUSY.
+ *
+ * The dispatcher acks every datapoint after its handler returned, with the handler return value
+ * as ret_code. After esp_welink_dedup_init(), a retransmitted datapoint is answered with the cached
+ * ack and its handler does not run again. Pass esp_welink_dispatch() to txd_init_datapoint().
+ */
+#define ESP_WELINK_DISPATCH_RET_UNKNOWN     (-1)    /*!< ret_code of a property without handler */
+#define ESP_WELINK_DISPATCH_RET_BUSY        (-2)    /*!< ret_code of a deferred property which could not be queued */
+
+/**
+ * @brief  Property handler
+ *
+ * @param  sender_id sender of the datapoint
+ * @param  datapoint received datapoint, the value is not NUL terminated
+ * @param  ack ack to send, filled with the property_id, seq and value of the datapoint. The handler
+ *             may point property_value to its own buffer, it must stay valid after the handler returns
+ *
+ * @return ret_code of the ack
+ */
+typedef int32_t (*esp_welink_dispatch_handler_t)(txd_uint64_t sender_id, const txd_datapoint_t *datapoint,
+                                                 txd_datapoint_t *ack);
+
+/**
+ * @brief Ack function, same as txd_ack_datapoint()
+ */
+typedef int32_t (*esp_welink_dispatch_ack_t)(txd_datapoint_t *datapoint, on_send_datapoint pCb, uint32_t *pCookie);
+
+typedef enum {
+    ESP_WELINK_DISPATCH_INLINE,     /*!< Run on the SDK thread, the handler must not block */
+    ESP_WELINK_DISPATCH_DEFERRED,   /*!< Run on the worker task */
+} esp_welink_dispatch_mode_t;
+
+/**
+ * @brief Table entry, the table must be sorted by property_id without duplicates
+ */
+typedef struct {
+    uint32_t property_id;
+    esp_welink_dispatch_handler_t handler;
+    esp_welink_dispatch_mode_t mode;
+} esp_welink_dispatch_entry_t;
+
+#define ESP_WELINK_DISPATCH_ENTRY(id, fn, how) { .property_id = (id), .handler = (fn), .mode = (how) }
+
+/**
+ * @brief Dispatcher configuration
+ */
+typedef struct {
+    const esp_welink_dispatch_entry_t *table;       /*!< Handlers sorted by property_id */
+    uint32_t table_count;                           /*!< Number of entries in the table */
+    esp_welink_dispatch_handler_t default_handler;  /*!< Inline handler of properties not in the table, may be NULL */
+    esp_welink_dispatch_ack_t ack;                  /*!< Ack function, NULL for txd_ack_datapoint */
+    on_send_datapoint ack_cb;                       /*!< Result callback passed to the ack function, may be NULL */
+    uint32_t pool_size;                             /*!< Deferred datapoints waiting for the worker, 0 for no worker */
+    uint32_t max_value_len;                         /*!< Longest value of a deferred datapoint */
+    uint8_t worker_priority;                        /*!< Priority of the worker task */
+    uint32_t worker_stack_size;                     /*!< Stack size of the worker task in bytes */
+} esp_welink_dispatch_config_t;
+
+#define ESP_WELINK_DISPATCH_CONFIG_DEFAULT() { \
+        .table = NULL, \
+        .table_count = 0, \
+        .default_handler = NULL, \
+        .ack = NULL, \
+        .ack_cb = NULL, \
+        .pool_size = 4, \
+        .max_value_len = 256, \
+        .worker_priority = 5, \
+        .worker_stack_size = 1024 * 3, \
+    }
+
+/**
+ * @brief Dispatcher statistics
+ */
+typedef struct {
+    uint32_t received;      /*!< Datapoints passed to esp_welink_dispatch() */
+    uint32_t inline_runs;   /*!< Handlers run on the SDK thread */
+    uint32_t deferred_runs; /*!< Handlers run on the worker task */
+    uint32_t unknown;       /*!< Datapoints without handler */
+    uint32_t busy;          /*!< Deferred datapoints rejected, the pool was full or the value too long */
+    uint32_t ack_failed;    /*!< Acks rejected by the ack function */
+    uint32_t max_queued;    /*!< Highest number of datapoints waiting for the worker */
+} esp_welink_dispatch_stats_t;
+
+/**
+ * @brief  Create the dispatcher and its worker task
+ *
+ * @param  config configuration, the table is not copied and must stay valid
+ *
+ * @return 0 on success, -1 on failure, e.g. the table is not sorted
+ */
+int32_t esp_welink_dispatch_init(const esp_welink_dispatch_config_t *config);
+
+/**
+ * @brief  Dispatch a received datapoint, same signature as on_receive_datapoint
+ *
+ * @param  u64SenderId sender of the datapoint
+ * @param  datapoint received datapoint
+ */
+void esp_welink_dispatch(txd_uint64_t u64SenderId, txd_datapoint_t *datapoint);
+
+/**
+ * @brief  Replace the default handler, e.g. when a gateway is started after the dispatcher
+ *
+ * @note   A datapoint being dispatched may still see the previous handler
+ *
+ * @param  handler inline handler of properties not in the table, NULL to ack them with
+ *                 ESP_WELINK_DISPATCH_RET_UNKNOWN
+ *
+ * @return 0 on success, -1 if the dispatcher was not created
+ */
+int32_t esp_welink_dispatch_set_default_handler(esp_welink_dispatch_handler_t handler);
+
+/**
+ * @brief  Get the dispatcher statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_dispatch_get_stats(esp_welink_dispatch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_DISPATCH_H__ */
@@ -0,0 +1,242 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_GW_H__
+#define __ESP_WELINK_GW_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Gateway multiplexing of sub-devices
+ *
+ * A hub bridges many sub-devices (BLE, RS-485, ...) over its own Welink identity. Every
+ * sub-device gets a slot and its properties are mapped into the property_id space of the hub:
+ *
+ *     property_id = base_id + (slot << id_bits) + local_id
+ *
+ * local_id WELINK_GW_ADDR_PROPERTY is reserved: when a sub-device is added, its address is
+ * reported on it as 16 hex digits, so the cloud can build the slot to address mapping table.
+ * The application keeps the slot of a sub-device stable, e.g. by storing it with the pairing.
+ *
+ * Each sub-device has a txd_ringbuf for its reports, so the bridge task of a sub-device queues
+ * without locks. A txd_timer drains the queues every interval_ms into one message of at most
+ * WELINK_GW_MAX_BYTES, picking the datapoints with deficit round robin: every sub-device with
+ * queued reports earns `quantum` bytes per round, so a chatty sub-device gets the same share
+ * of the link as a quiet one and cannot starve it. A message which fails to send is sent again
+ * on the next tick, so txd_timer_service_start() or esp_welink_loop must be running.
+ *
+ * The gateway packs its own messages instead of going through esp_welink_batch: a sub-device
+ * report is an event which has to arrive once and in order, while the batcher keeps only the last
+ * value of a property and packs first-fit decreasing, which reorders reports of different sizes.
+ * Use esp_welink_batch (or esp_welink_agg) for state of the hub itself.
+ *
+ * Incoming datapoints of a slot are copied into the receive txd_ringbuf of the sub-device, its
+ * bridge task reads them with esp_welink_gw_poll(). esp_welink_gw_receive() has the signature
+ * of an esp_welink_dispatch handler, use it as the default_handler of the dispatcher.
+ */
+#define WELINK_GW_MAX_BYTES         480     /*!< Value bytes per message, the txd_report_datapoints() limit */
+#define WELINK_GW_MAX_DATAPOINTS    32      /*!< Datapoints per message */
+#define WELINK_GW_ADDR_PROPERTY     0       /*!< local_id carrying the address of a sub-device */
+#define WELINK_GW_SLOT_ANY          (-1)    /*!< Let esp_welink_gw_add() pick the lowest free slot */
+
+#define ESP_WELINK_GW_RET_UNKNOWN   (-1)    /*!< ret_code of a datapoint for an unused slot */
+#define ESP_WELINK_GW_RET_BUSY      (-2)    /*!< ret_code of a datapoint which could not be queued */
+
+/**
+ * @brief  Called on the SDK thread after a datapoint was queued for a sub-device, must not block
+ *
+ * @param  handle handle of the sub-device
+ * @param  arg argument passed to esp_welink_gw_add()
+ */
+typedef void (*esp_welink_gw_notify_t)(int32_t handle, void *arg);
+
+/**
+ * @brief Gateway configuration
+ */
+typedef struct {
+    uint32_t base_id;               /*!< property_id of local_id 0 of slot 0 */
+    uint32_t id_bits;               /*!< Bits of local_id, a sub-device has 1 << id_bits properties */
+    uint32_t max_devices;           /*!< Number of slots */
+    uint32_t max_value_len;         /*!< Longest value of a sub-device datapoint */
+    uint32_t tx_queue_len;          /*!< Reports queued per sub-device */
+    uint32_t rx_queue_len;          /*!< Received datapoints queued per sub-device */
+    uint32_t quantum;               /*!< Bytes a sub-device may send per round, at least max_value_len */
+    uint32_t interval_ms;           /*!< Time between two messages */
+    esp_welink_report_t report;     /*!< Report function, NULL for txd_report_datapoints, esp_welink_sched_report to share the rate limit */
+    on_send_datapoint send_cb;      /*!< Result callback passed to the report function, may be NULL */
+} esp_welink_gw_config_t;
+
+#define ESP_WELINK_GW_CONFIG_DEFAULT() { \
+        .base_id = 0x10000, \
+        .id_bits = 8, \
+        .max_devices = 16, \
+        .max_value_len = 64, \
+        .tx_queue_len = 8, \
+        .rx_queue_len = 2, \
+        .quantum = 64, \
+        .interval_ms = 200, \
+        .report = NULL, \
+        .send_cb = NULL, \
+    }
+
+/**
+ * @brief Gateway statistics
+ */
+typedef struct {
+    uint32_t devices;       /*!< Sub-devices added */
+    uint32_t reports;       /*!< Reports queued by esp_welink_gw_report() */
+    uint32_t queue_full;    /*!< Reports rejected because the queue of the sub-device was full */
+    uint32_t datapoints;    /*!< Datapoints sent */
+    uint32_t messages;      /*!< Successful report calls */
+    uint32_t bytes;         /*!< Value bytes sent */
+    uint32_t send_errors;   /*!< Failed report calls, the message is sent again */
+    uint32_t received;      /*!< Datapoints passed to esp_welink_gw_receive() */
+    uint32_t rx_busy;       /*!< Received datapoints rejected, the queue was full or the value too long */
+    uint32_t rx_unknown;    /*!< Received datapoints for an unused slot */
+} esp_welink_gw_stats_t;
+
+/**
+ * @brief Statistics of one sub-device
+ */
+typedef struct {
+    uint64_t addr;          /*!< Address passed to esp_welink_gw_add() */
+    uint32_t queued;        /*!< Reports waiting in the queue */
+    uint32_t sent;          /*!< Datapoints sent */
+    uint32_t bytes;         /*!< Value bytes sent */
+    uint32_t dropped;       /*!< Reports rejected because the queue was full */
+    uint32_t received;      /*!< Datapoints queued for esp_welink_gw_poll() */
+} esp_welink_gw_device_stats_t;
+
+/**
+ * @brief  Create the gateway
+ *
+ * @param  config configuration, NULL for ESP_WELINK_GW_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_gw_init(const esp_welink_gw_config_t *config);
+
+/**
+ * @brief  Add a sub-device and queue the report of its address
+ *
+ * @param  addr   address of the sub-device, e.g. a BLE MAC or an RS-485 station
+ * @param  slot   slot of the sub-device, WELINK_GW_SLOT_ANY for the lowest free slot
+ * @param  notify called when a datapoint for the sub-device was received, may be NULL
+ * @param  arg    argument of notify
+ *
+ * @return handle (the slot) on success, -1 if the slot is used, the address is already added or
+ *         no memory is left
+ */
+int32_t esp_welink_gw_add(uint64_t addr, int32_t slot, esp_welink_gw_notify_t notify, void *arg);
+
+/**
+ * @brief  Remove a sub-device, its queued reports are discarded
+ *
+ * @note   The bridge task of the sub-device must have stopped using the handle
+ *
+ * @param  handle handle returned by esp_welink_gw_add()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_gw_remove(int32_t handle);
+
+/**
+ * @brief  Find the handle of a sub-device
+ *
+ * @param  addr address passed to esp_welink_gw_add()
+ *
+ * @return handle, -1 if the address was not added
+ */
+int32_t esp_welink_gw_find(uint64_t addr);
+
+/**
+ * @brief  Queue a report of a sub-device property, the value is copied
+ *
+ * @note   Lock free. Only one task may report for a given sub-device
+ *
+ * @param  handle    handle returned by esp_welink_gw_add()
+ * @param  local_id  property of the sub-device, 1 to (1 << id_bits) - 1
+ * @param  value     property value
+ * @param  value_len length of value, at most max_value_len
+ *
+ * @return 0 on success, -1 if a parameter is invalid or the queue is full
+ */
+int32_t esp_welink_gw_report(int32_t handle, uint32_t local_id, const uint8_t *value, uint32_t value_len);
+
+/**
+ * @brief  Read a datapoint received for a sub-device
+ *
+ * @note   Only one task may poll a given sub-device
+ *
+ * @param  handle    handle returned by esp_welink_gw_add()
+ * @param  local_id  output, property of the sub-device
+ * @param  value     output buffer of *value_len bytes
+ * @param  value_len input: size of value, output: length of the value
+ *
+ * @return 1 if a datapoint was read, 0 if none is queued, -1 on failure, e.g. value is too small
+ *         (the datapoint is dropped)
+ */
+int32_t esp_welink_gw_poll(int32_t handle, uint32_t *local_id, uint8_t *value, uint32_t *value_len);
+
+/**
+ * @brief  Queue a received datapoint for its sub-device, an esp_welink_dispatch handler
+ *
+ * @param  sender_id sender of the datapoint
+ * @param  datapoint received datapoint
+ * @param  ack ack to send
+ *
+ * @return 0 when queued, ESP_WELINK_GW_RET_UNKNOWN or ESP_WELINK_GW_RET_BUSY otherwise
+ */
+int32_t esp_welink_gw_receive(txd_uint64_t sender_id, const txd_datapoint_t *datapoint, txd_datapoint_t *ack);
+
+/**
+ * @brief  Get the gateway statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_gw_get_stats(esp_welink_gw_stats_t *stats);
+
+/**
+ * @brief  Get the statistics of a sub-device
+ *
+ * @param  handle handle returned by esp_welink_gw_add()
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_gw_get_device_stats(int32_t handle, esp_welink_gw_device_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_GW_H__ */
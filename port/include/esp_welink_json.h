@@ -0,0 +1,186 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_JSON_H__
+#define __ESP_WELINK_JSON_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief JSON tokenizer and writer without heap
+ *
+ * esp_welink_json_parse() validates a JSON text in place and fills a caller-provided token array
+ * (jsmn style): each token records the type and the byte range of a value, nothing is copied or
+ * allocated. The parser is iterative, nesting depth only costs tokens, not stack.
+ *
+ * Tokens are in document order. An object token is followed by its keys, each key (a string
+ * token with size 1) is followed by its value. Use the accessors to look up keys and convert values.
+ *
+ * The writer formats a reply into a caller buffer, commas and string escapes are handled by the
+ * writer. A buffer overflow is reported once by esp_welink_json_writer_finish().
+ */
+#define ESP_WELINK_JSON_ERR_NOMEM       (-1)    /*!< More tokens than max_tokens */
+#define ESP_WELINK_JSON_ERR_INVALID     (-2)    /*!< Not valid JSON */
+#define ESP_WELINK_JSON_ERR_PARTIAL     (-3)    /*!< The text ended inside a value */
+
+#define ESP_WELINK_JSON_MAX_LEN         0xFFFF  /*!< Longest text accepted by the parser */
+#define ESP_WELINK_JSON_WRITER_DEPTH    32      /*!< Deepest nesting of the writer */
+
+typedef enum {
+    ESP_WELINK_JSON_OBJECT = 1,
+    ESP_WELINK_JSON_ARRAY,
+    ESP_WELINK_JSON_STRING,         /*!< The range excludes the quotes, escapes are not decoded */
+    ESP_WELINK_JSON_PRIMITIVE,      /*!< Number, true, false or null */
+} esp_welink_json_type_t;
+
+/**
+ * @brief Token, the value is js[start, end)
+ */
+typedef struct {
+    uint8_t type;                   /*!< esp_welink_json_type_t */
+    uint16_t start;
+    uint16_t end;
+    uint16_t size;                  /*!< Keys of an object, elements of an array, 1 for a key */
+    int16_t parent;                 /*!< Index of the enclosing object key or array, -1 at the top */
+} esp_welink_json_token_t;
+
+/**
+ * @brief Writer state
+ */
+typedef struct {
+    char *buf;
+    uint32_t size;
+    uint32_t len;
+    uint32_t depth;
+    uint32_t has_items;             /*!< Bit n is set when the container at depth n has an item */
+    bool error;                     /*!< Overflow or unbalanced containers */
+} esp_welink_json_writer_t;
+
+/**
+ * @brief  Tokenize a JSON text
+ *
+ * @param  js text, need not be NUL terminated
+ * @param  len length of the text, at most ESP_WELINK_JSON_MAX_LEN
+ * @param  tokens output token array
+ * @param  max_tokens number of tokens in the array
+ *
+ * @return number of tokens, or ESP_WELINK_JSON_ERR_*
+ */
+int32_t esp_welink_json_parse(const char *js, uint32_t len, esp_welink_json_token_t *tokens, uint32_t max_tokens);
+
+/**
+ * @brief  Index of the token after the value at index, skipping its children
+ */
+int32_t esp_welink_json_next(const esp_welink_json_token_t *tokens, int32_t count, int32_t index);
+
+/**
+ * @brief  Look up a key of an object
+ *
+ * @param  js text
+ * @param  tokens tokens
+ * @param  count number of tokens
+ * @param  object index of the object token
+ * @param  key key, NUL terminated, compared without decoding escapes
+ *
+ * @return index of the value token, -1 if the key is not found
+ */
+int32_t esp_welink_json_find(const char *js, const esp_welink_json_token_t *tokens, int32_t count,
+                             int32_t object, const char *key);
+
+/**
+ * @brief  Element of an array
+ *
+ * @return index of the element token, -1 if the index is out of range
+ */
+int32_t esp_welink_json_array_get(const esp_welink_json_token_t *tokens, int32_t count, int32_t array, uint32_t index);
+
+/**
+ * @brief  Compare a string token with a NUL terminated string
+ *
+ * @return true if equal
+ */
+bool esp_welink_json_eq(const char *js, const esp_welink_json_token_t *token, const char *str);
+
+/**
+ * @brief  Convert an integer primitive
+ *
+ * @return 0 on success, -1 if the token is not an integer in the int32_t range
+ */
+int32_t esp_welink_json_get_int(const char *js, const esp_welink_json_token_t *token, int32_t *value);
+
+/**
+ * @brief  Convert a true or false primitive
+ *
+ * @return 0 on success, -1 if the token is not a boolean
+ */
+int32_t esp_welink_json_get_bool(const char *js, const esp_welink_json_token_t *token, bool *value);
+
+/**
+ * @brief  Copy a string token into a buffer and decode its escapes, \u escapes are written as UTF-8
+ *
+ * @param  out output, NUL terminated
+ * @param  size size of out
+ *
+ * @return length of the string, -1 if the token is not a string or out is too small
+ */
+int32_t esp_welink_json_get_string(const char *js, const esp_welink_json_token_t *token, char *out, uint32_t size);
+
+/**
+ * @brief  Start writing into buf
+ */
+void esp_welink_json_writer_init(esp_welink_json_writer_t *writer, char *buf, uint32_t size);
+
+/**
+ * @brief  Open an object or array, key is NULL at the top and inside arrays
+ */
+void esp_welink_json_write_object_begin(esp_welink_json_writer_t *writer, const char *key);
+void esp_welink_json_write_object_end(esp_welink_json_writer_t *writer);
+void esp_welink_json_write_array_begin(esp_welink_json_writer_t *writer, const char *key);
+void esp_welink_json_write_array_end(esp_welink_json_writer_t *writer);
+
+/**
+ * @brief  Write a member (key is not NULL) or an array element (key is NULL)
+ */
+void esp_welink_json_write_string(esp_welink_json_writer_t *writer, const char *key, const char *value, uint32_t len);
+void esp_welink_json_write_int(esp_welink_json_writer_t *writer, const char *key, int32_t value);
+void esp_welink_json_write_fixed(esp_welink_json_writer_t *writer, const char *key, int32_t value, uint8_t decimals);
+void esp_welink_json_write_bool(esp_welink_json_writer_t *writer, const char *key, bool value);
+void esp_welink_json_write_null(esp_welink_json_writer_t *writer, const char *key);
+
+/**
+ * @brief  Finish writing, the text is NUL terminated when there is room for it
+ *
+ * @return length of the text, -1 on overflow or unbalanced containers
+ */
+int32_t esp_welink_json_writer_finish(esp_welink_json_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_JSON_H__ */
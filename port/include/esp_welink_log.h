@@ -25,6 +25,9 @@
 #ifndef __ESP_WELINK_LOG_H__
 #define __ESP_WELINK_LOG_H__
 
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_log.h"
 #include "errno.h"
 
@@ -52,43 +55,399 @@ typedef enum {
 #define WELINK_LOCAL_LEVEL WELINK_LOG_NONE
 #endif
 
+/**
+ * @brief Log module
+ *
+ * WELINK_LOCAL_LEVEL is the highest level compiled in, each module also has a runtime level which
+ * can be changed without reflashing, see esp_welink_log_set_level(). A source file selects its
+ * module by defining WELINK_LOG_MODULE before including this header, the default is baseapi.
+ */
+typedef enum {
+    WELINK_LOG_MODULE_BASEAPI,   /*!< Port layer: socket, storage, system and the esp_welink_* helpers */
+    WELINK_LOG_MODULE_THREAD,    /*!< Thread, mutex, ringbuf and timer */
+    WELINK_LOG_MODULE_WIFI,      /*!< Wi-Fi connection */
+    WELINK_LOG_MODULE_OTA,       /*!< Firmware download and upgrade */
+    WELINK_LOG_MODULE_DATAPOINT, /*!< Datapoint report, receive and ack */
+    WELINK_LOG_MODULE_MAX,
+} WELINK_log_module_t;
+
+#ifndef WELINK_LOG_MODULE
+#define WELINK_LOG_MODULE WELINK_LOG_MODULE_BASEAPI
+#endif
+
+#ifdef CONFIG_WELINK_LOG_DEFAULT_LEVEL
+#define WELINK_LOG_DEFAULT_LEVEL CONFIG_WELINK_LOG_DEFAULT_LEVEL
+#else
+#define WELINK_LOG_DEFAULT_LEVEL WELINK_LOCAL_LEVEL
+#endif
+
+/**
+ * @brief Runtime level of each module, read by the WELINK_LOG* macros, use esp_welink_log_set_level() to change it
+ */
+extern uint8_t g_welink_log_level[WELINK_LOG_MODULE_MAX];
+
+/**
+ * @brief Runtime level check, a disabled line costs one load and one compare, its arguments are not evaluated
+ */
+#define WELINK_LOG_ENABLED(level) __builtin_expect(g_welink_log_level[WELINK_LOG_MODULE] >= (level), 0)
+
+/**
+ * @brief Binary log mode
+ *
+ * With CONFIG_WELINK_LOG_BINARY, WELINK_LOG* lines are not formatted on the device. The level, file,
+ * line and format string of each call site are concatenated at compile time into the non-loaded
+ * .welink_logfmt section, so they take no flash, and the offset of that string is the call site ID.
+ * A log call only stores the ID, a millisecond timestamp and the raw 32-bit arguments (at most
+ * WELINK_LOG_RECORD_MAX_ARGS). The console shows them as "#WL:<hex>" lines, which
+ * tools/welink_log_decode.py turns back into text using the ELF file.
+ *
+ * Only arguments which fit in 32 bits and are not floating point or strings can be recorded. The
+ * check is done at compile time for each call site: a call with a 64-bit, double or char * argument,
+ * or with more than WELINK_LOG_RECORD_MAX_ARGS arguments, is formatted as a text line instead, as
+ * without CONFIG_WELINK_LOG_BINARY. Pointers other than strings are recorded as their address.
+ */
+#define WELINK_LOG_RECORD_MAX_ARGS 8
+
+#define WELINK_LOG_STR_(x) #x
+#define WELINK_LOG_STR(x) WELINK_LOG_STR_(x)
+#define WELINK_LOG_CAT_(a, b) a##b
+#define WELINK_LOG_CAT(a, b) WELINK_LOG_CAT_(a, b)
+
+/* Counts up to 16 arguments, more than WELINK_LOG_RECORD_MAX_ARGS take the text path */
+#define WELINK_LOG_NARGS(...) WELINK_LOG_NARGS_(0, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, \
+                                                8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define WELINK_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+
+/* An argument can be recorded when va_arg(uint32_t) reads it back unchanged, __builtin_classify_type 8 is a real type */
+#define WELINK_LOG_IS_STRING(a) (__builtin_types_compatible_p(__typeof__((a) + 0), char *) || \
+                                 __builtin_types_compatible_p(__typeof__((a) + 0), const char *))
+#define WELINK_LOG_ARG_FITS(a) ((sizeof(a) <= sizeof(uint32_t)) && (__builtin_classify_type(a) != 8) && \
+                                !WELINK_LOG_IS_STRING(a))
+
+#define WELINK_LOG_FITS(...) WELINK_LOG_CAT(WELINK_LOG_FITS_, WELINK_LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define WELINK_LOG_FITS_0(...) 1
+#define WELINK_LOG_FITS_1(a) WELINK_LOG_ARG_FITS(a)
+#define WELINK_LOG_FITS_2(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_1(__VA_ARGS__))
+#define WELINK_LOG_FITS_3(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_2(__VA_ARGS__))
+#define WELINK_LOG_FITS_4(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_3(__VA_ARGS__))
+#define WELINK_LOG_FITS_5(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_4(__VA_ARGS__))
+#define WELINK_LOG_FITS_6(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_5(__VA_ARGS__))
+#define WELINK_LOG_FITS_7(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_6(__VA_ARGS__))
+#define WELINK_LOG_FITS_8(a, ...) (WELINK_LOG_ARG_FITS(a) && WELINK_LOG_FITS_7(__VA_ARGS__))
+#define WELINK_LOG_FITS_9(...) 0
+#define WELINK_LOG_FITS_10(...) 0
+#define WELINK_LOG_FITS_11(...) 0
+#define WELINK_LOG_FITS_12(...) 0
+#define WELINK_LOG_FITS_13(...) 0
+#define WELINK_LOG_FITS_14(...) 0
+#define WELINK_LOG_FITS_15(...) 0
+#define WELINK_LOG_FITS_16(...) 0
+
+/* "#" comments out the "a" flag the compiler appends, so the section is not allocated */
+#define WELINK_LOG_FMT_SECTION ".welink_logfmt,\"\",@progbits #"
+
+/* The condition is a constant, each call site keeps only one of the two branches */
+#define WELINK_LOG_RECORD(level, text, format, ...) do { \
+        if (WELINK_LOG_FITS(__VA_ARGS__)) { \
+            static const char __welink_log_fmt[] __attribute__((section(WELINK_LOG_FMT_SECTION), used)) = \
+                level ":" __FILE__ ":" WELINK_LOG_STR(__LINE__) ":" format; \
+            esp_welink_log_record((uint32_t)(uintptr_t)__welink_log_fmt, WELINK_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+        } else { \
+            text(format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+/**
+ * @brief  Store one binary log record, used by WELINK_LOG_RECORD
+ *
+ * @param  id    offset of the call site format string in the .welink_logfmt section
+ * @param  nargs number of 32-bit arguments which follow
+ */
+void esp_welink_log_record(uint32_t id, uint32_t nargs, ...);
+
+#define WELINK_LOG_TEXT_E( format, ... ) ESP_LOGE(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOG_TEXT_W( format, ... ) ESP_LOGW(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOG_TEXT_I( format, ... ) ESP_LOGI(TAG, format, ##__VA_ARGS__)
+#define WELINK_LOG_TEXT_D( format, ... ) ESP_LOGD(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOG_TEXT_V( format, ... ) ESP_LOGV(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+
+#ifdef CONFIG_WELINK_LOG_BINARY
+#define WELINK_LOG_EMIT_E( format, ... ) WELINK_LOG_RECORD("E", WELINK_LOG_TEXT_E, format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_W( format, ... ) WELINK_LOG_RECORD("W", WELINK_LOG_TEXT_W, format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_I( format, ... ) WELINK_LOG_RECORD("I", WELINK_LOG_TEXT_I, format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_D( format, ... ) WELINK_LOG_RECORD("D", WELINK_LOG_TEXT_D, format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_V( format, ... ) WELINK_LOG_RECORD("V", WELINK_LOG_TEXT_V, format, ##__VA_ARGS__)
+#else
+#define WELINK_LOG_EMIT_E( format, ... ) WELINK_LOG_TEXT_E(format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_W( format, ... ) WELINK_LOG_TEXT_W(format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_I( format, ... ) WELINK_LOG_TEXT_I(format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_D( format, ... ) WELINK_LOG_TEXT_D(format, ##__VA_ARGS__)
+#define WELINK_LOG_EMIT_V( format, ... ) WELINK_LOG_TEXT_V(format, ##__VA_ARGS__)
+#endif
+
 #if WELINK_LOCAL_LEVEL >=  WELINK_LOG_ERROR
-#define WELINK_LOGE( format, ... ) ESP_LOGE(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOGE( format, ... ) do { \
+        if (WELINK_LOG_ENABLED(WELINK_LOG_ERROR)) { WELINK_LOG_EMIT_E(format, ##__VA_ARGS__); } \
+    } while (0)
 #else
 #define WELINK_LOGE( format, ... )
 #endif
 
 #if WELINK_LOCAL_LEVEL >=  WELINK_LOG_WARN
-#define WELINK_LOGW( format, ... ) ESP_LOGW(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOGW( format, ... ) do { \
+        if (WELINK_LOG_ENABLED(WELINK_LOG_WARN)) { WELINK_LOG_EMIT_W(format, ##__VA_ARGS__); } \
+    } while (0)
 #else
 #define WELINK_LOGW( format, ... )
 #endif
 
 #if WELINK_LOCAL_LEVEL >=  WELINK_LOG_INFO
-#define WELINK_LOGI( format, ... ) ESP_LOGI(TAG, format, ##__VA_ARGS__)
+#define WELINK_LOGI( format, ... ) do { \
+        if (WELINK_LOG_ENABLED(WELINK_LOG_INFO)) { WELINK_LOG_EMIT_I(format, ##__VA_ARGS__); } \
+    } while (0)
 #else
 #define WELINK_LOGI( format, ... )
 #endif
 
 #if WELINK_LOCAL_LEVEL >=  WELINK_LOG_DEBUG
-#define WELINK_LOGD( format, ... ) ESP_LOGD(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOGD( format, ... ) do { \
+        if (WELINK_LOG_ENABLED(WELINK_LOG_DEBUG)) { WELINK_LOG_EMIT_D(format, ##__VA_ARGS__); } \
+    } while (0)
 #else
 #define WELINK_LOGD( format, ... )
 #endif
 
 #if WELINK_LOCAL_LEVEL >=  WELINK_LOG_VERBOSE
-#define WELINK_LOGV( format, ... ) ESP_LOGV(TAG, "[%s, %d]:" format, __func__, __LINE__, ##__VA_ARGS__)
+#define WELINK_LOGV( format, ... ) do { \
+        if (WELINK_LOG_ENABLED(WELINK_LOG_VERBOSE)) { WELINK_LOG_EMIT_V(format, ##__VA_ARGS__); } \
+    } while (0)
 #else
 #define WELINK_LOGV( format, ... )
 #endif
 
+/**
+ * @brief Log errno, the binary mode skips strerror() and logs the number only
+ */
+#ifdef CONFIG_WELINK_LOG_BINARY
+#define WELINK_LOG_ERRNO() WELINK_LOGE("errno: %d", errno)
+#else
+#define WELINK_LOG_ERRNO() WELINK_LOGE("errno: %d, errno_str: %s\n", errno, strerror(errno))
+#endif
+
+/**
+ * @brief Asynchronous log sink
+ *
+ * Once started, txd_printf() and every ESP_LOG / WELINK_LOG line are formatted into a fixed slot of a
+ * lock-free multi-producer ring and written to the console by a low-priority drain task, so the
+ * calling thread never waits on the UART. When the ring is full the line is dropped and counted,
+ * the drain task reports the number of dropped lines.
+ */
+#ifdef CONFIG_WELINK_LOG_SINK_LINES
+#define WELINK_LOG_SINK_LINES CONFIG_WELINK_LOG_SINK_LINES
+#else
+#define WELINK_LOG_SINK_LINES 16
+#endif
+
+#ifdef CONFIG_WELINK_LOG_SINK_LINE_SIZE
+#define WELINK_LOG_SINK_LINE_SIZE CONFIG_WELINK_LOG_SINK_LINE_SIZE
+#else
+#define WELINK_LOG_SINK_LINE_SIZE 128
+#endif
+
+/**
+ * @brief  Start the drain task and redirect the esp_log output to the ring
+ *
+ * @param  priority   drain task priority, should be lower than the SDK and application tasks
+ * @param  stack_size drain task stack size in bytes
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_log_sink_start(uint8_t priority, uint32_t stack_size);
+
+/**
+ * @brief  vprintf-like entry of the sink, falls back to vprintf() before esp_welink_log_sink_start()
+ *
+ * @return number of characters queued (truncated to WELINK_LOG_SINK_LINE_SIZE), 0 if dropped
+ */
+int esp_welink_log_vprintf(const char *format, va_list ap);
+
+/**
+ * @brief  Write every queued line to the console from the calling context
+ *
+ * @note   Never blocks, so it can be called from an ISR, with the scheduler suspended or from a panic
+ *         path. When the drain task is writing at that moment, the call returns at once and leaves
+ *         the lines to the drain task. The sink calls it from an esp_restart() shutdown handler, after
+ *         which lines are written synchronously; WELINK_ASSERT calls it before asserting. With
+ *         CONFIG_WELINK_LOG_FLUSH_ON_ABORT, abort() and failed assert() calls flush too. CPU exceptions
+ *         and watchdog resets enter the panic handler directly, without a hook to flush from, and the
+ *         lines still queued then are lost.
+ */
+void esp_welink_log_flush(void);
+
+/**
+ * @brief  Number of lines dropped because the ring was full
+ */
+uint32_t esp_welink_log_get_dropped(void);
+
+/**
+ * @brief  Set the runtime level of a module
+ *
+ * @note   Levels above WELINK_LOCAL_LEVEL are not compiled in and can not be enabled. In text mode
+ *         the line also goes through the esp_log level of its TAG.
+ *
+ * @param  module log module, WELINK_LOG_MODULE_MAX sets every module
+ * @param  level  new level
+ *
+ * @return 0 on success, -1 on invalid parameters
+ */
+int32_t esp_welink_log_set_level(WELINK_log_module_t module, WELINK_log_level_t level);
+
+/**
+ * @brief  Get the runtime level of a module
+ */
+WELINK_log_level_t esp_welink_log_get_level(WELINK_log_module_t module);
+
+/**
+ * @brief  Apply a level configuration string, e.g. the value of the log level datapoint
+ *
+ * The string is a comma separated list of "<module>=<level>", module is one of baseapi, thread,
+ * wifi, ota, datapoint or "*" for all, level is 0-6 or one of n, f, e, w, i, d, v.
+ * For example "*=2,ota=5". Nothing is changed if any item is invalid.
+ *
+ * @param  config configuration string, does not have to be null-terminated
+ * @param  len    length of config
+ *
+ * @return 0 on success, -1 on parse error
+ */
+int32_t esp_welink_log_set_level_str(const char *config, uint32_t len);
+
+/**
+ * @brief  Print the current levels as "baseapi=2,thread=2,...", the format accepted by esp_welink_log_set_level_str()
+ *
+ * @return length of the string, not including the terminating null
+ */
+int32_t esp_welink_log_get_level_str(char *buf, uint32_t size);
+
+/**
+ * @brief Span tracing
+ *
+ * With CONFIG_WELINK_TRACE, TXD_TRACE_BEGIN(name) / TXD_TRACE_END(name) measure the code between them,
+ * TXD_TRACE_SCOPE(name) measures until the enclosing scope is left, including early returns.
+ * Each call site aggregates its samples into count, min, max, sum and a log2 histogram, which can be
+ * read with esp_welink_trace_snapshot(). Durations are in ticks: CPU cycles on the target
+ * (WELINK_TRACE_TICKS_PER_US per microsecond) and nanoseconds on the host (_x86_).
+ * Without CONFIG_WELINK_TRACE the macros expand to nothing.
+ *
+ * @note  The ESP32 cycle counters of the two cores are not synchronized, a span during which the task
+ *        moves to the other core gives a wrong sample.
+ */
+#define WELINK_TRACE_BUCKETS 32
+
+#if defined(_x86_)
+#define WELINK_TRACE_TICKS_PER_US 1000
+#elif defined(CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+#define WELINK_TRACE_TICKS_PER_US CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#elif defined(CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ)
+#define WELINK_TRACE_TICKS_PER_US CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ
+#else
+#define WELINK_TRACE_TICKS_PER_US 80
+#endif
+
+typedef struct {
+    const char *name;                        /*!< Site name given to the trace macro */
+    uint32_t count;                          /*!< Number of samples */
+    uint32_t min;                            /*!< Shortest sample, ticks */
+    uint32_t max;                            /*!< Longest sample, ticks */
+    uint64_t sum;                            /*!< Sum of all samples, ticks */
+    uint32_t hist[WELINK_TRACE_BUCKETS];     /*!< hist[i] counts samples in [2^i, 2^(i+1)) ticks, hist[0] also counts 0 */
+} esp_welink_trace_stats_t;
+
+typedef struct esp_welink_trace_site {
+    esp_welink_trace_stats_t stats;
+    struct esp_welink_trace_site *next;
+    bool registered;
+} esp_welink_trace_site_t;
+
+typedef struct {
+    esp_welink_trace_site_t *site;
+    uint32_t start;
+} esp_welink_trace_span_t;
+
+#ifdef CONFIG_WELINK_TRACE
+
+#ifdef _x86_
+#include <time.h>
+
+static inline uint32_t esp_welink_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#else
+extern unsigned xthal_get_ccount(void);
+
+static inline uint32_t esp_welink_trace_now(void)
+{
+    return xthal_get_ccount();
+}
+#endif
+
+#define TXD_TRACE_SITE(site) \
+    static esp_welink_trace_site_t __txd_trace_site_##site = { .stats = { .name = #site } }
+
+#define TXD_TRACE_BEGIN(site) \
+    TXD_TRACE_SITE(site); \
+    esp_welink_trace_span_t __txd_trace_span_##site = { &__txd_trace_site_##site, esp_welink_trace_now() }
+
+#define TXD_TRACE_END(site) esp_welink_trace_end(&__txd_trace_span_##site)
+
+#define TXD_TRACE_SCOPE(site) \
+    TXD_TRACE_SITE(site); \
+    esp_welink_trace_span_t __txd_trace_span_##site __attribute__((cleanup(esp_welink_trace_end))) = \
+        { &__txd_trace_site_##site, esp_welink_trace_now() }
+
+#else
+#define TXD_TRACE_BEGIN(site)
+#define TXD_TRACE_END(site)
+#define TXD_TRACE_SCOPE(site)
+#endif
+
+/**
+ * @brief  Close a span and add its duration to the site, used by the trace macros
+ *
+ * @note   A span is recorded once, ending it again does nothing
+ */
+void esp_welink_trace_end(esp_welink_trace_span_t *span);
+
+/**
+ * @brief  Copy the statistics of every site that has recorded a sample
+ *
+ * @param  stats     output array
+ * @param  max_count size of the stats array
+ *
+ * @return number of sites, may be larger than max_count
+ */
+uint32_t esp_welink_trace_snapshot(esp_welink_trace_stats_t *stats, uint32_t max_count);
+
+/**
+ * @brief  Clear the statistics of every site
+ */
+void esp_welink_trace_reset(void);
+
+/**
+ * @brief  Print the statistics of every site to the console, in microseconds
+ */
+void esp_welink_trace_dump(void);
+
 /**
  * @brief Check the return value
  */
 #define WELINK_ERROR_CHECK(con, err, format, ...) do { \
         if (con) { \
             WELINK_LOGE(format , ##__VA_ARGS__); \
-            if(errno) WELINK_LOGE("errno: %d, errno_str: %s\n", errno, strerror(errno)); \
+            if(errno) WELINK_LOG_ERRNO(); \
             return err; \
         } \
     } while (0)
@@ -99,7 +458,7 @@ typedef enum {
 #define WELINK_ERROR_GOTO(con, lable, format, ...) do { \
         if (con) { \
             WELINK_LOGE(format , ##__VA_ARGS__); \
-            if(errno) WELINK_LOGE("errno: %d, errno_str: %s\n", errno, strerror(errno)); \
+            if(errno) WELINK_LOG_ERRNO(); \
             goto lable; \
         } \
     } while (0)
@@ -115,7 +474,7 @@ typedef enum {
  * @brief Set breakpoint
  */
 #define WELINK_ASSERT(con) do { \
-        if (!(con)) { WELINK_LOGE("errno:%d:%s\n", errno, strerror(errno)); assert(0 && #con); } \
+        if (!(con)) { WELINK_LOGE("errno:%d:%s\n", errno, strerror(errno)); esp_welink_log_flush(); assert(0 && #con); } \
     } while (0)
 
 #ifdef __cplusplus
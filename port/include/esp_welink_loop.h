@@ -0,0 +1,118 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_LOOP_H__
+#define __ESP_WELINK_LOOP_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Event loop driver for the single-threaded SDK (library built without _TXD_THREAD_)
+ *
+ * Each iteration waits once, on the SDK connection, the wakeup channel and the application file
+ * descriptors, with a timeout which is the earliest of the SDK expect_sleep_ms, the next txd_timer
+ * deadline and the caller limit. txd_sdk_run() is only called when its sleep has elapsed, the
+ * connection is readable or an application task requested a send with esp_welink_socket_wakeup().
+ * The loop registers itself with txd_timer_set_wakeup_hook(), so a timer started by another task
+ * before the current deadline also ends the wait.
+ *
+ * All functions except esp_welink_loop_get_stats() must be called from the loop task.
+ */
+
+#ifdef CONFIG_WELINK_LOOP_MAX_FDS
+#define WELINK_LOOP_MAX_FDS CONFIG_WELINK_LOOP_MAX_FDS
+#else
+#define WELINK_LOOP_MAX_FDS 4
+#endif
+
+/**
+ * @brief Callback when an application file descriptor is readable
+ */
+typedef void (*esp_welink_loop_fd_cb_t)(int fd, void *arg);
+
+/**
+ * @brief Loop statistics
+ */
+typedef struct {
+    uint32_t iterations;        /*!< Number of loop iterations */
+    uint32_t sdk_runs;          /*!< Number of txd_sdk_run() calls */
+    uint32_t fd_events;         /*!< Number of application fd callbacks */
+    uint32_t timer_events;      /*!< Number of txd_timer callbacks */
+    uint32_t last_busy_us;      /*!< CPU time of the last iteration, waiting excluded */
+    uint32_t max_busy_us;       /*!< Maximum CPU time of one iteration */
+    uint64_t total_busy_us;     /*!< Total CPU time of all iterations */
+} esp_welink_loop_stats_t;
+
+/**
+ * @brief  Watch an application file descriptor for readability
+ *
+ * @param  fd  file descriptor
+ * @param  cb  called from the loop when fd is readable
+ * @param  arg callback argument
+ *
+ * @return 0 on success, -1 if the table is full or the parameter is incorrect
+ */
+int32_t esp_welink_loop_add_fd(int fd, esp_welink_loop_fd_cb_t cb, void *arg);
+
+/**
+ * @brief  Stop watching an application file descriptor
+ *
+ * @param  fd file descriptor
+ *
+ * @return 0 on success, -1 if fd is not watched
+ */
+int32_t esp_welink_loop_remove_fd(int fd);
+
+/**
+ * @brief  Run one iteration: wait, then dispatch the SDK, timers and fd callbacks
+ *
+ * @param  max_wait_ms upper bound of the wait
+ *
+ * @return 0 on success, otherwise the error code of txd_sdk_run()
+ */
+int32_t esp_welink_loop_run_once(uint32_t max_wait_ms);
+
+/**
+ * @brief  Run the loop forever
+ */
+void esp_welink_loop_run(void);
+
+/**
+ * @brief  Get the loop statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_loop_get_stats(esp_welink_loop_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_LOOP_H__ */
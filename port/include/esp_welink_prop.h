@@ -0,0 +1,190 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_PROP_H__
+#define __ESP_WELINK_PROP_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Typed property encoding
+ *
+ * Numeric properties are declared once in an X-macro list, which generates the index enum and a
+ * const schema table:
+ *
+ *     #define APP_PROPERTIES(X) \
+ *         X(PROP_TEMPERATURE, 100, ESP_WELINK_PROP_FIXED, -400, 1250, 1) \
+ *         X(PROP_POWER,       101, ESP_WELINK_PROP_BOOL,     0,    1, 0) \
+ *         X(PROP_LEVEL,       102, ESP_WELINK_PROP_INT,      0,  100, 0)
+ *
+ *     enum { APP_PROPERTIES(ESP_WELINK_PROP_ENUM) PROP_MAX };
+ *     static const esp_welink_prop_schema_t s_props[] = { APP_PROPERTIES(ESP_WELINK_PROP_ENTRY) };
+ *
+ * Values are int32_t: the number for ESP_WELINK_PROP_INT, the value times 10^decimals for
+ * ESP_WELINK_PROP_FIXED (215 with 1 decimal is "21.5") and 0 / 1 for ESP_WELINK_PROP_BOOL
+ * ("false" / "true"). esp_welink_prop_put() checks the range and writes the text straight into
+ * the buffer of a batch, which is then passed to txd_report_datapoints(). The encoders do not use
+ * snprintf, and with a constant schema entry the type switch is resolved at compile time.
+ */
+#define ESP_WELINK_PROP_MAX_CHARS   12      /*!< Longest encoded value, "-2147483648" or "-2147483.648" */
+
+typedef enum {
+    ESP_WELINK_PROP_INT,        /*!< Decimal integer */
+    ESP_WELINK_PROP_FIXED,      /*!< Fixed-point decimal with a constant number of decimals */
+    ESP_WELINK_PROP_BOOL,       /*!< "true" or "false", "1" and "0" are also accepted when decoding */
+} esp_welink_prop_type_t;
+
+/**
+ * @brief Schema of one property
+ */
+typedef struct {
+    uint32_t property_id;
+    esp_welink_prop_type_t type;
+    int32_t min;                /*!< Smallest value, in units of 10^-decimals */
+    int32_t max;                /*!< Largest value, in units of 10^-decimals */
+    uint8_t decimals;           /*!< Digits after the decimal point of ESP_WELINK_PROP_FIXED, at most 9 */
+} esp_welink_prop_schema_t;
+
+#define ESP_WELINK_PROP_ENUM(name, id, kind, lo, hi, dec)     name,
+#define ESP_WELINK_PROP_ENTRY(name, id, kind, lo, hi, dec) \
+    { .property_id = (id), .type = (kind), .min = (lo), .max = (hi), .decimals = (dec) },
+
+/**
+ * @brief Datapoints and value text of one report, both in caller memory
+ */
+typedef struct {
+    txd_datapoint_t *datapoints;
+    uint32_t max_count;
+    uint32_t count;             /*!< Datapoints written, pass it to txd_report_datapoints() */
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t used;              /*!< Bytes of buf used by the values */
+} esp_welink_prop_batch_t;
+
+/**
+ * @brief  Encode a decimal integer, the text is not NUL terminated
+ *
+ * @param  buf output, at least ESP_WELINK_PROP_MAX_CHARS bytes
+ *
+ * @return length of the text
+ */
+uint32_t esp_welink_prop_encode_int(uint8_t *buf, int32_t value);
+
+/**
+ * @brief  Encode value / 10^decimals with exactly decimals digits after the point
+ *
+ * @param  buf output, at least ESP_WELINK_PROP_MAX_CHARS bytes
+ *
+ * @return length of the text
+ */
+uint32_t esp_welink_prop_encode_fixed(uint8_t *buf, int32_t value, uint8_t decimals);
+
+/**
+ * @brief  Encode "true" or "false"
+ *
+ * @param  buf output, at least ESP_WELINK_PROP_MAX_CHARS bytes
+ *
+ * @return length of the text
+ */
+uint32_t esp_welink_prop_encode_bool(uint8_t *buf, int32_t value);
+
+/**
+ * @brief  Decode a received property value and check it against the schema
+ *
+ * @param  prop schema of the property
+ * @param  text property_value, need not be NUL terminated
+ * @param  len property_value_len
+ * @param  value output, in the same units as esp_welink_prop_put(). Digits beyond the declared
+ *               decimals are truncated
+ *
+ * @return 0 on success, -1 if the text is malformed or out of range
+ */
+int32_t esp_welink_prop_decode(const esp_welink_prop_schema_t *prop, const uint8_t *text, uint32_t len, int32_t *value);
+
+/**
+ * @brief  Prepare a batch
+ *
+ * @param  batch batch to initialize
+ * @param  datapoints datapoint array of max_count entries
+ * @param  max_count number of datapoints
+ * @param  buf value buffer, max_count * ESP_WELINK_PROP_MAX_CHARS bytes are always enough
+ * @param  size size of buf
+ */
+void esp_welink_prop_batch_init(esp_welink_prop_batch_t *batch, txd_datapoint_t *datapoints, uint32_t max_count,
+                                uint8_t *buf, uint32_t size);
+
+/**
+ * @brief  Append a property value to a batch
+ *
+ * @param  batch batch
+ * @param  prop schema of the property
+ * @param  value value in units of 10^-decimals
+ *
+ * @return 0 on success, -1 if the value is out of range or the batch is full
+ */
+static inline int32_t esp_welink_prop_put(esp_welink_prop_batch_t *batch, const esp_welink_prop_schema_t *prop, int32_t value)
+{
+    uint8_t *text = batch->buf + batch->used;
+    uint32_t len = 0;
+
+    if (value < prop->min || value > prop->max || batch->count == batch->max_count
+            || batch->size - batch->used < ESP_WELINK_PROP_MAX_CHARS) {
+        return -1;
+    }
+
+    switch (prop->type) {
+        case ESP_WELINK_PROP_FIXED:
+            len = esp_welink_prop_encode_fixed(text, value, prop->decimals);
+            break;
+
+        case ESP_WELINK_PROP_BOOL:
+            len = esp_welink_prop_encode_bool(text, value);
+            break;
+
+        default:
+            len = esp_welink_prop_encode_int(text, value);
+            break;
+    }
+
+    batch->datapoints[batch->count].property_id = prop->property_id;
+    batch->datapoints[batch->count].property_value = text;
+    batch->datapoints[batch->count].property_value_len = len;
+    batch->datapoints[batch->count].seq = 0;
+    batch->datapoints[batch->count].ret_code = 0;
+    batch->count++;
+    batch->used += len;
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_PROP_H__ */
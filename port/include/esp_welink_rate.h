@@ -0,0 +1,144 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_RATE_H__
+#define __ESP_WELINK_RATE_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Adaptive report rate controller
+ *
+ * Each telemetry stream has a report rate between 1000 / max_interval_ms and 1000 / min_interval_ms
+ * reports per second. Reports sent with esp_welink_rate_report() are tracked until their
+ * on_send_datapoint completion arrives, and the rate follows AIMD congestion control:
+ *   - a success faster than latency_target_ms adds increase_mhz to the rate
+ *   - err_msg_sendtimeout, err_msg_cache_failed, err_msg_send_too_frequently, a success slower
+ *     than latency_target_ms or a completion missing for inflight_timeout_ms halves the rate,
+ *     at most once per smoothed round trip
+ * A stream is ready when its interval has elapsed since the last report and fewer than
+ * max_inflight of its reports are waiting for completion.
+ */
+#define WELINK_RATE_MAX_STREAMS     8
+#define WELINK_RATE_INFLIGHT        16
+
+/**
+ * @brief Controller configuration
+ */
+typedef struct {
+    uint32_t latency_target_ms;     /*!< Completions slower than this count as congestion */
+    uint32_t increase_mhz;          /*!< Additive increase per fast completion, in reports per 1000 seconds */
+    uint32_t inflight_timeout_ms;   /*!< A report without completion after this long counts as timed out */
+    esp_welink_report_t report;     /*!< Report function, NULL for txd_report_datapoints */
+} esp_welink_rate_config_t;
+
+#define ESP_WELINK_RATE_CONFIG_DEFAULT() { \
+        .latency_target_ms = 2000, \
+        .increase_mhz = 20, \
+        .inflight_timeout_ms = 30000, \
+        .report = NULL, \
+    }
+
+/**
+ * @brief Stream state and statistics
+ */
+typedef struct {
+    uint32_t interval_ms;       /*!< Current report interval */
+    uint32_t rate_mhz;          /*!< Current rate, reports per 1000 seconds */
+    uint32_t inflight;          /*!< Reports waiting for completion */
+    uint32_t srtt_ms;           /*!< Smoothed completion latency */
+    uint32_t sent;              /*!< Reports accepted by the report function */
+    uint32_t completed;         /*!< Successful completions */
+    uint32_t timeouts;          /*!< err_msg_sendtimeout completions and expired reports */
+    uint32_t cache_failed;      /*!< err_msg_cache_failed and err_msg_send_too_frequently results */
+    uint32_t errors;            /*!< Other errors, they do not change the rate */
+    uint32_t increases;         /*!< Additive increases */
+    uint32_t decreases;         /*!< Multiplicative decreases */
+} esp_welink_rate_stats_t;
+
+/**
+ * @brief  Create the controller
+ *
+ * @param  config configuration, NULL for ESP_WELINK_RATE_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_rate_init(const esp_welink_rate_config_t *config);
+
+/**
+ * @brief  Create a stream, it starts at the slowest rate
+ *
+ * @param  min_interval_ms shortest report interval
+ * @param  max_interval_ms longest report interval
+ * @param  max_inflight    reports of the stream waiting for completion at the same time
+ *
+ * @return stream ID, -1 on failure
+ */
+int32_t esp_welink_rate_stream_create(uint32_t min_interval_ms, uint32_t max_interval_ms, uint32_t max_inflight);
+
+/**
+ * @brief  Check whether the stream should report now
+ *
+ * @return true if the interval has elapsed and the in-flight window is not full
+ */
+bool esp_welink_rate_ready(int32_t stream);
+
+/**
+ * @brief  Current report interval of the stream in milliseconds, 0 for an invalid stream
+ */
+uint32_t esp_welink_rate_get_interval(int32_t stream);
+
+/**
+ * @brief  Send a report of the stream, parameters are the same as txd_report_datapoints()
+ *
+ * @note   pCb receives the completion with the cookie returned in pCookie. A report not completed within
+ *         inflight_timeout_ms completes with err_msg_sendtimeout, a later completion from the SDK is dropped,
+ *         so pCb is called exactly once per successful report.
+ *
+ * @return result of the report function
+ */
+int32_t esp_welink_rate_report(int32_t stream, txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                               on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief  Get the state and statistics of a stream
+ *
+ * @param  stream stream ID
+ * @param  stats  output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_rate_get_stats(int32_t stream, esp_welink_rate_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_RATE_H__ */
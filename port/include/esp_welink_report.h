@@ -0,0 +1,89 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_REPORT_H__
+#define __ESP_WELINK_REPORT_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif/*!< __ESP_WELINK_REPORT_H__ */
+
+#define WELINK_STASH_SIZE   8       /*!< Early completions kept by a stash, the largest window of a sender */
+
+/**
+ * @brief Report function, same as txd_report_datapoints()
+ *
+ * Set in the configuration of the port modules, NULL for txd_report_datapoints(). A module can be stacked
+ * on another one by passing its report function, e.g. esp_welink_sched_report to share the rate limit.
+ */
+typedef int32_t (*esp_welink_report_t)(txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                                       on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief Completions which arrived before the report function returned their cookie
+ *
+ * The SDK may call pCb before txd_report_datapoints() returns, when the cookie is not registered yet.
+ * pCb puts the completion into the stash and the sender takes it back after registering the cookie.
+ * When the stash is full the oldest completion is overwritten. Not thread safe, the caller holds its mutex.
+ */
+typedef struct {
+    struct {
+        bool used;
+        uint32_t cookie;
+        int32_t err_code;
+        uint32_t done_ms;   /*!< Time of the completion */
+    } entries[WELINK_STASH_SIZE];
+    uint32_t next;
+} esp_welink_stash_t;
+
+/**
+ * @brief  Keep a completion whose cookie is not registered yet
+ *
+ * @param  stash    the stash, zero initialized
+ * @param  cookie   cookie of the completion
+ * @param  err_code result of the completion
+ * @param  done_ms  time of the completion
+ */
+void esp_welink_stash_put(esp_welink_stash_t *stash, uint32_t cookie, int32_t err_code, uint32_t done_ms);
+
+/**
+ * @brief  Take back the completion of a cookie
+ *
+ * @param  stash    the stash
+ * @param  cookie   cookie just returned by the report function
+ * @param  err_code output, result of the completion
+ * @param  done_ms  output, time of the completion, may be NULL
+ *
+ * @return true if the completion had already arrived
+ */
+bool esp_welink_stash_take(esp_welink_stash_t *stash, uint32_t cookie, int32_t *err_code, uint32_t *done_ms);
+
+#ifdef __cplusplus
+}
+#endif/*!< __ESP_WELINK_REPORT_H__ */
+
+#endif/*!< __ESP_WELINK_REPORT_H__ */
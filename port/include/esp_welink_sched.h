@@ -0,0 +1,145 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_SCHED_H__
+#define __ESP_WELINK_SCHED_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Send scheduler
+ *
+ * txd_report_datapoints() and txd_ack_datapoint() share a limit of 5 calls per second. The scheduler
+ * queues both kinds of messages and sends them from a txd_timer callback at the rate of a token
+ * bucket. Acks have strict priority over reports, so command acks are not delayed by telemetry.
+ *
+ * When the SDK still answers err_msg_send_too_frequently or err_msg_cache_failed, the message stays
+ * at the head of its queue and is retried with exponential backoff. Other SDK errors are passed to
+ * the message callback. The application never sees err_msg_send_too_frequently.
+ *
+ * The queue functions return a scheduler cookie, the callback receives this cookie and the final
+ * result of the message. At most 16 sent messages wait for their SDK callback; while that many are
+ * waiting the scheduler stops sending. A message whose callback has not come after
+ * inflight_timeout_ms completes with err_msg_sendtimeout, and a
+ * later callback from the SDK for it is dropped, so each callback is called exactly once.
+ * txd_timer_service_start() or esp_welink_loop must be running.
+ */
+
+/**
+ * @brief Ack function, same as txd_ack_datapoint()
+ */
+typedef int32_t (*esp_welink_sched_ack_t)(txd_datapoint_t *datapoint, on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief Scheduler configuration
+ */
+typedef struct {
+    uint32_t rate;                      /*!< Sends per second, shared by acks and reports */
+    uint32_t burst;                     /*!< Token bucket size */
+    uint32_t ack_depth;                 /*!< Number of queued acks */
+    uint32_t report_depth;              /*!< Number of queued reports */
+    uint32_t backoff_min_ms;            /*!< First retry delay after the SDK rejected a send */
+    uint32_t backoff_max_ms;            /*!< Longest retry delay */
+    uint32_t inflight_timeout_ms;       /*!< A sent message without SDK callback after this long times out */
+    esp_welink_report_t report;         /*!< Report function, NULL for txd_report_datapoints */
+    esp_welink_sched_ack_t ack;         /*!< Ack function, NULL for txd_ack_datapoint */
+} esp_welink_sched_config_t;
+
+#define ESP_WELINK_SCHED_CONFIG_DEFAULT() { \
+        .rate = 5, \
+        .burst = 1, \
+        .ack_depth = 4, \
+        .report_depth = 8, \
+        .backoff_min_ms = 200, \
+        .backoff_max_ms = 5000, \
+        .inflight_timeout_ms = 30000, \
+        .report = NULL, \
+        .ack = NULL, \
+    }
+
+typedef enum {
+    ESP_WELINK_SCHED_ACK,       /*!< Ack lane, strict priority */
+    ESP_WELINK_SCHED_REPORT,    /*!< Report lane */
+    ESP_WELINK_SCHED_LANE_MAX,
+} esp_welink_sched_lane_t;
+
+/**
+ * @brief Scheduler statistics, arrays are indexed by esp_welink_sched_lane_t
+ */
+typedef struct {
+    uint32_t queued[ESP_WELINK_SCHED_LANE_MAX];     /*!< Messages accepted */
+    uint32_t full[ESP_WELINK_SCHED_LANE_MAX];       /*!< Messages rejected because the queue was full */
+    uint32_t sent[ESP_WELINK_SCHED_LANE_MAX];       /*!< Messages accepted by the SDK */
+    uint32_t failed[ESP_WELINK_SCHED_LANE_MAX];     /*!< Messages rejected by the SDK with a final error */
+    uint32_t max_wait_ms[ESP_WELINK_SCHED_LANE_MAX];/*!< Longest time between queueing and sending */
+    uint32_t throttled;                             /*!< Sends rejected by the SDK and retried */
+    uint32_t stalled;                               /*!< Sends delayed because 16 messages waited for their callback */
+    uint32_t timeouts;                              /*!< Messages completed with err_msg_sendtimeout */
+    uint32_t pending;                               /*!< Messages waiting in both queues */
+} esp_welink_sched_stats_t;
+
+/**
+ * @brief  Create the scheduler
+ *
+ * @param  config configuration, NULL for ESP_WELINK_SCHED_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_sched_init(const esp_welink_sched_config_t *config);
+
+/**
+ * @brief  Queue a report, parameters are the same as txd_report_datapoints(), the values are copied
+ *
+ * @return err_success when queued, err_msg_cache_failed when the queue is full, err_invalid_param
+ */
+int32_t esp_welink_sched_report(txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                                on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief  Queue an ack, parameters are the same as txd_ack_datapoint(), the value is copied
+ *
+ * @return err_success when queued, err_msg_cache_failed when the queue is full, err_invalid_param
+ */
+int32_t esp_welink_sched_ack(txd_datapoint_t *datapoint, on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief  Get the scheduler statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_sched_get_stats(esp_welink_sched_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_SCHED_H__ */
@@ -0,0 +1,186 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_SF_H__
+#define __ESP_WELINK_SF_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Offline store-and-forward queue
+ *
+ * Datapoints reported while the device is offline are appended to a circular log in flash
+ * instead of being lost. When the device comes back online the log is replayed in order,
+ * one message of at most WELINK_SF_MAX_BYTES at a time. A record is marked consumed only after
+ * the send callback reported err_success, so points survive a reboot or a lost connection
+ * during the replay (at-least-once delivery).
+ *
+ * The log is a ring of flash sectors. Each sector starts with a header carrying a sequence number,
+ * the records follow back to back. Marking a record consumed only clears bits of its state word,
+ * so no sector is rewritten before it is recycled. The log size is bounded by the flash area,
+ * the drop policy decides what happens when it is full.
+ *
+ * The flash is accessed through esp_welink_sf_flash_t, the default is the data partition
+ * WELINK_SF_PARTITION_LABEL. A file-backed implementation can be used to run the log on a host.
+ * Replay runs on a txd_timer, so txd_timer_service_start() or esp_welink_loop must be running.
+ */
+#define WELINK_SF_PARTITION_LABEL   "welink_sf"
+#define WELINK_SF_MAX_BYTES         480     /*!< Values per replayed message, the txd_report_datapoints() limit */
+#define WELINK_SF_MAX_POINTS        8       /*!< Datapoints per replayed message */
+
+/**
+ * @brief Flash access, offsets are relative to the start of the log area
+ */
+typedef struct {
+    int32_t (*read)(void *ctx, uint32_t offset, void *buf, uint32_t len);          /*!< Return 0 on success */
+    int32_t (*write)(void *ctx, uint32_t offset, const void *buf, uint32_t len);   /*!< Only clears bits, return 0 on success */
+    int32_t (*erase)(void *ctx, uint32_t offset, uint32_t len);                    /*!< Set a sector to 0xFF, return 0 on success */
+    void *ctx;                  /*!< Passed to the functions above */
+    uint32_t size;              /*!< Size of the log area, a multiple of sector_size */
+    uint32_t sector_size;       /*!< Erase unit */
+} esp_welink_sf_flash_t;
+
+/**
+ * @brief What to do when the log is full or a property is stored again
+ */
+typedef enum {
+    ESP_WELINK_SF_DROP_OLDEST,      /*!< Recycle the oldest sector, its unsent records are dropped */
+    ESP_WELINK_SF_DROP_NEWEST,      /*!< Reject the new record */
+    ESP_WELINK_SF_LATEST_ONLY,      /*!< Keep only the latest value of each property, drop the oldest sector when full */
+} esp_welink_sf_policy_t;
+
+/**
+ * @brief Store-and-forward configuration
+ */
+typedef struct {
+    esp_welink_sf_flash_t flash;        /*!< Flash access, flash.read NULL for the WELINK_SF_PARTITION_LABEL partition */
+    esp_welink_sf_policy_t policy;      /*!< Drop policy */
+    uint32_t replay_interval_ms;        /*!< Delay between two replayed messages */
+    uint32_t ack_timeout_ms;            /*!< Resend a replayed message when its callback did not come in time */
+    esp_welink_report_t report;         /*!< Report function, NULL for txd_report_datapoints, esp_welink_sched_report to share the rate limit */
+} esp_welink_sf_config_t;
+
+#define ESP_WELINK_SF_CONFIG_DEFAULT() { \
+        .flash = { 0 }, \
+        .policy = ESP_WELINK_SF_DROP_OLDEST, \
+        .replay_interval_ms = 250, \
+        .ack_timeout_ms = 10000, \
+        .report = NULL, \
+    }
+
+/**
+ * @brief Store-and-forward statistics
+ */
+typedef struct {
+    uint32_t appended;          /*!< Records written to the log */
+    uint32_t replayed;          /*!< Records sent and confirmed after a replay */
+    uint32_t dropped;           /*!< Records lost because the log was full */
+    uint32_t superseded;        /*!< Records replaced by a newer value (ESP_WELINK_SF_LATEST_ONLY) */
+    uint32_t corrupted;         /*!< Torn or damaged records skipped at mount */
+    uint32_t resent;            /*!< Replayed messages sent again after an error or timeout */
+    uint32_t pending;           /*!< Records waiting for replay */
+    uint32_t used_sectors;      /*!< Sectors between the oldest pending record and the write position */
+    uint32_t sector_count;      /*!< Sectors in the log */
+} esp_welink_sf_stats_t;
+
+/**
+ * @brief  Fill the flash access functions for a data partition
+ *
+ * @param  flash output
+ * @param  label partition label, usually WELINK_SF_PARTITION_LABEL
+ *
+ * @return 0 on success, -1 if the partition does not exist
+ */
+int32_t esp_welink_sf_partition_flash(esp_welink_sf_flash_t *flash, const char *label);
+
+/**
+ * @brief  Mount the log, records left by the previous boot are kept for replay
+ *
+ * @note   An unformatted area is erased, this takes a while for a large partition
+ *
+ * @param  config configuration, NULL for ESP_WELINK_SF_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_sf_init(const esp_welink_sf_config_t *config);
+
+/**
+ * @brief  Unmount the log, the records in flash are replayed after the next esp_welink_sf_init()
+ *
+ * @note   No other function of the module may run during the call, and no send callback of a
+ *         replayed message may arrive after it
+ *
+ * @return 0 on success, -1 if the log is not mounted
+ */
+int32_t esp_welink_sf_deinit(void);
+
+/**
+ * @brief  Report datapoints, parameters are the same as txd_report_datapoints()
+ *
+ * While online with an empty log the datapoints are passed to the report function. Otherwise,
+ * or when the report function fails because the device is not online or the SDK cache is full,
+ * they are appended to the log. pCb is not called for stored datapoints and *pCookie is set to 0.
+ *
+ * @return err_success when sent or stored, err_msg_cache_failed when the log rejected the datapoints,
+ *         err_invalid_param, or the error of the report function
+ */
+int32_t esp_welink_sf_report(txd_datapoint_t datapoints[], uint32_t datapoints_count,
+                             on_send_datapoint pCb, uint32_t *pCookie);
+
+/**
+ * @brief  Append datapoints to the log without trying to send them
+ *
+ * @return 0 on success, -1 if at least one datapoint was rejected
+ */
+int32_t esp_welink_sf_append(const txd_datapoint_t datapoints[], uint32_t datapoints_count);
+
+/**
+ * @brief  Start or stop the replay
+ *
+ * @note   Call it from the on_online_status callback, it does not access the flash
+ *
+ * @param  status 1 online, 0 offline
+ */
+void esp_welink_sf_set_online(int32_t status);
+
+/**
+ * @brief  Get the store-and-forward statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_sf_get_stats(esp_welink_sf_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_SF_H__ */
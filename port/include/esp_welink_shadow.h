@@ -0,0 +1,187 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_SHADOW_H__
+#define __ESP_WELINK_SHADOW_H__
+
+#include "txd_stdtypes.h"
+#include "txd_sdk.h"
+#include "esp_welink_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Device shadow
+ *
+ * The shadow keeps the current value of each property together with two versions:
+ *   - desired:  incremented whenever the value changes, by esp_welink_shadow_set() or a command
+ *   - reported: the desired version the cloud acknowledged
+ *
+ * esp_welink_shadow_report() only sends the properties whose versions differ, packed into as few
+ * messages as fit WELINK_SHADOW_MAX_BYTES, and marks them reported when the send callback
+ * confirms them. Setting a property to its current value changes nothing, so a periodic
+ * report of an unchanged device sends nothing.
+ *
+ * Commands accepted with esp_welink_shadow_apply() update the value and count as reported, as
+ * the cloud sent them. esp_welink_shadow_get() never waits on the network.
+ *
+ * The shadow is saved to NVS snapshot_delay_ms after a change and loaded by
+ * esp_welink_shadow_init(), so values and pending reports survive a restart.
+ */
+#define WELINK_SHADOW_MAX_BYTES     480     /*!< Value bytes per message, the txd_report_datapoints() limit */
+#define WELINK_SHADOW_MAX_POINTS    16      /*!< Datapoints per message */
+
+/**
+ * @brief Shadow configuration
+ */
+typedef struct {
+    uint32_t max_entries;                   /*!< Number of properties */
+    uint32_t max_value_len;                 /*!< Longest property value */
+    uint32_t ack_timeout_ms;                /*!< Report a property again when its send callback did not come after this long */
+    uint32_t snapshot_delay_ms;             /*!< Save to NVS this long after the first unsaved change, 0 to save only in esp_welink_shadow_save() */
+    const char *nvs_namespace;              /*!< NVS namespace of the snapshot, NULL to disable snapshots */
+    esp_welink_report_t report;             /*!< Report function, NULL for txd_report_datapoints */
+    on_send_datapoint report_cb;            /*!< Called after the shadow processed a send result, may be NULL */
+} esp_welink_shadow_config_t;
+
+#define ESP_WELINK_SHADOW_CONFIG_DEFAULT() { \
+        .max_entries = 32, \
+        .max_value_len = 32, \
+        .ack_timeout_ms = 5000, \
+        .snapshot_delay_ms = 60000, \
+        .nvs_namespace = "welink_shadow", \
+        .report = NULL, \
+        .report_cb = NULL, \
+    }
+
+/**
+ * @brief Versions of a property
+ */
+typedef struct {
+    uint32_t desired;       /*!< Version of the current value */
+    uint32_t reported;      /*!< Version acknowledged by the cloud, equal to desired when in sync */
+} esp_welink_shadow_version_t;
+
+/**
+ * @brief Shadow statistics
+ */
+typedef struct {
+    uint32_t entries;       /*!< Properties in the shadow */
+    uint32_t dirty;         /*!< Properties not reported yet */
+    uint32_t sets;          /*!< esp_welink_shadow_set() calls which changed a value */
+    uint32_t unchanged;     /*!< esp_welink_shadow_set() calls with the current value */
+    uint32_t commands;      /*!< Commands applied */
+    uint32_t datapoints;    /*!< Datapoints reported */
+    uint32_t messages;      /*!< Successful report calls */
+    uint32_t send_errors;   /*!< Failed report calls and send callbacks */
+    uint32_t saves;         /*!< Snapshots written */
+} esp_welink_shadow_stats_t;
+
+/**
+ * @brief  Create the shadow and load the snapshot
+ *
+ * @param  config configuration, NULL for ESP_WELINK_SHADOW_CONFIG_DEFAULT()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_shadow_init(const esp_welink_shadow_config_t *config);
+
+/**
+ * @brief  Delete the shadow, a snapshot not saved yet is lost
+ *
+ * @note   No other function of the module may run during the call, and no send callback of a
+ *         report may arrive after it
+ *
+ * @return 0 on success, -1 if the shadow was not created
+ */
+int32_t esp_welink_shadow_deinit(void);
+
+/**
+ * @brief  Set the local value of a property, the value is copied
+ *
+ * @param  property_id property ID
+ * @param  value       property value
+ * @param  value_len   length of value, at most max_value_len
+ *
+ * @return 0 when the value changed, 1 when it is the current value, -1 if the value is too long or the shadow is full
+ */
+int32_t esp_welink_shadow_set(uint32_t property_id, const uint8_t *value, uint32_t value_len);
+
+/**
+ * @brief  Read the current value of a property
+ *
+ * @param  property_id property ID
+ * @param  value       output buffer
+ * @param  value_len   in: size of value, out: length of the value
+ * @param  version     output versions, may be NULL
+ *
+ * @return 0 on success, -1 if the property is not in the shadow or the buffer is too small
+ */
+int32_t esp_welink_shadow_get(uint32_t property_id, uint8_t *value, uint32_t *value_len,
+                              esp_welink_shadow_version_t *version);
+
+/**
+ * @brief  Record a command accepted by the device, the value counts as reported
+ *
+ * @param  datapoint received datapoint
+ *
+ * @return 0 on success, -1 if the value is too long or the shadow is full
+ */
+int32_t esp_welink_shadow_apply(const txd_datapoint_t *datapoint);
+
+/**
+ * @brief  Report the properties which changed since they were last acknowledged
+ *
+ * The properties to send are chosen when the call starts and each is sent at most once, even when
+ * its send result arrives during the call. Changes made meanwhile are sent by the next call.
+ *
+ * @param  full report every property, e.g. after login
+ *
+ * @return number of messages sent, -1 if a report call failed (the properties stay dirty)
+ */
+int32_t esp_welink_shadow_report(bool full);
+
+/**
+ * @brief  Write the snapshot to NVS now if the shadow changed since the last save
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_shadow_save(void);
+
+/**
+ * @brief  Get the shadow statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_shadow_get_stats(esp_welink_shadow_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_SHADOW_H__ */
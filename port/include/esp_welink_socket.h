@@ -0,0 +1,78 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_SOCKET_H__
+#define __ESP_WELINK_SOCKET_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Interrupt the SDK thread while it is waiting in txd_tcp_recv()
+ *
+ * @note   The SDK thread only flushes its send queue between two recv waits, so call this after
+ *         txd_report_datapoints() or txd_ack_datapoint() from an application task to get the message
+ *         out immediately instead of after the recv timeout. The wait returns 0 (no data), which the
+ *         SDK treats as a normal timeout. Several wakeups before the wait returns are merged into one.
+ *
+ * @note   Only the long connection socket (the first one created by txd_tcp_socket_create()) listens
+ *         to the wakeup channel, other sockets such as the OTA download are not affected.
+ *
+ * @return 0 on success, -1 if the wakeup channel is not available
+ */
+int32_t esp_welink_socket_wakeup(void);
+
+/**
+ * @brief  Get the file descriptors an external event loop has to wait on for the SDK
+ *
+ * @param  conn_fd   output, the long connection socket, -1 if not connected
+ * @param  wakeup_fd output, the wakeup channel socket, -1 if not available
+ */
+void esp_welink_socket_get_fds(int *conn_fd, int *wakeup_fd);
+
+/**
+ * @brief  Consume pending wakeups without going through txd_tcp_recv()
+ *
+ * @note   Used by an external event loop after the wakeup socket became readable
+ */
+void esp_welink_socket_wakeup_clear(void);
+
+/**
+ * @brief  Make txd_tcp_recv() on the long connection return immediately instead of waiting timeout_ms
+ *
+ * @note   Used when an external event loop already waits for socket readiness before calling
+ *         txd_sdk_run(), so the SDK never blocks inside the loop iteration
+ *
+ * @param  enable true to poll, false to wait for timeout_ms (default)
+ */
+void esp_welink_socket_set_recv_poll(bool enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_SOCKET_H__ */
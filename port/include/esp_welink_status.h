@@ -0,0 +1,95 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_STATUS_H__
+#define __ESP_WELINK_STATUS_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Connectivity statistics
+ */
+typedef struct {
+    int32_t  online;            /*!< Current status, 1 online, 0 offline */
+    uint32_t transitions;       /*!< Number of status changes since init */
+    uint32_t last_change_ms;    /*!< txd_time_get_sysclock() at the last status change */
+    uint32_t first_online_ms;   /*!< txd_time_get_sysclock() at the first login, 0 if never online */
+    uint64_t online_ms;         /*!< Cumulative time spent online, including the current period */
+    uint64_t offline_ms;        /*!< Cumulative time spent offline, including the current period */
+} esp_welink_status_stats_t;
+
+/**
+ * @brief  Create the connectivity state object, the initial state is offline
+ *
+ * @note   Call it before txd_init_notify()
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_status_init(void);
+
+/**
+ * @brief  Record an online status change
+ *
+ * @note   Call it from the on_online_status callback, it never blocks
+ *
+ * @param  status 1 online, 0 offline
+ */
+void esp_welink_status_update(int32_t status);
+
+/**
+ * @brief  Block the calling task until the device is online
+ *
+ * @param  timeout_ms maximum time to wait, portMAX_DELAY waits forever
+ *
+ * @return 0 if online, -1 on timeout
+ */
+int32_t esp_welink_status_wait_online(uint32_t timeout_ms);
+
+/**
+ * @brief  Block the calling task until the device is offline
+ *
+ * @param  timeout_ms maximum time to wait, portMAX_DELAY waits forever
+ *
+ * @return 0 if offline, -1 on timeout
+ */
+int32_t esp_welink_status_wait_offline(uint32_t timeout_ms);
+
+/**
+ * @brief  Get the connectivity statistics
+ *
+ * @param  stats output
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t esp_welink_status_get_stats(esp_welink_status_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_STATUS_H__ */
@@ -0,0 +1,120 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __ESP_WELINK_TSPACK_H__
+#define __ESP_WELINK_TSPACK_H__
+
+#include "txd_stdtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Time series packing
+ *
+ * Packs (timestamp, value) samples into one base64 datapoint value with the Gorilla scheme:
+ * timestamps as delta-of-delta and values as the XOR with the previous value. Samples taken at a
+ * regular interval with slowly changing values cost a few bits each instead of a CSV line.
+ *
+ * Block layout, bits are written most significant first:
+ *
+ *     version:8 count:16 t0:32 v0:32 { sample }*
+ *
+ * with each following sample encoded as
+ *
+ *     timestamp, dod = (t - t_prev) - (t_prev - t_prev2), the first delta uses 0 as previous delta
+ *         '0'                   dod == 0
+ *         '10'   + 7 bits       dod in [-63, 64]
+ *         '110'  + 9 bits       dod in [-255, 256]
+ *         '1110' + 12 bits      dod in [-2047, 2048]
+ *         '1111' + 32 bits      otherwise
+ *     value, x = v ^ v_prev
+ *         '0'                   x == 0
+ *         '10' + meaningful     the non-zero bits of x fit in the previous leading/trailing window
+ *         '11' + leading:5 + (length - 1):5 + length bits
+ *
+ * The n-bit dod fields hold dod - 1 + 2^(n-1) so that the ranges above map to [0, 2^n).
+ * tools/welink_tspack_decode.py is the reference decoder.
+ */
+#define WELINK_TSPACK_VERSION       1
+#define WELINK_TSPACK_HEADER_BITS   (8 + 16 + 32 + 32)
+#define WELINK_TSPACK_MAX_LEN       480     /*!< Longest encoded value, the txd_report_datapoints() limit */
+#define WELINK_TSPACK_MAX_BYTES     (WELINK_TSPACK_MAX_LEN / 4 * 3)
+
+/**
+ * @brief Packer state, owned by the caller
+ */
+typedef struct {
+    uint8_t buf[WELINK_TSPACK_MAX_BYTES];
+    uint32_t capacity;              /*!< Usable bits */
+    uint32_t bits;                  /*!< Bits written */
+    uint32_t count;                 /*!< Samples */
+    uint32_t timestamp;             /*!< Previous sample */
+    int32_t delta;
+    uint32_t value;
+    uint8_t leading;                /*!< Window of the previous XOR */
+    uint8_t trailing;
+} esp_welink_tspack_t;
+
+/**
+ * @brief  Start a block
+ *
+ * @param  pack state
+ * @param  max_len longest base64 text, at most WELINK_TSPACK_MAX_LEN
+ */
+void esp_welink_tspack_init(esp_welink_tspack_t *pack, uint32_t max_len);
+
+/**
+ * @brief  Append a sample
+ *
+ * @param  pack state
+ * @param  timestamp_ms sample time
+ * @param  value sample, e.g. in fixed point
+ *
+ * @return 0 on success, -1 if the block is full (the block is unchanged, finish it and start a new one)
+ */
+int32_t esp_welink_tspack_add(esp_welink_tspack_t *pack, uint32_t timestamp_ms, int32_t value);
+
+/**
+ * @brief  Encode the block as base64, the block can still be appended to afterwards
+ *
+ * @param  pack state
+ * @param  out output, no NUL is written
+ * @param  size size of out
+ *
+ * @return length of the text, -1 if out is too small or the block is empty
+ */
+int32_t esp_welink_tspack_finish(esp_welink_tspack_t *pack, char *out, uint32_t size);
+
+/**
+ * @brief  Compression ratio in percent, raw size (8 bytes per sample) over the packed size
+ */
+uint32_t esp_welink_tspack_ratio(const esp_welink_tspack_t *pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!< __ESP_WELINK_TSPACK_H__ */
@@ -36,7 +36,9 @@
 #include "netdb.h"
 #include "txd_stdtypes.h"
 #include "txd_baseapi.h"
+#include "esp_welink_boot.h"
 #include "esp_welink_log.h"
+#include "esp_welink_socket.h"
 #include "nvs_flash.h"
 
 static const char* TAG = "txd_baseapi";
@@ -89,6 +91,7 @@ int32_t txd_write_basicinfo(uint8_t* buf, uint32_t count)
 {
     nvs_handle my_handle;
     int32_t ret = -1;
+    TXD_TRACE_SCOPE(txd_write_basicinfo);
 
     if(nvs_open("storage", NVS_READWRITE, &my_handle) != ESP_OK){
         WELINK_LOGE("nvs open fail");
@@ -115,7 +118,8 @@ int32_t txd_write_basicinfo(uint8_t* buf, uint32_t count)
 int32_t txd_read_basicinfo(uint8_t* buf, uint32_t count)
 {
     nvs_handle my_handle;
-    uint32_t len = count;
+    size_t len = count;
+    TXD_TRACE_SCOPE(txd_read_basicinfo);
 
     if(nvs_open("storage", NVS_READWRITE, &my_handle) != ESP_OK){
         WELINK_LOGE("nvs open fail");
@@ -163,15 +167,135 @@ uint32_t txd_time_get_sysclock()
 
 struct txd_socket_handler_t {
     int fd;
+    bool wakeup;    // 是否监听唤醒通道，只有长连接socket监听
 };
 
+/*
+ * 唤醒通道：一对绑定在回环地址上的UDP socket，txd_tcp_recv同时select长连接和唤醒socket，
+ * 应用任务发送一个字节即可让等待中的txd_tcp_recv立即返回
+ */
+static int s_wakeup_rx_fd = -1;
+static int s_wakeup_tx_fd = -1;
+static struct sockaddr_in s_wakeup_addr;
+static volatile uint8_t s_wakeup_pending = 0;
+static txd_socket_handler_t* s_long_conn_sock = NULL;
+static bool s_recv_poll = false;
+
+static int32_t esp_welink_socket_wakeup_init()
+{
+    socklen_t addr_len = sizeof(s_wakeup_addr);
+
+    memset(&s_wakeup_addr, 0, sizeof(s_wakeup_addr));
+    s_wakeup_addr.sin_family = AF_INET;
+    s_wakeup_addr.sin_port = 0;
+    s_wakeup_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    s_wakeup_rx_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    WELINK_ERROR_GOTO(s_wakeup_rx_fd < 0, end, "create wakeup socket fail");
+
+    WELINK_ERROR_GOTO(bind(s_wakeup_rx_fd, (struct sockaddr*)&s_wakeup_addr, sizeof(s_wakeup_addr)) != 0,
+                      end, "bind wakeup socket fail");
+    WELINK_ERROR_GOTO(getsockname(s_wakeup_rx_fd, (struct sockaddr*)&s_wakeup_addr, &addr_len) != 0,
+                      end, "get wakeup socket name fail");
+
+    s_wakeup_tx_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    WELINK_ERROR_GOTO(s_wakeup_tx_fd < 0, end, "create wakeup socket fail");
+
+    return 0;
+
+end:
+
+    if (s_wakeup_rx_fd >= 0) {
+        close(s_wakeup_rx_fd);
+        s_wakeup_rx_fd = -1;
+    }
+
+    return -1;
+}
+
+// 先读空唤醒socket再清除标志，保证清除标志之后的唤醒一定会发出新的数据报
+static void esp_welink_socket_wakeup_drain()
+{
+    uint8_t buf[8];
+
+    while (recv(s_wakeup_rx_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+
+    s_wakeup_pending = 0;
+}
+
+void esp_welink_socket_wakeup_clear(void)
+{
+    if (s_wakeup_rx_fd >= 0) {
+        esp_welink_socket_wakeup_drain();
+    }
+}
+
+void esp_welink_socket_get_fds(int* conn_fd, int* wakeup_fd)
+{
+    if (conn_fd != NULL) {
+        *conn_fd = (s_long_conn_sock != NULL) ? s_long_conn_sock->fd : -1;
+    }
+
+    if (wakeup_fd != NULL) {
+        *wakeup_fd = s_wakeup_rx_fd;
+    }
+}
+
+void esp_welink_socket_set_recv_poll(bool enable)
+{
+    s_recv_poll = enable;
+}
+
+int32_t esp_welink_socket_wakeup(void)
+{
+    uint8_t msg = 0;
+
+    if (s_wakeup_tx_fd < 0) {
+        return -1;
+    }
+
+    // SDK线程还没有处理上一次唤醒，不需要重复发送
+    if (s_wakeup_pending) {
+        return 0;
+    }
+
+    s_wakeup_pending = 1;
+
+    if (sendto(s_wakeup_tx_fd, &msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr*)&s_wakeup_addr, sizeof(s_wakeup_addr)) < 0) {
+        s_wakeup_pending = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
 /**  创建tcp socket
  *
  * @return tcp socket
  */
 txd_socket_handler_t* txd_tcp_socket_create()
 {
-    return (txd_socket_handler_t*)txd_malloc(sizeof(txd_socket_handler_t));
+    TXD_TRACE_SCOPE(txd_tcp_socket_create);
+    txd_socket_handler_t* sock = (txd_socket_handler_t*)txd_malloc(sizeof(txd_socket_handler_t));
+
+    if (sock == NULL) {
+        WELINK_LOGE("malloc fail");
+        return sock;
+    }
+
+    sock->fd = -1;
+    sock->wakeup = false;
+
+    /*
+     * 长连接socket存在时创建的（如文件传输、OTA下载）不监听唤醒通道；SDK重连时会销毁长连接socket再重新创建，
+     * 之后创建的第一个socket仍是长连接。唤醒通道只创建一次，其他任务随时可能在发送唤醒
+     */
+    if (s_long_conn_sock == NULL) {
+        s_long_conn_sock = sock;
+        sock->wakeup = (s_wakeup_rx_fd >= 0) || (esp_welink_socket_wakeup_init() == 0);
+    }
+
+    return sock;
 }
 
 /**  连接服务器
@@ -189,6 +313,7 @@ int32_t txd_tcp_connect(txd_socket_handler_t* sock, uint8_t* ip, uint16_t port,
     int32_t ret = -1;
     struct sockaddr_in addr;
     struct timeval timeout = {0, 0};
+    TXD_TRACE_SCOPE(txd_tcp_connect);
 
     if ((sock == NULL) || (ip == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
@@ -219,7 +344,7 @@ int32_t txd_tcp_connect(txd_socket_handler_t* sock, uint8_t* ip, uint16_t port,
 
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
-    inet_aton((char*)ip, &(addr.sin_addr.s_addr));
+    inet_aton((char*)ip, &addr.sin_addr);
 
     if (connect(sock->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
         WELINK_LOGE("socket connect fail");
@@ -227,6 +352,7 @@ int32_t txd_tcp_connect(txd_socket_handler_t* sock, uint8_t* ip, uint16_t port,
     }
 
     WELINK_LOGI("socket connect success");
+    esp_welink_boot_mark(ESP_WELINK_BOOT_TCP_CONNECT);
     return 0;
 }
 
@@ -247,6 +373,7 @@ int32_t txd_tcp_connect_dns(txd_socket_handler_t* sock, uint8_t* dns, uint16_t p
     struct hostent* hptr = NULL;
     ip_addr_t ip_address;
     struct timeval timeout = {0, 0};
+    TXD_TRACE_SCOPE(txd_tcp_connect_dns);
 
     if ((sock == NULL) || (dns == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
@@ -283,6 +410,7 @@ int32_t txd_tcp_connect_dns(txd_socket_handler_t* sock, uint8_t* dns, uint16_t p
         return ret;
     }
 
+    esp_welink_boot_mark(ESP_WELINK_BOOT_DNS);
     ip_address = *(ip_addr_t*)hptr->h_addr_list[0];
     addr.sin_addr.s_addr = ip_address.u_addr.ip4.addr;
 
@@ -292,6 +420,7 @@ int32_t txd_tcp_connect_dns(txd_socket_handler_t* sock, uint8_t* dns, uint16_t p
     }
 
     WELINK_LOGI("socket connect success - DNS");
+    esp_welink_boot_mark(ESP_WELINK_BOOT_TCP_CONNECT);
 
     return 0;
 }
@@ -306,6 +435,7 @@ int32_t txd_tcp_connect_dns(txd_socket_handler_t* sock, uint8_t* dns, uint16_t p
 int32_t txd_tcp_disconnect(txd_socket_handler_t* sock)
 {
     int32_t ret = -1;
+    TXD_TRACE_SCOPE(txd_tcp_disconnect);
 
     if (sock == NULL) {
         WELINK_LOGE("the parameter is incorrect");
@@ -331,35 +461,71 @@ int32_t txd_tcp_disconnect(txd_socket_handler_t* sock)
 int32_t txd_tcp_recv(txd_socket_handler_t* sock, uint8_t* buf, uint32_t len, uint32_t timeout_ms)
 {
     int32_t ret = -1;
-    int32_t optval = 0;
-    socklen_t optlen = 0;
+    int maxfd = 0;
+    fd_set readfds;
     struct timeval timeout = {0, 0};
+    TXD_TRACE_SCOPE(txd_tcp_recv);
 
     if ((sock == NULL) || (buf == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
         return ret;
     }
 
+    // 外部事件循环已经等待过socket就绪，这里只做非阻塞读取
+    if (s_recv_poll && (sock == s_long_conn_sock)) {
+        timeout_ms = 0;
+    }
+
     timeout.tv_sec = (timeout_ms / 1000);
     timeout.tv_usec = ((timeout_ms % 1000) * 1000);
 
-    if (setsockopt(sock->fd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(struct timeval)) != 0) {
-        WELINK_LOGE("set socket opt fail");
-        return ret;
+    FD_ZERO(&readfds);
+    maxfd = -1;
+
+    // 断开连接后fd为-1，此时只等待唤醒通道
+    if (sock->fd >= 0) {
+        FD_SET(sock->fd, &readfds);
+        maxfd = sock->fd;
     }
 
-    ret = recv(sock->fd, buf, len, 0);
+    if (sock->wakeup) {
+        FD_SET(s_wakeup_rx_fd, &readfds);
+        maxfd = (s_wakeup_rx_fd > maxfd) ? s_wakeup_rx_fd : maxfd;
+    }
+
+    if (maxfd < 0) {
+        WELINK_LOGE("socket is not connected");
+        return -1;
+    }
+
+    ret = select(maxfd + 1, &readfds, NULL, NULL, &timeout);
+
+    if (ret < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    } else if (ret == 0) {
+        return 0;
+    }
 
-    if (ret == -1) {
-        optlen = sizeof(optval);
+    if (sock->wakeup && FD_ISSET(s_wakeup_rx_fd, &readfds)) {
+        esp_welink_socket_wakeup_drain();
 
-        if (getsockopt(sock->fd, SOL_SOCKET, SO_ERROR, &optval, &optlen) == 0) {
-            if (optval == EAGAIN) {
-                return 0;
-            }
+        if ((sock->fd < 0) || !FD_ISSET(sock->fd, &readfds)) {
+            return 0;
         }
     }
 
+    ret = recv(sock->fd, buf, len, MSG_DONTWAIT);
+
+    if (ret == 0) {
+        // select可读但读到0字节，说明对端已关闭连接
+        WELINK_LOGE("connection closed by peer");
+        return -1;
+    }
+
+    if ((ret == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+        return 0;
+    }
+
     return ret;
 }
 
@@ -377,6 +543,7 @@ int32_t txd_tcp_send(txd_socket_handler_t* sock, uint8_t* buf, uint32_t len, uin
 {
     int32_t ret = -1;
     struct timeval timeout = {0, 0};
+    TXD_TRACE_SCOPE(txd_tcp_send);
 
     if ((sock == NULL) || (buf == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
@@ -403,9 +570,15 @@ int32_t txd_tcp_send(txd_socket_handler_t* sock, uint8_t* buf, uint32_t len, uin
 int32_t txd_tcp_socket_destroy(txd_socket_handler_t* sock)
 {
     int32_t ret = -1;
+    TXD_TRACE_SCOPE(txd_tcp_socket_destroy);
 
     if (sock) {
         ret = close(sock->fd);
+
+        if (sock == s_long_conn_sock) {
+            s_long_conn_sock = NULL;
+        }
+
         txd_free(sock);
     }
 
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include "txd_stdapi.h"
+#include "esp_welink_log.h"
 
 /*****************************************头文件说明******************************************/
 /*
@@ -90,8 +91,9 @@ int32_t txd_printf(const char* template, ...)
     int32_t ret = 0;
 
     va_list args;
+    // 启动异步日志后写入日志环形队列，不在SDK线程中等待串口输出
     va_start(args, template);
-    ret = vprintf(template, args);
+    ret = esp_welink_log_vprintf(template, args);
     va_end(args);
 
     return ret;
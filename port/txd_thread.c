@@ -28,6 +28,8 @@
 #include <freertos/task.h>
 #include <freertos/semphr.h>
 
+#include "esp_attr.h"
+#define WELINK_LOG_MODULE WELINK_LOG_MODULE_THREAD
 #include "esp_welink_log.h"
 #include "txd_stdtypes.h"
 #include "txd_baseapi.h"
@@ -131,6 +133,7 @@ txd_mutex_handler_t* txd_mutex_create()
 int32_t txd_mutex_lock(txd_mutex_handler_t* mutex)
 {
     int32_t ret = -1;
+    TXD_TRACE_SCOPE(txd_mutex_lock);
 
     if ((mutex == NULL) || (mutex->xHandle == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
@@ -154,6 +157,7 @@ int32_t txd_mutex_lock(txd_mutex_handler_t* mutex)
 int32_t txd_mutex_unlock(txd_mutex_handler_t* mutex)
 {
     int32_t ret = -1;
+    TXD_TRACE_SCOPE(txd_mutex_unlock);
 
     if ((mutex == NULL) || (mutex->xHandle == NULL)) {
         WELINK_LOGE("the parameter is incorrect");
@@ -185,3 +189,747 @@ int32_t txd_mutex_destroy(txd_mutex_handler_t* mutex)
     txd_free(mutex);
     return 0;
 }
+
+/************************ ringbuf 接口 *********************************/
+/*
+ * head只由生产者写，tail只由消费者写，二者都是自由递增的计数，取模后得到下标。
+ * 生产者先写入元素再以release语义发布head，消费者以acquire语义读取head后再读元素，
+ * 反方向同理，这样在Xtensa（编译为memw）和x86上都能保证元素内容先于下标可见。
+ */
+struct txd_ringbuf_handler_t {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t mask;
+    uint32_t item_size;
+    uint32_t dropped;
+    uint8_t* buf;
+};
+
+/**  创建环形队列
+ * @param item_size 每个元素的大小（字节数）
+ * @param item_count 队列能容纳的元素个数，内部会向上取整为2的幂
+ *
+ * @return 环形队列（句柄）标记，失败返回NULL
+ */
+txd_ringbuf_handler_t* txd_ringbuf_create(uint32_t item_size, uint32_t item_count)
+{
+    uint32_t size = 1;
+    txd_ringbuf_handler_t* ringbuf = NULL;
+
+    if ((item_size == 0) || (item_count == 0) || (item_count > 0x80000000)) {
+        WELINK_LOGE("the parameter is incorrect");
+        return NULL;
+    }
+
+    while (size < item_count) {
+        size <<= 1;
+    }
+
+    ringbuf = (txd_ringbuf_handler_t*)txd_malloc(sizeof(txd_ringbuf_handler_t));
+
+    if (ringbuf == NULL) {
+        WELINK_LOGE("malloc fail");
+        return NULL;
+    }
+
+    memset(ringbuf, 0, sizeof(txd_ringbuf_handler_t));
+    ringbuf->mask = size - 1;
+    ringbuf->item_size = item_size;
+    ringbuf->buf = (uint8_t*)txd_malloc(size * item_size);
+
+    if (ringbuf->buf == NULL) {
+        txd_free(ringbuf);
+        WELINK_LOGE("malloc fail");
+        return NULL;
+    }
+
+    return ringbuf;
+}
+
+/**  写入一个元素（生产者）
+ * @note 不加锁、不申请内存，可以在中断中调用
+ * @param ringbuf 环形队列
+ * @param item 待写入元素的首地址，长度为创建时的item_size
+ *
+ * @return 0 表示成功
+ *         -1 表示队列已满或参数错误
+ */
+int32_t IRAM_ATTR txd_ringbuf_push(txd_ringbuf_handler_t* ringbuf, const void* item)
+{
+    uint32_t head = 0;
+    uint32_t tail = 0;
+
+    if ((ringbuf == NULL) || (item == NULL)) {
+        return -1;
+    }
+
+    head = __atomic_load_n(&ringbuf->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&ringbuf->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > ringbuf->mask) {
+        __atomic_store_n(&ringbuf->dropped, ringbuf->dropped + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    memcpy(ringbuf->buf + (head & ringbuf->mask) * ringbuf->item_size, item, ringbuf->item_size);
+    __atomic_store_n(&ringbuf->head, head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**  批量读取元素（消费者）
+ * @param ringbuf 环形队列
+ * @param items 接收缓冲区的首地址，大小至少为 max_count * item_size
+ * @param max_count 最多读取的元素个数
+ *
+ * @return 实际读取的元素个数，队列为空时返回0
+ */
+uint32_t txd_ringbuf_pop(txd_ringbuf_handler_t* ringbuf, void* items, uint32_t max_count)
+{
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t count = 0;
+    uint32_t index = 0;
+    uint32_t first = 0;
+
+    if ((ringbuf == NULL) || (items == NULL)) {
+        return 0;
+    }
+
+    tail = __atomic_load_n(&ringbuf->tail, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&ringbuf->head, __ATOMIC_ACQUIRE);
+    count = head - tail;
+
+    if (count > max_count) {
+        count = max_count;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // 可读区域可能跨越缓冲区末尾，分两段拷贝
+    index = tail & ringbuf->mask;
+    first = ringbuf->mask + 1 - index;
+
+    if (first > count) {
+        first = count;
+    }
+
+    memcpy(items, ringbuf->buf + index * ringbuf->item_size, first * ringbuf->item_size);
+
+    if (count > first) {
+        memcpy((uint8_t*)items + first * ringbuf->item_size, ringbuf->buf, (count - first) * ringbuf->item_size);
+    }
+
+    __atomic_store_n(&ringbuf->tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+/**  获取队列中待读取的元素个数
+ * @param ringbuf 环形队列
+ *
+ * @return 元素个数
+ */
+uint32_t txd_ringbuf_count(txd_ringbuf_handler_t* ringbuf)
+{
+    if (ringbuf == NULL) {
+        return 0;
+    }
+
+    return __atomic_load_n(&ringbuf->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ringbuf->tail, __ATOMIC_ACQUIRE);
+}
+
+/**  获取因队列已满而被丢弃的元素个数
+ * @param ringbuf 环形队列
+ *
+ * @return 丢弃的元素个数
+ */
+uint32_t txd_ringbuf_dropped(txd_ringbuf_handler_t* ringbuf)
+{
+    if (ringbuf == NULL) {
+        return 0;
+    }
+
+    return __atomic_load_n(&ringbuf->dropped, __ATOMIC_RELAXED);
+}
+
+/**  销毁环形队列
+ * @note 调用前需保证生产者和消费者都已停止访问该队列
+ * @param ringbuf 环形队列
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+int32_t txd_ringbuf_destroy(txd_ringbuf_handler_t* ringbuf)
+{
+    if (ringbuf == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_free(ringbuf->buf);
+    txd_free(ringbuf);
+    return 0;
+}
+
+/************************ timer 接口 *********************************/
+/*
+ * 4层时间轮，每层64个槽，刻度为TXD_TIMER_TICK_MS，第0层覆盖64个刻度，第n层的每个槽覆盖64^n个刻度，
+ * 每当第n层转完一圈，就把第n+1层当前槽里的定时器重新分配到下层（cascade）。
+ * 每层用一个64位的位图记录非空的槽，用来快速跳过空闲的刻度并计算下一次到期时间。
+ */
+#ifdef CONFIG_WELINK_TIMER_TICK_MS
+#define TXD_TIMER_TICK_MS CONFIG_WELINK_TIMER_TICK_MS
+#else
+#define TXD_TIMER_TICK_MS 10
+#endif
+
+#define TXD_TIMER_LEVELS    4
+#define TXD_TIMER_SLOT_BITS 6
+#define TXD_TIMER_SLOTS     (1 << TXD_TIMER_SLOT_BITS)
+#define TXD_TIMER_SLOT_MASK (TXD_TIMER_SLOTS - 1)
+#define TXD_TIMER_MAX_TICKS ((1UL << (TXD_TIMER_SLOT_BITS * TXD_TIMER_LEVELS)) - 1)
+
+struct txd_timer_handler_t {
+    txd_timer_handler_t* next;
+    txd_timer_handler_t** pprev;    // 指向前一个节点的next，为NULL表示定时器未启动
+    uint32_t expires;               // 到期的刻度
+    uint32_t period;                // 周期（刻度数），0表示单次定时器
+    uint32_t slack;                 // 允许推迟的刻度数
+    uint8_t level;                  // 所在的层
+    uint8_t slot;                   // 所在的槽
+    txd_timer_callback callback;
+    void* arg;
+};
+
+static struct {
+    txd_mutex_handler_t* mutex;
+    SemaphoreHandle_t wakeup;
+    TaskHandle_t service;
+    uint32_t now;                   // 下一个要处理的刻度
+    uint32_t clock_tick;            // 系统时钟折算出的当前刻度
+    uint32_t clock_ms;              // 上一次读取的系统时钟
+    uint32_t clock_rem;             // 不足一个刻度的毫秒数
+    uint32_t deadline_ms;           // 下一次到期的系统时钟（供空闲钩子无锁读取）
+    uint32_t pending;               // 已启动的定时器个数，在锁内原子地修改，供空闲钩子无锁读取
+    txd_timer_wakeup_hook wakeup_hook;
+    uint64_t bitmap[TXD_TIMER_LEVELS];
+    txd_timer_handler_t* slots[TXD_TIMER_LEVELS][TXD_TIMER_SLOTS];
+    txd_timer_handler_t* expired;
+} s_timer_wheel;
+
+static int32_t txd_timer_wheel_init()
+{
+    if (s_timer_wheel.mutex != NULL) {
+        return 0;
+    }
+
+    vTaskSuspendAll();
+
+    if (s_timer_wheel.mutex == NULL) {
+        s_timer_wheel.wakeup = xSemaphoreCreateBinary();
+        s_timer_wheel.mutex = txd_mutex_create();
+        s_timer_wheel.clock_ms = txd_time_get_sysclock();
+        s_timer_wheel.deadline_ms = s_timer_wheel.clock_ms + 0x7FFFFFFF;
+    }
+
+    xTaskResumeAll();
+
+    if ((s_timer_wheel.mutex == NULL) || (s_timer_wheel.wakeup == NULL)) {
+        WELINK_LOGE("timer wheel init fail");
+        return -1;
+    }
+
+    return 0;
+}
+
+// 将系统时钟折算成刻度，按差值累加，避免txd_time_get_sysclock回绕时刻度跳变
+static uint32_t txd_timer_update_clock()
+{
+    uint32_t clock_ms = txd_time_get_sysclock();
+    uint32_t elapsed = clock_ms - s_timer_wheel.clock_ms + s_timer_wheel.clock_rem;
+
+    s_timer_wheel.clock_ms = clock_ms;
+    s_timer_wheel.clock_tick += elapsed / TXD_TIMER_TICK_MS;
+    s_timer_wheel.clock_rem = elapsed % TXD_TIMER_TICK_MS;
+
+    return s_timer_wheel.clock_tick;
+}
+
+static void txd_timer_link(txd_timer_handler_t** head, txd_timer_handler_t* timer)
+{
+    timer->next = *head;
+
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void txd_timer_unlink(txd_timer_handler_t* timer)
+{
+    *timer->pprev = timer->next;
+
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static void txd_timer_enqueue(txd_timer_handler_t* timer)
+{
+    uint32_t level = 0;
+    uint32_t slot = 0;
+    uint32_t delta = timer->expires - s_timer_wheel.now;
+
+    if ((int32_t)delta < 0) {
+        timer->expires = s_timer_wheel.now;
+        delta = 0;
+    } else if (delta > TXD_TIMER_MAX_TICKS) {
+        timer->expires = s_timer_wheel.now + TXD_TIMER_MAX_TICKS;
+        delta = TXD_TIMER_MAX_TICKS;
+    }
+
+    while ((level < TXD_TIMER_LEVELS - 1) && (delta >= (1UL << (TXD_TIMER_SLOT_BITS * (level + 1))))) {
+        level++;
+    }
+
+    slot = (timer->expires >> (TXD_TIMER_SLOT_BITS * level)) & TXD_TIMER_SLOT_MASK;
+    timer->level = level;
+    timer->slot = slot;
+    txd_timer_link(&s_timer_wheel.slots[level][slot], timer);
+    s_timer_wheel.bitmap[level] |= (1ULL << slot);
+}
+
+static void txd_timer_dequeue(txd_timer_handler_t* timer)
+{
+    txd_timer_unlink(timer);
+
+    // 已在expired链表中的定时器level为TXD_TIMER_LEVELS，不对应任何槽
+    if ((timer->level < TXD_TIMER_LEVELS) && (s_timer_wheel.slots[timer->level][timer->slot] == NULL)) {
+        s_timer_wheel.bitmap[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+// 将第level层当前槽中的定时器重新分配到下层，返回该槽的下标
+static uint32_t txd_timer_cascade(uint32_t level)
+{
+    uint32_t slot = (s_timer_wheel.now >> (TXD_TIMER_SLOT_BITS * level)) & TXD_TIMER_SLOT_MASK;
+    txd_timer_handler_t* list = s_timer_wheel.slots[level][slot];
+    txd_timer_handler_t* timer = NULL;
+
+    s_timer_wheel.slots[level][slot] = NULL;
+    s_timer_wheel.bitmap[level] &= ~(1ULL << slot);
+
+    while (list != NULL) {
+        timer = list;
+        list = list->next;
+        txd_timer_enqueue(timer);
+    }
+
+    return slot;
+}
+
+// 推进时间轮到clock_tick，已到期的定时器移入expired链表
+static void txd_timer_advance(uint32_t clock_tick)
+{
+    uint32_t index = 0;
+    uint32_t level = 0;
+    txd_timer_handler_t* timer = NULL;
+
+    if (s_timer_wheel.pending == 0) {
+        s_timer_wheel.now = clock_tick + 1;
+        return;
+    }
+
+    while ((int32_t)(clock_tick - s_timer_wheel.now) >= 0) {
+        index = s_timer_wheel.now & TXD_TIMER_SLOT_MASK;
+
+        // 第0层剩余的槽都为空时，直接跳到下一次cascade的位置
+        if ((index != 0) && ((s_timer_wheel.bitmap[0] >> index) == 0)) {
+            uint32_t skip = TXD_TIMER_SLOTS - index;
+
+            if (skip > clock_tick - s_timer_wheel.now + 1) {
+                skip = clock_tick - s_timer_wheel.now + 1;
+            }
+
+            s_timer_wheel.now += skip;
+            continue;
+        }
+
+        for (level = 1; (index == 0) && (level < TXD_TIMER_LEVELS); level++) {
+            index = txd_timer_cascade(level);
+        }
+
+        index = s_timer_wheel.now & TXD_TIMER_SLOT_MASK;
+
+        while (s_timer_wheel.slots[0][index] != NULL) {
+            timer = s_timer_wheel.slots[0][index];
+            txd_timer_unlink(timer);
+            timer->level = TXD_TIMER_LEVELS;
+            txd_timer_link(&s_timer_wheel.expired, timer);
+        }
+
+        s_timer_wheel.bitmap[0] &= ~(1ULL << index);
+        s_timer_wheel.now++;
+    }
+}
+
+// 计算下一个需要处理的刻度，高层的槽取其cascade的时刻，是到期时间的下界
+static uint32_t txd_timer_next_tick(uint32_t* next_tick)
+{
+    uint32_t level = 0;
+    uint32_t shift = 0;
+    uint32_t index = 0;
+    uint32_t offset = 0;
+    uint32_t tick = 0;
+    uint32_t found = 0;
+    uint64_t rotated = 0;
+
+    if (s_timer_wheel.expired != NULL) {
+        *next_tick = s_timer_wheel.now;
+        return 1;
+    }
+
+    for (level = 0; level < TXD_TIMER_LEVELS; level++) {
+        if (s_timer_wheel.bitmap[level] == 0) {
+            continue;
+        }
+
+        shift = TXD_TIMER_SLOT_BITS * level;
+        index = (s_timer_wheel.now >> shift) & TXD_TIMER_SLOT_MASK;
+        rotated = index ? ((s_timer_wheel.bitmap[level] >> index) | (s_timer_wheel.bitmap[level] << (TXD_TIMER_SLOTS - index))) : s_timer_wheel.bitmap[level];
+        offset = __builtin_ctzll(rotated);
+
+        if (level == 0) {
+            tick = s_timer_wheel.now + offset;
+        } else {
+            // now不在本层的槽边界上时，当前槽已经cascade过，其中的定时器要等转完一圈
+            if ((offset == 0) && ((s_timer_wheel.now & ((1UL << shift) - 1)) != 0)) {
+                offset = TXD_TIMER_SLOTS;
+            }
+
+            tick = ((s_timer_wheel.now >> shift) + offset) << shift;
+        }
+
+        if ((found == 0) || ((int32_t)(tick - *next_tick) < 0)) {
+            *next_tick = tick;
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+static uint32_t txd_timer_ticks_to_ms(uint32_t tick, uint32_t clock_tick)
+{
+    if ((int32_t)(tick - clock_tick) <= 0) {
+        return 0;
+    }
+
+    return (tick - clock_tick) * TXD_TIMER_TICK_MS - s_timer_wheel.clock_rem;
+}
+
+/**  创建定时器
+ * @param callback 定时器到期时的回调函数，在服务线程（或调用txd_timer_process的线程）中执行
+ * @param arg callback的参数
+ *
+ * @return 定时器（句柄）标记，失败返回NULL
+ */
+txd_timer_handler_t* txd_timer_create(txd_timer_callback callback, void* arg)
+{
+    txd_timer_handler_t* timer = NULL;
+
+    if (callback == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return NULL;
+    }
+
+    if (txd_timer_wheel_init() != 0) {
+        return NULL;
+    }
+
+    timer = (txd_timer_handler_t*)txd_malloc(sizeof(txd_timer_handler_t));
+
+    if (timer == NULL) {
+        WELINK_LOGE("malloc fail");
+        return NULL;
+    }
+
+    memset(timer, 0, sizeof(txd_timer_handler_t));
+    timer->callback = callback;
+    timer->arg = arg;
+
+    return timer;
+}
+
+/**  启动定时器，若定时器已启动则按新的参数重新启动
+ * @note 时间轮最多覆盖2^24-1个刻度（默认10毫秒刻度时约46.6小时），timeout_ms（加上slack对齐）或period_ms超出时返回-1，
+ *       定时器保持原来的状态；更长的延时需要由回调分段重新启动
+ * @param timer 定时器
+ * @param timeout_ms 首次到期时间，单位：毫秒
+ * @param period_ms 周期，单位：毫秒，0表示单次定时器
+ * @param slack_ms 允许推迟的时间，单位：毫秒，到期时间会在该范围内对齐，使相近的定时器合并到同一次唤醒中，0表示不对齐
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+int32_t txd_timer_start(txd_timer_handler_t* timer, uint32_t timeout_ms, uint32_t period_ms, uint32_t slack_ms)
+{
+    uint32_t clock_tick = 0;
+    uint32_t expires = 0;
+    uint32_t align = 1;
+    uint32_t deadline_ms = 0;
+    txd_timer_wakeup_hook hook = NULL;
+
+    if ((timer == NULL) || ((uint64_t)period_ms > (uint64_t)TXD_TIMER_MAX_TICKS * TXD_TIMER_TICK_MS)) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_timer_wheel.mutex);
+    clock_tick = txd_timer_update_clock();
+    txd_timer_advance(clock_tick);
+
+    // 到期时间向上取整到刻度，再在slack范围内按2的幂对齐，对齐点相同的定时器会在同一刻度到期
+    expires = clock_tick + (uint32_t)(((uint64_t)timeout_ms + s_timer_wheel.clock_rem + TXD_TIMER_TICK_MS - 1) / TXD_TIMER_TICK_MS);
+
+    while ((align << 1) <= slack_ms / TXD_TIMER_TICK_MS) {
+        align <<= 1;
+    }
+
+    expires = (expires + align - 1) & ~(align - 1);
+
+    // 超出时间轮范围的定时器不能排入，拒绝而不是提前到期
+    if (expires - clock_tick > TXD_TIMER_MAX_TICKS) {
+        txd_mutex_unlock(s_timer_wheel.mutex);
+        WELINK_LOGE("timeout %u ms is out of range", timeout_ms);
+        return -1;
+    }
+
+    if (timer->pprev != NULL) {
+        txd_timer_dequeue(timer);
+        __atomic_fetch_sub(&s_timer_wheel.pending, 1, __ATOMIC_RELAXED);
+    }
+
+    timer->period = (period_ms + TXD_TIMER_TICK_MS - 1) / TXD_TIMER_TICK_MS;
+    timer->slack = slack_ms / TXD_TIMER_TICK_MS;
+    timer->expires = expires;
+    txd_timer_enqueue(timer);
+    __atomic_fetch_add(&s_timer_wheel.pending, 1, __ATOMIC_RELAXED);
+
+    deadline_ms = s_timer_wheel.clock_ms + txd_timer_ticks_to_ms(timer->expires, clock_tick);
+
+    if ((int32_t)(deadline_ms - s_timer_wheel.deadline_ms) < 0) {
+        __atomic_store_n(&s_timer_wheel.deadline_ms, deadline_ms, __ATOMIC_RELAXED);
+
+        // 新定时器早于计划的唤醒时间，需要提前唤醒服务线程；没有服务线程时由设置了唤醒函数的事件循环驱动
+        if (s_timer_wheel.service != NULL) {
+            xSemaphoreGive(s_timer_wheel.wakeup);
+        } else {
+            hook = s_timer_wheel.wakeup_hook;
+        }
+    }
+
+    txd_mutex_unlock(s_timer_wheel.mutex);
+
+    if (hook != NULL) {
+        hook();
+    }
+
+    return 0;
+}
+
+/**  停止定时器
+ * @param timer 定时器
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+int32_t txd_timer_stop(txd_timer_handler_t* timer)
+{
+    if (timer == NULL) {
+        WELINK_LOGE("the parameter is incorrect");
+        return -1;
+    }
+
+    txd_mutex_lock(s_timer_wheel.mutex);
+
+    if (timer->pprev != NULL) {
+        txd_timer_dequeue(timer);
+        __atomic_fetch_sub(&s_timer_wheel.pending, 1, __ATOMIC_RELAXED);
+    }
+
+    timer->period = 0;
+    txd_mutex_unlock(s_timer_wheel.mutex);
+
+    return 0;
+}
+
+/**  销毁定时器
+ * @note 不能在其它线程中销毁回调正在执行的定时器，可以在定时器自己的回调中销毁
+ * @param timer 定时器
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+int32_t txd_timer_destroy(txd_timer_handler_t* timer)
+{
+    if (txd_timer_stop(timer) != 0) {
+        return -1;
+    }
+
+    txd_free(timer);
+    return 0;
+}
+
+/**  处理所有已到期的定时器
+ * @remarks 使用txd_timer_service_start时由服务线程调用；不使用服务线程时，开发者可在自己的事件循环中调用
+ * @param next_ms 出参，距离下一次需要处理的时间，单位：毫秒，没有待处理的定时器时为TXD_TIMER_WAIT_FOREVER
+ *
+ * @return 本次回调的定时器个数
+ */
+int32_t txd_timer_process(uint32_t* next_ms)
+{
+    int32_t count = 0;
+    uint32_t clock_tick = 0;
+    uint32_t next_tick = 0;
+    uint32_t wait_ms = TXD_TIMER_WAIT_FOREVER;
+    txd_timer_handler_t* timer = NULL;
+    txd_timer_callback callback = NULL;
+    void* arg = NULL;
+
+    if (txd_timer_wheel_init() != 0) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_timer_wheel.mutex);
+    clock_tick = txd_timer_update_clock();
+    txd_timer_advance(clock_tick);
+
+    // 回调时释放锁，回调中可以启动、停止或销毁定时器
+    while (s_timer_wheel.expired != NULL) {
+        timer = s_timer_wheel.expired;
+        txd_timer_unlink(timer);
+        __atomic_fetch_sub(&s_timer_wheel.pending, 1, __ATOMIC_RELAXED);
+        callback = timer->callback;
+        arg = timer->arg;
+
+        if (timer->period != 0) {
+            timer->expires += timer->period;
+
+            // 处理被延误时跳过错过的周期，避免连续补发
+            if ((int32_t)(timer->expires - clock_tick) <= 0) {
+                timer->expires = clock_tick + timer->period;
+            }
+
+            txd_timer_enqueue(timer);
+            __atomic_fetch_add(&s_timer_wheel.pending, 1, __ATOMIC_RELAXED);
+        }
+
+        txd_mutex_unlock(s_timer_wheel.mutex);
+        callback(arg);
+        count++;
+        txd_mutex_lock(s_timer_wheel.mutex);
+    }
+
+    clock_tick = txd_timer_update_clock();
+
+    if (txd_timer_next_tick(&next_tick)) {
+        wait_ms = txd_timer_ticks_to_ms(next_tick, clock_tick);
+        __atomic_store_n(&s_timer_wheel.deadline_ms, s_timer_wheel.clock_ms + wait_ms, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(&s_timer_wheel.deadline_ms, s_timer_wheel.clock_ms + 0x7FFFFFFF, __ATOMIC_RELAXED);
+    }
+
+    txd_mutex_unlock(s_timer_wheel.mutex);
+
+    if (next_ms != NULL) {
+        *next_ms = wait_ms;
+    }
+
+    return count;
+}
+
+/**  获取距离下一个定时器到期的时间
+ * @note 不加锁，可以在空闲钩子中调用，用于决定系统可以休眠多长时间
+ *
+ * @return 距离下一次到期的时间，单位：毫秒，没有待处理的定时器时为TXD_TIMER_WAIT_FOREVER
+ */
+uint32_t txd_timer_next_deadline()
+{
+    int32_t delta = 0;
+
+    if (__atomic_load_n(&s_timer_wheel.pending, __ATOMIC_RELAXED) == 0) {
+        return TXD_TIMER_WAIT_FOREVER;
+    }
+
+    delta = (int32_t)(__atomic_load_n(&s_timer_wheel.deadline_ms, __ATOMIC_RELAXED) - txd_time_get_sysclock());
+
+    return (delta > 0) ? (uint32_t)delta : 0;
+}
+
+/**  设置没有服务线程时的唤醒函数
+ * @param hook 唤醒函数，NULL表示不唤醒
+ */
+void txd_timer_set_wakeup_hook(txd_timer_wakeup_hook hook)
+{
+    if (txd_timer_wheel_init() != 0) {
+        return;
+    }
+
+    txd_mutex_lock(s_timer_wheel.mutex);
+    s_timer_wheel.wakeup_hook = hook;
+    txd_mutex_unlock(s_timer_wheel.mutex);
+}
+
+static void txd_timer_service(void* arg)
+{
+    uint32_t next_ms = 0;
+
+    for (;;) {
+        txd_timer_process(&next_ms);
+
+        if (next_ms == TXD_TIMER_WAIT_FOREVER) {
+            xSemaphoreTake(s_timer_wheel.wakeup, portMAX_DELAY);
+        } else if (next_ms > 0) {
+            xSemaphoreTake(s_timer_wheel.wakeup, (next_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS);
+        }
+    }
+}
+
+/**  启动定时器服务线程
+ * @note 只需调用一次，重复调用直接返回成功
+ * @param priority 线程优先级
+ * @param stack_size 线程需要使用的栈大小
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+int32_t txd_timer_service_start(uint8_t priority, uint32_t stack_size)
+{
+    int32_t ret = 0;
+
+    if (txd_timer_wheel_init() != 0) {
+        return -1;
+    }
+
+    txd_mutex_lock(s_timer_wheel.mutex);
+
+    if ((s_timer_wheel.service == NULL) &&
+            (xTaskCreate(txd_timer_service, "txd_timer_task", stack_size / sizeof(portSTACK_TYPE), NULL, priority, &s_timer_wheel.service) != pdTRUE)) {
+        s_timer_wheel.service = NULL;
+        WELINK_LOGE("thread create fail");
+        ret = -1;
+    }
+
+    txd_mutex_unlock(s_timer_wheel.mutex);
+
+    return ret;
+}
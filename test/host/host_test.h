@@ -0,0 +1,80 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_port.h"
+
+/**
+ * @brief Minimal test helpers, a failed check prints the location and exits with 1 so ctest reports it
+ */
+#define TEST_ASSERT(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL(expected, actual) do { \
+        long long __expected = (long long)(expected); \
+        long long __actual = (long long)(actual); \
+        if (__expected != __actual) { \
+            fprintf(stderr, "%s:%d: %s == %s failed: expected %lld, got %lld\n", \
+                    __FILE__, __LINE__, #expected, #actual, __expected, __actual); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_MEMORY(expected, actual, len) do { \
+        if (memcmp((expected), (actual), (len)) != 0) { \
+            fprintf(stderr, "%s:%d: %s and %s differ\n", __FILE__, __LINE__, #expected, #actual); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define RUN_TEST(func) do { \
+        printf("%s\n", #func); \
+        func(); \
+    } while (0)
+
+/**
+ * @brief Real monotonic time for benchmarks, unlike the simulated clock in host_port.h
+ */
+static inline uint64_t host_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* __HOST_TEST_H__ */
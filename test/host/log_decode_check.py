@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+
+
+"""Decode the console written by test_log_binary with tools/welink_log_decode.py and compare each line
+with the message printf formats from the same arguments.
+
+Usage:
+    log_decode_check.py elf_file console_file expected_file
+"""
+
+from __future__ import print_function
+
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'tools'))
+
+import welink_log_decode  # noqa: E402
+
+
+def main():
+    elf = welink_log_decode.ElfFile(sys.argv[1])
+    logfmt = elf.section(welink_log_decode.LOGFMT_SECTION)
+
+    if logfmt is None:
+        print('%s has no %s section' % (sys.argv[1], welink_log_decode.LOGFMT_SECTION))
+        return 1
+
+    with open(sys.argv[2]) as f:
+        console = [line.rstrip('\n') for line in f if line.strip()]
+
+    with open(sys.argv[3]) as f:
+        expected = [line.rstrip('\n') for line in f if line.strip()]
+
+    records = 0
+
+    for i, (line, want) in enumerate(zip(console, expected)):
+        kind, message = want.split(' ', 1)
+        recorded = line.startswith(welink_log_decode.RECORD_PREFIX)
+
+        if recorded != (kind == 'R'):
+            print('line %d: %s, expected a %s' % (i, line, 'record' if kind == 'R' else 'text line'))
+            return 1
+
+        if recorded:
+            line = welink_log_decode.decode_record(elf, logfmt, line[len(welink_log_decode.RECORD_PREFIX):])
+            records += 1
+
+        if line is None or not line.endswith(message):
+            print('line %d: decoded %s, expected %s' % (i, line, message))
+            return 1
+
+    if len(console) != len(expected):
+        print('%d console lines, %d expected' % (len(console), len(expected)))
+        return 1
+
+    print('%d lines, %d records decoded' % (len(console), records))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
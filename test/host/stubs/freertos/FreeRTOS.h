@@ -0,0 +1,78 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Host build stand-in for the FreeRTOS headers, just enough for the port layer.
+ * Tasks, semaphores, queues and event groups are implemented on pthreads in host_freertos.c,
+ * critical sections share one recursive lock.
+ */
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_attr.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef TickType_t portTickType;
+typedef uint32_t portSTACK_TYPE;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           0xFFFFFFFFU
+#define configTICK_RATE_HZ      100
+#define configMAX_PRIORITIES    25
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS        portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define BIT0                    0x00000001
+#define BIT1                    0x00000002
+#define BIT2                    0x00000004
+#define BIT3                    0x00000008
+#define BIT4                    0x00000010
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+/* ESP32 takes a spinlock, ESP8266 takes none, both map to the same lock on the host */
+#define portENTER_CRITICAL(...)         vPortEnterCritical()
+#define portEXIT_CRITICAL(...)          vPortExitCritical()
+#define portENTER_CRITICAL_ISR(...)     vPortEnterCritical()
+#define portEXIT_CRITICAL_ISR(...)      vPortExitCritical()
+
+int xPortGetCoreID(void);
+int xPortGetTickRateHz(void);
+
+#endif /* __HOST_FREERTOS_H__ */
@@ -0,0 +1,448 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "nvs_flash.h"
+#include "host_port.h"
+
+/************************ 模拟时钟 *********************************/
+
+static uint64_t s_clock_us;
+static int64_t s_clock_real_offset_us;
+static bool s_clock_real;
+
+static uint64_t host_real_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void host_clock_set_us(uint64_t us)
+{
+    if (s_clock_real) {
+        s_clock_real_offset_us = (int64_t)(us - host_real_us());
+    }
+
+    __atomic_store_n(&s_clock_us, us, __ATOMIC_RELAXED);
+}
+
+uint64_t host_clock_get_us(void)
+{
+    if (s_clock_real) {
+        return host_real_us() + s_clock_real_offset_us;
+    }
+
+    return __atomic_load_n(&s_clock_us, __ATOMIC_RELAXED);
+}
+
+uint32_t host_clock_ms(void)
+{
+    return (uint32_t)(host_clock_get_us() / 1000);
+}
+
+void host_clock_advance_ms(uint32_t ms)
+{
+    if (s_clock_real) {
+        __atomic_fetch_add(&s_clock_real_offset_us, (int64_t)ms * 1000, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&s_clock_us, (uint64_t)ms * 1000, __ATOMIC_RELAXED);
+    }
+}
+
+void host_clock_follow_real_time(bool enable)
+{
+    uint64_t now = host_clock_get_us();
+
+    // 切换时时钟连续
+    s_clock_real = false;
+    s_clock_us = now;
+    s_clock_real_offset_us = (int64_t)(now - host_real_us());
+    s_clock_real = enable;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)host_clock_get_us();
+}
+
+/************************ esp_log *********************************/
+
+static vprintf_like_t s_log_vprintf = vprintf;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    vprintf_like_t orig = s_log_vprintf;
+
+    s_log_vprintf = func;
+    return orig;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    s_log_vprintf(format, args);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return host_clock_ms();
+}
+
+uint32_t esp_log_early_timestamp(void)
+{
+    return host_clock_ms();
+}
+
+/************************ esp_system *********************************/
+
+#define HOST_SHUTDOWN_HANDLERS 8
+
+static shutdown_handler_t s_shutdown_handlers[HOST_SHUTDOWN_HANDLERS];
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < HOST_SHUTDOWN_HANDLERS; i++) {
+        if (s_shutdown_handlers[i] == handle) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        if (s_shutdown_handlers[i] == NULL) {
+            s_shutdown_handlers[i] = handle;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+uint32_t host_shutdown(void)
+{
+    uint32_t i = 0;
+
+    // 与esp_restart()相同，按注册的逆序调用
+    for (i = HOST_SHUTDOWN_HANDLERS; i-- > 0;) {
+        if (s_shutdown_handlers[i] != NULL) {
+            s_shutdown_handlers[i]();
+        }
+    }
+
+    for (i = 0; (i < HOST_SHUTDOWN_HANDLERS) && (s_shutdown_handlers[i] != NULL); i++) {
+    }
+
+    return i;
+}
+
+/************************ nvs *********************************/
+
+/*
+ * 每个命名空间对应一个句柄，键值保存在一个链表中，进程内有效。
+ * 不区分是否commit，写入后立即可读
+ */
+#define HOST_NVS_NAMESPACES 16
+
+typedef struct host_nvs_entry {
+    struct host_nvs_entry* next;
+    nvs_handle handle;
+    char key[16];
+    size_t length;
+    uint8_t value[];
+} host_nvs_entry_t;
+
+static char s_nvs_namespace[HOST_NVS_NAMESPACES][16];
+static host_nvs_entry_t* s_nvs_entries;
+static uint32_t s_nvs_commits;
+
+static host_nvs_entry_t** host_nvs_find(nvs_handle handle, const char* key)
+{
+    host_nvs_entry_t** entry = &s_nvs_entries;
+
+    while ((*entry != NULL) && (((*entry)->handle != handle) || (strcmp((*entry)->key, key) != 0))) {
+        entry = &(*entry)->next;
+    }
+
+    return entry;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    host_nvs_reset();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle* out_handle)
+{
+    uint32_t i = 0;
+
+    if ((name == NULL) || (strlen(name) >= sizeof(s_nvs_namespace[0])) || (out_handle == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (s_nvs_namespace[i][0] == '\0') {
+            strcpy(s_nvs_namespace[i], name);
+        }
+
+        if (strcmp(s_nvs_namespace[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NVS_NO_FREE_PAGES;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length)
+{
+    host_nvs_entry_t* entry = NULL;
+
+    if ((key == NULL) || (strlen(key) >= sizeof(entry->key)) || ((value == NULL) && (length != 0))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_erase_key(handle, key);
+    entry = (host_nvs_entry_t*)malloc(sizeof(host_nvs_entry_t) + length);
+
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    entry->handle = handle;
+    strcpy(entry->key, key);
+    entry->length = length;
+    memcpy(entry->value, value, length);
+    entry->next = s_nvs_entries;
+    s_nvs_entries = entry;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length)
+{
+    host_nvs_entry_t* entry = *host_nvs_find(handle, key);
+
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    // 与IDF一致：out_value为NULL时只返回长度
+    if (out_value != NULL) {
+        if (*length < entry->length) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+
+        memcpy(out_value, entry->value, entry->length);
+    }
+
+    *length = entry->length;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key)
+{
+    host_nvs_entry_t** link = host_nvs_find(handle, key);
+    host_nvs_entry_t* entry = *link;
+
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *link = entry->next;
+    free(entry);
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    s_nvs_commits++;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+void host_nvs_reset(void)
+{
+    host_nvs_entry_t* entry = NULL;
+
+    while (s_nvs_entries != NULL) {
+        entry = s_nvs_entries;
+        s_nvs_entries = entry->next;
+        free(entry);
+    }
+
+    s_nvs_commits = 0;
+}
+
+uint32_t host_nvs_commits(void)
+{
+    return s_nvs_commits;
+}
+
+/************************ 分区（模拟NOR flash） *********************************/
+
+#define HOST_PARTITIONS 4
+
+typedef struct {
+    esp_partition_t partition;
+    host_partition_stats_t stats;
+    uint8_t* data;
+} host_partition_t;
+
+static host_partition_t s_partitions[HOST_PARTITIONS];
+
+static host_partition_t* host_partition_get(const esp_partition_t* partition)
+{
+    return (host_partition_t*)partition;
+}
+
+const esp_partition_t* host_partition_create(const char* label, uint32_t size)
+{
+    uint32_t i = 0;
+    host_partition_t* part = NULL;
+
+    for (i = 0; i < HOST_PARTITIONS; i++) {
+        part = &s_partitions[i];
+
+        if ((part->data != NULL) && (strcmp(part->partition.label, label) != 0)) {
+            continue;
+        }
+
+        // 同名分区重新创建时内容清空（擦除状态）
+        free(part->data);
+        memset(part, 0, sizeof(host_partition_t));
+        part->data = (uint8_t*)malloc(size);
+
+        if (part->data == NULL) {
+            return NULL;
+        }
+
+        memset(part->data, 0xFF, size);
+        part->partition.type = ESP_PARTITION_TYPE_DATA;
+        part->partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+        part->partition.address = 0x100000 * (i + 1);
+        part->partition.size = size;
+        strncpy(part->partition.label, label, sizeof(part->partition.label) - 1);
+
+        return &part->partition;
+    }
+
+    return NULL;
+}
+
+uint8_t* host_partition_data(const esp_partition_t* partition)
+{
+    return host_partition_get(partition)->data;
+}
+
+void host_partition_get_stats(const esp_partition_t* partition, host_partition_stats_t* stats)
+{
+    *stats = host_partition_get(partition)->stats;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < HOST_PARTITIONS; i++) {
+        if ((s_partitions[i].data != NULL) && (s_partitions[i].partition.type == type) &&
+                ((label == NULL) || (strcmp(s_partitions[i].partition.label, label) == 0))) {
+            return &s_partitions[i].partition;
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+    host_partition_t* part = host_partition_get(partition);
+
+    if ((src_offset > partition->size) || (size > partition->size - src_offset)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(dst, part->data + src_offset, size);
+    part->stats.reads++;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size)
+{
+    host_partition_t* part = host_partition_get(partition);
+    const uint8_t* bytes = (const uint8_t*)src;
+    size_t i = 0;
+
+    if ((dst_offset > partition->size) || (size > partition->size - dst_offset)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // NOR flash只能把1写成0
+    for (i = 0; i < size; i++) {
+        part->data[dst_offset + i] &= bytes[i];
+    }
+
+    part->stats.writes++;
+    part->stats.bytes_written += size;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t start_addr, size_t size)
+{
+    host_partition_t* part = host_partition_get(partition);
+
+    if ((start_addr % SPI_FLASH_SEC_SIZE != 0) || (size % SPI_FLASH_SEC_SIZE != 0) ||
+            (start_addr > partition->size) || (size > partition->size - start_addr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(part->data + start_addr, 0xFF, size);
+    part->stats.erases += size / SPI_FLASH_SEC_SIZE;
+
+    return ESP_OK;
+}
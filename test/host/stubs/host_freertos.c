@@ -0,0 +1,460 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "host_port.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t func;
+    void* arg;
+};
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t* items;
+};
+
+struct host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+static __thread struct host_task* s_current_task;
+
+static void host_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(void)
+{
+    pthread_once(&s_critical_once, host_critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+int xPortGetCoreID(void)
+{
+    return 0;
+}
+
+int xPortGetTickRateHz(void)
+{
+    return configTICK_RATE_HZ;
+}
+
+// 把超时的tick数换算成pthread_cond_timedwait使用的绝对时间（真实时间）
+static void host_deadline(TickType_t ticks, struct timespec* deadline)
+{
+    uint64_t ns = (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL;
+
+    clock_gettime(CLOCK_REALTIME, deadline);
+    ns += deadline->tv_nsec;
+    deadline->tv_sec += ns / 1000000000ULL;
+    deadline->tv_nsec = ns % 1000000000ULL;
+}
+
+// 在cond上等待pred成立，ticks为0时不等待，portMAX_DELAY为一直等待，调用者持有lock
+#define HOST_WAIT(lock, cond, ticks, pred) ({ \
+        struct timespec __deadline; \
+        int __ret = 0; \
+        if ((ticks) != portMAX_DELAY) { \
+            host_deadline(ticks, &__deadline); \
+        } \
+        while (!(pred) && (ticks) != 0 && __ret != ETIMEDOUT) { \
+            __ret = ((ticks) == portMAX_DELAY) ? pthread_cond_wait(cond, lock) : pthread_cond_timedwait(cond, lock, &__deadline); \
+        } \
+        (pred); \
+    })
+
+/************************ task *********************************/
+
+static void* host_task_entry(void* arg)
+{
+    struct host_task* task = (struct host_task*)arg;
+
+    s_current_task = task;
+    task->func(task->arg);
+
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char* name, uint32_t stack_depth, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle)
+{
+    struct host_task* task = (struct host_task*)calloc(1, sizeof(struct host_task));
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    task->func = func;
+    task->arg = arg;
+
+    // 句柄要在任务开始运行前写好，任务中可能马上会用到
+    if (handle != NULL) {
+        *handle = task;
+    }
+
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+
+    pthread_detach(task->thread);
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // 只支持删除自己，其它任务会一直运行到进程退出
+    if ((task == NULL) || (task == s_current_task)) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks * portTICK_PERIOD_MS / 1000,
+        .tv_nsec = (ticks * portTICK_PERIOD_MS % 1000) * 1000000L,
+    };
+
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return host_clock_ms() / portTICK_PERIOD_MS;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return taskSCHEDULER_RUNNING;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+void vTaskSuspendAll(void)
+{
+    vPortEnterCritical();
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    vPortExitCritical();
+    return pdFALSE;
+}
+
+/************************ semaphore *********************************/
+
+static SemaphoreHandle_t host_sem_create(UBaseType_t max, UBaseType_t count)
+{
+    struct host_sem* sem = (struct host_sem*)calloc(1, sizeof(struct host_sem));
+
+    if (sem == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->max = max;
+    sem->count = count;
+
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_sem_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return host_sem_create(max_count, initial_count);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+
+    if (HOST_WAIT(&sem->lock, &sem->cond, ticks, sem->count > 0)) {
+        sem->count--;
+        ret = pdTRUE;
+    }
+
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+
+    if (sem->count < sem->max) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+        ret = pdTRUE;
+    }
+
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t* woken)
+{
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+
+    return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+/************************ queue *********************************/
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue* queue = (struct host_queue*)calloc(1, sizeof(struct host_queue));
+
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    queue->items = (uint8_t*)calloc(length, item_size);
+
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (HOST_WAIT(&queue->lock, &queue->cond, ticks, queue->count < queue->length)) {
+        memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        ret = pdTRUE;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return ret;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    return xQueueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (HOST_WAIT(&queue->lock, &queue->cond, ticks, queue->count > 0)) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        ret = pdTRUE;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->items);
+    free(queue);
+}
+
+/************************ event group *********************************/
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group* group = (struct host_event_group*)calloc(1, sizeof(struct host_event_group));
+
+    if (group == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->cond, NULL);
+
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t ret = 0;
+
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    ret = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+
+    return ret;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t ret = 0;
+
+    pthread_mutex_lock(&group->lock);
+    ret = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+
+    return ret;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    EventBits_t ret = 0;
+
+    pthread_mutex_lock(&group->lock);
+    ret = group->bits;
+    pthread_mutex_unlock(&group->lock);
+
+    return ret;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    EventBits_t ret = 0;
+
+    pthread_mutex_lock(&group->lock);
+
+    if (HOST_WAIT(&group->lock, &group->cond, ticks,
+                  wait_for_all ? ((group->bits & bits) == bits) : ((group->bits & bits) != 0)) && clear_on_exit) {
+        ret = group->bits;
+        group->bits &= ~bits;
+    } else {
+        ret = group->bits;
+    }
+
+    pthread_mutex_unlock(&group->lock);
+
+    return ret;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->cond);
+    free(group);
+}
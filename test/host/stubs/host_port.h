@@ -0,0 +1,101 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __HOST_PORT_H__
+#define __HOST_PORT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Simulated clock
+ *
+ * txd_time_get_sysclock(), esp_timer_get_time(), esp_log_timestamp() and xTaskGetTickCount() all
+ * read this clock, it only moves when a test advances it, so timer driven code runs deterministically.
+ * Blocking waits (semaphores, queues, vTaskDelay) still use the real time.
+ */
+void host_clock_set_us(uint64_t us);
+uint64_t host_clock_get_us(void);
+uint32_t host_clock_ms(void);
+void host_clock_advance_ms(uint32_t ms);
+
+/**
+ * @brief  Let the simulated clock follow the real monotonic time from its current value, for tests
+ *         where the code under test waits in select() or on semaphores with timeouts from that clock
+ */
+void host_clock_follow_real_time(bool enable);
+
+/**
+ * @brief  Advance the simulated clock by ms, calling txd_timer_process() at every timer deadline
+ *
+ * @return number of timer callbacks
+ */
+uint32_t host_timer_run(uint32_t ms);
+
+/**
+ * @brief  Call the handlers registered with esp_register_shutdown_handler(), as esp_restart() does
+ *
+ * @return number of handlers called
+ */
+uint32_t host_shutdown(void);
+
+/**
+ * @brief Emulated NOR flash partition, write can only clear bits and erase sets a whole sector to 0xFF
+ */
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;
+    uint64_t bytes_written;
+} host_partition_stats_t;
+
+const esp_partition_t* host_partition_create(const char* label, uint32_t size);
+uint8_t* host_partition_data(const esp_partition_t* partition);
+void host_partition_get_stats(const esp_partition_t* partition, host_partition_stats_t* stats);
+
+/**
+ * @brief  Forget every blob stored with nvs_set_blob()
+ */
+void host_nvs_reset(void);
+
+/**
+ * @brief  Number of nvs_commit() calls since the last host_nvs_reset()
+ */
+uint32_t host_nvs_commits(void);
+
+/**
+ * @brief  Number of esp_welink_socket_wakeup() calls, when the test does not link txd_baseapi.c
+ */
+uint32_t host_socket_wakeups(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_PORT_H__ */
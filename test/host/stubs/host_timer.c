@@ -0,0 +1,53 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "txd_stdtypes.h"
+#include "txd_thread.h"
+#include "host_port.h"
+
+uint32_t host_timer_run(uint32_t ms)
+{
+    uint32_t count = 0;
+    uint32_t next_ms = 0;
+    uint32_t end = host_clock_ms() + ms;
+    uint32_t step = 0;
+    int32_t left = 0;
+    int32_t ret = 0;
+
+    // 每次把时钟推进到下一个到期时间（不超过end），与服务线程的等待方式相同
+    for (;;) {
+        ret = txd_timer_process(&next_ms);
+        count += (ret > 0) ? ret : 0;
+        left = (int32_t)(end - host_clock_ms());
+
+        if (left <= 0) {
+            break;
+        }
+
+        step = (next_ms < (uint32_t)left) ? next_ms : (uint32_t)left;
+        host_clock_advance_ms((step != 0) ? step : 1);
+    }
+
+    return count;
+}
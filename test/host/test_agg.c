@@ -0,0 +1,356 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_agg: every emitted window of a sliding stream compared with the exact statistics of
+ * the samples in it, streams with different slides sharing the timer, the timer going idle, and
+ * the cost of a sample.
+ */
+#include "host_test.h"
+#include "esp_welink_agg.h"
+#include "esp_welink_json.h"
+
+#define LOG_SAMPLES     200000
+#define BENCH_SAMPLES   4000000
+#define MAX_IDS         16
+
+static struct {
+    int32_t checked;                // 检查这个property_id发出的每个窗口，-1表示不检查
+    esp_welink_agg_stream_config_t config;  // 被检查的流的配置
+    uint32_t added_ms;              // 被检查的流创建的时间，pane从这里开始按slide对齐
+    uint32_t windows[MAX_IDS];      // 按property_id统计发出的窗口
+    uint32_t mismatches;
+    uint32_t percentile_windows;
+    int32_t percentile_error;
+    uint32_t count;
+    uint32_t times[LOG_SAMPLES];
+    int32_t values[LOG_SAMPLES];
+} s_log;
+
+static int32_t s_sorted[LOG_SAMPLES];
+
+int32_t esp_welink_batch_update(uint32_t property_id, const uint8_t* value, uint32_t value_len)
+{
+    return -1;
+}
+
+static int compare_int(const void* a, const void* b)
+{
+    int32_t x = *(const int32_t*)a;
+    int32_t y = *(const int32_t*)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static int32_t summary_int(const char* js, const esp_welink_json_token_t* tokens, int32_t count, const char* key)
+{
+    int32_t value = 0;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(js, &tokens[esp_welink_json_find(js, tokens, count, 0, key)], &value));
+    return value;
+}
+
+static int32_t percentile(uint32_t n, uint32_t percent)
+{
+    return s_sorted[(n * percent + 99) / 100 - 1];
+}
+
+// 按窗口的边界从样本记录中算出精确的统计，与发出的摘要比较
+static int32_t check_emit(uint32_t property_id, const uint8_t* value, uint32_t value_len)
+{
+    const esp_welink_agg_stream_config_t* config = &s_log.config;
+    esp_welink_json_token_t tokens[20];
+    const char* js = (const char*)value;
+    uint32_t slide_ms = 0;
+    uint32_t end = 0;
+    uint32_t start = 0;
+    uint32_t n = 0;
+    uint32_t i = 0;
+    int64_t sum = 0;
+    int32_t last = 0;
+    int32_t count = 0;
+    int32_t error = 0;
+    int32_t width = 0;
+
+    TEST_ASSERT(property_id < MAX_IDS);
+    s_log.windows[property_id]++;
+
+    if (s_log.checked < 0 || property_id != (uint32_t)s_log.checked) {
+        return 0;
+    }
+
+    // 窗口在发出它的时刻之前最后一个pane边界结束
+    slide_ms = config->slide_ms ? config->slide_ms : config->window_ms;
+    end = s_log.added_ms + (host_clock_ms() - s_log.added_ms) / slide_ms * slide_ms;
+    start = end - config->window_ms;
+
+    for (i = 0; i < s_log.count; i++) {
+        if (s_log.times[i] - start < config->window_ms) {
+            s_sorted[n++] = s_log.values[i];
+            sum += s_log.values[i];
+            last = s_log.values[i];
+        }
+    }
+
+    TEST_ASSERT(n > 0);
+    qsort(s_sorted, n, sizeof(int32_t), compare_int);
+
+    count = esp_welink_json_parse(js, value_len, tokens, 20);
+    TEST_ASSERT_EQUAL(17, count);
+
+    if ((uint32_t)summary_int(js, tokens, count, "count") != n || summary_int(js, tokens, count, "min") != s_sorted[0]
+            || summary_int(js, tokens, count, "max") != s_sorted[n - 1] || summary_int(js, tokens, count, "last") != last
+            || summary_int(js, tokens, count, "mean") != (int32_t)((sum + (int64_t)(n / 2)) / n)) {
+        fprintf(stderr, "window [%u, %u) of %u samples: %.*s\n", start, end, n, (int)value_len, js);
+        s_log.mismatches++;
+    }
+
+    // 百分位在草图区间内时误差不超过一个桶宽
+    if (percentile(n, 1) < config->sketch_lo || percentile(n, 99) >= config->sketch_hi) {
+        return 0;
+    }
+
+    width = (config->sketch_hi - config->sketch_lo + WELINK_AGG_SKETCH_BUCKETS) / WELINK_AGG_SKETCH_BUCKETS;
+    error = abs(summary_int(js, tokens, count, "p50") - percentile(n, 50));
+    error = (abs(summary_int(js, tokens, count, "p90") - percentile(n, 90)) > error) ? abs(summary_int(js, tokens, count, "p90") - percentile(n, 90)) : error;
+    error = (abs(summary_int(js, tokens, count, "p99") - percentile(n, 99)) > error) ? abs(summary_int(js, tokens, count, "p99") - percentile(n, 99)) : error;
+    s_log.percentile_windows++;
+    s_log.percentile_error = (error > s_log.percentile_error) ? error : s_log.percentile_error;
+
+    if (error > width) {
+        fprintf(stderr, "percentile error %d > %d: %.*s\n", error, width, (int)value_len, js);
+        s_log.mismatches++;
+    }
+
+    return 0;
+}
+
+static void agg_start(void)
+{
+    esp_welink_agg_config_t config = ESP_WELINK_AGG_CONFIG_DEFAULT();
+
+    config.emit = check_emit;
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_init(&config));
+    memset(&s_log, 0, sizeof(s_log));
+    s_log.checked = -1;
+}
+
+// 模拟重启：丢弃全部流
+static void agg_reboot(void)
+{
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_deinit());
+}
+
+static void test_agg_windows(void)
+{
+    esp_welink_agg_stream_config_t tumbling = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(5);
+    esp_welink_agg_stream_config_t sliding = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(7);
+    esp_welink_agg_stats_t stats;
+    int32_t streams[2];
+    int32_t value = 0;
+    uint32_t i = 0;
+
+    agg_start();
+    tumbling.window_ms = 1000;
+    sliding.window_ms = 10000;
+    sliding.slide_ms = 1000;
+    sliding.stats = ESP_WELINK_AGG_BASIC | ESP_WELINK_AGG_PERCENTILES;
+    sliding.sketch_lo = -200;
+    sliding.sketch_hi = 800;
+    streams[0] = esp_welink_agg_add_stream(&tumbling);
+    streams[1] = esp_welink_agg_add_stream(&sliding);
+    TEST_ASSERT(streams[0] >= 0 && streams[1] >= 0);
+    s_log.checked = sliding.property_id;
+    s_log.config = sliding;
+    s_log.added_ms = host_clock_ms();
+    srand48(3);
+
+    // 100Hz，偶尔停几秒到二十几秒，取值200到400，1%的离群值落在草图区间外
+    for (i = 0; i < LOG_SAMPLES; i++) {
+        host_timer_run((lrand48() % 500 == 0) ? 3000 + lrand48() % 20000 : 10);
+        value = 300 + (int32_t)(lrand48() % 200) - 100 + ((lrand48() % 100 == 0) ? (int32_t)(lrand48() % 2000) - 1000 : 0);
+        s_log.times[s_log.count] = host_clock_ms();
+        s_log.values[s_log.count++] = value;
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(streams[1], value));
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(streams[0], value));
+    }
+
+    // 没有样本后窗口由定时器关闭，最后一个窗口关闭后定时器停止
+    host_timer_run(60000);
+    TEST_ASSERT_EQUAL(0, host_timer_run(60000));
+
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_get_stats(&stats));
+    printf("  %u windows checked, %u mismatches, %u percentile windows, max percentile error %d (bucket width %d)\n",
+           s_log.windows[7], s_log.mismatches, s_log.percentile_windows, s_log.percentile_error,
+           (sliding.sketch_hi - sliding.sketch_lo + WELINK_AGG_SKETCH_BUCKETS) / WELINK_AGG_SKETCH_BUCKETS);
+    TEST_ASSERT_EQUAL(0, s_log.mismatches);
+    TEST_ASSERT(s_log.percentile_windows > 1000);
+    TEST_ASSERT_EQUAL(2 * LOG_SAMPLES, stats.samples);
+    TEST_ASSERT_EQUAL(stats.windows, s_log.windows[5] + s_log.windows[7]);
+    TEST_ASSERT_EQUAL(0, stats.emit_errors);
+
+    agg_reboot();
+}
+
+// 定时器按最早到期的流设置，其他流的窗口只在各自的pane结束时发出
+static void test_agg_mixed_slides(void)
+{
+    esp_welink_agg_stream_config_t fast = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(1);
+    esp_welink_agg_stream_config_t slow = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(2);
+    esp_welink_agg_stream_config_t sliding = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(3);
+    esp_welink_agg_summary_t summary;
+    int32_t streams[3];
+    uint32_t i = 0;
+
+    agg_start();
+    fast.window_ms = 1000;
+    slow.window_ms = 60000;
+    sliding.window_ms = 30000;
+    sliding.slide_ms = 10000;
+    streams[0] = esp_welink_agg_add_stream(&fast);
+    streams[1] = esp_welink_agg_add_stream(&slow);
+    streams[2] = esp_welink_agg_add_stream(&sliding);
+
+    // 5分钟，每个流每秒一个样本
+    for (i = 0; i < 300; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(streams[0], i));
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(streams[1], i));
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(streams[2], i));
+        host_timer_run(1000);
+    }
+
+    // 最后一个pane在刻度上到期
+    host_timer_run(1000);
+
+    printf("  5 minutes: %u windows of 1 s, %u of 60 s, %u of 30 s sliding by 10 s\n",
+           s_log.windows[1], s_log.windows[2], s_log.windows[3]);
+    TEST_ASSERT_EQUAL(300, s_log.windows[1]);
+    TEST_ASSERT_EQUAL(5, s_log.windows[2]);
+    TEST_ASSERT_EQUAL(30, s_log.windows[3]);
+
+    // 滑动窗口包含最近3个pane的样本
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_get(streams[2], &summary));
+    TEST_ASSERT_EQUAL(20, summary.count);
+    TEST_ASSERT_EQUAL(280, summary.min);
+    TEST_ASSERT_EQUAL(299, summary.last);
+
+    agg_reboot();
+}
+
+static void test_agg_config(void)
+{
+    esp_welink_agg_stream_config_t config = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(1);
+    esp_welink_agg_config_t agg_config = ESP_WELINK_AGG_CONFIG_DEFAULT();
+    esp_welink_agg_summary_t summary;
+    uint32_t i = 0;
+
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_add_stream(&config));
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_sample(0, 1));
+
+    agg_config.max_streams = 2;
+    agg_config.emit = check_emit;
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_init(&agg_config));
+    memset(&s_log, 0, sizeof(s_log));
+    s_log.checked = -1;
+
+    config.slide_ms = 3000;
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_add_stream(&config));
+    config.slide_ms = config.window_ms / (WELINK_AGG_MAX_PANES + 1);
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_add_stream(&config));
+    config.slide_ms = 0;
+    config.stats |= ESP_WELINK_AGG_P50;
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_add_stream(&config));
+    config.sketch_hi = 100;
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_add_stream(&config));
+    TEST_ASSERT_EQUAL(1, esp_welink_agg_add_stream(&config));
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_add_stream(&config));
+    TEST_ASSERT_EQUAL(-1, esp_welink_agg_sample(2, 1));
+
+    // 桶计数饱和，不回绕
+    for (i = 0; i < 70000; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_agg_sample(0, 50));
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_get(0, &summary));
+    TEST_ASSERT_EQUAL(70000, summary.count);
+    TEST_ASSERT(summary.p50 >= 48 && summary.p50 <= 52);
+
+    agg_reboot();
+}
+
+static void test_agg_sample_cost(void)
+{
+    esp_welink_agg_stream_config_t basic = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(1);
+    esp_welink_agg_stream_config_t sketch = ESP_WELINK_AGG_STREAM_CONFIG_DEFAULT(2);
+    esp_welink_agg_stats_t stats;
+    int32_t streams[4];
+    uint32_t random = 1;
+    uint64_t start = 0;
+    double cost = 0;
+    uint32_t i = 0;
+
+    agg_start();
+    basic.window_ms = 1000;
+    sketch.window_ms = 10000;
+    sketch.slide_ms = 1000;
+    sketch.stats = ESP_WELINK_AGG_BASIC | ESP_WELINK_AGG_PERCENTILES;
+    sketch.sketch_lo = -300;
+    sketch.sketch_hi = 700;
+    streams[0] = esp_welink_agg_add_stream(&basic);
+    streams[1] = esp_welink_agg_add_stream(&sketch);
+    basic.property_id = 3;
+    sketch.property_id = 4;
+    streams[2] = esp_welink_agg_add_stream(&basic);
+    streams[3] = esp_welink_agg_add_stream(&sketch);
+
+    // 4个流共100k样本每秒，包括窗口的关闭和发出
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_SAMPLES; i++) {
+        if (i % 100 == 0) {
+            host_timer_run(1);
+        }
+
+        random = random * 1103515245 + 12345;
+        esp_welink_agg_sample(streams[i & 3], (int32_t)(random >> 22) - 300);
+    }
+
+    cost = (double)(host_bench_now_ns() - start) / BENCH_SAMPLES;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_agg_get_stats(&stats));
+    printf("  %u samples over 4 streams, %u windows: %.1f ns per sample\n", stats.samples, stats.windows, cost);
+    TEST_ASSERT_EQUAL(BENCH_SAMPLES, stats.samples);
+
+    agg_reboot();
+}
+
+int main(void)
+{
+    RUN_TEST(test_agg_windows);
+    RUN_TEST(test_agg_mixed_slides);
+    RUN_TEST(test_agg_config);
+    RUN_TEST(test_agg_sample_cost);
+
+    return 0;
+}
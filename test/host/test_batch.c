@@ -0,0 +1,276 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_batch: last write wins, packing into WELINK_BATCH_MAX_BYTES messages, and the size, deadline
+ * and idle flushes, against a fake send function which records every message.
+ */
+#include "host_test.h"
+#include "esp_welink_batch.h"
+#include "txd_error.h"
+
+#define MAX_ENTRIES     16
+#define MAX_VALUE_LEN   200
+#define MAX_DELAY_MS    1000
+#define IDLE_MS         100
+#define FAKE_MESSAGES   512
+
+typedef struct {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t sent_ms;
+} fake_message_t;
+
+static struct {
+    fake_message_t messages[FAKE_MESSAGES];
+    uint32_t count;
+    int32_t ret;
+    uint8_t last_value[MAX_ENTRIES][MAX_VALUE_LEN];     // 每个属性最后发送的值
+    uint32_t last_len[MAX_ENTRIES];
+} s_fake;
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+static int32_t fake_send(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    fake_message_t* message = &s_fake.messages[s_fake.count];
+    uint32_t id = 0;
+    uint32_t i = 0;
+
+    if (s_fake.ret != err_success) {
+        return s_fake.ret;
+    }
+
+    TEST_ASSERT(s_fake.count < FAKE_MESSAGES);
+    message->count = datapoints_count;
+    message->bytes = 0;
+    message->sent_ms = host_clock_ms();
+
+    for (i = 0; i < datapoints_count; i++) {
+        id = datapoints[i].property_id;
+        TEST_ASSERT(id < MAX_ENTRIES);
+        memcpy(s_fake.last_value[id], datapoints[i].property_value, datapoints[i].property_value_len);
+        s_fake.last_len[id] = datapoints[i].property_value_len;
+        message->bytes += datapoints[i].property_value_len;
+    }
+
+    TEST_ASSERT(message->bytes <= WELINK_BATCH_MAX_BYTES);
+    s_fake.count++;
+    *pCookie = s_fake.count;
+
+    return err_success;
+}
+
+static void update(uint32_t id, uint8_t fill, uint32_t len)
+{
+    uint8_t value[MAX_VALUE_LEN];
+
+    memset(value, fill, len);
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_update(id, value, len));
+}
+
+static esp_welink_batch_stats_t stats(void)
+{
+    esp_welink_batch_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_get_stats(&stats));
+    return stats;
+}
+
+// 同一属性的多次更新只发送最后一个值
+static void test_batch_last_write_wins(void)
+{
+    uint32_t coalesced = stats().coalesced;
+
+    s_fake.count = 0;
+    update(1, 'a', 1);
+    update(2, 'c', 3);
+    update(1, 'b', 2);
+    TEST_ASSERT_EQUAL(2, esp_welink_batch_pending());
+    TEST_ASSERT_EQUAL(coalesced + 1, stats().coalesced);
+
+    TEST_ASSERT_EQUAL(1, esp_welink_batch_flush());
+    TEST_ASSERT_EQUAL(1, s_fake.count);
+    TEST_ASSERT_EQUAL(2, s_fake.messages[0].count);
+    TEST_ASSERT_EQUAL(5, s_fake.messages[0].bytes);
+    TEST_ASSERT_EQUAL(2, s_fake.last_len[1]);
+    TEST_ASSERT(memcmp(s_fake.last_value[1], "bb", 2) == 0);
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_pending());
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_flush());
+}
+
+// 待发送的数据够一条消息时按首次适应递减装箱，只发送最满的一条，其余的留下
+static void test_batch_flush_on_size(void)
+{
+    uint32_t flush_size = stats().flush_size;
+
+    s_fake.count = 0;
+    update(1, 1, 100);
+    update(2, 2, 90);
+    update(3, 3, 200);
+    TEST_ASSERT_EQUAL(0, s_fake.count);
+
+    // 540字节：200 + 150 + 100 = 450装入第一条，90放不下
+    update(4, 4, 150);
+    TEST_ASSERT_EQUAL(flush_size + 1, stats().flush_size);
+    TEST_ASSERT_EQUAL(1, s_fake.count);
+    TEST_ASSERT_EQUAL(3, s_fake.messages[0].count);
+    TEST_ASSERT_EQUAL(450, s_fake.messages[0].bytes);
+    TEST_ASSERT_EQUAL(1, esp_welink_batch_pending());
+
+    TEST_ASSERT_EQUAL(1, esp_welink_batch_flush());
+    TEST_ASSERT_EQUAL(90, s_fake.messages[1].bytes);
+}
+
+// 随机的更新流：每条消息不超过480字节，每个属性最后发送的都是最后更新的值，消息的平均填充率
+static void test_batch_packing_stream(void)
+{
+    uint8_t latest[MAX_ENTRIES];
+    uint32_t latest_len[MAX_ENTRIES];
+    esp_welink_batch_stats_t before = stats();
+    esp_welink_batch_stats_t after;
+    uint32_t bytes = 0;
+    uint32_t id = 0;
+    uint32_t len = 0;
+    uint32_t i = 0;
+
+    s_fake.count = 0;
+    memset(latest_len, 0, sizeof(latest_len));
+    srand48(35);
+
+    for (i = 0; i < 2000; i++) {
+        id = lrand48() % MAX_ENTRIES;
+        len = 1 + lrand48() % 120;
+        latest[id] = (uint8_t)i;
+        latest_len[id] = len;
+        update(id, latest[id], len);
+        host_timer_run(lrand48() % 3);
+    }
+
+    esp_welink_batch_flush();
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_pending());
+
+    for (id = 0; id < MAX_ENTRIES; id++) {
+        TEST_ASSERT_EQUAL(latest_len[id], s_fake.last_len[id]);
+        TEST_ASSERT_EQUAL(latest[id], s_fake.last_value[id][0]);
+        TEST_ASSERT_EQUAL(latest[id], s_fake.last_value[id][latest_len[id] - 1]);
+    }
+
+    for (i = 0; i < s_fake.count; i++) {
+        bytes += s_fake.messages[i].bytes;
+    }
+
+    after = stats();
+    printf("  2000 updates, %u datapoints in %u messages, average fill %.1f%% of %u bytes, "
+           "%u size, %u deadline, %u idle flushes\n",
+           after.datapoints - before.datapoints, s_fake.count, 100.0 * bytes / s_fake.count / WELINK_BATCH_MAX_BYTES,
+           WELINK_BATCH_MAX_BYTES, after.flush_size - before.flush_size, after.flush_deadline - before.flush_deadline,
+           after.flush_idle - before.flush_idle);
+    TEST_ASSERT_EQUAL(s_fake.count, after.messages - before.messages);
+    TEST_ASSERT(bytes * 100 > s_fake.count * WELINK_BATCH_MAX_BYTES * 75);
+}
+
+// 一直有更新时空闲不会触发，最早的更新等待max_delay_ms后发送
+static void test_batch_flush_on_deadline(void)
+{
+    uint32_t flush_deadline = stats().flush_deadline;
+    uint32_t start = host_clock_ms();
+    uint32_t i = 0;
+
+    s_fake.count = 0;
+
+    for (i = 0; i < 30 && s_fake.count == 0; i++) {
+        update(5, (uint8_t)i, 4);
+        host_timer_run(IDLE_MS / 2);
+    }
+
+    TEST_ASSERT_EQUAL(1, s_fake.count);
+    TEST_ASSERT_EQUAL(flush_deadline + 1, stats().flush_deadline);
+    TEST_ASSERT(s_fake.messages[0].sent_ms - start >= MAX_DELAY_MS);
+    TEST_ASSERT(s_fake.messages[0].sent_ms - start <= MAX_DELAY_MS + 10);
+}
+
+// 最后一次更新后idle_ms没有新的更新时发送
+static void test_batch_flush_on_idle(void)
+{
+    uint32_t flush_idle = stats().flush_idle;
+    uint32_t start = 0;
+
+    s_fake.count = 0;
+    host_timer_run(MAX_DELAY_MS);
+    update(6, 6, 10);
+    host_timer_run(IDLE_MS / 2);
+    start = host_clock_ms();
+    update(7, 7, 10);
+    TEST_ASSERT_EQUAL(0, s_fake.count);
+
+    host_timer_run(IDLE_MS + 10);
+    TEST_ASSERT_EQUAL(1, s_fake.count);
+    TEST_ASSERT_EQUAL(2, s_fake.messages[0].count);
+    TEST_ASSERT_EQUAL(flush_idle + 1, stats().flush_idle);
+    TEST_ASSERT(s_fake.messages[0].sent_ms - start >= IDLE_MS);
+    TEST_ASSERT(s_fake.messages[0].sent_ms - start <= IDLE_MS + 10);
+}
+
+// 发送失败的值留在池中，WELINK_BATCH_RETRY_MS后重试
+static void test_batch_send_error(void)
+{
+    uint32_t send_errors = stats().send_errors;
+
+    s_fake.count = 0;
+    s_fake.ret = err_failed;
+    update(8, 8, 10);
+    TEST_ASSERT_EQUAL(-1, esp_welink_batch_flush());
+    TEST_ASSERT_EQUAL(1, esp_welink_batch_pending());
+    TEST_ASSERT_EQUAL(send_errors + 1, stats().send_errors);
+
+    s_fake.ret = err_success;
+    host_timer_run(WELINK_BATCH_RETRY_MS + 10);
+    TEST_ASSERT_EQUAL(1, s_fake.count);
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_pending());
+}
+
+int main(void)
+{
+    esp_welink_batch_config_t config = ESP_WELINK_BATCH_CONFIG_DEFAULT();
+
+    config.max_entries = MAX_ENTRIES;
+    config.max_value_len = MAX_VALUE_LEN;
+    config.max_delay_ms = MAX_DELAY_MS;
+    config.idle_ms = IDLE_MS;
+    config.send = fake_send;
+    TEST_ASSERT_EQUAL(0, esp_welink_batch_init(&config));
+
+    RUN_TEST(test_batch_last_write_wins);
+    RUN_TEST(test_batch_flush_on_size);
+    RUN_TEST(test_batch_packing_stream);
+    RUN_TEST(test_batch_flush_on_deadline);
+    RUN_TEST(test_batch_flush_on_idle);
+    RUN_TEST(test_batch_send_error);
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_boot: the breakdown datapoint of a boot, the history rotating over ten boots and
+ * shrinking with the configuration, completion on the timeout, marks before init, a corrupted
+ * history, marks from several tasks while the boot completes, and the cost of a mark.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+#include "host_test.h"
+#include "nvs.h"
+#include "esp_welink_boot.h"
+#include "txd_error.h"
+
+#define BOOT_PROPERTY   900
+#define BOOT_NVS_KEY    "boots"         // 历史记录在NVS中的键，与esp_welink_boot.c相同
+#define HISTORY_SIZE    (3 * sizeof(uint32_t) + sizeof(esp_welink_boot_record_t) * WELINK_BOOT_MAX_HISTORY)
+#define MAX_VALUE       320
+#define BOOT_SPACING_US 100000000       // 每次启动在模拟时钟上间隔100秒
+#define MARKERS         4
+
+// 每个阶段相对于启动的时间，与实际设备上的量级相当
+static const uint32_t s_offsets_us[ESP_WELINK_BOOT_PHASE_MAX] = {
+    31200, 48900, 120000, 1900000, 2300000, 2310000, 2320000, 2400000, 2600000, 3100000, 3150000,
+};
+
+static struct {
+    uint32_t reports;
+    uint32_t property_id;
+    char value[MAX_VALUE + 1];
+} s_fake;
+
+static uint64_t s_base_us;
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    TEST_ASSERT_EQUAL(1, datapoints_count);
+    TEST_ASSERT(datapoints[0].property_value_len <= MAX_VALUE);
+    s_fake.reports++;
+    s_fake.property_id = datapoints[0].property_id;
+    memcpy(s_fake.value, datapoints[0].property_value, datapoints[0].property_value_len);
+    s_fake.value[datapoints[0].property_value_len] = '\0';
+    *pCookie = s_fake.reports;
+
+    return err_success;
+}
+
+// 模拟重启：丢弃内存中的打点，NVS中的历史保留；时钟跳到下一次启动的起点
+static void boot_reboot(void)
+{
+    esp_welink_boot_deinit();
+    memset(&s_fake, 0, sizeof(s_fake));
+    s_base_us = (host_clock_get_us() / BOOT_SPACING_US + 1) * BOOT_SPACING_US;
+    host_clock_set_us(s_base_us);
+}
+
+static void boot_start(uint32_t history)
+{
+    esp_welink_boot_config_t config = ESP_WELINK_BOOT_CONFIG_DEFAULT();
+
+    config.history = history;
+    config.property_id = BOOT_PROPERTY;
+    config.report = fake_report;
+    TEST_ASSERT_EQUAL(0, esp_welink_boot_init(&config));
+}
+
+static void mark_at(esp_welink_boot_phase_t phase, uint32_t offset_us)
+{
+    host_clock_set_us(s_base_us + offset_us);
+    esp_welink_boot_mark(phase);
+}
+
+// 在打点之间运行定时器，与设备上服务线程一直在运行相同
+static void boot_run(esp_welink_boot_phase_t last)
+{
+    uint32_t i = 0;
+
+    for (i = ESP_WELINK_BOOT_APP_MAIN; i <= last; i++) {
+        mark_at(i, s_offsets_us[i]);
+        host_timer_run(0);
+    }
+}
+
+static void assert_record(const esp_welink_boot_record_t* record, uint32_t boot, uint64_t base_us,
+                          esp_welink_boot_phase_t last)
+{
+    uint32_t i = 0;
+
+    TEST_ASSERT_EQUAL(boot, record->boot);
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        TEST_ASSERT_EQUAL((i <= last) ? (uint32_t)(base_us + s_offsets_us[i]) : 0, record->us[i]);
+    }
+}
+
+static void test_boot_breakdown(void)
+{
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+
+    host_nvs_reset();
+    boot_reboot();
+    s_base_us = 0;
+    host_clock_set_us(0);
+    boot_start(WELINK_BOOT_MAX_HISTORY);
+    boot_run(ESP_WELINK_BOOT_ONLINE);
+    TEST_ASSERT_EQUAL(0, s_fake.reports);
+
+    // 第一次上报确认后立即完成
+    mark_at(ESP_WELINK_BOOT_FIRST_REPORT, s_offsets_us[ESP_WELINK_BOOT_FIRST_REPORT]);
+    host_timer_run(10);
+    TEST_ASSERT_EQUAL(1, s_fake.reports);
+    TEST_ASSERT_EQUAL(BOOT_PROPERTY, s_fake.property_id);
+    printf("  %u B: %s\n", (uint32_t)strlen(s_fake.value), s_fake.value);
+    TEST_ASSERT(strcmp(s_fake.value, "{\"boot\":1,\"app_main\":31.2,\"nvs_init\":48.9,\"wifi_start\":120.0,"
+                       "\"wifi_connected\":1900.0,\"got_ip\":2300.0,\"task_start\":2310.0,\"device_info\":2320.0,"
+                       "\"dns\":2400.0,\"tcp_connect\":2600.0,\"online\":3100.0,\"first_report\":3150.0}") == 0);
+
+    // 完成之后重连的打点不再生效
+    mark_at(ESP_WELINK_BOOT_TCP_CONNECT, 60000000);
+    host_timer_run(20000);
+    TEST_ASSERT_EQUAL(1, s_fake.reports);
+    TEST_ASSERT_EQUAL(1, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    assert_record(&records[0], 1, 0, ESP_WELINK_BOOT_FIRST_REPORT);
+    TEST_ASSERT(strcmp(esp_welink_boot_phase_name(ESP_WELINK_BOOT_PHASE_MAX), "unknown") == 0);
+}
+
+static void test_boot_history(void)
+{
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+    uint64_t bases[11];
+    uint32_t boot = 0;
+    int32_t i = 0;
+
+    // 接着上一个测试的第1次启动
+    for (boot = 2; boot <= 10; boot++) {
+        boot_reboot();
+        bases[boot] = s_base_us;
+        boot_start(WELINK_BOOT_MAX_HISTORY);
+
+        if (boot < 10) {
+            boot_run(ESP_WELINK_BOOT_FIRST_REPORT);
+            host_timer_run(10);
+        } else {
+            // 上线后没有确认的消息，complete_timeout_ms后完成
+            boot_run(ESP_WELINK_BOOT_ONLINE);
+            host_timer_run(9980);
+            TEST_ASSERT_EQUAL(0, s_fake.reports);
+            host_timer_run(30);
+        }
+
+        TEST_ASSERT_EQUAL(1, s_fake.reports);
+    }
+
+    TEST_ASSERT(strstr(s_fake.value, "\"first_report\"") == NULL);
+    TEST_ASSERT_EQUAL(WELINK_BOOT_MAX_HISTORY, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+
+    for (i = 0; i < WELINK_BOOT_MAX_HISTORY; i++) {
+        boot = i + 3;
+        assert_record(&records[i], boot, bases[boot],
+                      (boot < 10) ? ESP_WELINK_BOOT_FIRST_REPORT : ESP_WELINK_BOOT_ONLINE);
+    }
+
+    TEST_ASSERT_EQUAL(3, esp_welink_boot_get_history(records, 3));
+    TEST_ASSERT_EQUAL(8, records[0].boot);
+
+    // 减少保留的次数后只剩最近的3次
+    boot_reboot();
+    boot_start(3);
+    boot_run(ESP_WELINK_BOOT_FIRST_REPORT);
+    host_timer_run(10);
+    TEST_ASSERT_EQUAL(3, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    TEST_ASSERT_EQUAL(9, records[0].boot);
+    TEST_ASSERT_EQUAL(11, records[2].boot);
+    printf("  11 boots, history %u..%u\n", records[0].boot, records[2].boot);
+}
+
+static void test_boot_before_init(void)
+{
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+
+    // 第一次上报在初始化之前已经确认，初始化后立即完成
+    boot_reboot();
+    boot_run(ESP_WELINK_BOOT_FIRST_REPORT);
+    boot_start(WELINK_BOOT_MAX_HISTORY);
+    host_timer_run(10);
+    TEST_ASSERT_EQUAL(1, s_fake.reports);
+
+    // 初始化之前已经上线，从初始化开始等待complete_timeout_ms
+    boot_reboot();
+    boot_run(ESP_WELINK_BOOT_ONLINE);
+    boot_start(WELINK_BOOT_MAX_HISTORY);
+    host_timer_run(9980);
+    TEST_ASSERT_EQUAL(0, s_fake.reports);
+    host_timer_run(30);
+    TEST_ASSERT_EQUAL(1, s_fake.reports);
+    TEST_ASSERT_EQUAL(5, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    TEST_ASSERT_EQUAL(13, records[4].boot);
+}
+
+static void test_boot_corrupted(void)
+{
+    uint8_t history[HISTORY_SIZE];
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+    nvs_handle handle;
+    size_t len = 0;
+
+    // 先确认历史记录的大小，大小正确的无效记录才会检查到magic
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open("welink_boot", NVS_READWRITE, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(handle, BOOT_NVS_KEY, NULL, &len));
+    TEST_ASSERT_EQUAL(sizeof(history), len);
+    memset(history, 0xA5, sizeof(history));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(handle, BOOT_NVS_KEY, history, sizeof(history)));
+    TEST_ASSERT_EQUAL(0, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(handle, BOOT_NVS_KEY, history, sizeof(history) - 4));
+    TEST_ASSERT_EQUAL(0, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    nvs_close(handle);
+
+    // 无效的历史被丢弃，启动序号从1重新开始
+    boot_reboot();
+    boot_start(WELINK_BOOT_MAX_HISTORY);
+    boot_run(ESP_WELINK_BOOT_FIRST_REPORT);
+    host_timer_run(10);
+    TEST_ASSERT_EQUAL(1, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    TEST_ASSERT_EQUAL(1, records[0].boot);
+}
+
+static int32_t s_markers_done;
+
+// 按上报的格式写出一条记录：启动序号和到达的各阶段，单位为毫秒，保留一位小数
+static void format_record(const esp_welink_boot_record_t* record, char* out, uint32_t size)
+{
+    uint32_t len = 0;
+    uint32_t i = 0;
+
+    len = snprintf(out, size, "{\"boot\":%u", record->boot);
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        if (record->us[i] != 0) {
+            len += snprintf(out + len, size - len, ",\"%s\":%u.%u", esp_welink_boot_phase_name(i),
+                            record->us[i] / 1000, record->us[i] / 100 % 10);
+        }
+    }
+
+    snprintf(out + len, size - len, "}");
+}
+
+// 事件回调、welink任务和SDK线程同时打点，每个阶段都重复打；DNS和TCP连接在第一次上报之后才打，模拟完成时正在重连
+static void* marker_task(void* arg)
+{
+    esp_welink_boot_record_t current;
+    uint32_t seed = (uint32_t)(intptr_t)arg;
+    uint32_t after = 0;
+    esp_welink_boot_phase_t phase = ESP_WELINK_BOOT_APP_MAIN;
+
+    while (after < 20000) {
+        seed = seed * 1103515245 + 12345;
+        phase = (esp_welink_boot_phase_t)((seed >> 16) % ESP_WELINK_BOOT_PHASE_MAX);
+
+        esp_welink_boot_get_current(&current);
+
+        if ((phase == ESP_WELINK_BOOT_DNS || phase == ESP_WELINK_BOOT_TCP_CONNECT)
+            && current.us[ESP_WELINK_BOOT_FIRST_REPORT] == 0) {
+            continue;
+        }
+
+        esp_welink_boot_mark(phase);
+        after += esp_welink_boot_get_current(&current);
+    }
+
+    __atomic_fetch_add(&s_markers_done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void test_boot_threads(void)
+{
+    esp_welink_boot_record_t records[WELINK_BOOT_MAX_HISTORY];
+    esp_welink_boot_record_t after;
+    pthread_t threads[MARKERS];
+    char value[MAX_VALUE + 1];
+    int32_t i = 0;
+
+    host_nvs_reset();
+    boot_reboot();
+    boot_start(WELINK_BOOT_MAX_HISTORY);
+    s_markers_done = 0;
+
+    for (i = 0; i < MARKERS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, marker_task, (void*)(intptr_t)(i + 1)));
+    }
+
+    // 定时器在主线程中运行，完成与打点同时进行
+    while (__atomic_load_n(&s_markers_done, __ATOMIC_ACQUIRE) != MARKERS) {
+        host_timer_run(1);
+        sched_yield();
+    }
+
+    for (i = 0; i < MARKERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    host_timer_run(20000);
+    TEST_ASSERT_EQUAL(1, s_fake.reports);
+    TEST_ASSERT_EQUAL(1, esp_welink_boot_get_history(records, WELINK_BOOT_MAX_HISTORY));
+    TEST_ASSERT(records[0].us[ESP_WELINK_BOOT_FIRST_REPORT] != 0);
+
+    // 上报的和保存的是同一份记录
+    format_record(&records[0], value, sizeof(value));
+    TEST_ASSERT(strcmp(value, s_fake.value) == 0);
+
+    TEST_ASSERT_EQUAL(1, esp_welink_boot_get_current(&after));
+
+    for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX; i++) {
+        TEST_ASSERT(after.us[i] >= s_base_us);
+    }
+
+    printf("  %u tasks marking while the boot completes: %s\n", MARKERS, value);
+}
+
+static void test_boot_cost(void)
+{
+    esp_welink_boot_record_t current;
+    uint64_t start = 0;
+    uint32_t boots = 0;
+    uint32_t i = 0;
+
+    boot_reboot();
+    start = host_bench_now_ns();
+
+    // 每个阶段打一次新的，再重复打十次
+    for (boots = 0; boots < 200000; boots++) {
+        esp_welink_boot_deinit();
+
+        for (i = 0; i < ESP_WELINK_BOOT_PHASE_MAX * 11; i++) {
+            esp_welink_boot_mark((esp_welink_boot_phase_t)(i % ESP_WELINK_BOOT_PHASE_MAX));
+        }
+    }
+
+    printf("  %.1f ns per mark\n", (double)(host_bench_now_ns() - start) / (boots * ESP_WELINK_BOOT_PHASE_MAX * 11));
+    TEST_ASSERT_EQUAL(0, esp_welink_boot_get_current(&current));
+    TEST_ASSERT(current.us[ESP_WELINK_BOOT_FIRST_REPORT] != 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_boot_breakdown);
+    RUN_TEST(test_boot_history);
+    RUN_TEST(test_boot_before_init);
+    RUN_TEST(test_boot_corrupted);
+    RUN_TEST(test_boot_threads);
+    RUN_TEST(test_boot_cost);
+
+    return 0;
+}
@@ -0,0 +1,506 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_chunk against a fake SDK which allows 5 sends per second and calls back late, early, with an
+ * error or never: the window is respected and only the failed chunks are sent again. The receiver gets
+ * the chunks out of order, duplicated, malformed, mutated and with a bad CRC.
+ */
+#include "host_test.h"
+#include "esp_welink_chunk.h"
+#include "txd_error.h"
+
+#define PROPERTY_ID     900
+#define CHUNK_SIZE      100
+#define WINDOW          4
+#define TIMEOUT_MS      5000
+#define MAX_RETRIES     5
+#define RX_MAX_LEN      4096
+#define DATA_LEN        3000
+#define CHUNKS          ((DATA_LEN + CHUNK_SIZE - 1) / CHUNK_SIZE)
+#define FAKE_RATE       5
+#define FAKE_FRAMES     256
+
+typedef struct {
+    uint32_t cookie;
+    uint32_t due_ms;
+    uint32_t frame;
+    bool lost;
+} fake_pending_t;
+
+typedef struct {
+    uint8_t value[WELINK_CHUNK_MAX_FRAME];
+    uint32_t len;
+} fake_frame_t;
+
+static struct {
+    uint32_t next_cookie;
+    on_send_datapoint cb;
+    fake_pending_t pending[FAKE_FRAMES];
+    uint32_t count;
+    fake_frame_t frames[FAKE_FRAMES];   // 每次成功发送的分片
+    uint32_t frame_count;
+    uint32_t sent_ms[FAKE_RATE];
+    uint32_t sends;
+    uint32_t rejected;
+    uint32_t max_inflight;
+    uint32_t latency_ms;
+    uint32_t early_every;       // 每隔几条在发送函数返回前回调
+    uint32_t fail_every;        // 每隔几条回调错误，分片没有送达
+    uint32_t lost_every;        // 每隔几条送达了但一直不回调
+    bool deliver;               // 送达的分片交给接收端
+} s_fake;
+
+static uint8_t s_data[DATA_LEN];
+static uint32_t s_seq_sends[CHUNKS];
+static uint32_t s_seq_failures[CHUNKS];
+static uint32_t s_done_calls;
+static int32_t s_done_result;
+static uint32_t s_rx_calls;
+static uint32_t s_rx_len;
+static uint8_t s_rx_data[RX_MAX_LEN];
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+static uint32_t frame_seq(const fake_frame_t* frame)
+{
+    const uint8_t* p = memchr(frame->value, ':', frame->len);
+
+    return (uint32_t)atoi((const char*)p + 1);
+}
+
+static int32_t deliver(const uint8_t* value, uint32_t len)
+{
+    txd_uint64_t sender = {{1, 2, 3, 4, 5, 6, 7, 8}};
+    txd_datapoint_t dp = {0};
+    txd_datapoint_t ack = {0};
+    int32_t ret = 0;
+
+    dp.property_id = PROPERTY_ID;
+    dp.property_value = (uint8_t*)value;
+    dp.property_value_len = len;
+    ret = esp_welink_chunk_receive(sender, &dp, &ack);
+
+    // ack带回的是分片头
+    if (ret != ESP_WELINK_CHUNK_RET_INVALID) {
+        TEST_ASSERT(ack.property_value == value);
+        TEST_ASSERT(ack.property_value_len > 10 && ack.property_value_len <= WELINK_CHUNK_MAX_HEADER);
+        TEST_ASSERT_EQUAL(':', ack.property_value[ack.property_value_len - 1]);
+    }
+
+    return ret;
+}
+
+static void fake_complete(fake_pending_t* p)
+{
+    fake_frame_t* frame = &s_fake.frames[p->frame];
+    int32_t err_code = err_success;
+
+    if (s_fake.fail_every != 0 && p->cookie % s_fake.fail_every == 0) {
+        err_code = err_failed;
+        s_seq_failures[frame_seq(frame)]++;
+    } else if (s_fake.deliver) {
+        TEST_ASSERT(deliver(frame->value, frame->len) >= 0);
+    }
+
+    if (p->lost) {
+        s_seq_failures[frame_seq(frame)] += (err_code == err_success);
+    } else {
+        s_fake.cb(err_code, p->cookie);
+    }
+}
+
+// 与SDK相同，任意1秒内最多发送5次
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    uint32_t now = host_clock_ms();
+    uint32_t oldest = s_fake.sent_ms[s_fake.sends % FAKE_RATE];
+    fake_pending_t* p = NULL;
+    fake_frame_t* frame = NULL;
+    uint32_t inflight = 0;
+    uint32_t i = 0;
+
+    TEST_ASSERT_EQUAL(1, datapoints_count);
+    TEST_ASSERT_EQUAL(PROPERTY_ID, datapoints[0].property_id);
+    TEST_ASSERT(datapoints[0].property_value_len <= WELINK_CHUNK_MAX_FRAME);
+
+    if (s_fake.sends >= FAKE_RATE && now - oldest < 1000) {
+        s_fake.rejected++;
+        return err_msg_send_too_frequently;
+    }
+
+    // 发送端看来，丢失的回调在超时之前都还在窗口中
+    for (i = 0; i < s_fake.count; i++) {
+        inflight += !(s_fake.pending[i].lost && now >= s_fake.pending[i].due_ms);
+    }
+
+    if (inflight + 1 > s_fake.max_inflight) {
+        s_fake.max_inflight = inflight + 1;
+    }
+
+    TEST_ASSERT(s_fake.frame_count < FAKE_FRAMES);
+    frame = &s_fake.frames[s_fake.frame_count];
+    memcpy(frame->value, datapoints[0].property_value, datapoints[0].property_value_len);
+    frame->len = datapoints[0].property_value_len;
+    s_seq_sends[frame_seq(frame)]++;
+
+    s_fake.sent_ms[s_fake.sends++ % FAKE_RATE] = now;
+    *pCookie = ++s_fake.next_cookie;
+    s_fake.cb = pCb;
+
+    TEST_ASSERT(s_fake.count < FAKE_FRAMES);
+    p = &s_fake.pending[s_fake.count++];
+    p->cookie = *pCookie;
+    p->frame = s_fake.frame_count++;
+    p->lost = (s_fake.lost_every != 0 && *pCookie % s_fake.lost_every == 0);
+    p->due_ms = now + (p->lost ? TIMEOUT_MS : s_fake.latency_ms);
+
+    if (!p->lost && s_fake.early_every != 0 && *pCookie % s_fake.early_every == 0) {
+        fake_complete(&s_fake.pending[--s_fake.count]);
+    }
+
+    return err_success;
+}
+
+// 回调所有到期的分片
+static void fake_complete_due(void)
+{
+    fake_pending_t due = {0};
+    uint32_t i = 0;
+
+    while (i < s_fake.count) {
+        if (host_clock_ms() >= s_fake.pending[i].due_ms) {
+            due = s_fake.pending[i];
+            s_fake.pending[i] = s_fake.pending[--s_fake.count];
+            fake_complete(&due);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+static void done_cb(uint32_t id, int32_t result, void* arg)
+{
+    s_done_calls++;
+    s_done_result = result;
+}
+
+static void rx_cb(txd_uint64_t sender_id, const uint8_t* data, uint32_t len)
+{
+    s_rx_calls++;
+    s_rx_len = len;
+    memcpy(s_rx_data, data, len);
+}
+
+static void fake_reset(void)
+{
+    memset(&s_fake, 0, sizeof(s_fake));
+    memset(s_seq_sends, 0, sizeof(s_seq_sends));
+    memset(s_seq_failures, 0, sizeof(s_seq_failures));
+    s_done_calls = 0;
+    s_rx_calls = 0;
+    s_fake.deliver = true;
+}
+
+// 发送整个s_data，运行到传输结束
+static uint32_t run_transfer(void)
+{
+    uint32_t start = host_clock_ms();
+
+    TEST_ASSERT(esp_welink_chunk_send(s_data, DATA_LEN, done_cb, NULL) > 0);
+
+    while (s_done_calls == 0 && host_clock_ms() - start < 600000) {
+        host_timer_run(10);
+        fake_complete_due();
+    }
+
+    TEST_ASSERT_EQUAL(1, s_done_calls);
+
+    return host_clock_ms() - start;
+}
+
+static esp_welink_chunk_stats_t stats(void)
+{
+    esp_welink_chunk_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_chunk_get_stats(&stats));
+    return stats;
+}
+
+// 回调晚到、提前到、出错或丢失：窗口内最多4片，只重发失败的分片，接收端拼出原始数据
+static void test_chunk_window_and_resend(void)
+{
+    esp_welink_chunk_stats_t before = stats();
+    esp_welink_chunk_stats_t after;
+    uint32_t resent = 0;
+    uint32_t elapsed = 0;
+    uint32_t i = 0;
+
+    fake_reset();
+    s_fake.latency_ms = 1500;
+    s_fake.early_every = 5;
+    s_fake.fail_every = 7;
+    s_fake.lost_every = 11;
+    elapsed = run_transfer();
+    after = stats();
+
+    TEST_ASSERT_EQUAL(0, s_done_result);
+
+    for (i = 0; i < CHUNKS; i++) {
+        TEST_ASSERT_EQUAL(1 + s_seq_failures[i], s_seq_sends[i]);
+        resent += s_seq_failures[i];
+    }
+
+    printf("  %u chunks in %u ms, %u sends, %u resent, at most %u in flight, %u rejected by the SDK, "
+           "%u duplicates received\n",
+           CHUNKS, elapsed, s_fake.sends, resent, s_fake.max_inflight, s_fake.rejected,
+           after.rx_duplicates - before.rx_duplicates);
+    TEST_ASSERT(resent > 0);
+    TEST_ASSERT_EQUAL(resent, after.tx_resent - before.tx_resent);
+    TEST_ASSERT_EQUAL(CHUNKS, after.tx_chunks - before.tx_chunks);
+    TEST_ASSERT_EQUAL(1, after.tx_transfers - before.tx_transfers);
+    TEST_ASSERT(s_fake.max_inflight <= WINDOW);
+    TEST_ASSERT_EQUAL(0, s_fake.rejected);
+    TEST_ASSERT(after.rx_duplicates > before.rx_duplicates);
+    TEST_ASSERT_EQUAL(1, s_rx_calls);
+    TEST_ASSERT_EQUAL(DATA_LEN, s_rx_len);
+    TEST_ASSERT(memcmp(s_rx_data, s_data, DATA_LEN) == 0);
+}
+
+// 同一片失败max_retries次后传输失败
+static void test_chunk_retries_exhausted(void)
+{
+    esp_welink_chunk_stats_t before = stats();
+
+    fake_reset();
+    s_fake.latency_ms = 100;
+    s_fake.fail_every = 1;
+    run_transfer();
+
+    TEST_ASSERT_EQUAL(-1, s_done_result);
+    TEST_ASSERT_EQUAL(before.tx_failed + 1, stats().tx_failed);
+    TEST_ASSERT_EQUAL(MAX_RETRIES + 1, s_seq_sends[0]);
+}
+
+// 录下一次传输的所有分片，之后直接交给接收端
+static void record_frames(void)
+{
+    fake_reset();
+    s_fake.latency_ms = 10;
+    s_fake.deliver = false;
+    run_transfer();
+    TEST_ASSERT_EQUAL(0, s_done_result);
+    TEST_ASSERT_EQUAL(CHUNKS, s_fake.frame_count);
+}
+
+// 乱序并重复到达的分片拼出同一份数据，只回调一次
+static void test_chunk_receive_out_of_order(void)
+{
+    esp_welink_chunk_stats_t before;
+    uint32_t order[CHUNKS];
+    uint32_t tmp = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    record_frames();
+    before = stats();
+    srand48(44);
+
+    for (i = 0; i < CHUNKS; i++) {
+        order[i] = i;
+    }
+
+    for (i = CHUNKS - 1; i > 0; i--) {
+        j = lrand48() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (i = 0; i < CHUNKS; i++) {
+        TEST_ASSERT_EQUAL(0, deliver(s_fake.frames[order[i]].value, s_fake.frames[order[i]].len));
+
+        // 每隔3片重复一次之前的分片
+        if (i % 3 == 2) {
+            TEST_ASSERT_EQUAL(0, deliver(s_fake.frames[order[i / 2]].value, s_fake.frames[order[i / 2]].len));
+        }
+    }
+
+    TEST_ASSERT_EQUAL(1, s_rx_calls);
+    TEST_ASSERT(memcmp(s_rx_data, s_data, DATA_LEN) == 0);
+    TEST_ASSERT_EQUAL(before.rx_transfers + 1, stats().rx_transfers);
+    TEST_ASSERT_EQUAL(before.rx_duplicates + CHUNKS / 3, stats().rx_duplicates);
+    TEST_ASSERT_EQUAL(before.rx_errors, stats().rx_errors);
+
+    // 完成后再收到的分片是重复的
+    TEST_ASSERT_EQUAL(0, deliver(s_fake.frames[0].value, s_fake.frames[0].len));
+    TEST_ASSERT_EQUAL(1, s_rx_calls);
+}
+
+// 格式错误的分片被拒绝并计入rx_errors
+static void test_chunk_receive_malformed(void)
+{
+    static const char* const invalid[] = {
+        "",
+        "1:0:2:10",
+        "1:0:2:10:",
+        "1:0:2:10:0123abcd",
+        "x:0:2:10:0123abcd:AAAA",
+        "1:0:0:10:0123abcd:AAAA",                   // count为0
+        "1:2:2:10:0123abcd:AAAA",                   // seq不小于count
+        "1:0:65:100:0123abcd:AAAA",                 // 超过WELINK_CHUNK_MAX_CHUNKS
+        "1:0:4:3:0123abcd:AAAA",                    // len小于count
+        "1:0:2:10:0123abcdef:AAAA",                 // crc超过8位
+        "1:0:2:10:0123abcg:AAAA",
+        "1234567890:0:2:10:0123abcd:AAAA",          // 超过9位十进制
+        "1:0:2:10:0123abcd:AAAA",                   // 第0片应有5字节，base64长度不对
+        "1:0:2:10:0123abcd:AAAAAA==",               // 只有4字节
+        "1:0:2:10:0123abcd:AA*AAAAA",
+    };
+    esp_welink_chunk_stats_t before = stats();
+    uint32_t i = 0;
+
+    s_rx_calls = 0;
+
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_WELINK_CHUNK_RET_INVALID, deliver((const uint8_t*)invalid[i], strlen(invalid[i])));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_WELINK_CHUNK_RET_TOO_LARGE, deliver((const uint8_t*)"1:0:2:5000:0123abcd:AAAA", 24));
+    TEST_ASSERT_EQUAL(before.rx_errors + sizeof(invalid) / sizeof(invalid[0]) + 1, stats().rx_errors);
+    TEST_ASSERT_EQUAL(0, s_rx_calls);
+}
+
+// 随机改写分片头的字节：不越界，也不会把错误的数据交给应用
+static void test_chunk_receive_mutated(void)
+{
+    static const uint8_t chars[] = "0123456789abcdefx:+/=A";
+    uint8_t value[WELINK_CHUNK_MAX_FRAME];
+    fake_frame_t* frame = NULL;
+    uint32_t header = 0;
+    uint32_t colons = 0;
+    uint32_t len = 0;
+    uint32_t accepted = 0;
+    uint32_t i = 0;
+    int32_t ret = 0;
+
+    record_frames();
+    srand48(4444);
+
+    for (i = 0; i < 20000; i++) {
+        frame = &s_fake.frames[lrand48() % CHUNKS];
+        memcpy(value, frame->value, frame->len);
+        len = frame->len;
+
+        // 分片头到第5个冒号为止
+        for (header = 0, colons = 0; colons < 5; header++) {
+            colons += (value[header] == ':');
+        }
+
+        value[lrand48() % header] = chars[lrand48() % (sizeof(chars) - 1)];
+
+        // 偶尔截断
+        if (lrand48() % 8 == 0) {
+            len = lrand48() % len;
+        }
+
+        ret = deliver(value, len);
+        TEST_ASSERT(ret == 0 || ret == ESP_WELINK_CHUNK_RET_INVALID || ret == ESP_WELINK_CHUNK_RET_TOO_LARGE
+                    || ret == ESP_WELINK_CHUNK_RET_CRC);
+        accepted += (ret == 0);
+    }
+
+    printf("  20000 mutated chunks, %u accepted, %u buffers passed to the application\n", accepted, s_rx_calls);
+
+    // 通过了CRC校验的一定是原始数据
+    TEST_ASSERT(s_rx_calls == 0 || (s_rx_len == DATA_LEN && memcmp(s_rx_data, s_data, DATA_LEN) == 0));
+}
+
+// 一片数据被改写时最后一片返回CRC错误，丢弃已收到的分片，重新收到正确的分片后完成
+static void test_chunk_receive_crc(void)
+{
+    esp_welink_chunk_stats_t before;
+    fake_frame_t bad;
+    uint8_t* payload = NULL;
+    uint32_t i = 0;
+
+    record_frames();
+    before = stats();
+    bad = s_fake.frames[3];
+
+    // 改写第一个base64字符，长度不变，只有CRC能发现
+    for (payload = bad.value, i = 0; i < 5; payload++) {
+        i += (*payload == ':');
+    }
+
+    *payload = (*payload == 'A') ? 'B' : 'A';
+
+    for (i = 0; i < CHUNKS - 1; i++) {
+        TEST_ASSERT_EQUAL(0, deliver(i == 3 ? bad.value : s_fake.frames[i].value, s_fake.frames[i].len));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_WELINK_CHUNK_RET_CRC, deliver(s_fake.frames[CHUNKS - 1].value, s_fake.frames[CHUNKS - 1].len));
+    TEST_ASSERT_EQUAL(0, s_rx_calls);
+    TEST_ASSERT_EQUAL(before.rx_errors + 1, stats().rx_errors);
+
+    for (i = 0; i < CHUNKS; i++) {
+        TEST_ASSERT_EQUAL(0, deliver(s_fake.frames[i].value, s_fake.frames[i].len));
+    }
+
+    TEST_ASSERT_EQUAL(1, s_rx_calls);
+    TEST_ASSERT(memcmp(s_rx_data, s_data, DATA_LEN) == 0);
+}
+
+int main(void)
+{
+    esp_welink_chunk_config_t config = ESP_WELINK_CHUNK_CONFIG_DEFAULT();
+    uint32_t i = 0;
+
+    for (i = 0; i < DATA_LEN; i++) {
+        s_data[i] = (uint8_t)(i * 7 + i / 256);
+    }
+
+    config.property_id = PROPERTY_ID;
+    config.chunk_size = CHUNK_SIZE;
+    config.window = WINDOW;
+    config.ack_timeout_ms = TIMEOUT_MS;
+    config.max_retries = MAX_RETRIES;
+    config.rx_max_len = RX_MAX_LEN;
+    config.report = fake_report;
+    config.rx_cb = rx_cb;
+    TEST_ASSERT_EQUAL(0, esp_welink_chunk_init(&config));
+
+    RUN_TEST(test_chunk_window_and_resend);
+    RUN_TEST(test_chunk_retries_exhausted);
+    RUN_TEST(test_chunk_receive_out_of_order);
+    RUN_TEST(test_chunk_receive_malformed);
+    RUN_TEST(test_chunk_receive_mutated);
+    RUN_TEST(test_chunk_receive_crc);
+
+    return 0;
+}
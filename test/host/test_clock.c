@@ -0,0 +1,312 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_clock: a day against the server time of an SDK whose oscillator drifts, compared
+ * with txd_get_server_time() itself, free running offline on the estimated drift, a reboot with
+ * the saved state and a step of the server time.
+ */
+#include <math.h>
+
+#include "host_test.h"
+#include "esp_welink_clock.h"
+#include "txd_error.h"
+
+#define EPOCH_MS        1700000000000.0
+#define HOUR_MS         (60.0 * 60 * 1000)
+
+// 真实时间由单调时钟换算：true = true_base + (mono - mono_base) / rate，振荡器慢时rate < 1
+static struct {
+    double rate;
+    double true_base;
+    uint32_t mono_base;
+    double epoch;                   // 服务器时间与真实时间之差，服务器调整时间时改变
+    bool online;
+    uint32_t sdk_sec;               // SDK上一次校时得到的秒数，之后按本地振荡器计时
+    uint32_t sdk_mono;
+    double heartbeat;               // 下一次校时的真实时间
+} s_sim;
+
+static struct {
+    bool enabled;
+    double max;
+    double sum;
+    uint32_t count;
+    double raw_max;                 // txd_get_server_time() * 1000的误差
+    uint64_t last;
+    uint32_t backwards;
+} s_err;
+
+uint32_t txd_get_server_time(void)
+{
+    if (!s_sim.online) {
+        return 0;
+    }
+
+    return s_sim.sdk_sec + (host_clock_ms() - s_sim.sdk_mono) / 1000;
+}
+
+static double sim_true(void)
+{
+    return s_sim.true_base + (double)(host_clock_ms() - s_sim.mono_base) / s_sim.rate;
+}
+
+// 从当前时刻起重新换算，true_jump为单调时钟停止期间经过的真实时间
+static void sim_rebase(double true_jump)
+{
+    s_sim.true_base = sim_true() + true_jump;
+    s_sim.mono_base = host_clock_ms();
+}
+
+// SDK登录或心跳时校时，服务器的应答有50～300ms的延迟
+static void sim_resync(void)
+{
+    double delay = 50 + lrand48() % 250;
+
+    s_sim.sdk_sec = (uint32_t)floor((s_sim.epoch + sim_true() - delay) / 1000);
+    s_sim.sdk_mono = host_clock_ms();
+    s_sim.heartbeat = sim_true() + 55000 + lrand48() % 10000;
+}
+
+static void sim_online(void)
+{
+    s_sim.online = true;
+    sim_resync();
+    esp_welink_clock_sync();
+}
+
+static void measure(void)
+{
+    uint64_t now = esp_welink_clock_now_ms();
+    double truth = s_sim.epoch + sim_true();
+    double error = 0;
+
+    if (now < s_err.last) {
+        s_err.backwards++;
+    }
+
+    s_err.last = now;
+
+    if (!s_err.enabled || esp_welink_clock_get_state() != ESP_WELINK_CLOCK_SYNCED) {
+        return;
+    }
+
+    error = fabs((double)now - truth);
+    s_err.max = (error > s_err.max) ? error : s_err.max;
+    s_err.sum += error;
+    s_err.count++;
+
+    if (s_sim.online) {
+        error = fabs(txd_get_server_time() * 1000.0 - truth);
+        s_err.raw_max = (error > s_err.raw_max) ? error : s_err.raw_max;
+    }
+}
+
+static void measure_reset(bool enabled)
+{
+    s_err.enabled = enabled;
+    s_err.max = 0;
+    s_err.sum = 0;
+    s_err.count = 0;
+    s_err.raw_max = 0;
+}
+
+// 运行ms毫秒真实时间，每秒检查一次时钟
+static void sim_run(double ms)
+{
+    double end = sim_true() + ms;
+    double next_measure = floor(sim_true() / 1000) * 1000 + 1333;
+    double next = 0;
+    uint32_t target = 0;
+
+    while (sim_true() < end) {
+        next = (next_measure < end) ? next_measure : end;
+        next = (s_sim.online && s_sim.heartbeat < next) ? s_sim.heartbeat : next;
+        target = s_sim.mono_base + (uint32_t)ceil((next - s_sim.true_base) * s_sim.rate);
+
+        if ((int32_t)(target - host_clock_ms()) > 0) {
+            host_timer_run(target - host_clock_ms());
+        } else {
+            host_timer_run(0);
+        }
+
+        if (s_sim.online && sim_true() >= s_sim.heartbeat) {
+            sim_resync();
+        }
+
+        if (sim_true() >= next_measure) {
+            measure();
+            next_measure += 1000;
+        }
+    }
+}
+
+static esp_welink_clock_stats_t stats(void)
+{
+    esp_welink_clock_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_get_stats(&stats));
+    return stats;
+}
+
+// 模拟重启：丢弃内存中的状态，NVS中保存的时间保留
+static void clock_reboot(void)
+{
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_deinit());
+}
+
+static void drifting_day(double ppm)
+{
+    esp_welink_clock_stats_t st;
+    double expected = (1 / (1 - ppm * 1e-6) - 1) * 1e6;
+    double error = 0;
+    double uncorrected = fabs(ppm) * 1e-6 * 6 * HOUR_MS;
+    uint32_t steps = 0;
+
+    printf("  oscillator %+.0f ppm\n", ppm);
+    memset(&s_sim, 0, sizeof(s_sim));
+    memset(&s_err, 0, sizeof(s_err));
+    s_sim.rate = 1 - ppm * 1e-6;
+    s_sim.epoch = EPOCH_MS;
+    s_sim.mono_base = host_clock_ms();
+    host_nvs_reset();
+    srand48(3);
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_init(NULL));
+
+    // 登录之前没有时间
+    sim_run(36000);
+    st = stats();
+    TEST_ASSERT_EQUAL(ESP_WELINK_CLOCK_NONE, st.state);
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_now_ms());
+    TEST_ASSERT(st.misses >= 3);
+
+    // 样本跨度达到min_drift_span_ms之后才估计漂移
+    sim_online();
+    sim_run(2 * HOUR_MS);
+    st = stats();
+    TEST_ASSERT_EQUAL(ESP_WELINK_CLOCK_SYNCED, st.state);
+    TEST_ASSERT_EQUAL(0, st.drift_ppb);
+
+    measure_reset(true);
+    sim_run(22 * HOUR_MS);
+    st = stats();
+    printf("    online 2 h to 24 h: |error| max %.0f ms mean %.0f ms, txd_get_server_time() max %.0f ms, drift %.2f ppm (true %.2f)\n",
+           s_err.max, s_err.sum / s_err.count, s_err.raw_max, st.drift_ppb / 1000.0, expected);
+    TEST_ASSERT(s_err.max < 500);
+    TEST_ASSERT(s_err.max < s_err.raw_max / 2);
+    TEST_ASSERT(fabs(st.drift_ppb / 1000.0 - expected) < 15);
+    TEST_ASSERT_EQUAL(1, st.steps);
+    TEST_ASSERT_EQUAL(0, s_err.backwards);
+
+    // 离线时按估计的漂移继续走
+    s_sim.online = false;
+    measure_reset(true);
+    sim_run(6 * HOUR_MS);
+    printf("    offline 6 h: |error| max %.0f ms, %.0f ms without the drift\n", s_err.max, uncorrected);
+    TEST_ASSERT(s_err.max < 600);
+    TEST_ASSERT(ppm == 0 || s_err.max < uncorrected);
+    TEST_ASSERT_EQUAL(0, s_err.backwards);
+
+    // 关机20秒后重启，从保存的时间继续，落后关机的时间直到第一次采样
+    sim_online();
+    sim_run(HOUR_MS);
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_save());
+    st = stats();
+    clock_reboot();
+    s_sim.online = false;
+    sim_rebase(20000);
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_init(NULL));
+    TEST_ASSERT_EQUAL(ESP_WELINK_CLOCK_ESTIMATED, esp_welink_clock_get_state());
+    TEST_ASSERT_EQUAL(st.drift_ppb, stats().drift_ppb);
+    error = (double)esp_welink_clock_now_ms() - (s_sim.epoch + sim_true());
+    printf("    after a 20 s power off: %.0f ms\n", error);
+    TEST_ASSERT(error > -20600 && error < -19400);
+
+    s_err.last = 0;
+    sim_run(8000);
+    sim_online();
+    measure_reset(true);
+    sim_run(10 * 60 * 1000);
+    st = stats();
+    printf("    first 10 min after the reboot: |error| max %.0f ms\n", s_err.max);
+    TEST_ASSERT_EQUAL(ESP_WELINK_CLOCK_SYNCED, st.state);
+    // 只有一两个采样，误差取决于采样时服务器秒数的相位和应答延迟，在-800～+450ms之间
+    TEST_ASSERT(s_err.max < 850);
+    steps = st.steps;
+
+    // 服务器时间向前调整5秒
+    s_sim.epoch += 5000;
+    sim_run(20 * 60 * 1000);
+    measure_reset(true);
+    sim_run(10 * 60 * 1000);
+    st = stats();
+    printf("    after a +5 s server step: |error| max %.0f ms, steps %u\n", s_err.max, st.steps - steps);
+    TEST_ASSERT_EQUAL(steps + 1, st.steps);
+    TEST_ASSERT(s_err.max < 850);
+    TEST_ASSERT_EQUAL(0, s_err.backwards);
+
+    clock_reboot();
+}
+
+static void test_clock_drift(void)
+{
+    drifting_day(40);
+    drifting_day(-120);
+    drifting_day(0);
+}
+
+static void test_clock_cost(void)
+{
+    uint64_t start = 0;
+    uint64_t sum = 0;
+    uint32_t i = 0;
+
+    memset(&s_sim, 0, sizeof(s_sim));
+    s_sim.rate = 1;
+    s_sim.epoch = EPOCH_MS;
+    s_sim.mono_base = host_clock_ms();
+    host_nvs_reset();
+    TEST_ASSERT_EQUAL(0, esp_welink_clock_init(NULL));
+    sim_online();
+    sim_run(60000);
+    TEST_ASSERT_EQUAL(ESP_WELINK_CLOCK_SYNCED, esp_welink_clock_get_state());
+
+    start = host_bench_now_ns();
+
+    for (i = 0; i < 10000000; i++) {
+        sum += esp_welink_clock_now_ms();
+    }
+
+    printf("  %.1f ns per esp_welink_clock_now_ms()\n", (double)(host_bench_now_ns() - start) / i);
+    TEST_ASSERT(sum != 0);
+    clock_reboot();
+}
+
+int main(void)
+{
+    RUN_TEST(test_clock_drift);
+    RUN_TEST(test_clock_cost);
+
+    return 0;
+}
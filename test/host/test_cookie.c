@@ -0,0 +1,216 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_cookie: the open-addressing table (collisions, backward-shift delete, wraparound at the end of the
+ * table, the high water mark) and completions which arrive before the submit.
+ */
+#include "host_test.h"
+#include "esp_welink_cookie.h"
+#include "esp_welink_report.h"
+#include "txd_error.h"
+
+#define TIMEOUT_MS      5000
+#define HIGH_WATER      (WELINK_COOKIE_SLOTS * 3 / 4)
+
+static uint32_t s_next_cookie = 1;
+
+// 与cookie_hash相同，用来构造落在指定槽的cookie
+static uint32_t home_slot(uint32_t cookie)
+{
+    return (cookie * 2654435761u) >> (32 - __builtin_ctz(WELINK_COOKIE_SLOTS));
+}
+
+static uint32_t cookie_at(uint32_t home)
+{
+    while (home_slot(s_next_cookie) != home) {
+        s_next_cookie++;
+    }
+
+    return s_next_cookie++;
+}
+
+static esp_welink_cookie_stats_t stats_of(uint32_t cls)
+{
+    esp_welink_cookie_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_get_stats(cls, &stats));
+    return stats;
+}
+
+// 完成一个正在跟踪的cookie，找不到时结果会进入暂存区，completed不变
+static void complete_tracked(uint32_t cls, uint32_t cookie)
+{
+    uint32_t completed = stats_of(cls).completed;
+
+    esp_welink_cookie_complete(err_success, cookie);
+    TEST_ASSERT_EQUAL(completed + 1, stats_of(cls).completed);
+}
+
+// 同一个槽的探测链跨过表尾回到0，删除链首后后面的条目前移，仍然都能找到
+static void test_cookie_wraparound_delete(void)
+{
+    uint32_t last = WELINK_COOKIE_SLOTS - 1;
+    uint32_t a = cookie_at(last);
+    uint32_t b = cookie_at(last);
+    uint32_t c = cookie_at(last);
+    uint32_t d = cookie_at(0);
+    esp_welink_cookie_stats_t stats;
+
+    esp_welink_cookie_reset();
+
+    // a在表尾，b、c回绕到0和1，d的起始槽0已被占用，放在2
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(a, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(b, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(c, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(d, 0));
+    TEST_ASSERT_EQUAL(4, stats_of(0).pending);
+
+    host_clock_advance_ms(10);
+    complete_tracked(0, a);
+    host_clock_advance_ms(10);
+    complete_tracked(0, d);
+    host_clock_advance_ms(10);
+    complete_tracked(0, c);
+    host_clock_advance_ms(10);
+    complete_tracked(0, b);
+
+    stats = stats_of(0);
+    TEST_ASSERT_EQUAL(0, stats.pending);
+    TEST_ASSERT_EQUAL(10, stats.min_ms);
+    TEST_ASSERT_EQUAL(40, stats.max_ms);
+    TEST_ASSERT_EQUAL(100, stats.sum_ms);
+}
+
+// 删除链中间的条目时，起始槽在空位之后的条目不能前移
+static void test_cookie_delete_keeps_home(void)
+{
+    uint32_t a = cookie_at(10);
+    uint32_t b = cookie_at(10);
+    uint32_t y = cookie_at(11);
+    uint32_t z = cookie_at(10);
+
+    esp_welink_cookie_reset();
+
+    // a在10，b在11，y的起始槽11被b占用放在12，z放在13
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(a, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(b, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(y, 0));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(z, 0));
+
+    // 删除b后y前移到11（它的起始槽），z前移到12，a不动
+    complete_tracked(0, b);
+    complete_tracked(0, z);
+    complete_tracked(0, y);
+    complete_tracked(0, a);
+    TEST_ASSERT_EQUAL(0, stats_of(0).pending);
+
+    // 重复提交同一个cookie不跟踪
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(a, 0));
+    TEST_ASSERT_EQUAL(-1, esp_welink_cookie_submit(a, 0));
+    TEST_ASSERT_EQUAL(1, stats_of(0).untracked);
+    complete_tracked(0, a);
+}
+
+// 超过高水位时不再跟踪，超时的条目清理后又能提交
+static void test_cookie_high_water(void)
+{
+    uint32_t cookies[HIGH_WATER];
+    uint32_t i = 0;
+
+    esp_welink_cookie_reset();
+
+    for (i = 0; i < HIGH_WATER; i++) {
+        cookies[i] = s_next_cookie++;
+        TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(cookies[i], 2));
+    }
+
+    TEST_ASSERT_EQUAL(-1, esp_welink_cookie_submit(s_next_cookie++, 2));
+    TEST_ASSERT_EQUAL(1, stats_of(2).untracked);
+
+    // 完成一半，其余的超时计为丢失
+    for (i = 0; i < HIGH_WATER; i += 2) {
+        complete_tracked(2, cookies[i]);
+    }
+
+    host_clock_advance_ms(TIMEOUT_MS + 1);
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(s_next_cookie, 2));
+    TEST_ASSERT_EQUAL(HIGH_WATER / 2, stats_of(2).lost);
+    complete_tracked(2, s_next_cookie++);
+    TEST_ASSERT_EQUAL(0, stats_of(2).pending);
+}
+
+// 提交前就到达的完成：成功只计数，不产生时延样本；错误照常计入
+static void test_cookie_stash(void)
+{
+    uint32_t early = s_next_cookie++;
+    uint32_t failed = s_next_cookie++;
+    uint32_t evicted = s_next_cookie++;
+    esp_welink_cookie_stats_t stats;
+    uint32_t i = 0;
+
+    esp_welink_cookie_reset();
+
+    esp_welink_cookie_complete(err_success, early);
+    esp_welink_cookie_complete(err_msg_sendtimeout, failed);
+    stats = stats_of(1);
+    TEST_ASSERT_EQUAL(0, stats.completed + stats.unmeasured + stats.errors);
+
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(early, 1));
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(failed, 1));
+    stats = stats_of(1);
+    TEST_ASSERT_EQUAL(2, stats.submitted);
+    TEST_ASSERT_EQUAL(0, stats.completed);
+    TEST_ASSERT_EQUAL(1, stats.unmeasured);
+    TEST_ASSERT_EQUAL(1, stats.errors);
+    TEST_ASSERT_EQUAL(err_msg_sendtimeout, stats.last_error);
+    TEST_ASSERT_EQUAL(0, stats.pending);
+    TEST_ASSERT_EQUAL(0, stats.hist[0]);
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_percentile(&stats, 50));
+
+    // 暂存区只保留最近的WELINK_STASH_SIZE个结果，被挤掉的cookie提交后正常跟踪，直到超时
+    esp_welink_cookie_complete(err_success, evicted);
+
+    for (i = 0; i < WELINK_STASH_SIZE; i++) {
+        esp_welink_cookie_complete(err_success, s_next_cookie++);
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_submit(evicted, 1));
+    TEST_ASSERT_EQUAL(1, stats_of(1).pending);
+    host_clock_advance_ms(TIMEOUT_MS + 1);
+    TEST_ASSERT_EQUAL(1, esp_welink_cookie_expire());
+    TEST_ASSERT_EQUAL(1, stats_of(1).lost);
+}
+
+int main(void)
+{
+    TEST_ASSERT_EQUAL(0, esp_welink_cookie_init(TIMEOUT_MS));
+
+    RUN_TEST(test_cookie_wraparound_delete);
+    RUN_TEST(test_cookie_delete_keeps_home);
+    RUN_TEST(test_cookie_high_water);
+    RUN_TEST(test_cookie_stash);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_dedup: replayed acks keep their value up to WELINK_DEDUP_ACK_BYTES, a longer ack makes the
+ * retransmission run the handler again, in-progress duplicates, eviction, TTL and the lookup cost.
+ */
+#include "host_test.h"
+#include "esp_welink_dedup.h"
+
+#define LEVEL_ACK       "baseapi=2,thread=2,wifi=2,ota=2,datapoint=2"
+#define BENCH_LOOKUPS   1000000
+
+static const txd_uint64_t s_sender = {{1, 2, 3, 4, 5, 6, 7, 8}};
+static uint8_t s_value[] = "*=2";
+
+static txd_datapoint_t datapoint(uint32_t property_id, uint32_t seq)
+{
+    txd_datapoint_t dp = {0};
+
+    dp.property_id = property_id;
+    dp.seq = seq;
+    dp.property_value = s_value;
+    dp.property_value_len = sizeof(s_value) - 1;
+
+    return dp;
+}
+
+static void test_dedup_replay_keeps_ack_value(void)
+{
+    txd_datapoint_t dp = datapoint(10, 1);
+    txd_datapoint_t ack = dp;
+    txd_datapoint_t replay = {0};
+    uint8_t ack_value[WELINK_DEDUP_ACK_BYTES];
+    uint8_t retransmitted[] = "*=2";
+
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+
+    // 处理函数返回前到达的重传被丢弃
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_IN_PROGRESS, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+
+    // 日志级别ACK带回当前生效的级别，44字节也要原样重放
+    ack.property_value = (uint8_t*)LEVEL_ACK;
+    ack.property_value_len = strlen(LEVEL_ACK);
+    ack.ret_code = 0;
+    esp_welink_dedup_complete(s_sender, &dp, &ack);
+
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_REPLAY, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    TEST_ASSERT_EQUAL(strlen(LEVEL_ACK), replay.property_value_len);
+    TEST_ASSERT_EQUAL_MEMORY(LEVEL_ACK, replay.property_value, strlen(LEVEL_ACK));
+    TEST_ASSERT_EQUAL(1, replay.seq);
+
+    // 回显收到的值的ACK，重放时引用重传数据点的值
+    dp = datapoint(11, 1);
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    ack = dp;
+    ack.ret_code = 4;
+    esp_welink_dedup_complete(s_sender, &dp, &ack);
+    dp.property_value = retransmitted;
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_REPLAY, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    TEST_ASSERT(replay.property_value == retransmitted);
+    TEST_ASSERT_EQUAL(4, replay.ret_code);
+}
+
+static void test_dedup_long_ack_runs_handler_again(void)
+{
+    esp_welink_dedup_stats_t stats;
+    txd_datapoint_t dp = datapoint(12, 1);
+    txd_datapoint_t ack = dp;
+    txd_datapoint_t replay = {0};
+    uint8_t ack_value[WELINK_DEDUP_ACK_BYTES];
+    uint8_t long_value[WELINK_DEDUP_ACK_BYTES + 1];
+
+    memset(long_value, 'x', sizeof(long_value));
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    ack.property_value = long_value;
+    ack.property_value_len = sizeof(long_value);
+    esp_welink_dedup_complete(s_sender, &dp, &ack);
+
+    // 不能重放一个空值的ACK，重传按新数据点处理
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    TEST_ASSERT_EQUAL(0, esp_welink_dedup_get_stats(&stats));
+    TEST_ASSERT_EQUAL(1, stats.uncached_acks);
+
+    // 这次的ACK放得下，之后的重传就会重放
+    ack.property_value_len = WELINK_DEDUP_ACK_BYTES;
+    esp_welink_dedup_complete(s_sender, &dp, &ack);
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_REPLAY, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    TEST_ASSERT_EQUAL(WELINK_DEDUP_ACK_BYTES, replay.property_value_len);
+    TEST_ASSERT_EQUAL_MEMORY(long_value, replay.property_value, WELINK_DEDUP_ACK_BYTES);
+}
+
+static void test_dedup_eviction_and_ttl(void)
+{
+    esp_welink_dedup_stats_t stats;
+    txd_datapoint_t dp = datapoint(20, 1);
+    txd_datapoint_t replay = {0};
+    uint8_t ack_value[WELINK_DEDUP_ACK_BYTES];
+    uint32_t seq = 0;
+
+    for (seq = 1; seq <= 1000; seq++) {
+        dp.seq = seq;
+        TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+        esp_welink_dedup_complete(s_sender, &dp, &dp);
+    }
+
+    // 最近的还在缓存中，最早的已被替换
+    dp.seq = 1000;
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_REPLAY, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    dp.seq = 1;
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    esp_welink_dedup_complete(s_sender, &dp, &dp);
+    TEST_ASSERT_EQUAL(0, esp_welink_dedup_get_stats(&stats));
+    TEST_ASSERT(stats.evictions > 900);
+
+    // 超过TTL后服务器可以复用seq
+    host_clock_advance_ms(WELINK_DEDUP_TTL_MS);
+    dp.seq = 1000;
+    TEST_ASSERT_EQUAL(ESP_WELINK_DEDUP_NEW, esp_welink_dedup_check(s_sender, &dp, &replay, ack_value));
+    esp_welink_dedup_complete(s_sender, &dp, &dp);
+}
+
+static void test_dedup_lookup_cost(void)
+{
+    txd_datapoint_t dp = datapoint(30, 0);
+    txd_datapoint_t replay = {0};
+    uint8_t ack_value[WELINK_DEDUP_ACK_BYTES];
+    uint64_t start = host_bench_now_ns();
+    uint32_t i = 0;
+
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+        dp.seq = i;
+        esp_welink_dedup_check(s_sender, &dp, &replay, ack_value);
+        esp_welink_dedup_complete(s_sender, &dp, &dp);
+    }
+
+    printf("  %.1f ns per new datapoint (check and complete, mutex included)\n",
+           (double)(host_bench_now_ns() - start) / BENCH_LOOKUPS);
+}
+
+int main(void)
+{
+    TEST_ASSERT_EQUAL(0, esp_welink_dedup_init());
+
+    RUN_TEST(test_dedup_replay_keeps_ack_value);
+    RUN_TEST(test_dedup_long_ack_runs_handler_again);
+    RUN_TEST(test_dedup_eviction_and_ttl);
+    RUN_TEST(test_dedup_lookup_cost);
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_dispatch: table validation, lookup of every entry and of the gaps, inline zero-copy handlers,
+ * deferred handlers on the worker with the pool full and over-long values, and the dispatch cost.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+#include "host_test.h"
+#include "esp_welink_dispatch.h"
+#include "txd_error.h"
+
+#define TABLE_COUNT     64
+#define TABLE_FIRST     100
+#define TABLE_STEP      3
+#define DEFERRED_ID     1000
+#define POOL_SIZE       2
+#define MAX_VALUE_LEN   16
+#define BENCH_MSGS      10000000
+
+static esp_welink_dispatch_entry_t s_table[TABLE_COUNT + 1];
+static const uint8_t* s_seen_value;
+static uint32_t s_seen_property;
+static uint32_t s_seen_len;
+static uint8_t s_seen_copy[MAX_VALUE_LEN];
+static pthread_mutex_t s_ack_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_acks;
+static txd_datapoint_t s_last_ack;
+static uint8_t s_last_ack_value[64];
+static bool s_worker_hold;
+static uint32_t s_worker_runs;
+static uint8_t s_reply[] = "ok";
+
+int32_t txd_ack_datapoint(txd_datapoint_t* datapoint, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+// worker和调用者都会回复ACK，加锁后记录最后一个
+static int32_t fake_ack(txd_datapoint_t* datapoint, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    pthread_mutex_lock(&s_ack_lock);
+    s_last_ack = *datapoint;
+    memcpy(s_last_ack_value, datapoint->property_value, datapoint->property_value_len);
+    s_acks++;
+    pthread_mutex_unlock(&s_ack_lock);
+    return err_success;
+}
+
+static uint32_t acks_sent(void)
+{
+    uint32_t acks = 0;
+
+    pthread_mutex_lock(&s_ack_lock);
+    acks = s_acks;
+    pthread_mutex_unlock(&s_ack_lock);
+
+    return acks;
+}
+
+static int32_t inline_handler(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    s_seen_value = datapoint->property_value;
+    s_seen_property = datapoint->property_id;
+    return (int32_t)datapoint->property_id;
+}
+
+static int32_t reply_handler(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    ack->property_value = s_reply;
+    ack->property_value_len = sizeof(s_reply) - 1;
+    return 7;
+}
+
+static int32_t deferred_handler(txd_uint64_t sender_id, const txd_datapoint_t* datapoint, txd_datapoint_t* ack)
+{
+    while (__atomic_load_n(&s_worker_hold, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    s_seen_value = datapoint->property_value;
+    s_seen_len = datapoint->property_value_len;
+    memcpy(s_seen_copy, datapoint->property_value, datapoint->property_value_len);
+    __atomic_add_fetch(&s_worker_runs, 1, __ATOMIC_RELEASE);
+    return 3;
+}
+
+static void dispatch_id(uint32_t property_id, uint8_t* value, uint32_t len)
+{
+    txd_uint64_t sender = {{0}};
+    txd_datapoint_t dp = {0};
+
+    dp.property_id = property_id;
+    dp.property_value = value;
+    dp.property_value_len = len;
+    dp.seq = property_id;
+    esp_welink_dispatch(sender, &dp);
+}
+
+static void wait_acks(uint32_t count)
+{
+    uint64_t deadline = host_bench_now_ns() + 5000000000ULL;
+
+    while (acks_sent() < count) {
+        TEST_ASSERT(host_bench_now_ns() < deadline);
+        sched_yield();
+    }
+}
+
+static void test_dispatch_init_checks_table(void)
+{
+    esp_welink_dispatch_config_t config = ESP_WELINK_DISPATCH_CONFIG_DEFAULT();
+    esp_welink_dispatch_entry_t unsorted[] = {
+        ESP_WELINK_DISPATCH_ENTRY(2, inline_handler, ESP_WELINK_DISPATCH_INLINE),
+        ESP_WELINK_DISPATCH_ENTRY(2, inline_handler, ESP_WELINK_DISPATCH_INLINE),
+    };
+    esp_welink_dispatch_entry_t no_handler[] = {
+        ESP_WELINK_DISPATCH_ENTRY(1, inline_handler, ESP_WELINK_DISPATCH_INLINE),
+        ESP_WELINK_DISPATCH_ENTRY(2, NULL, ESP_WELINK_DISPATCH_INLINE),
+    };
+    uint32_t i = 0;
+
+    config.ack = fake_ack;
+    config.table = unsorted;
+    config.table_count = 2;
+    TEST_ASSERT_EQUAL(-1, esp_welink_dispatch_init(&config));
+    config.table = no_handler;
+    TEST_ASSERT_EQUAL(-1, esp_welink_dispatch_init(&config));
+    TEST_ASSERT_EQUAL(-1, esp_welink_dispatch_get_stats(&(esp_welink_dispatch_stats_t){0}));
+
+    for (i = 0; i < TABLE_COUNT; i++) {
+        s_table[i].property_id = TABLE_FIRST + i * TABLE_STEP;
+        s_table[i].handler = (i == 1) ? reply_handler : inline_handler;
+        s_table[i].mode = ESP_WELINK_DISPATCH_INLINE;
+    }
+
+    s_table[TABLE_COUNT].property_id = DEFERRED_ID;
+    s_table[TABLE_COUNT].handler = deferred_handler;
+    s_table[TABLE_COUNT].mode = ESP_WELINK_DISPATCH_DEFERRED;
+
+    config.table = s_table;
+    config.table_count = TABLE_COUNT + 1;
+    config.pool_size = POOL_SIZE;
+    config.max_value_len = MAX_VALUE_LEN;
+    TEST_ASSERT_EQUAL(0, esp_welink_dispatch_init(&config));
+}
+
+static void test_dispatch_lookup(void)
+{
+    esp_welink_dispatch_stats_t stats;
+    uint8_t value[4] = {1, 2, 3, 4};
+    uint32_t acks = s_acks;
+    uint32_t id = 0;
+    uint32_t unknown = 0;
+
+    // 表内的每个ID都找到自己的处理函数，表之间和表外的ID都不匹配
+    for (id = 0; id < TABLE_FIRST + TABLE_COUNT * TABLE_STEP + 10; id++) {
+        s_seen_property = UINT32_MAX;
+        dispatch_id(id, value, sizeof(value));
+        TEST_ASSERT_EQUAL(++acks, s_acks);
+        TEST_ASSERT_EQUAL(id, s_last_ack.property_id);
+        TEST_ASSERT_EQUAL(id, s_last_ack.seq);
+
+        if (id >= TABLE_FIRST && (id - TABLE_FIRST) % TABLE_STEP == 0 && id < TABLE_FIRST + TABLE_COUNT * TABLE_STEP) {
+            if (id == TABLE_FIRST + TABLE_STEP) {
+                TEST_ASSERT_EQUAL(7, s_last_ack.ret_code);
+                TEST_ASSERT_EQUAL_MEMORY("ok", s_last_ack_value, 2);
+                continue;
+            }
+
+            TEST_ASSERT_EQUAL(id, s_seen_property);
+            TEST_ASSERT_EQUAL(id, s_last_ack.ret_code);
+            // 内联处理函数直接看到收到的缓冲区，ACK默认带回原值
+            TEST_ASSERT(s_seen_value == value);
+            TEST_ASSERT(s_last_ack.property_value == value);
+        } else {
+            TEST_ASSERT_EQUAL(UINT32_MAX, s_seen_property);
+            TEST_ASSERT_EQUAL(ESP_WELINK_DISPATCH_RET_UNKNOWN, s_last_ack.ret_code);
+            unknown++;
+        }
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_dispatch_get_stats(&stats));
+    TEST_ASSERT_EQUAL(unknown, stats.unknown);
+
+    // 默认处理函数接收表外的属性
+    TEST_ASSERT_EQUAL(0, esp_welink_dispatch_set_default_handler(inline_handler));
+    dispatch_id(TABLE_FIRST + 1, value, sizeof(value));
+    TEST_ASSERT_EQUAL(TABLE_FIRST + 1, s_last_ack.ret_code);
+    TEST_ASSERT_EQUAL(0, esp_welink_dispatch_set_default_handler(NULL));
+}
+
+static void test_dispatch_deferred(void)
+{
+    esp_welink_dispatch_stats_t stats;
+    uint8_t value[MAX_VALUE_LEN + 1];
+    uint32_t acks = s_acks;
+    uint32_t i = 0;
+
+    memset(value, 0xA5, sizeof(value));
+
+    // 数据点被拷贝到槽位，返回后调用者的缓冲区可以复用
+    dispatch_id(DEFERRED_ID, value, MAX_VALUE_LEN);
+    memset(value, 0, sizeof(value));
+    wait_acks(++acks);
+    TEST_ASSERT(s_seen_value != value);
+    TEST_ASSERT_EQUAL(MAX_VALUE_LEN, s_seen_len);
+
+    for (i = 0; i < MAX_VALUE_LEN; i++) {
+        TEST_ASSERT_EQUAL(0xA5, s_seen_copy[i]);
+    }
+
+    TEST_ASSERT_EQUAL(3, s_last_ack.ret_code);
+
+    // 值放不下时直接回复忙
+    dispatch_id(DEFERRED_ID, value, MAX_VALUE_LEN + 1);
+    TEST_ASSERT_EQUAL(++acks, s_acks);
+    TEST_ASSERT_EQUAL(ESP_WELINK_DISPATCH_RET_BUSY, s_last_ack.ret_code);
+
+    // worker卡住时最多排队pool_size个，之后的回复忙
+    __atomic_store_n(&s_worker_hold, true, __ATOMIC_RELEASE);
+
+    for (i = 0; i < POOL_SIZE + 3; i++) {
+        dispatch_id(DEFERRED_ID, value, 4);
+    }
+
+    TEST_ASSERT_EQUAL(acks + 3, s_acks);
+    TEST_ASSERT_EQUAL(ESP_WELINK_DISPATCH_RET_BUSY, s_last_ack.ret_code);
+    __atomic_store_n(&s_worker_hold, false, __ATOMIC_RELEASE);
+    wait_acks(acks + 3 + POOL_SIZE);
+    TEST_ASSERT_EQUAL(3, s_last_ack.ret_code);
+
+    TEST_ASSERT_EQUAL(0, esp_welink_dispatch_get_stats(&stats));
+    TEST_ASSERT_EQUAL(1 + POOL_SIZE, stats.deferred_runs);
+    TEST_ASSERT_EQUAL(4, stats.busy);
+    TEST_ASSERT_EQUAL(POOL_SIZE, stats.max_queued);
+}
+
+static void test_dispatch_cost(void)
+{
+    txd_uint64_t sender = {{0}};
+    txd_datapoint_t dp = {0};
+    uint8_t value[8] = {0};
+    uint64_t start = 0;
+    uint32_t i = 0;
+
+    dp.property_value = value;
+    dp.property_value_len = sizeof(value);
+    start = host_bench_now_ns();
+
+    // 五分之一的ID不在表中
+    for (i = 0; i < BENCH_MSGS; i++) {
+        dp.property_id = TABLE_FIRST + (i % (TABLE_COUNT + TABLE_COUNT / 4)) * TABLE_STEP;
+        esp_welink_dispatch(sender, &dp);
+    }
+
+    printf("  %.1f ns per datapoint with %u entries, lookup and ack included\n",
+           (double)(host_bench_now_ns() - start) / BENCH_MSGS, TABLE_COUNT + 1);
+}
+
+int main(void)
+{
+    RUN_TEST(test_dispatch_init_checks_table);
+    RUN_TEST(test_dispatch_lookup);
+    RUN_TEST(test_dispatch_deferred);
+    RUN_TEST(test_dispatch_cost);
+
+    return 0;
+}
@@ -0,0 +1,430 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_gw with 256 sub-devices: ten minutes of 8 chatty and 248 quiet sub-devices over a link
+ * that fails 10% of the sends, checking order, fair shares, latency and address announcements;
+ * slot management and the receive path; bridge threads reporting concurrently with the timer;
+ * and the cost of queueing and packing a report.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+#include "host_test.h"
+#include "esp_welink_gw.h"
+
+#define DEVICES         256
+#define CHATTY          8
+#define BASE_ADDR       0xAB00000000ULL
+#define SIM_MS          600000
+#define SHARE_FROM_MS   300000          // 队列稳定后开始统计带宽份额
+#define BRIDGES         4
+#define BRIDGE_REPORTS  2000
+
+static struct {
+    uint32_t fail_percent;
+    uint32_t next_seq[DEVICES];         // 下一个报告的序号
+    uint32_t expect_seq[DEVICES];       // 下一个应该送达的序号
+    uint32_t delivered[DEVICES];
+    uint32_t share_bytes[DEVICES];
+    uint32_t max_latency[DEVICES];
+    uint32_t addr_seen[DEVICES];
+    uint32_t notified[DEVICES];
+    uint32_t errors;
+    uint32_t sends;
+} s_link;
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+// 检查每个数据点：地址只宣告一次，每个子设备的报告按序号到达且不重复
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    char addr[17];
+    uint32_t offset = 0;
+    uint32_t slot = 0;
+    uint32_t seq = 0;
+    uint32_t sent_ms = 0;
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < datapoints_count; i++) {
+        bytes += datapoints[i].property_value_len;
+    }
+
+    TEST_ASSERT(datapoints_count <= WELINK_GW_MAX_DATAPOINTS && bytes <= WELINK_GW_MAX_BYTES);
+
+    if ((uint32_t)(rand() % 100) < s_link.fail_percent) {
+        return err_msg_send_too_frequently;
+    }
+
+    s_link.sends++;
+
+    for (i = 0; i < datapoints_count; i++) {
+        offset = datapoints[i].property_id - 0x10000;
+        slot = offset >> 8;
+        TEST_ASSERT(slot < DEVICES);
+
+        if ((offset & 0xFF) == WELINK_GW_ADDR_PROPERTY) {
+            snprintf(addr, sizeof(addr), "%016llx", (unsigned long long)(BASE_ADDR + slot));
+            TEST_ASSERT_EQUAL(16, datapoints[i].property_value_len);
+            TEST_ASSERT_EQUAL_MEMORY(addr, datapoints[i].property_value, 16);
+            s_link.addr_seen[slot]++;
+            continue;
+        }
+
+        memcpy(&seq, datapoints[i].property_value, sizeof(seq));
+        memcpy(&sent_ms, datapoints[i].property_value + 4, sizeof(sent_ms));
+
+        if (seq != s_link.expect_seq[slot] || (offset & 0xFF) != 1 + seq % 7) {
+            fprintf(stderr, "slot %u: seq %u, expected %u\n", slot, seq, s_link.expect_seq[slot]);
+            s_link.errors++;
+        }
+
+        s_link.expect_seq[slot] = seq + 1;
+        s_link.delivered[slot]++;
+
+        if (host_clock_ms() >= SHARE_FROM_MS) {
+            s_link.share_bytes[slot] += datapoints[i].property_value_len;
+        }
+
+        if (host_clock_ms() - sent_ms > s_link.max_latency[slot]) {
+            s_link.max_latency[slot] = host_clock_ms() - sent_ms;
+        }
+    }
+
+    *pCookie = s_link.sends;
+
+    return err_success;
+}
+
+static void fake_notify(int32_t handle, void* arg)
+{
+    TEST_ASSERT_EQUAL((intptr_t)arg, handle);
+    s_link.notified[handle]++;
+}
+
+static void gw_start(void)
+{
+    esp_welink_gw_config_t config = ESP_WELINK_GW_CONFIG_DEFAULT();
+    int32_t i = 0;
+
+    config.max_devices = DEVICES;
+    config.max_value_len = 32;
+    config.quantum = 32;
+    config.tx_queue_len = 16;
+    config.rx_queue_len = 4;
+    config.report = fake_report;
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_init(&config));
+
+    memset(&s_link, 0, sizeof(s_link));
+
+    for (i = 0; i < DEVICES; i++) {
+        TEST_ASSERT_EQUAL(i, esp_welink_gw_add(BASE_ADDR + i, WELINK_GW_SLOT_ANY, fake_notify, (void*)(intptr_t)i));
+    }
+}
+
+static int32_t report_seq(int32_t handle, uint32_t len)
+{
+    uint8_t value[32];
+    uint32_t now = host_clock_ms();
+    uint32_t seq = s_link.next_seq[handle];
+
+    memcpy(value, &seq, sizeof(seq));
+    memcpy(value + 4, &now, sizeof(now));
+    memset(value + 8, handle, sizeof(value) - 8);
+
+    if (esp_welink_gw_report(handle, 1 + seq % 7, value, len) != 0) {
+        return -1;
+    }
+
+    s_link.next_seq[handle]++;
+    return 0;
+}
+
+/*
+ * 8个子设备每秒报告20次24字节，248个每5秒报告一次8字节；链路每200ms一条480字节的消息，
+ * 即每秒2400字节，比需求少，频繁的子设备的队列会满，安静的子设备不应受影响
+ */
+static void test_gw_fair_share(void)
+{
+    esp_welink_gw_device_stats_t device;
+    esp_welink_gw_stats_t stats;
+    uint32_t phase[DEVICES];
+    uint32_t share_min = UINT32_MAX;
+    uint32_t share_max = 0;
+    uint32_t chatty_latency = 0;
+    uint32_t quiet_latency = 0;
+    uint32_t chatty_dropped = 0;
+    uint32_t quiet_dropped = 0;
+    uint32_t now = 0;
+    int32_t i = 0;
+
+    host_clock_set_us(0);
+    gw_start();
+    s_link.fail_percent = 10;
+    srand(5);
+
+    for (i = 0; i < DEVICES; i++) {
+        phase[i] = rand() % 5000;
+    }
+
+    for (now = 1; now <= SIM_MS; now++) {
+        host_timer_run(1);
+
+        for (i = 0; i < DEVICES; i++) {
+            if ((i < CHATTY) ? (now % 50 == (uint32_t)i) : ((now + phase[i]) % 5000 == 0)) {
+                report_seq(i, (i < CHATTY) ? 24 : 8);
+            }
+        }
+    }
+
+    // 不再有报告后队列在两分钟内排空，定时器停止
+    host_timer_run(120000);
+    TEST_ASSERT_EQUAL(0, host_timer_run(60000));
+
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_get_stats(&stats));
+
+    for (i = 0; i < DEVICES; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_gw_get_device_stats(i, &device));
+        TEST_ASSERT_EQUAL(0, device.queued);
+        TEST_ASSERT_EQUAL(1, s_link.addr_seen[i]);
+        TEST_ASSERT_EQUAL(s_link.next_seq[i], s_link.delivered[i]);
+
+        if (i < CHATTY) {
+            chatty_dropped += device.dropped;
+            share_min = (s_link.share_bytes[i] < share_min) ? s_link.share_bytes[i] : share_min;
+            share_max = (s_link.share_bytes[i] > share_max) ? s_link.share_bytes[i] : share_max;
+            chatty_latency = (s_link.max_latency[i] > chatty_latency) ? s_link.max_latency[i] : chatty_latency;
+        } else {
+            quiet_dropped += device.dropped;
+            quiet_latency = (s_link.max_latency[i] > quiet_latency) ? s_link.max_latency[i] : quiet_latency;
+        }
+    }
+
+    printf("  %u messages, %.0f bytes and %.1f datapoints per message, %u send errors, %u reports dropped\n",
+           stats.messages, (double)stats.bytes / stats.messages, (double)stats.datapoints / stats.messages,
+           stats.send_errors, stats.queue_full);
+    printf("  chatty: %u dropped, last 300 s share %u..%u bytes, max latency %u ms\n",
+           chatty_dropped, share_min, share_max, chatty_latency);
+    printf("  quiet: %u dropped, max latency %u ms\n", quiet_dropped, quiet_latency);
+
+    TEST_ASSERT_EQUAL(0, s_link.errors);
+    TEST_ASSERT_EQUAL(0, quiet_dropped);
+    TEST_ASSERT(chatty_dropped > 0);
+    TEST_ASSERT(stats.send_errors > 0);
+    TEST_ASSERT(share_max - share_min <= share_max / 20);
+    TEST_ASSERT(quiet_latency < 5000);
+}
+
+static void test_gw_slots(void)
+{
+    esp_welink_gw_device_stats_t device;
+    esp_welink_gw_stats_t stats;
+    txd_uint64_t sender = { 0 };
+    txd_datapoint_t datapoint = { .property_id = 0x10000 + (7 << 8) + 5 };
+    uint8_t value[40] = { 1, 2, 3, 4 };
+    uint8_t out[32];
+    uint32_t local_id = 0;
+    uint32_t len = sizeof(out);
+    uint32_t i = 0;
+
+    // 上一个测试的网关还在，所有槽位都已使用
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_add(BASE_ADDR + 3, WELINK_GW_SLOT_ANY, NULL, NULL));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_add(BASE_ADDR + 999, WELINK_GW_SLOT_ANY, NULL, NULL));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_add(BASE_ADDR + 999, DEVICES, NULL, NULL));
+    TEST_ASSERT_EQUAL(77, esp_welink_gw_find(BASE_ADDR + 77));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_find(BASE_ADDR + 999));
+
+    // 参数检查
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_report(3, WELINK_GW_ADDR_PROPERTY, value, 4));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_report(3, 256, value, 4));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_report(3, 1, value, 33));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_report(DEVICES, 1, value, 4));
+
+    // 移除时丢弃排队的报告，重新加入时用最低的空闲槽位并再次宣告地址
+    for (i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_gw_report(10, 1, value, 4));
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_remove(10));
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_remove(20));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_remove(10));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_report(10, 1, value, 4));
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_get_device_stats(10, &device));
+    TEST_ASSERT_EQUAL(20, esp_welink_gw_add(BASE_ADDR + 20, 20, NULL, NULL));
+    TEST_ASSERT_EQUAL(10, esp_welink_gw_add(BASE_ADDR + 10, WELINK_GW_SLOT_ANY, NULL, NULL));
+    host_timer_run(1000);
+    TEST_ASSERT_EQUAL(2, s_link.addr_seen[10]);
+    TEST_ASSERT_EQUAL(2, s_link.addr_seen[20]);
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_get_stats(&stats));
+    TEST_ASSERT_EQUAL(DEVICES, stats.devices);
+
+    // 下发的数据点进入子设备的接收队列并通知它
+    datapoint.property_value = value;
+    datapoint.property_value_len = 8;
+
+    for (i = 0; i < 4; i++) {
+        value[4] = i;
+        TEST_ASSERT_EQUAL(0, esp_welink_gw_receive(sender, &datapoint, NULL));
+    }
+
+    TEST_ASSERT_EQUAL(4, s_link.notified[7]);
+    TEST_ASSERT_EQUAL(ESP_WELINK_GW_RET_BUSY, esp_welink_gw_receive(sender, &datapoint, NULL));
+
+    for (i = 0; i < 4; i++) {
+        len = sizeof(out);
+        TEST_ASSERT_EQUAL(1, esp_welink_gw_poll(7, &local_id, out, &len));
+        TEST_ASSERT_EQUAL(5, local_id);
+        TEST_ASSERT_EQUAL(8, len);
+        TEST_ASSERT_EQUAL(i, out[4]);
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_poll(7, &local_id, out, &len));
+
+    // 缓冲区太小时丢弃
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_receive(sender, &datapoint, NULL));
+    len = 4;
+    TEST_ASSERT_EQUAL(-1, esp_welink_gw_poll(7, &local_id, out, &len));
+    len = sizeof(out);
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_poll(7, &local_id, out, &len));
+
+    // 值太长、地址属性、未使用的槽位
+    datapoint.property_value_len = 33;
+    TEST_ASSERT_EQUAL(ESP_WELINK_GW_RET_BUSY, esp_welink_gw_receive(sender, &datapoint, NULL));
+    datapoint.property_value_len = 8;
+    datapoint.property_id = 0x10000 + (7 << 8);
+    TEST_ASSERT_EQUAL(ESP_WELINK_GW_RET_UNKNOWN, esp_welink_gw_receive(sender, &datapoint, NULL));
+    datapoint.property_id = 0xFFFF;
+    TEST_ASSERT_EQUAL(ESP_WELINK_GW_RET_UNKNOWN, esp_welink_gw_receive(sender, &datapoint, NULL));
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_remove(30));
+    datapoint.property_id = 0x10000 + (30 << 8) + 1;
+    TEST_ASSERT_EQUAL(ESP_WELINK_GW_RET_UNKNOWN, esp_welink_gw_receive(sender, &datapoint, NULL));
+
+    TEST_ASSERT_EQUAL(0, esp_welink_gw_get_stats(&stats));
+    TEST_ASSERT_EQUAL(2, stats.rx_busy);
+    TEST_ASSERT_EQUAL(3, stats.rx_unknown);
+    TEST_ASSERT_EQUAL(30, esp_welink_gw_add(BASE_ADDR + 30, 30, NULL, NULL));
+}
+
+static int32_t s_bridges_done;
+
+// 每个桥接线程负责DEVICES / BRIDGES个子设备，队列满时让出CPU后重试
+static void* bridge_task(void* arg)
+{
+    uint32_t bridge = (uint32_t)(intptr_t)arg;
+    uint32_t per = DEVICES / BRIDGES;
+    uint32_t n = 0;
+    uint32_t i = 0;
+    int32_t handle = 0;
+
+    for (n = 0; n < BRIDGE_REPORTS; n++) {
+        for (i = 0; i < per; i++) {
+            handle = bridge * per + i;
+
+            while (report_seq(handle, 8) != 0) {
+                sched_yield();
+            }
+        }
+    }
+
+    __atomic_fetch_add(&s_bridges_done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void test_gw_bridges(void)
+{
+    esp_welink_gw_device_stats_t device;
+    pthread_t threads[BRIDGES];
+    uint32_t total = 0;
+    int32_t i = 0;
+
+    // 地址和上一个测试剩下的报告先送出
+    host_timer_run(10000);
+    memset(&s_link, 0, sizeof(s_link));
+    memset(s_link.addr_seen, 0, sizeof(s_link.addr_seen));
+
+    for (i = 0; i < DEVICES; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_gw_get_device_stats(i, &device));
+        TEST_ASSERT_EQUAL(0, device.queued);
+    }
+
+    for (i = 0; i < BRIDGES; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, bridge_task, (void*)(intptr_t)i));
+    }
+
+    while (__atomic_load_n(&s_bridges_done, __ATOMIC_ACQUIRE) != BRIDGES) {
+        host_timer_run(200);
+        sched_yield();
+    }
+
+    for (i = 0; i < BRIDGES; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    host_timer_run(600000);
+
+    for (i = 0; i < DEVICES; i++) {
+        TEST_ASSERT_EQUAL(BRIDGE_REPORTS, s_link.delivered[i]);
+        total += s_link.delivered[i];
+    }
+
+    printf("  %u bridge threads, %u reports delivered in order\n", BRIDGES, total);
+    TEST_ASSERT_EQUAL(0, s_link.errors);
+}
+
+static void test_gw_cost(void)
+{
+    uint64_t start = 0;
+    uint32_t reports = 0;
+    uint32_t round = 0;
+    int32_t i = 0;
+
+    start = host_bench_now_ns();
+
+    // 每轮64个子设备各报告一次8字节，再由定时器打包发出
+    for (round = 0; round < 20000; round++) {
+        for (i = 0; i < DEVICES; i += 4) {
+            reports += (report_seq(i, 8) == 0);
+        }
+
+        host_timer_run(400);
+    }
+
+    printf("  %.0f ns per report queued and packed\n", (double)(host_bench_now_ns() - start) / reports);
+    TEST_ASSERT_EQUAL(0, s_link.errors);
+}
+
+int main(void)
+{
+    RUN_TEST(test_gw_fair_share);
+    RUN_TEST(test_gw_slots);
+    RUN_TEST(test_gw_bridges);
+    RUN_TEST(test_gw_cost);
+
+    return 0;
+}
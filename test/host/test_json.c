@@ -0,0 +1,404 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_json: a command parsed and looked up, the error codes for truncated, malformed and
+ * oversized input, string escapes, writer output read back by the parser, nesting and overflow
+ * limits, and the cost of parsing a command and writing a reply.
+ */
+#include "host_test.h"
+#include "esp_welink_json.h"
+
+#define MAX_TOKENS      32
+#define BENCH_ROUNDS    1000000
+
+static const char s_command[] = "{\"cmd\":\"set\",\"id\":12345,\"params\":{\"power\":true,\"level\":42,"
+                                "\"name\":\"living \\\"room\\\"\",\"rgb\":[255,128,0]},\"ts\":1700000000}";
+
+static int32_t parse(const char* js, esp_welink_json_token_t* tokens, uint32_t max_tokens)
+{
+    return esp_welink_json_parse(js, strlen(js), tokens, max_tokens);
+}
+
+static void test_json_parse_command(void)
+{
+    esp_welink_json_token_t tokens[MAX_TOKENS];
+    char name[32];
+    int32_t count = parse(s_command, tokens, MAX_TOKENS);
+    int32_t params = 0;
+    int32_t rgb = 0;
+    int32_t value = 0;
+    bool power = false;
+
+    // 对象、4个键值、params里4个键值、rgb的3个元素
+    TEST_ASSERT_EQUAL(1 + 4 * 2 + 4 * 2 + 3, count);
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_OBJECT, tokens[0].type);
+    TEST_ASSERT_EQUAL(4, tokens[0].size);
+    TEST_ASSERT_EQUAL(0, tokens[0].start);
+    TEST_ASSERT_EQUAL(strlen(s_command), tokens[0].end);
+    TEST_ASSERT_EQUAL(-1, tokens[0].parent);
+
+    TEST_ASSERT(esp_welink_json_eq(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, 0, "cmd")], "set"));
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, 0, "id")], &value));
+    TEST_ASSERT_EQUAL(12345, value);
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, 0, "ts")], &value));
+    TEST_ASSERT_EQUAL(1700000000, value);
+
+    // 嵌套对象里的键不会被外层的查找找到
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_find(s_command, tokens, count, 0, "level"));
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_find(s_command, tokens, count, 0, "missing"));
+
+    params = esp_welink_json_find(s_command, tokens, count, 0, "params");
+    TEST_ASSERT(params > 0);
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_OBJECT, tokens[params].type);
+    TEST_ASSERT_EQUAL(params - 1, tokens[params].parent);
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_find(s_command, tokens, count, params, "cmd"));
+
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_bool(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, params, "power")], &power));
+    TEST_ASSERT(power);
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, params, "level")], &value));
+    TEST_ASSERT_EQUAL(42, value);
+    TEST_ASSERT_EQUAL(13, esp_welink_json_get_string(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, params, "name")],
+                      name, sizeof(name)));
+    TEST_ASSERT(strcmp(name, "living \"room\"") == 0);
+
+    rgb = esp_welink_json_find(s_command, tokens, count, params, "rgb");
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_ARRAY, tokens[rgb].type);
+    TEST_ASSERT_EQUAL(3, tokens[rgb].size);
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(s_command, &tokens[esp_welink_json_array_get(tokens, count, rgb, 1)], &value));
+    TEST_ASSERT_EQUAL(128, value);
+    TEST_ASSERT_EQUAL(rgb, tokens[esp_welink_json_array_get(tokens, count, rgb, 2)].parent);
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_array_get(tokens, count, rgb, 3));
+
+    // 类型不对的转换都失败
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_get_int(s_command, &tokens[params], &value));
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_get_bool(s_command, &tokens[rgb + 1], &power));
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_get_string(s_command, &tokens[rgb + 1], name, sizeof(name)));
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_find(s_command, tokens, count, rgb, "x"));
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_find(s_command, tokens, count, count, "cmd"));
+
+    // 输出缓冲区不够放下字符串和结尾的NUL
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_get_string(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, params, "name")],
+                      name, 13));
+}
+
+static void test_json_parse_errors(void)
+{
+    static const struct {
+        const char* js;
+        int32_t result;
+    } cases[] = {
+        { "", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "   ", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "{\"a\":1", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "{\"a\":", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "{\"a", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[1,2", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[tr", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[-", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[1.", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[1e", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "[\"\\u12", ESP_WELINK_JSON_ERR_PARTIAL },
+        { "{\"a\":1,}", ESP_WELINK_JSON_ERR_INVALID },
+        { "[1,]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[1 2]", ESP_WELINK_JSON_ERR_INVALID },
+        { "{\"a\" 1}", ESP_WELINK_JSON_ERR_INVALID },
+        { "{a:1}", ESP_WELINK_JSON_ERR_INVALID },
+        { "{\"a\":1]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[1}", ESP_WELINK_JSON_ERR_INVALID },
+        { "[01]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[+1]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[1.e3]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[.5]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[truex]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[nul]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[\"\\x\"]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[\"\\u12g4\"]", ESP_WELINK_JSON_ERR_INVALID },
+        { "[\"a\tb\"]", ESP_WELINK_JSON_ERR_INVALID },
+        { "{} {}", ESP_WELINK_JSON_ERR_INVALID },
+        { "1 2", ESP_WELINK_JSON_ERR_INVALID },
+        { "]", ESP_WELINK_JSON_ERR_INVALID },
+    };
+    esp_welink_json_token_t tokens[MAX_TOKENS];
+    char* big = NULL;
+    uint32_t len = strlen(s_command);
+    uint32_t i = 0;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (parse(cases[i].js, tokens, MAX_TOKENS) != cases[i].result) {
+            fprintf(stderr, "case %u: %s\n", i, cases[i].js);
+        }
+
+        TEST_ASSERT_EQUAL(cases[i].result, parse(cases[i].js, tokens, MAX_TOKENS));
+    }
+
+    TEST_ASSERT_EQUAL(1, parse(" -0.5e+3 ", tokens, MAX_TOKENS));
+    TEST_ASSERT_EQUAL(2, parse("[null]", tokens, MAX_TOKENS));
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_ERR_INVALID, esp_welink_json_parse(NULL, 0, tokens, MAX_TOKENS));
+
+    // 命令的每个前缀都是不完整的，不会被当成错误或者完整的文本
+    for (i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL(ESP_WELINK_JSON_ERR_PARTIAL, esp_welink_json_parse(s_command, i, tokens, MAX_TOKENS));
+    }
+
+    // token不够时报NOMEM，刚好够时成功
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_ERR_NOMEM, parse(s_command, tokens, 19));
+    TEST_ASSERT_EQUAL(20, parse(s_command, tokens, 20));
+
+    // 嵌套只消耗token
+    big = malloc(ESP_WELINK_JSON_MAX_LEN + 1);
+    memset(big, '[', 16);
+    memset(big + 16, ']', 16);
+    TEST_ASSERT_EQUAL(16, esp_welink_json_parse(big, 32, tokens, MAX_TOKENS));
+    TEST_ASSERT_EQUAL(15, tokens[15].parent + 1);
+
+    memset(big, ' ', ESP_WELINK_JSON_MAX_LEN + 1);
+    big[0] = '1';
+    TEST_ASSERT_EQUAL(1, esp_welink_json_parse(big, ESP_WELINK_JSON_MAX_LEN, tokens, MAX_TOKENS));
+    TEST_ASSERT_EQUAL(ESP_WELINK_JSON_ERR_INVALID, esp_welink_json_parse(big, ESP_WELINK_JSON_MAX_LEN + 1, tokens, MAX_TOKENS));
+    free(big);
+}
+
+// 逐字节改动命令，解析结果要么是错误，要么所有token都落在文本之内
+static void test_json_parse_mutations(void)
+{
+    static const char replacements[] = "{}[]\":, \\0-.eatu";
+    esp_welink_json_token_t tokens[MAX_TOKENS];
+    char js[sizeof(s_command)];
+    uint32_t len = strlen(s_command);
+    uint32_t valid = 0;
+    uint32_t pos = 0;
+    uint32_t i = 0;
+    int32_t count = 0;
+    int32_t t = 0;
+
+    for (pos = 0; pos < len; pos++) {
+        for (i = 0; i < sizeof(replacements) - 1; i++) {
+            memcpy(js, s_command, sizeof(js));
+            js[pos] = replacements[i];
+            count = esp_welink_json_parse(js, len, tokens, MAX_TOKENS);
+
+            if (count < 0) {
+                TEST_ASSERT(count >= ESP_WELINK_JSON_ERR_PARTIAL);
+                continue;
+            }
+
+            valid++;
+
+            for (t = 0; t < count; t++) {
+                TEST_ASSERT(tokens[t].start <= tokens[t].end && tokens[t].end <= len);
+                TEST_ASSERT(tokens[t].parent < t);
+                TEST_ASSERT(esp_welink_json_next(tokens, count, t) <= count);
+            }
+        }
+    }
+
+    printf("  %u of %u single-byte mutations still parse\n", valid, len * (uint32_t)(sizeof(replacements) - 1));
+    TEST_ASSERT(valid > 0);
+}
+
+static void test_json_string_escapes(void)
+{
+    static const char js[] = "[\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\",\"\\u00e9\\u4e2d\\ud83d\\ude00\",\"\\ud800x\"]";
+    esp_welink_json_token_t tokens[4];
+    char out[32];
+
+    TEST_ASSERT_EQUAL(4, parse(js, tokens, 4));
+
+    TEST_ASSERT_EQUAL(12, esp_welink_json_get_string(js, &tokens[1], out, sizeof(out)));
+    TEST_ASSERT(strcmp(out, "a\"b\\c/d\b\f\n\r\t") == 0);
+
+    // 2、3、4字节的UTF-8，代理对合成一个码点
+    TEST_ASSERT_EQUAL(9, esp_welink_json_get_string(js, &tokens[2], out, sizeof(out)));
+    TEST_ASSERT(strcmp(out, "\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80") == 0);
+
+    // 落单的高位代理按原值写出
+    TEST_ASSERT_EQUAL(4, esp_welink_json_get_string(js, &tokens[3], out, sizeof(out)));
+    TEST_ASSERT(strcmp(out, "\xed\xa0\x80x") == 0);
+
+    // 查找比较的是原文，不解码转义
+    TEST_ASSERT(esp_welink_json_eq(js, &tokens[3], "\\ud800x"));
+}
+
+static void test_json_writer(void)
+{
+    static const char name[] = "a \"quoted\"\\ name\n\x01";
+    esp_welink_json_writer_t writer;
+    esp_welink_json_token_t tokens[MAX_TOKENS];
+    char buf[256];
+    char out[32];
+    int32_t count = 0;
+    int32_t len = 0;
+    int32_t value = 0;
+    int32_t data = 0;
+    int32_t i = 0;
+
+    esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+    esp_welink_json_write_object_begin(&writer, NULL);
+    esp_welink_json_write_int(&writer, "id", 12345);
+    esp_welink_json_write_bool(&writer, "ok", true);
+    esp_welink_json_write_object_begin(&writer, "data");
+    esp_welink_json_write_fixed(&writer, "temperature", -215, 1);
+    esp_welink_json_write_string(&writer, "name", name, sizeof(name) - 1);
+    esp_welink_json_write_array_begin(&writer, "rgb");
+    esp_welink_json_write_int(&writer, NULL, INT32_MIN);
+    esp_welink_json_write_null(&writer, NULL);
+    esp_welink_json_write_array_begin(&writer, NULL);
+    esp_welink_json_write_array_end(&writer);
+    esp_welink_json_write_array_end(&writer);
+    esp_welink_json_write_object_end(&writer);
+    esp_welink_json_write_object_end(&writer);
+    len = esp_welink_json_writer_finish(&writer);
+
+    TEST_ASSERT(len > 0);
+    TEST_ASSERT_EQUAL(strlen(buf), len);
+    TEST_ASSERT(strcmp(buf, "{\"id\":12345,\"ok\":true,\"data\":{\"temperature\":-21.5,"
+                       "\"name\":\"a \\\"quoted\\\"\\\\ name\\n\\u0001\",\"rgb\":[-2147483648,null,[]]}}") == 0);
+
+    // 写出的文本解析回来得到同样的值
+    count = parse(buf, tokens, MAX_TOKENS);
+    TEST_ASSERT_EQUAL(16, count);
+    data = esp_welink_json_find(buf, tokens, count, 0, "data");
+    TEST_ASSERT_EQUAL(sizeof(name) - 1, esp_welink_json_get_string(buf, &tokens[esp_welink_json_find(buf, tokens, count, data, "name")],
+                      out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY(name, out, sizeof(name));
+    i = esp_welink_json_find(buf, tokens, count, data, "rgb");
+    TEST_ASSERT_EQUAL(0, esp_welink_json_get_int(buf, &tokens[esp_welink_json_array_get(tokens, count, i, 0)], &value));
+    TEST_ASSERT_EQUAL(INT32_MIN, value);
+
+    // 缓冲区不够时只在finish时报一次错，不写出缓冲区
+    for (i = 0; i < len; i++) {
+        memset(buf, 0x55, sizeof(buf));
+        esp_welink_json_writer_init(&writer, buf, i);
+        esp_welink_json_write_object_begin(&writer, NULL);
+        esp_welink_json_write_string(&writer, "name", name, sizeof(name) - 1);
+        esp_welink_json_write_int(&writer, "id", 12345);
+        esp_welink_json_write_object_end(&writer);
+
+        if (esp_welink_json_writer_finish(&writer) >= 0) {
+            break;
+        }
+
+        TEST_ASSERT_EQUAL(0x55, (uint8_t)buf[i]);
+    }
+
+    // 刚好放下时没有空间写结尾的NUL，仍然返回长度
+    TEST_ASSERT_EQUAL(i, esp_welink_json_writer_finish(&writer));
+    TEST_ASSERT_EQUAL(0x55, (uint8_t)buf[i]);
+
+    // 不配对的容器
+    esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+    esp_welink_json_write_object_begin(&writer, NULL);
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_writer_finish(&writer));
+    esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+    esp_welink_json_write_array_end(&writer);
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_writer_finish(&writer));
+    esp_welink_json_writer_init(&writer, NULL, 0);
+    esp_welink_json_write_null(&writer, NULL);
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_writer_finish(&writer));
+
+    // 最多嵌套ESP_WELINK_JSON_WRITER_DEPTH层，更深的层里不能再写值
+    esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+
+    for (i = 0; i < ESP_WELINK_JSON_WRITER_DEPTH; i++) {
+        esp_welink_json_write_array_begin(&writer, NULL);
+    }
+
+    for (i = 0; i < ESP_WELINK_JSON_WRITER_DEPTH; i++) {
+        esp_welink_json_write_array_end(&writer);
+    }
+
+    TEST_ASSERT_EQUAL(2 * ESP_WELINK_JSON_WRITER_DEPTH, esp_welink_json_writer_finish(&writer));
+
+    esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+
+    for (i = 0; i < ESP_WELINK_JSON_WRITER_DEPTH; i++) {
+        esp_welink_json_write_array_begin(&writer, NULL);
+    }
+
+    esp_welink_json_write_int(&writer, NULL, 1);
+
+    for (i = 0; i < ESP_WELINK_JSON_WRITER_DEPTH; i++) {
+        esp_welink_json_write_array_end(&writer);
+    }
+
+    TEST_ASSERT_EQUAL(-1, esp_welink_json_writer_finish(&writer));
+}
+
+static void test_json_cost(void)
+{
+    esp_welink_json_token_t tokens[MAX_TOKENS];
+    esp_welink_json_writer_t writer;
+    char buf[128];
+    volatile uint32_t sink = 0;
+    uint64_t start = 0;
+    double parse_ns = 0;
+    double write_ns = 0;
+    int32_t count = 0;
+    int32_t value = 0;
+    uint32_t i = 0;
+
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        count = esp_welink_json_parse(s_command, sizeof(s_command) - 1, tokens, MAX_TOKENS);
+        esp_welink_json_get_int(s_command, &tokens[esp_welink_json_find(s_command, tokens, count, 0, "id")], &value);
+        sink += value + esp_welink_json_find(s_command, tokens, count, 0, "params");
+    }
+
+    parse_ns = (double)(host_bench_now_ns() - start) / BENCH_ROUNDS;
+
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        esp_welink_json_writer_init(&writer, buf, sizeof(buf));
+        esp_welink_json_write_object_begin(&writer, NULL);
+        esp_welink_json_write_int(&writer, "id", i);
+        esp_welink_json_write_int(&writer, "code", 0);
+        esp_welink_json_write_object_begin(&writer, "data");
+        esp_welink_json_write_bool(&writer, "power", i & 1);
+        esp_welink_json_write_fixed(&writer, "temperature", (int32_t)(i % 1600) - 400, 1);
+        esp_welink_json_write_string(&writer, "name", "living \"room\"", 13);
+        esp_welink_json_write_object_end(&writer);
+        esp_welink_json_write_object_end(&writer);
+        sink += esp_welink_json_writer_finish(&writer);
+    }
+
+    write_ns = (double)(host_bench_now_ns() - start) / BENCH_ROUNDS;
+
+    printf("  %u-byte command, parse and look up 2 keys: %.1f ns\n", (uint32_t)sizeof(s_command) - 1, parse_ns);
+    printf("  reply with 6 members: %.1f ns\n", write_ns);
+}
+
+int main(void)
+{
+    RUN_TEST(test_json_parse_command);
+    RUN_TEST(test_json_parse_errors);
+    RUN_TEST(test_json_parse_mutations);
+    RUN_TEST(test_json_string_escapes);
+    RUN_TEST(test_json_writer);
+    RUN_TEST(test_json_cost);
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_log sink: ordering and single consumer with concurrent producers and flushes, the non-blocking
+ * flush while the drain task is writing, the shutdown and abort() flushes, and the cost of a line for the caller.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "esp_log.h"
+#include "esp_welink_log.h"
+
+#define ORDER_PRODUCERS     4
+#define ORDER_LINES         20000
+#define BENCH_LINES         20000
+#define BENCH_BATCH         (WELINK_LOG_SINK_LINES / 2)
+#define UART_BAUD           115200
+
+static uint32_t s_inside;
+static uint32_t s_overlap;
+static uint32_t s_lines;
+static uint32_t s_disorder;
+static uint32_t s_last_seq[ORDER_PRODUCERS + 4];
+static bool s_slow;
+static pthread_t s_last_thread;
+static bool s_producing;
+static int s_abort_fd = -1;
+
+// 控制台输出，检查是否有两个消费者同时输出，以及每个生产者的行是否按顺序到达
+static int capture_vprintf(const char* format, va_list ap)
+{
+    char line[WELINK_LOG_SINK_LINE_SIZE + 64];
+    unsigned producer = 0;
+    unsigned seq = 0;
+    int len = 0;
+
+    if (__atomic_add_fetch(&s_inside, 1, __ATOMIC_ACQ_REL) != 1) {
+        __atomic_add_fetch(&s_overlap, 1, __ATOMIC_RELAXED);
+    }
+
+    len = vsnprintf(line, sizeof(line), format, ap);
+
+    if (__atomic_load_n(&s_slow, __ATOMIC_ACQUIRE)) {
+        struct timespec ts = { 0, 20 * 1000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    if ((sscanf(line, "P%u N%u", &producer, &seq) == 2) && (producer < ORDER_PRODUCERS + 4)) {
+        if (seq <= s_last_seq[producer]) {
+            s_disorder++;
+        }
+
+        s_last_seq[producer] = seq;
+        s_last_thread = pthread_self();
+        __atomic_add_fetch(&s_lines, 1, __ATOMIC_RELEASE);
+    }
+
+    if ((s_abort_fd >= 0) && (len > 0)) {
+        (void)!write(s_abort_fd, line, strnlen(line, sizeof(line)));
+    }
+
+    __atomic_sub_fetch(&s_inside, 1, __ATOMIC_ACQ_REL);
+    return len;
+}
+
+static void log_line(const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    esp_welink_log_vprintf(format, args);
+    va_end(args);
+}
+
+static uint32_t lines(void)
+{
+    return __atomic_load_n(&s_lines, __ATOMIC_ACQUIRE);
+}
+
+// 等待count行输出，或者被丢弃
+static void wait_lines(uint32_t count, uint32_t dropped_before)
+{
+    uint64_t deadline = host_bench_now_ns() + 5000000000ULL;
+
+    while (lines() + (esp_welink_log_get_dropped() - dropped_before) < count) {
+        TEST_ASSERT(host_bench_now_ns() < deadline);
+        esp_welink_log_flush();
+        sched_yield();
+    }
+}
+
+static void* order_producer(void* arg)
+{
+    uint32_t producer = (uint32_t)(uintptr_t)arg;
+    uint32_t i = 0;
+
+    for (i = 1; i <= ORDER_LINES; i++) {
+        log_line("P%u N%u\n", producer, i);
+
+        if ((i & 0x07) == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void* order_flusher(void* arg)
+{
+    while (__atomic_load_n(&s_producing, __ATOMIC_ACQUIRE)) {
+        esp_welink_log_flush();
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void test_log_order_with_concurrent_flush(void)
+{
+    pthread_t producers[ORDER_PRODUCERS];
+    pthread_t flusher;
+    uint32_t dropped = esp_welink_log_get_dropped();
+    uint32_t i = 0;
+
+    s_lines = 0;
+    __atomic_store_n(&s_producing, true, __ATOMIC_RELEASE);
+    TEST_ASSERT_EQUAL(0, pthread_create(&flusher, NULL, order_flusher, NULL));
+
+    for (i = 0; i < ORDER_PRODUCERS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_create(&producers[i], NULL, order_producer, (void*)(uintptr_t)i));
+    }
+
+    for (i = 0; i < ORDER_PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+
+    __atomic_store_n(&s_producing, false, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    wait_lines(ORDER_PRODUCERS * ORDER_LINES, dropped);
+
+    printf("  %u lines written, %u dropped\n", lines(), esp_welink_log_get_dropped() - dropped);
+    TEST_ASSERT_EQUAL(ORDER_PRODUCERS * ORDER_LINES, lines() + (esp_welink_log_get_dropped() - dropped));
+    TEST_ASSERT_EQUAL(0, s_disorder);
+    TEST_ASSERT_EQUAL(0, s_overlap);
+}
+
+// 排空任务正在慢速输出时，flush立即返回，不会成为第二个消费者
+static void test_log_flush_does_not_wait(void)
+{
+    uint64_t deadline = host_bench_now_ns() + 5000000000ULL;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    uint32_t before = lines();
+
+    __atomic_store_n(&s_slow, true, __ATOMIC_RELEASE);
+    log_line("P%u N%u\n", ORDER_PRODUCERS, 1);
+
+    while (__atomic_load_n(&s_inside, __ATOMIC_ACQUIRE) == 0) {
+        TEST_ASSERT(host_bench_now_ns() < deadline);
+        sched_yield();
+    }
+
+    log_line("P%u N%u\n", ORDER_PRODUCERS, 2);
+    start = host_bench_now_ns();
+    esp_welink_log_flush();
+    elapsed = host_bench_now_ns() - start;
+    __atomic_store_n(&s_slow, false, __ATOMIC_RELEASE);
+
+    wait_lines(before + 2, esp_welink_log_get_dropped());
+    printf("  flush returned after %.1f us while the drain task was writing\n", elapsed / 1000.0);
+    TEST_ASSERT(elapsed < 5000000);
+    TEST_ASSERT_EQUAL(0, s_overlap);
+    TEST_ASSERT_EQUAL(0, s_disorder);
+}
+
+static double bench_enqueue_ns(void)
+{
+    uint64_t total = 0;
+    uint64_t start = 0;
+    uint32_t dropped = esp_welink_log_get_dropped();
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    s_lines = 0;
+    memset(s_last_seq, 0, sizeof(s_last_seq));
+
+    // 每批不超过队列的一半，批之间排空队列，只计调用者的时间
+    for (i = 0; i < BENCH_LINES; i += BENCH_BATCH) {
+        start = host_bench_now_ns();
+
+        for (j = 1; j <= BENCH_BATCH; j++) {
+            esp_log_write(ESP_LOG_INFO, "welink", "P%u N%u I (%u) welink: prop %d value %d.%d rssi %d\n",
+                          ORDER_PRODUCERS + 1, i + j, 123456, 3, 25, 5, -60);
+        }
+
+        total += host_bench_now_ns() - start;
+        wait_lines(i + BENCH_BATCH, dropped);
+    }
+
+    TEST_ASSERT_EQUAL(dropped, esp_welink_log_get_dropped());
+    return (double)total / BENCH_LINES;
+}
+
+static double bench_sync_ns(FILE* out, uint32_t* line_len)
+{
+    uint64_t start = host_bench_now_ns();
+    uint32_t i = 0;
+    int len = 0;
+
+    for (i = 0; i < BENCH_LINES; i++) {
+        len = fprintf(out, "P%u N%u I (%u) welink: prop %d value %d.%d rssi %d\n",
+                      ORDER_PRODUCERS + 1, i + 1, 123456, 3, 25, 5, -60);
+    }
+
+    fflush(out);
+    *line_len = len;
+    return (double)(host_bench_now_ns() - start) / BENCH_LINES;
+}
+
+static void test_log_line_cost(void)
+{
+    FILE* null = fopen("/dev/null", "w");
+    uint32_t line_len = 0;
+    double enqueue = 0;
+    double sync = 0;
+    double uart = 0;
+
+    TEST_ASSERT(null != NULL);
+    enqueue = bench_enqueue_ns();
+    sync = bench_sync_ns(null, &line_len);
+    fclose(null);
+
+    // 同步输出时调用者要等串口发完整行，每字节10位
+    uart = line_len * 10 * 1e9 / UART_BAUD;
+    printf("  %u byte line: enqueue %.0f ns, synchronous format to /dev/null %.0f ns, "
+           "synchronous UART at %u baud %.0f ns\n", line_len, enqueue, sync, UART_BAUD, uart);
+    TEST_ASSERT(enqueue < uart);
+}
+
+// abort()先排空队列再终止进程；fork出的子进程中没有drain任务，输出的行只能来自abort()的flush
+static void test_log_abort(void)
+{
+    int fds[2] = { -1, -1 };
+    char buf[256];
+    uint32_t received = 0;
+    ssize_t len = 0;
+    ssize_t i = 0;
+    int status = 0;
+    pid_t pid = 0;
+
+    // 等drain任务输出完前面的行并进入等待，fork时消费者标志空闲
+    usleep(50 * 1000);
+    fflush(stdout);
+    TEST_ASSERT_EQUAL(0, pipe(fds));
+
+    pid = fork();
+    TEST_ASSERT(pid >= 0);
+
+    if (pid == 0) {
+        close(fds[0]);
+        s_abort_fd = fds[1];
+
+        for (i = 1; i <= BENCH_BATCH; i++) {
+            log_line("P%u N%u\n", ORDER_PRODUCERS + 3, (unsigned)i);
+        }
+
+        abort();
+    }
+
+    close(fds[1]);
+
+    while ((len = read(fds[0], buf, sizeof(buf))) > 0) {
+        for (i = 0; i < len; i++) {
+            received += (buf[i] == '\n');
+        }
+    }
+
+    close(fds[0]);
+    TEST_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT(WIFSIGNALED(status) && (WTERMSIG(status) == SIGABRT));
+    printf("  abort(): %u of %u queued lines written before the process ended\n", received, BENCH_BATCH);
+    TEST_ASSERT_EQUAL(BENCH_BATCH, received);
+}
+
+// esp_restart()的关机处理排空队列，之后的日志在调用者中同步输出
+static void test_log_shutdown(void)
+{
+    uint32_t i = 0;
+    uint32_t before = 0;
+
+    s_lines = 0;
+    memset(s_last_seq, 0, sizeof(s_last_seq));
+
+    for (i = 1; i <= BENCH_BATCH; i++) {
+        log_line("P%u N%u\n", ORDER_PRODUCERS + 2, i);
+    }
+
+    TEST_ASSERT_EQUAL(1, host_shutdown());
+    wait_lines(BENCH_BATCH, esp_welink_log_get_dropped());
+
+    before = lines();
+    log_line("P%u N%u\n", ORDER_PRODUCERS + 2, BENCH_BATCH + 1);
+    TEST_ASSERT_EQUAL(before + 1, lines());
+    TEST_ASSERT(pthread_equal(s_last_thread, pthread_self()));
+    TEST_ASSERT_EQUAL(0, s_disorder);
+    TEST_ASSERT_EQUAL(0, s_overlap);
+}
+
+int main(void)
+{
+    esp_log_set_vprintf(capture_vprintf);
+    TEST_ASSERT_EQUAL(0, esp_welink_log_sink_start(1, 1024 * 3));
+
+    RUN_TEST(test_log_order_with_concurrent_flush);
+    RUN_TEST(test_log_flush_does_not_wait);
+    RUN_TEST(test_log_line_cost);
+    RUN_TEST(test_log_abort);
+    RUN_TEST(test_log_shutdown);
+
+    return 0;
+}
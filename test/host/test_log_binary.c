@@ -0,0 +1,153 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * CONFIG_WELINK_LOG_BINARY: which call sites are recorded and which fall back to text lines, and the round
+ * trip of the records through tools/welink_log_decode.py, run by log_decode_check.py after this test.
+ */
+
+#define CONFIG_WELINK_LOG_BINARY 1
+
+#include <errno.h>
+#include <stdarg.h>
+
+#include "host_test.h"
+#include "esp_welink_log.h"
+
+#define CONSOLE_FILE    "log_binary_console.txt"
+#define EXPECTED_FILE   "log_binary_expected.txt"
+
+typedef enum {
+    TEST_STATE_IDLE,
+    TEST_STATE_BUSY,
+} test_state_t;
+
+static const char* TAG = "test_log_binary";
+static FILE* s_console;
+static FILE* s_expected;
+
+static int capture_vprintf(const char* format, va_list ap)
+{
+    return vfprintf(s_console, format, ap);
+}
+
+// 预期的消息，R表示应记录为二进制，T表示应输出文本行
+static void expect(char kind, const char* format, ...)
+{
+    va_list args;
+
+    fprintf(s_expected, "%c ", kind);
+    va_start(args, format);
+    vfprintf(s_expected, format, args);
+    va_end(args);
+    fputc('\n', s_expected);
+}
+
+// 调用点是否记录为二进制在编译时决定
+static void test_log_binary_fits(void)
+{
+    char buf[8] = "abc";
+    const char* str = buf;
+    int64_t wide = 1;
+    uint16_t half = 1;
+    float real = 1.0f;
+    bool flag = true;
+    test_state_t state = TEST_STATE_BUSY;
+
+    TEST_ASSERT(WELINK_LOG_FITS());
+    TEST_ASSERT(WELINK_LOG_FITS(1, 2u, 'c', half, flag, state, (uint8_t)3, -1));
+    TEST_ASSERT(!WELINK_LOG_FITS(1, 2, 3, 4, 5, 6, 7, 8, 9));
+    TEST_ASSERT(!WELINK_LOG_FITS(wide));
+    TEST_ASSERT(!WELINK_LOG_FITS(1, real));
+    TEST_ASSERT(!WELINK_LOG_FITS(1.0));
+    TEST_ASSERT(!WELINK_LOG_FITS(str));
+    TEST_ASSERT(!WELINK_LOG_FITS(buf));
+    TEST_ASSERT(!WELINK_LOG_FITS("literal"));
+    TEST_ASSERT(!WELINK_LOG_FITS(1, 2, 3, 4, 5, 6, 7, str));
+}
+
+// 二进制记录和回退的文本行混在一起输出，解码后与printf的结果一致
+static void test_log_binary_round_trip(void)
+{
+    char buf[16];
+    int64_t wide = -1234567890123LL;
+    uint16_t half = 65535;
+    int16_t negative = -300;
+    float real = 2.5f;
+    uint32_t i = 0;
+
+    WELINK_LOGE("plain line");
+    expect('R', "plain line");
+
+    WELINK_LOGE("int %d unsigned %u hex %08x char %c", -5, 7u, 0xdeadbeefu, 'x');
+    expect('R', "int %d unsigned %u hex %08x char %c", -5, 7u, 0xdeadbeefu, 'x');
+
+    WELINK_LOGE("short %d %u %hd", negative, half, negative);
+    expect('R', "short %d %u %hd", negative, half, negative);
+
+    WELINK_LOGE("eight %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+    expect('R', "eight %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+
+    WELINK_LOGE("nine %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+    expect('T', "nine %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+
+    WELINK_LOGE("wide %lld", (long long)wide);
+    expect('T', "wide %lld", (long long)wide);
+
+    WELINK_LOGE("double %.3f float %.1f", 3.25, real);
+    expect('T', "double %.3f float %.1f", 3.25, real);
+
+    for (i = 0; i < 3; i++) {
+        snprintf(buf, sizeof(buf), "dev-%u", i);
+        WELINK_LOGE("string %s index %u", buf, i);
+        expect('T', "string %s index %u", buf, i);
+    }
+
+    WELINK_LOGE("constant %s", "string");
+    expect('T', "constant %s", "string");
+
+    errno = EINVAL;
+    WELINK_LOG_ERRNO();
+    expect('R', "errno: %d", EINVAL);
+}
+
+int main(void)
+{
+    s_console = fopen(CONSOLE_FILE, "w");
+    s_expected = fopen(EXPECTED_FILE, "w");
+    TEST_ASSERT(s_console != NULL && s_expected != NULL);
+
+    // 启动后立即关机，之后的记录和文本行都在调用者中按顺序输出到同一个文件
+    esp_log_set_vprintf(capture_vprintf);
+    TEST_ASSERT_EQUAL(0, esp_welink_log_sink_start(1, 1024 * 3));
+    TEST_ASSERT_EQUAL(1, host_shutdown());
+
+    RUN_TEST(test_log_binary_fits);
+    RUN_TEST(test_log_binary_round_trip);
+
+    fclose(s_console);
+    fclose(s_expected);
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Runtime per-module log levels: the level string parser, and the cost of a WELINK_LOG* line which is
+ * compiled in but disabled at runtime, the case the level check has to keep cheap.
+ */
+
+// 编译进所有级别，运行时再关闭
+#undef CONFIG_LOG_WELINK_LEVEL
+#define CONFIG_LOG_WELINK_LEVEL 6
+#define WELINK_LOG_MODULE WELINK_LOG_MODULE_OTA
+
+#include <stdarg.h>
+
+#include "host_test.h"
+#include "esp_welink_log.h"
+
+#define BENCH_CALLS 100000000
+
+static const char* TAG = "test_log_level";
+static uint32_t s_evaluated;
+static uint32_t s_lines;
+
+static int capture_vprintf(const char* format, va_list ap)
+{
+    s_lines++;
+    return 0;
+}
+
+static int expensive_arg(void)
+{
+    s_evaluated++;
+    return 1;
+}
+
+static void test_log_level_str(void)
+{
+    char buf[96];
+
+    TEST_ASSERT_EQUAL(0, esp_welink_log_set_level_str("*=2,ota=v,wifi=5", 16));
+    esp_welink_log_get_level_str(buf, sizeof(buf));
+    TEST_ASSERT(strcmp(buf, "baseapi=2,thread=2,wifi=5,ota=6,datapoint=2") == 0);
+
+    // 任何一项非法时都不修改
+    TEST_ASSERT_EQUAL(-1, esp_welink_log_set_level_str("*=3,bad=2", 9));
+    TEST_ASSERT_EQUAL(-1, esp_welink_log_set_level_str("*=3,thread=x", 12));
+    TEST_ASSERT_EQUAL(-1, esp_welink_log_set_level_str("*=3,ota", 7));
+    esp_welink_log_get_level_str(buf, sizeof(buf));
+    TEST_ASSERT(strcmp(buf, "baseapi=2,thread=2,wifi=5,ota=6,datapoint=2") == 0);
+
+    // 输出的字符串可以原样设置回去
+    TEST_ASSERT_EQUAL(0, esp_welink_log_set_level_str(buf, strlen(buf) + 1));
+    TEST_ASSERT_EQUAL(WELINK_LOG_VERBOSE, esp_welink_log_get_level(WELINK_LOG_MODULE_OTA));
+    TEST_ASSERT_EQUAL(WELINK_LOG_DEBUG, esp_welink_log_get_level(WELINK_LOG_MODULE_WIFI));
+}
+
+static void test_log_level_filter(void)
+{
+    s_lines = 0;
+    s_evaluated = 0;
+
+    esp_welink_log_set_level(WELINK_LOG_MODULE_OTA, WELINK_LOG_DEBUG);
+    WELINK_LOGD("value %d", expensive_arg());
+    WELINK_LOGV("value %d", expensive_arg());
+    TEST_ASSERT_EQUAL(1, s_lines);
+    TEST_ASSERT_EQUAL(1, s_evaluated);
+
+    // 其他模块的级别不影响本模块
+    esp_welink_log_set_level(WELINK_LOG_MODULE_BASEAPI, WELINK_LOG_NONE);
+    esp_welink_log_set_level(WELINK_LOG_MODULE_OTA, WELINK_LOG_WARN);
+    WELINK_LOGW("value %d", expensive_arg());
+    WELINK_LOGI("value %d", expensive_arg());
+    TEST_ASSERT_EQUAL(2, s_lines);
+    TEST_ASSERT_EQUAL(2, s_evaluated);
+}
+
+static void test_log_level_disabled_cost(void)
+{
+    volatile uint32_t count = 0;
+    uint64_t start = 0;
+    double empty = 0;
+    double disabled = 0;
+    uint32_t i = 0;
+
+    esp_welink_log_set_level(WELINK_LOG_MODULE_OTA, WELINK_LOG_INFO);
+    s_lines = 0;
+    s_evaluated = 0;
+
+    // 空循环作为基准，循环计数器用volatile，避免整个循环被优化掉
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_CALLS; i++) {
+        count++;
+    }
+
+    empty = (double)(host_bench_now_ns() - start) / BENCH_CALLS;
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_CALLS; i++) {
+        count++;
+        WELINK_LOGD("value %d %d", expensive_arg(), i);
+    }
+
+    disabled = (double)(host_bench_now_ns() - start) / BENCH_CALLS;
+
+    printf("  disabled WELINK_LOGD: %.2f ns/call, empty loop %.2f ns/call\n", disabled, empty);
+    TEST_ASSERT_EQUAL(0, s_lines);
+    TEST_ASSERT_EQUAL(0, s_evaluated);
+    TEST_ASSERT(disabled - empty < 10.0);
+}
+
+int main(void)
+{
+    esp_log_set_vprintf(capture_vprintf);
+
+    RUN_TEST(test_log_level_str);
+    RUN_TEST(test_log_level_filter);
+    RUN_TEST(test_log_level_disabled_cost);
+
+    (void)TAG;
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_loop with the real socket port: a timer started from another task must end the select wait,
+ * and fd callbacks which remove fds must not make the loop skip a ready fd.
+ */
+#include <pthread.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "txd_stdtypes.h"
+#include "txd_baseapi.h"
+#include "txd_error.h"
+#include "txd_sdk.h"
+#include "txd_thread.h"
+#include "esp_welink_boot.h"
+#include "esp_welink_loop.h"
+
+#define SDK_SLEEP_MS 100000
+
+static uint32_t s_sdk_runs;
+static uint32_t s_timer_fired;
+
+void esp_welink_boot_mark(esp_welink_boot_phase_t phase)
+{
+}
+
+int32_t txd_sdk_run(uint32_t* expect_sleep_ms)
+{
+    s_sdk_runs++;
+    *expect_sleep_ms = SDK_SLEEP_MS;
+
+    return err_success;
+}
+
+static void timer_cb(void* arg)
+{
+    s_timer_fired++;
+}
+
+static void* start_timer_later(void* arg)
+{
+    usleep(50 * 1000);
+    txd_timer_start((txd_timer_handler_t*)arg, 0, 0, 0);
+
+    return NULL;
+}
+
+static void test_loop_timer_from_other_task(void)
+{
+    uint64_t start_ns = 0;
+    uint64_t elapsed_ms = 0;
+    pthread_t starter;
+    txd_timer_handler_t* timer = txd_timer_create(timer_cb, NULL);
+    txd_socket_handler_t* sock = txd_tcp_socket_create();
+
+    TEST_ASSERT((timer != NULL) && (sock != NULL));
+    host_clock_follow_real_time(true);
+
+    // 第一次循环运行SDK，之后SDK要睡眠SDK_SLEEP_MS，也没有定时器，循环只会等待到max_wait_ms
+    TEST_ASSERT_EQUAL(err_success, esp_welink_loop_run_once(0));
+    TEST_ASSERT_EQUAL(1, s_sdk_runs);
+
+    start_ns = host_bench_now_ns();
+    TEST_ASSERT_EQUAL(0, pthread_create(&starter, NULL, start_timer_later, timer));
+
+    while ((s_timer_fired == 0) && ((host_bench_now_ns() - start_ns) < 3000000000ULL)) {
+        esp_welink_loop_run_once(3000);
+    }
+
+    elapsed_ms = (host_bench_now_ns() - start_ns) / 1000000;
+    pthread_join(starter, NULL);
+    printf("  timer started by another task fired after %u ms\n", (uint32_t)elapsed_ms);
+    TEST_ASSERT_EQUAL(1, s_timer_fired);
+    TEST_ASSERT(elapsed_ms < 1000);
+
+    txd_timer_destroy(timer);
+    txd_tcp_socket_destroy(sock);
+}
+
+#define PIPES 4
+
+static int s_pipes[PIPES][2];
+static uint32_t s_fd_calls[PIPES];
+
+static void fd_cb(int fd, void* arg)
+{
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    uint8_t byte = 0;
+
+    TEST_ASSERT_EQUAL(1, read(fd, &byte, 1));
+    s_fd_calls[index]++;
+
+    // 偶数下标的回调删除自己，1号还删除3号
+    if (index % 2 == 0) {
+        TEST_ASSERT_EQUAL(0, esp_welink_loop_remove_fd(fd));
+    } else if (index == 1) {
+        TEST_ASSERT_EQUAL(0, esp_welink_loop_remove_fd(s_pipes[3][0]));
+    }
+}
+
+static void test_loop_fd_removed_in_callback(void)
+{
+    uint32_t i = 0;
+    uint8_t byte = 1;
+    uint32_t total = 0;
+
+    for (i = 0; i < PIPES; i++) {
+        TEST_ASSERT_EQUAL(0, pipe(s_pipes[i]));
+        TEST_ASSERT_EQUAL(0, esp_welink_loop_add_fd(s_pipes[i][0], fd_cb, (void*)(uintptr_t)i));
+        TEST_ASSERT_EQUAL(1, write(s_pipes[i][1], &byte, 1));
+    }
+
+    esp_welink_loop_run_once(0);
+
+    // 3号可能在1号删除它之前回调，其余每个就绪的fd都在这一次循环中回调一次
+    for (i = 0; i < PIPES; i++) {
+        total += s_fd_calls[i];
+        TEST_ASSERT(s_fd_calls[i] <= 1);
+    }
+
+    TEST_ASSERT_EQUAL(1, s_fd_calls[0]);
+    TEST_ASSERT_EQUAL(1, s_fd_calls[1]);
+    TEST_ASSERT_EQUAL(1, s_fd_calls[2]);
+    TEST_ASSERT(total >= 3);
+
+    // 只剩下1号
+    TEST_ASSERT_EQUAL(-1, esp_welink_loop_remove_fd(s_pipes[0][0]));
+    TEST_ASSERT_EQUAL(-1, esp_welink_loop_remove_fd(s_pipes[3][0]));
+    TEST_ASSERT_EQUAL(0, esp_welink_loop_remove_fd(s_pipes[1][0]));
+
+    for (i = 0; i < PIPES; i++) {
+        close(s_pipes[i][0]);
+        close(s_pipes[i][1]);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_loop_timer_from_other_task);
+    RUN_TEST(test_loop_fd_removed_in_callback);
+
+    return 0;
+}
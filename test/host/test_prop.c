@@ -0,0 +1,223 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_prop: the encoders against snprintf over edge and random values, decode round trips and
+ * malformed input, batch limits, and a batch of three values encoded with the schema versus snprintf.
+ */
+#include "host_test.h"
+#include "esp_welink_prop.h"
+
+#define APP_PROPERTIES(X) \
+    X(PROP_TEMPERATURE, 100, ESP_WELINK_PROP_FIXED, -400, 1250, 1) \
+    X(PROP_POWER,       101, ESP_WELINK_PROP_BOOL,  0, 1, 0) \
+    X(PROP_LEVEL,       102, ESP_WELINK_PROP_INT,   INT32_MIN, INT32_MAX, 0)
+
+enum { APP_PROPERTIES(ESP_WELINK_PROP_ENUM) PROP_MAX };
+static const esp_welink_prop_schema_t s_props[] = { APP_PROPERTIES(ESP_WELINK_PROP_ENTRY) };
+
+#define RANDOM_VALUES   500000
+#define BENCH_BATCHES   3000000
+
+static const int32_t s_edges[] = {
+    0, 1, -1, 9, 10, 99, 100, -100, INT32_MIN, INT32_MAX, INT32_MIN + 1, 123456789, -5, -50, 5,
+    1000000000, -1000000000, 999, 1001, -99, 7,
+};
+
+// snprintf给出的参考结果
+static int reference_fixed(char* out, int32_t value, uint8_t decimals)
+{
+    long long magnitude = (value < 0) ? -(long long)value : value;
+    long long scale = 1;
+    uint8_t i = 0;
+
+    if (decimals == 0) {
+        return snprintf(out, 32, "%d", (int)value);
+    }
+
+    for (i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+
+    return snprintf(out, 32, "%s%lld.%0*lld", (value < 0) ? "-" : "", magnitude / scale, decimals, magnitude % scale);
+}
+
+static void check_value(int32_t value)
+{
+    esp_welink_prop_schema_t schema = { 1, ESP_WELINK_PROP_FIXED, INT32_MIN, INT32_MAX, 0 };
+    uint8_t text[ESP_WELINK_PROP_MAX_CHARS];
+    char expected[32];
+    int32_t decoded = 0;
+    uint32_t len = 0;
+    uint8_t decimals = 0;
+
+    for (decimals = 0; decimals <= 9; decimals++) {
+        len = esp_welink_prop_encode_fixed(text, value, decimals);
+        TEST_ASSERT(len <= ESP_WELINK_PROP_MAX_CHARS);
+        TEST_ASSERT_EQUAL(reference_fixed(expected, value, decimals), len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, text, len);
+
+        schema.decimals = decimals;
+        TEST_ASSERT_EQUAL(0, esp_welink_prop_decode(&schema, text, len, &decoded));
+        TEST_ASSERT_EQUAL(value, decoded);
+    }
+
+    len = esp_welink_prop_encode_int(text, value);
+    TEST_ASSERT_EQUAL(snprintf(expected, sizeof(expected), "%d", (int)value), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, text, len);
+}
+
+static void test_prop_encode_matches_snprintf(void)
+{
+    uint32_t i = 0;
+    int32_t value = 0;
+
+    for (i = 0; i < sizeof(s_edges) / sizeof(s_edges[0]); i++) {
+        check_value(s_edges[i]);
+    }
+
+    // 随机值，四分之一右移到较短的位数
+    srand(1);
+
+    for (i = 0; i < RANDOM_VALUES; i++) {
+        value = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+        check_value((i % 4 == 0) ? value >> (rand() % 31) : value);
+    }
+}
+
+static void test_prop_decode(void)
+{
+    static const char* malformed[] = {
+        "", "-", ".", " 1", "1 ", "1.2.3", "2147483648", "-2147483649", "1e3", "+1", "--1", "99999999999999999999",
+    };
+    const esp_welink_prop_schema_t level = { 1, ESP_WELINK_PROP_INT, INT32_MIN, INT32_MAX, 0 };
+    int32_t value = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        TEST_ASSERT_EQUAL(-1, esp_welink_prop_decode(&level, (const uint8_t*)malformed[i], strlen(malformed[i]), &value));
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_decode(&level, (const uint8_t*)"-2147483648", 11, &value));
+    TEST_ASSERT_EQUAL(INT32_MIN, value);
+
+    // 多余的小数位截断，超出范围的值拒绝
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_decode(&s_props[PROP_TEMPERATURE], (const uint8_t*)"21.57", 5, &value));
+    TEST_ASSERT_EQUAL(215, value);
+    TEST_ASSERT_EQUAL(-1, esp_welink_prop_decode(&s_props[PROP_TEMPERATURE], (const uint8_t*)"125.1", 5, &value));
+
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_decode(&s_props[PROP_POWER], (const uint8_t*)"true", 4, &value));
+    TEST_ASSERT_EQUAL(1, value);
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_decode(&s_props[PROP_POWER], (const uint8_t*)"0", 1, &value));
+    TEST_ASSERT_EQUAL(0, value);
+    TEST_ASSERT_EQUAL(-1, esp_welink_prop_decode(&s_props[PROP_POWER], (const uint8_t*)"yes", 3, &value));
+}
+
+static void test_prop_batch(void)
+{
+    esp_welink_prop_batch_t batch;
+    txd_datapoint_t datapoints[3];
+    uint8_t buf[3 * ESP_WELINK_PROP_MAX_CHARS];
+
+    esp_welink_prop_batch_init(&batch, datapoints, 3, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(-1, esp_welink_prop_put(&batch, &s_props[PROP_TEMPERATURE], 1251));
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_put(&batch, &s_props[PROP_TEMPERATURE], -5));
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_put(&batch, &s_props[PROP_POWER], 1));
+    TEST_ASSERT_EQUAL(0, esp_welink_prop_put(&batch, &s_props[PROP_LEVEL], INT32_MIN));
+    TEST_ASSERT_EQUAL(-1, esp_welink_prop_put(&batch, &s_props[PROP_LEVEL], 0));
+
+    TEST_ASSERT_EQUAL(3, batch.count);
+    TEST_ASSERT_EQUAL(100, datapoints[0].property_id);
+    TEST_ASSERT_EQUAL(4, datapoints[0].property_value_len);
+    TEST_ASSERT_EQUAL_MEMORY("-0.5", datapoints[0].property_value, 4);
+    TEST_ASSERT_EQUAL_MEMORY("true", datapoints[1].property_value, 4);
+    TEST_ASSERT_EQUAL_MEMORY("-2147483648", datapoints[2].property_value, 11);
+    TEST_ASSERT_EQUAL(4 + 4 + 11, batch.used);
+}
+
+static void test_prop_encode_cost(void)
+{
+    esp_welink_prop_batch_t batch;
+    txd_datapoint_t datapoints[3];
+    uint8_t buf[3 * ESP_WELINK_PROP_MAX_CHARS];
+    volatile uint32_t sink = 0;
+    uint64_t start = 0;
+    double schema = 0;
+    double formatted = 0;
+    int32_t temperature = 0;
+    uint32_t used = 0;
+    uint32_t i = 0;
+    int len = 0;
+
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_BATCHES; i++) {
+        esp_welink_prop_batch_init(&batch, datapoints, 3, buf, sizeof(buf));
+        esp_welink_prop_put(&batch, &s_props[PROP_TEMPERATURE], (int32_t)(i % 1600) - 400);
+        esp_welink_prop_put(&batch, &s_props[PROP_POWER], i & 1);
+        esp_welink_prop_put(&batch, &s_props[PROP_LEVEL], (int32_t)(i * 7919));
+        sink += batch.used;
+    }
+
+    schema = (double)(host_bench_now_ns() - start) / BENCH_BATCHES;
+
+    // 同样的三个值用snprintf写入同样的数据点
+    start = host_bench_now_ns();
+
+    for (i = 0; i < BENCH_BATCHES; i++) {
+        temperature = (int32_t)(i % 1600) - 400;
+        used = 0;
+
+        len = snprintf((char*)buf, ESP_WELINK_PROP_MAX_CHARS + 1, "%s%d.%d", (temperature < 0) ? "-" : "",
+                       abs(temperature) / 10, abs(temperature) % 10);
+        datapoints[0].property_value = buf;
+        datapoints[0].property_value_len = len;
+        used += len;
+
+        len = snprintf((char*)buf + used, ESP_WELINK_PROP_MAX_CHARS + 1, "%s", (i & 1) ? "true" : "false");
+        datapoints[1].property_value = buf + used;
+        datapoints[1].property_value_len = len;
+        used += len;
+
+        len = snprintf((char*)buf + used, ESP_WELINK_PROP_MAX_CHARS, "%d", (int32_t)(i * 7919));
+        datapoints[2].property_value = buf + used;
+        datapoints[2].property_value_len = len;
+        sink += used + len;
+    }
+
+    formatted = (double)(host_bench_now_ns() - start) / BENCH_BATCHES;
+
+    printf("  batch of 3 values: schema encoder %.1f ns, snprintf %.1f ns\n", schema, formatted);
+    TEST_ASSERT(schema < formatted);
+}
+
+int main(void)
+{
+    RUN_TEST(test_prop_encode_matches_snprintf);
+    RUN_TEST(test_prop_decode);
+    RUN_TEST(test_prop_batch);
+    RUN_TEST(test_prop_encode_cost);
+
+    return 0;
+}
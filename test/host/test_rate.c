@@ -0,0 +1,252 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_rate: every report completes exactly once (on time, early, expired or evicted from a full
+ * in-flight table), and a simulated congestion episode against a fake SDK.
+ */
+#include "host_test.h"
+#include "esp_welink_rate.h"
+#include "txd_error.h"
+
+#define FAKE_PENDING    4096
+#define TIMEOUT_MS      1000
+
+typedef struct {
+    uint32_t cookie;
+    uint32_t due_ms;
+    int32_t err_code;
+} fake_pending_t;
+
+static struct {
+    uint32_t next_cookie;
+    on_send_datapoint cb;
+    fake_pending_t pending[FAKE_PENDING];
+    uint32_t count;
+    bool complete_now;          // 在发送函数返回前完成
+    uint32_t latency_ms;
+    bool congested;
+} s_fake;
+
+static uint32_t s_calls[FAKE_PENDING];
+static int32_t s_last_err[FAKE_PENDING];
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    fake_pending_t* p = NULL;
+
+    *pCookie = ++s_fake.next_cookie;
+    s_fake.cb = pCb;
+
+    if (s_fake.complete_now) {
+        pCb(err_success, *pCookie);
+        return err_success;
+    }
+
+    TEST_ASSERT(s_fake.count < FAKE_PENDING);
+    p = &s_fake.pending[s_fake.count++];
+    p->cookie = *pCookie;
+    p->due_ms = host_clock_ms() + s_fake.latency_ms;
+    p->err_code = err_success;
+
+    // 拥塞时三分之一超时返回，四分之一一直不返回
+    if (s_fake.congested) {
+        p->err_code = (rand() % 3 == 0) ? err_msg_sendtimeout : err_success;
+        p->due_ms = (rand() % 4 == 0) ? UINT32_MAX : p->due_ms;
+    }
+
+    return err_success;
+}
+
+// 完成所有到期的消息
+static void fake_complete_due(void)
+{
+    uint32_t i = 0;
+    uint32_t kept = 0;
+
+    for (i = 0; i < s_fake.count; i++) {
+        if ((s_fake.pending[i].due_ms != UINT32_MAX) && (host_clock_ms() >= s_fake.pending[i].due_ms)) {
+            s_fake.cb(s_fake.pending[i].err_code, s_fake.pending[i].cookie);
+        } else {
+            s_fake.pending[kept++] = s_fake.pending[i];
+        }
+    }
+
+    s_fake.count = kept;
+}
+
+static void user_cb(int32_t err_code, uint32_t cookie)
+{
+    TEST_ASSERT(cookie < FAKE_PENDING);
+    s_calls[cookie]++;
+    s_last_err[cookie] = err_code;
+}
+
+static uint32_t report(int32_t stream)
+{
+    txd_datapoint_t dp = {0};
+    uint32_t cookie = 0;
+
+    TEST_ASSERT_EQUAL(err_success, esp_welink_rate_report(stream, &dp, 1, user_cb, &cookie));
+    return cookie;
+}
+
+static void test_rate_expired_report_completes_once(void)
+{
+    esp_welink_rate_stats_t stats;
+    int32_t stream = esp_welink_rate_stream_create(100, 10000, 4);
+    uint32_t cookie = 0;
+
+    TEST_ASSERT(stream >= 0);
+    s_fake.latency_ms = 5 * TIMEOUT_MS;
+    cookie = report(stream);
+
+    host_clock_advance_ms(TIMEOUT_MS + 1);
+    TEST_ASSERT_EQUAL(0, esp_welink_rate_get_stats(stream, &stats));
+    TEST_ASSERT_EQUAL(1, s_calls[cookie]);
+    TEST_ASSERT_EQUAL(err_msg_sendtimeout, s_last_err[cookie]);
+
+    // SDK之后才返回的完成被丢弃，不再调用回调，也不计入统计
+    host_clock_advance_ms(5 * TIMEOUT_MS);
+    fake_complete_due();
+    TEST_ASSERT_EQUAL(1, s_calls[cookie]);
+    TEST_ASSERT_EQUAL(err_msg_sendtimeout, s_last_err[cookie]);
+
+    TEST_ASSERT_EQUAL(0, esp_welink_rate_get_stats(stream, &stats));
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+    TEST_ASSERT_EQUAL(0, stats.completed);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+}
+
+static void test_rate_early_completion(void)
+{
+    esp_welink_rate_stats_t stats;
+    int32_t stream = esp_welink_rate_stream_create(100, 10000, 4);
+    uint32_t cookie = 0;
+
+    s_fake.complete_now = true;
+    cookie = report(stream);
+    s_fake.complete_now = false;
+
+    TEST_ASSERT_EQUAL(1, s_calls[cookie]);
+    TEST_ASSERT_EQUAL(err_success, s_last_err[cookie]);
+    TEST_ASSERT_EQUAL(0, esp_welink_rate_get_stats(stream, &stats));
+    TEST_ASSERT_EQUAL(1, stats.completed);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+}
+
+static void test_rate_full_table_evicts_oldest(void)
+{
+    int32_t stream = esp_welink_rate_stream_create(1, 10000, WELINK_RATE_INFLIGHT + 1);
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t i = 0;
+
+    s_fake.latency_ms = TIMEOUT_MS / 2;
+    first = report(stream);
+
+    for (i = 1; i < WELINK_RATE_INFLIGHT; i++) {
+        host_clock_advance_ms(1);
+        report(stream);
+    }
+
+    host_clock_advance_ms(1);
+    last = report(stream);
+    TEST_ASSERT_EQUAL(1, s_calls[first]);
+    TEST_ASSERT_EQUAL(err_msg_sendtimeout, s_last_err[first]);
+
+    host_clock_advance_ms(TIMEOUT_MS / 2);
+    fake_complete_due();
+
+    for (i = first; i <= last; i++) {
+        TEST_ASSERT_EQUAL(1, s_calls[i]);
+    }
+
+    TEST_ASSERT_EQUAL(err_success, s_last_err[last]);
+}
+
+// 正常、拥塞、恢复三个阶段，速率先升后降再回升，每条消息都恰好完成一次
+static void test_rate_congestion_episode(void)
+{
+    esp_welink_rate_stats_t stats;
+    int32_t stream = esp_welink_rate_stream_create(200, 60000, 2);
+    uint32_t first = s_fake.next_cookie + 1;
+    uint32_t interval[3] = {0};
+    uint32_t t = 0;
+    uint32_t i = 0;
+
+    srand(1);
+    s_fake.latency_ms = 300;
+
+    for (t = 0; t < 600000; t += 10) {
+        s_fake.congested = (t >= 200000) && (t < 350000);
+        host_clock_advance_ms(10);
+        fake_complete_due();
+
+        if (esp_welink_rate_ready(stream)) {
+            report(stream);
+        }
+
+        if ((t + 10) % 200000 == 0) {
+            interval[t / 200000] = esp_welink_rate_get_interval(stream);
+        }
+    }
+
+    // 超过超时时间后所有消息都已完成
+    host_clock_advance_ms(TIMEOUT_MS + 1);
+    TEST_ASSERT_EQUAL(0, esp_welink_rate_get_stats(stream, &stats));
+
+    printf("  interval %u ms before, %u ms after congestion, %u ms after recovery; "
+           "sent %u, completed %u, timeouts %u\n", interval[0], interval[1], interval[2],
+           stats.sent, stats.completed, stats.timeouts);
+    TEST_ASSERT(interval[1] > 4 * interval[0]);
+    TEST_ASSERT(interval[2] < interval[1]);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+    TEST_ASSERT_EQUAL(stats.sent, stats.completed + stats.timeouts);
+
+    for (i = first; i <= s_fake.next_cookie; i++) {
+        TEST_ASSERT_EQUAL(1, s_calls[i]);
+    }
+}
+
+int main(void)
+{
+    esp_welink_rate_config_t config = ESP_WELINK_RATE_CONFIG_DEFAULT();
+
+    config.inflight_timeout_ms = TIMEOUT_MS;
+    config.report = fake_report;
+    TEST_ASSERT_EQUAL(0, esp_welink_rate_init(&config));
+
+    RUN_TEST(test_rate_expired_report_completes_once);
+    RUN_TEST(test_rate_early_completion);
+    RUN_TEST(test_rate_full_table_evicts_oldest);
+    RUN_TEST(test_rate_congestion_episode);
+
+    return 0;
+}
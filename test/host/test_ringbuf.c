@@ -0,0 +1,156 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * txd_ringbuf: boundary cases, then a two-thread stress test which also reports the throughput.
+ * Build with -DWELINK_HOST_SANITIZE=thread to run the stress test under ThreadSanitizer.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+#include "host_test.h"
+#include "txd_stdtypes.h"
+#include "txd_thread.h"
+
+#define STRESS_ITEMS    2000000
+#define STRESS_BATCH    32
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+    uint32_t pad[2];
+} stress_item_t;
+
+static txd_ringbuf_handler_t* s_ring;
+static uint32_t s_push_retries;
+
+static void test_ringbuf_boundary(void)
+{
+    uint32_t i = 0;
+    uint32_t items[8] = {0};
+    txd_ringbuf_handler_t* ring = NULL;
+
+    TEST_ASSERT(txd_ringbuf_create(0, 4) == NULL);
+    TEST_ASSERT(txd_ringbuf_create(4, 0) == NULL);
+    TEST_ASSERT(txd_ringbuf_push(NULL, &i) == -1);
+    TEST_ASSERT_EQUAL(0, txd_ringbuf_pop(NULL, items, 1));
+
+    // 5个元素向上取整为8
+    ring = txd_ringbuf_create(sizeof(uint32_t), 5);
+    TEST_ASSERT(ring != NULL);
+
+    for (i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL(0, txd_ringbuf_push(ring, &i));
+    }
+
+    TEST_ASSERT_EQUAL(-1, txd_ringbuf_push(ring, &i));
+    TEST_ASSERT_EQUAL(1, txd_ringbuf_dropped(ring));
+    TEST_ASSERT_EQUAL(8, txd_ringbuf_count(ring));
+
+    TEST_ASSERT_EQUAL(3, txd_ringbuf_pop(ring, items, 3));
+    TEST_ASSERT_EQUAL(0, items[0]);
+    TEST_ASSERT_EQUAL(2, items[2]);
+
+    // 写入的元素绕回缓冲区开头，批量读取时分两段拷贝
+    for (i = 8; i < 11; i++) {
+        TEST_ASSERT_EQUAL(0, txd_ringbuf_push(ring, &i));
+    }
+
+    TEST_ASSERT_EQUAL(8, txd_ringbuf_pop(ring, items, 8));
+
+    for (i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL(i + 3, items[i]);
+    }
+
+    TEST_ASSERT_EQUAL(0, txd_ringbuf_pop(ring, items, 8));
+    TEST_ASSERT_EQUAL(0, txd_ringbuf_count(ring));
+    TEST_ASSERT_EQUAL(0, txd_ringbuf_destroy(ring));
+}
+
+static void* stress_producer(void* arg)
+{
+    stress_item_t item = {0};
+
+    for (item.seq = 0; item.seq < STRESS_ITEMS; item.seq++) {
+        item.check = item.seq * 2654435761U;
+
+        while (txd_ringbuf_push(s_ring, &item) != 0) {
+            s_push_retries++;
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_ringbuf_stress(void)
+{
+    uint32_t i = 0;
+    uint32_t count = 0;
+    uint32_t expected = 0;
+    uint64_t start_ns = 0;
+    uint64_t elapsed_ns = 0;
+    stress_item_t items[STRESS_BATCH];
+    pthread_t producer;
+
+    s_ring = txd_ringbuf_create(sizeof(stress_item_t), 256);
+    TEST_ASSERT(s_ring != NULL);
+
+    start_ns = host_bench_now_ns();
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, stress_producer, NULL));
+
+    while (expected < STRESS_ITEMS) {
+        count = txd_ringbuf_pop(s_ring, items, STRESS_BATCH);
+
+        // 单核主机上忙等会占满时间片，让出CPU给生产者
+        if (count == 0) {
+            sched_yield();
+        }
+
+        for (i = 0; i < count; i++, expected++) {
+            TEST_ASSERT_EQUAL(expected, items[i].seq);
+            TEST_ASSERT_EQUAL(expected * 2654435761U, items[i].check);
+        }
+    }
+
+    pthread_join(producer, NULL);
+    elapsed_ns = host_bench_now_ns() - start_ns;
+
+    // 满时生产者重试而不是丢弃，dropped只统计失败的push次数
+    TEST_ASSERT_EQUAL(s_push_retries, txd_ringbuf_dropped(s_ring));
+    TEST_ASSERT_EQUAL(0, txd_ringbuf_count(s_ring));
+    printf("  %u items of %u bytes in %.1f ms: %.1f Mitems/s, %u full retries\n",
+           STRESS_ITEMS, (uint32_t)sizeof(stress_item_t), elapsed_ns / 1e6,
+           STRESS_ITEMS * 1e3 / elapsed_ns, s_push_retries);
+
+    txd_ringbuf_destroy(s_ring);
+}
+
+int main(void)
+{
+    RUN_TEST(test_ringbuf_boundary);
+    RUN_TEST(test_ringbuf_stress);
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_sched against a fake SDK which allows 5 sends per second and calls back late, early or never:
+ * the application never sees err_msg_send_too_frequently and every callback is called exactly once.
+ */
+#include "host_test.h"
+#include "esp_welink_sched.h"
+#include "txd_error.h"
+
+#define FAKE_PENDING    256
+#define FAKE_RATE       5
+#define MESSAGES        120
+#define TIMEOUT_MS      30000
+
+typedef struct {
+    uint32_t cookie;
+    uint32_t due_ms;
+} fake_pending_t;
+
+static struct {
+    uint32_t next_cookie;
+    on_send_datapoint cb;
+    fake_pending_t pending[FAKE_PENDING];
+    uint32_t count;
+    uint32_t sent_ms[FAKE_RATE];
+    uint32_t sends;
+    uint32_t rejected;
+    uint32_t max_pending;
+    uint32_t latency_ms;
+    uint32_t early_every;       // 每隔几条在发送函数返回前回调
+    uint32_t lost_every;        // 每隔几条一直不回调
+} s_fake;
+
+static uint32_t s_calls[MESSAGES + 1];
+static int32_t s_last_err[MESSAGES + 1];
+static uint32_t s_too_frequently;
+static uint32_t s_cookie_base;          // 本轮第一条消息的调度器cookie减1
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+int32_t txd_ack_datapoint(txd_datapoint_t* datapoint, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+// 与SDK相同，任意1秒内最多发送5次
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    uint32_t now = host_clock_ms();
+    uint32_t oldest = s_fake.sent_ms[s_fake.sends % FAKE_RATE];
+    fake_pending_t* p = NULL;
+
+    if (s_fake.sends >= FAKE_RATE && now - oldest < 1000) {
+        s_fake.rejected++;
+        return err_msg_send_too_frequently;
+    }
+
+    s_fake.sent_ms[s_fake.sends++ % FAKE_RATE] = now;
+    *pCookie = ++s_fake.next_cookie;
+    s_fake.cb = pCb;
+
+    if (s_fake.early_every != 0 && s_fake.next_cookie % s_fake.early_every == 0) {
+        pCb(err_success, *pCookie);
+        return err_success;
+    }
+
+    TEST_ASSERT(s_fake.count < FAKE_PENDING);
+    p = &s_fake.pending[s_fake.count++];
+    p->cookie = *pCookie;
+    p->due_ms = (s_fake.lost_every != 0 && s_fake.next_cookie % s_fake.lost_every == 0) ? UINT32_MAX : now + s_fake.latency_ms;
+
+    if (s_fake.count > s_fake.max_pending) {
+        s_fake.max_pending = s_fake.count;
+    }
+
+    return err_success;
+}
+
+// 回调所有到期的消息，all为true时连从不回调的消息也回调，模拟超时之后才到达的结果
+static void fake_complete_due(bool all)
+{
+    uint32_t i = 0;
+    uint32_t kept = 0;
+
+    for (i = 0; i < s_fake.count; i++) {
+        if (all || host_clock_ms() >= s_fake.pending[i].due_ms) {
+            s_fake.cb(err_success, s_fake.pending[i].cookie);
+        } else {
+            s_fake.pending[kept++] = s_fake.pending[i];
+        }
+    }
+
+    s_fake.count = kept;
+}
+
+static void user_cb(int32_t err_code, uint32_t cookie)
+{
+    cookie -= s_cookie_base;
+    TEST_ASSERT(cookie >= 1 && cookie <= MESSAGES);
+    s_calls[cookie]++;
+    s_last_err[cookie] = err_code;
+    s_too_frequently += (err_code == err_msg_send_too_frequently);
+}
+
+// 每100ms提交一条，是SDK发送速率的两倍，运行到所有回调都完成
+static void run_messages(uint32_t run_ms)
+{
+    esp_welink_sched_stats_t stats;
+    txd_datapoint_t dp = {0};
+    uint8_t value = 1;
+    uint32_t cookie = 0;
+    uint32_t submitted = 0;
+    uint32_t elapsed = 0;
+
+    dp.property_value = &value;
+    dp.property_value_len = sizeof(value);
+    memset(s_calls, 0, sizeof(s_calls));
+    TEST_ASSERT_EQUAL(0, esp_welink_sched_get_stats(&stats));
+    s_cookie_base = stats.queued[ESP_WELINK_SCHED_ACK] + stats.queued[ESP_WELINK_SCHED_REPORT];
+
+    for (elapsed = 0; elapsed < run_ms; elapsed += 10) {
+        if (submitted < MESSAGES && elapsed % 100 == 0
+                && esp_welink_sched_report(&dp, 1, user_cb, &cookie) == err_success) {
+            submitted++;
+        }
+
+        host_timer_run(10);
+        fake_complete_due(false);
+    }
+
+    TEST_ASSERT_EQUAL(MESSAGES, submitted);
+}
+
+// SDK的回调要8秒后才到达，远多于16条消息在等待回调：发送暂停而不是覆盖等待中的消息
+static void test_sched_long_latency(void)
+{
+    esp_welink_sched_stats_t stats;
+    uint32_t i = 0;
+
+    s_fake.latency_ms = 8000;
+    s_fake.early_every = 7;
+    run_messages(120000);
+
+    for (i = 1; i <= MESSAGES; i++) {
+        TEST_ASSERT_EQUAL(1, s_calls[i]);
+        TEST_ASSERT_EQUAL(err_success, s_last_err[i]);
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_sched_get_stats(&stats));
+    printf("  %u messages, %u sends rejected by the SDK, at most %u waiting for their callback, "
+           "%u sends delayed by back-pressure, longest queue wait %u ms\n",
+           MESSAGES, s_fake.rejected, s_fake.max_pending, stats.stalled, stats.max_wait_ms[ESP_WELINK_SCHED_REPORT]);
+    TEST_ASSERT_EQUAL(0, s_too_frequently);
+    TEST_ASSERT(s_fake.max_pending <= 16);
+    TEST_ASSERT(stats.stalled > 0);
+    TEST_ASSERT_EQUAL(0, stats.timeouts);
+    TEST_ASSERT_EQUAL(0, stats.pending);
+}
+
+// 从不回调的消息超时后以err_msg_sendtimeout完成，之后才到达的结果被丢弃
+static void test_sched_lost_callbacks(void)
+{
+    esp_welink_sched_stats_t stats;
+    esp_welink_sched_stats_t before;
+    uint32_t lost = 0;
+    uint32_t i = 0;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_sched_get_stats(&before));
+    s_fake.latency_ms = 2000;
+    s_fake.early_every = 0;
+    s_fake.lost_every = 5;
+    run_messages(200000);
+
+    for (i = 1; i <= MESSAGES; i++) {
+        TEST_ASSERT_EQUAL(1, s_calls[i]);
+        lost += (s_last_err[i] == err_msg_sendtimeout);
+    }
+
+    fake_complete_due(true);
+
+    for (i = 1; i <= MESSAGES; i++) {
+        TEST_ASSERT_EQUAL(1, s_calls[i]);
+    }
+
+    TEST_ASSERT_EQUAL(0, esp_welink_sched_get_stats(&stats));
+    printf("  %u of %u callbacks never came, completed with err_msg_sendtimeout\n", lost, MESSAGES);
+    TEST_ASSERT_EQUAL(MESSAGES / 5, lost);
+    TEST_ASSERT_EQUAL(MESSAGES / 5, stats.timeouts - before.timeouts);
+    TEST_ASSERT_EQUAL(0, s_too_frequently);
+}
+
+int main(void)
+{
+    esp_welink_sched_config_t config = ESP_WELINK_SCHED_CONFIG_DEFAULT();
+
+    config.report = fake_report;
+    config.report_depth = MESSAGES;
+    config.inflight_timeout_ms = TIMEOUT_MS;
+    TEST_ASSERT_EQUAL(0, esp_welink_sched_init(&config));
+
+    RUN_TEST(test_sched_long_latency);
+    RUN_TEST(test_sched_lost_callbacks);
+
+    return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_sf on an emulated NOR partition: 10k points stored offline, replayed in order across a reboot
+ * with send failures and lost completions, the three drop policies and a torn record at mount.
+ */
+#include "host_test.h"
+#include "esp_welink_sf.h"
+#include "txd_error.h"
+
+#define SF_SECTORS      64
+#define SF_POINTS       10000
+#define FAKE_PENDING    64
+#define STEP_MS         10
+
+typedef struct {
+    uint32_t cookie;
+    uint32_t due_ms;
+    uint32_t first;
+    uint32_t count;
+    on_send_datapoint cb;
+} fake_pending_t;
+
+static struct {
+    uint32_t next_cookie;
+    uint32_t sends;
+    uint32_t fail_every;        // 每N次发送返回一次err_msg_send_too_frequently
+    uint32_t lose_every;        // 每N次发送丢失一次完成回调
+    fake_pending_t pending[FAKE_PENDING];
+    uint32_t count;
+    bool check_gaps;
+    uint32_t acked_end;         // 已确认的值都小于它
+    uint32_t order_errors;
+} s_fake;
+
+static uint8_t s_seen[SF_POINTS];
+static const esp_partition_t* s_partition;
+static esp_welink_sf_flash_t s_flash;
+static uint32_t s_write_end;        // 最后一次写入的结束位置
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+// 写入分区并记下写到了哪里，掉电测试据此找到最后一条记录
+static int32_t track_write(void* ctx, uint32_t offset, const void* buf, uint32_t len)
+{
+    s_write_end = offset + len;
+    return s_flash.write(ctx, offset, buf, len);
+}
+
+static uint32_t point_value(const txd_datapoint_t* dp)
+{
+    uint32_t value = 0;
+
+    memcpy(&value, dp->property_value, sizeof(value));
+    return value;
+}
+
+// 检查顺序：一条消息内递增，且不跳过任何未确认的值
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    fake_pending_t* p = NULL;
+    uint32_t i = 0;
+
+    s_fake.sends++;
+
+    if (s_fake.fail_every && (s_fake.sends % s_fake.fail_every) == 0) {
+        return err_msg_send_too_frequently;
+    }
+
+    for (i = 0; i < datapoints_count; i++) {
+        if ((i > 0) && (point_value(&datapoints[i]) <= point_value(&datapoints[i - 1]))) {
+            s_fake.order_errors++;
+        }
+    }
+
+    if (s_fake.check_gaps && (point_value(&datapoints[0]) > s_fake.acked_end)) {
+        s_fake.order_errors++;
+    }
+
+    // 记录送达次数，丢失完成回调的消息也已送达
+    for (i = 0; i < datapoints_count; i++) {
+        if (point_value(&datapoints[i]) < SF_POINTS) {
+            s_seen[point_value(&datapoints[i])]++;
+        }
+    }
+
+    *pCookie = ++s_fake.next_cookie;
+
+    if (s_fake.lose_every && (s_fake.sends % s_fake.lose_every) == 0) {
+        return err_success;
+    }
+
+    TEST_ASSERT(s_fake.count < FAKE_PENDING);
+    p = &s_fake.pending[s_fake.count++];
+    p->cookie = *pCookie;
+    p->due_ms = host_clock_ms() + 50;
+    p->first = point_value(&datapoints[0]);
+    p->count = datapoints_count;
+    p->cb = pCb;
+
+    return err_success;
+}
+
+// 推进时钟，到期的消息返回成功
+static void run_ms(uint32_t ms)
+{
+    uint32_t t = 0;
+    uint32_t i = 0;
+    uint32_t kept = 0;
+
+    for (t = 0; t < ms; t += STEP_MS) {
+        for (i = 0, kept = 0; i < s_fake.count; i++) {
+            if ((int32_t)(host_clock_ms() - s_fake.pending[i].due_ms) >= 0) {
+                s_fake.acked_end = (s_fake.pending[i].first + s_fake.pending[i].count > s_fake.acked_end)
+                                   ? s_fake.pending[i].first + s_fake.pending[i].count : s_fake.acked_end;
+
+                if (s_fake.pending[i].cb != NULL) {
+                    s_fake.pending[i].cb(err_success, s_fake.pending[i].cookie);
+                }
+            } else {
+                s_fake.pending[kept++] = s_fake.pending[i];
+            }
+        }
+
+        s_fake.count = kept;
+        host_timer_run(STEP_MS);
+    }
+}
+
+static esp_welink_sf_stats_t stats(void)
+{
+    esp_welink_sf_stats_t st;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_sf_get_stats(&st));
+    return st;
+}
+
+// 模拟重启：丢弃内存中的状态和未返回的消息，重新挂载同一个分区
+static void sf_reboot(esp_welink_sf_policy_t policy)
+{
+    esp_welink_sf_config_t config = ESP_WELINK_SF_CONFIG_DEFAULT();
+
+    esp_welink_sf_deinit();
+
+    s_fake.count = 0;
+    config.flash = s_flash;
+    config.flash.write = track_write;
+    config.policy = policy;
+    config.replay_interval_ms = 200;
+    config.ack_timeout_ms = 2000;
+    config.report = fake_report;
+    TEST_ASSERT_EQUAL(0, esp_welink_sf_init(&config));
+}
+
+static void append_points(uint32_t first, uint32_t count, uint32_t len, uint32_t* rejected)
+{
+    uint8_t value[WELINK_SF_MAX_BYTES];
+    txd_datapoint_t dp = {0};
+    uint32_t i = 0;
+
+    memset(value, 0x5A, sizeof(value));
+
+    for (i = first; i < first + count; i++) {
+        memcpy(value, &i, sizeof(i));
+        dp.property_id = (len > sizeof(i)) ? 9 : 1 + i % 5;
+        dp.property_value = value;
+        dp.property_value_len = len;
+
+        if (esp_welink_sf_append(&dp, 1) != 0) {
+            (*rejected)++;
+        }
+    }
+}
+
+static void test_sf_offline_replay_across_reboot(void)
+{
+    host_partition_stats_t flash = {0};
+    esp_welink_sf_stats_t st;
+    txd_datapoint_t dp = {0};
+    uint32_t duplicates = 0;
+    uint32_t start_ms = 0;
+    uint32_t cookie = 0;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    uint32_t i = 0;
+
+    sf_reboot(ESP_WELINK_SF_DROP_OLDEST);
+
+    // 离线时report写入日志，不调用发送函数
+    start = host_bench_now_ns();
+
+    for (i = 0; i < SF_POINTS; i++) {
+        dp.property_id = 1 + i % 5;
+        dp.property_value = (uint8_t*)&i;
+        dp.property_value_len = sizeof(i);
+        TEST_ASSERT_EQUAL(err_success, esp_welink_sf_report(&dp, 1, NULL, &cookie));
+    }
+
+    elapsed = host_bench_now_ns() - start;
+    host_partition_get_stats(s_partition, &flash);
+    st = stats();
+    printf("  append %u points: %.2f us/point, %llu bytes written, %u sector erases, %u of %u sectors\n",
+           SF_POINTS, elapsed / 1000.0 / SF_POINTS, (unsigned long long)flash.bytes_written, flash.erases,
+           st.used_sectors, st.sector_count);
+    TEST_ASSERT_EQUAL(0, s_fake.sends);
+    TEST_ASSERT_EQUAL(SF_POINTS, st.pending);
+    TEST_ASSERT_EQUAL(0, st.dropped);
+
+    // 重放60秒后重启，剩余的记录在重启后继续重放
+    s_fake.check_gaps = true;
+    start_ms = host_clock_ms();
+    esp_welink_sf_set_online(1);
+    run_ms(60000);
+    st = stats();
+    TEST_ASSERT(st.pending > 0 && st.pending < SF_POINTS);
+
+    sf_reboot(ESP_WELINK_SF_DROP_OLDEST);
+    TEST_ASSERT_EQUAL(st.pending, stats().pending);
+
+    s_fake.fail_every = 5;
+    s_fake.lose_every = 7;
+    esp_welink_sf_set_online(1);
+
+    for (i = 0; (i < 100) && (stats().pending != 0); i++) {
+        run_ms(10000);
+    }
+
+    st = stats();
+
+    for (i = 0; i < SF_POINTS; i++) {
+        TEST_ASSERT(s_seen[i] >= 1);
+        duplicates += s_seen[i] - 1;
+    }
+
+    printf("  replayed in %u s simulated, %u sends, %u resent messages, %u duplicate points\n",
+           (host_clock_ms() - start_ms) / 1000, s_fake.sends, st.resent, duplicates);
+    TEST_ASSERT_EQUAL(0, st.pending);
+    TEST_ASSERT_EQUAL(0, s_fake.order_errors);
+    TEST_ASSERT(st.resent > 0);
+
+    // 日志为空时在线上报直接交给发送函数
+    i = SF_POINTS;
+    dp.property_value = (uint8_t*)&i;
+    TEST_ASSERT_EQUAL(err_success, esp_welink_sf_report(&dp, 1, NULL, &cookie));
+    TEST_ASSERT(cookie != 0);
+    TEST_ASSERT_EQUAL(0, stats().pending);
+
+    s_fake.check_gaps = false;
+    s_fake.fail_every = 0;
+    s_fake.lose_every = 0;
+    run_ms(1000);
+}
+
+static void test_sf_drop_oldest(void)
+{
+    esp_welink_sf_stats_t st;
+    uint32_t rejected = 0;
+    uint32_t before = stats().appended;
+
+    esp_welink_sf_set_online(0);
+    append_points(SF_POINTS, 1000, 400, &rejected);
+    st = stats();
+    printf("  1000 x 400 B: %u pending, %u dropped\n", st.pending, st.dropped);
+    TEST_ASSERT_EQUAL(0, rejected);
+    TEST_ASSERT(st.dropped > 0);
+    TEST_ASSERT_EQUAL(st.appended - before, st.pending + st.dropped);
+    TEST_ASSERT_EQUAL(SF_SECTORS, st.used_sectors);
+
+    esp_welink_sf_set_online(1);
+    run_ms(600000);
+    TEST_ASSERT_EQUAL(0, stats().pending);
+    TEST_ASSERT_EQUAL(0, s_fake.order_errors);
+}
+
+static void test_sf_latest_only(void)
+{
+    uint32_t rejected = 0;
+
+    sf_reboot(ESP_WELINK_SF_LATEST_ONLY);
+    append_points(0, 3000, 4, &rejected);
+    TEST_ASSERT_EQUAL(0, rejected);
+    TEST_ASSERT_EQUAL(5, stats().pending);
+    TEST_ASSERT(stats().superseded >= 2995);
+
+    sf_reboot(ESP_WELINK_SF_LATEST_ONLY);
+    TEST_ASSERT_EQUAL(5, stats().pending);
+}
+
+static void test_sf_drop_newest_and_torn_record(void)
+{
+    esp_welink_sf_stats_t st;
+    uint8_t* data = host_partition_data(s_partition);
+    uint32_t rejected = 0;
+    uint32_t pending = 0;
+
+    sf_reboot(ESP_WELINK_SF_DROP_NEWEST);
+    append_points(SF_POINTS, 1000, 400, &rejected);
+    st = stats();
+    TEST_ASSERT(rejected > 0);
+    TEST_ASSERT_EQUAL(rejected, st.dropped);
+    pending = st.pending;
+
+    // 掉电时最后一条记录的值还没写完
+    memset(data + s_write_end - 8, 0xFF, 8);
+    sf_reboot(ESP_WELINK_SF_DROP_NEWEST);
+    st = stats();
+    TEST_ASSERT_EQUAL(1, st.corrupted);
+    TEST_ASSERT_EQUAL(pending - 1, st.pending);
+
+    // 损坏的记录已标记为消费，再次挂载不再计数
+    sf_reboot(ESP_WELINK_SF_DROP_NEWEST);
+    TEST_ASSERT_EQUAL(0, stats().corrupted);
+    TEST_ASSERT_EQUAL(pending - 1, stats().pending);
+}
+
+int main(void)
+{
+    s_partition = host_partition_create(WELINK_SF_PARTITION_LABEL, SF_SECTORS * SPI_FLASH_SEC_SIZE);
+    TEST_ASSERT(s_partition != NULL);
+    TEST_ASSERT_EQUAL(0, esp_welink_sf_partition_flash(&s_flash, WELINK_SF_PARTITION_LABEL));
+
+    RUN_TEST(test_sf_offline_replay_across_reboot);
+    RUN_TEST(test_sf_drop_oldest);
+    RUN_TEST(test_sf_latest_only);
+    RUN_TEST(test_sf_drop_newest_and_torn_record);
+
+    return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_shadow: a day of periodic reports compared with sending every property, full and
+ * dirty reports that span several messages while send results arrive synchronously, from the
+ * SDK thread or not at all, changes made during a report, the ack timeout, and the NVS snapshot
+ * across a restart.
+ */
+#include "host_test.h"
+#include "nvs.h"
+#include "esp_welink_shadow.h"
+#include "txd_error.h"
+
+#define PROPERTIES      40
+#define PROPERTY_BASE   100
+#define FAKE_PENDING    64
+#define FAKE_MAX_SENDS  64              // 一次上报中超过这么多条消息说明在重复上报
+#define SHADOW_NVS_KEY  "shadow"        // 快照在NVS中的键，与esp_welink_shadow.c相同
+
+typedef enum {
+    FAKE_SYNC,                          // 上报函数返回之前就回调结果
+    FAKE_DEFERRED,                      // 由fake_complete()回调
+    FAKE_PREVIOUS,                      // 上报下一条消息时回调上一条，模拟SDK线程
+} fake_mode_t;
+
+typedef struct {
+    uint32_t cookie;
+    int32_t err;
+    on_send_datapoint cb;
+} fake_pending_t;
+
+static struct {
+    fake_mode_t mode;
+    uint32_t next_cookie;
+    uint32_t sends;
+    uint32_t report_sends;          // 本次esp_welink_shadow_report中的消息数
+    uint32_t datapoints;
+    uint32_t bytes;
+    uint32_t fail_every;            // 每N条消息的结果为err_msg_sendtimeout
+    uint32_t sent[PROPERTIES];
+    fake_pending_t pending[FAKE_PENDING];
+    uint32_t count;
+    uint32_t set_during;            // 上报第N条消息时修改属性，0表示不修改
+} s_fake;
+
+int32_t txd_report_datapoints(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    return err_failed;
+}
+
+static void fake_complete(void)
+{
+    uint32_t count = s_fake.count;
+    uint32_t i = 0;
+
+    s_fake.count = 0;
+
+    for (i = 0; i < count; i++) {
+        s_fake.pending[i].cb(s_fake.pending[i].err, s_fake.pending[i].cookie);
+    }
+}
+
+static int32_t fake_report(txd_datapoint_t datapoints[], uint32_t datapoints_count, on_send_datapoint pCb, uint32_t* pCookie)
+{
+    uint32_t cookie = ++s_fake.next_cookie;
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+    int32_t err = err_success;
+
+    s_fake.sends++;
+
+    if (++s_fake.report_sends > FAKE_MAX_SENDS) {
+        return err_failed;
+    }
+
+    TEST_ASSERT(datapoints_count > 0 && datapoints_count <= WELINK_SHADOW_MAX_POINTS);
+
+    for (i = 0; i < datapoints_count; i++) {
+        TEST_ASSERT(datapoints[i].property_id >= PROPERTY_BASE && datapoints[i].property_id < PROPERTY_BASE + PROPERTIES);
+        s_fake.sent[datapoints[i].property_id - PROPERTY_BASE]++;
+        bytes += datapoints[i].property_value_len;
+    }
+
+    TEST_ASSERT(bytes <= WELINK_SHADOW_MAX_BYTES);
+    s_fake.datapoints += datapoints_count;
+    s_fake.bytes += bytes;
+
+    if (s_fake.fail_every != 0 && s_fake.sends % s_fake.fail_every == 0) {
+        err = err_msg_sendtimeout;
+    }
+
+    if (s_fake.set_during != 0 && s_fake.sends == s_fake.set_during) {
+        TEST_ASSERT_EQUAL(0, esp_welink_shadow_set(PROPERTY_BASE, (const uint8_t*)"during", 6));
+    }
+
+    if (s_fake.mode == FAKE_PREVIOUS) {
+        fake_complete();
+    }
+
+    if (s_fake.mode == FAKE_SYNC) {
+        pCb(err, cookie);
+    } else {
+        TEST_ASSERT(s_fake.count < FAKE_PENDING);
+        s_fake.pending[s_fake.count].cookie = cookie;
+        s_fake.pending[s_fake.count].err = err;
+        s_fake.pending[s_fake.count].cb = pCb;
+        s_fake.count++;
+    }
+
+    *pCookie = cookie;
+
+    return err_success;
+}
+
+static void fake_reset(fake_mode_t mode)
+{
+    memset(&s_fake, 0, sizeof(s_fake));
+    s_fake.mode = mode;
+}
+
+static void shadow_start(uint32_t max_value_len)
+{
+    esp_welink_shadow_config_t config = ESP_WELINK_SHADOW_CONFIG_DEFAULT();
+
+    config.max_entries = PROPERTIES;
+    config.max_value_len = max_value_len;
+    config.snapshot_delay_ms = 1000;
+    config.report = fake_report;
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_init(&config));
+}
+
+// 模拟重启：丢弃内存中的状态，NVS中的快照保留
+static void shadow_reboot(void)
+{
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_deinit());
+}
+
+static int32_t report(bool full)
+{
+    s_fake.report_sends = 0;
+    return esp_welink_shadow_report(full);
+}
+
+static void set_int(uint32_t property_id, int32_t value)
+{
+    char text[16];
+
+    TEST_ASSERT(esp_welink_shadow_set(property_id, (const uint8_t*)text, sprintf(text, "%d", value)) >= 0);
+}
+
+static uint32_t dirty(void)
+{
+    esp_welink_shadow_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get_stats(&stats));
+    return stats.dirty;
+}
+
+static void test_shadow_periodic(void)
+{
+    esp_welink_shadow_stats_t stats;
+    txd_datapoint_t command = { .property_id = PROPERTY_BASE + 5 };
+    int32_t values[PROPERTIES] = { 0 };
+    char text[16];
+    uint32_t full_bytes = 0;
+    uint32_t period = 0;
+    uint32_t i = 0;
+
+    host_nvs_reset();
+    fake_reset(FAKE_SYNC);
+    s_fake.fail_every = 10;
+    shadow_start(24);
+    srand48(1);
+
+    // 1440个周期，4个属性经常变化，其余偶尔变化，结果同步、延迟或者由SDK线程回调轮流出现
+    for (period = 0; period < 1440; period++) {
+        s_fake.mode = period % 3;
+
+        for (i = 0; i < PROPERTIES; i++) {
+            if (lrand48() % 100 < ((i < 4) ? 50 : 3)) {
+                values[i] += 1 + lrand48() % 5;
+            }
+
+            set_int(PROPERTY_BASE + i, values[i]);
+            full_bytes += sprintf(text, "%d", values[i]);
+        }
+
+        if (period % 50 == 7) {
+            values[5] += 1000;
+            command.property_value = (uint8_t*)text;
+            command.property_value_len = sprintf(text, "%d", values[5]);
+            TEST_ASSERT_EQUAL(0, esp_welink_shadow_apply(&command));
+        }
+
+        TEST_ASSERT(report(false) >= 0);
+        fake_complete();
+        host_timer_run(60000);
+    }
+
+    // 失败的属性在下一次上报中补发
+    s_fake.fail_every = 0;
+    TEST_ASSERT(report(false) >= 0);
+    fake_complete();
+    TEST_ASSERT_EQUAL(0, dirty());
+
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get_stats(&stats));
+    printf("  %u periods of %u properties: %u bytes in %u messages, %u bytes if every property is sent (%.1f%%)\n",
+           period, PROPERTIES, s_fake.bytes, stats.messages, full_bytes, 100.0 * s_fake.bytes / full_bytes);
+    printf("  %u unchanged sets, %u commands, %u send errors, %u snapshots written\n",
+           stats.unchanged, stats.commands, stats.send_errors, stats.saves);
+    TEST_ASSERT(s_fake.bytes * 4 < full_bytes);
+    TEST_ASSERT(stats.send_errors > 0);
+
+    shadow_reboot();
+}
+
+// 全量和差量上报跨越多条消息，每个属性每次调用只发送一次，无论结果何时到达
+static void test_shadow_report_once(void)
+{
+    static const char* const modes[] = { "synchronous", "deferred", "from the SDK thread" };
+    uint8_t value[24];
+    uint32_t mode = 0;
+    uint32_t fail = 0;
+    uint32_t i = 0;
+    int32_t messages = 0;
+
+    memset(value, 'v', sizeof(value));
+
+    for (mode = FAKE_SYNC; mode <= FAKE_PREVIOUS; mode++) {
+        for (fail = 0; fail <= 1; fail++) {
+            host_nvs_reset();
+            fake_reset(mode);
+            shadow_start(sizeof(value));
+
+            for (i = 0; i < PROPERTIES; i++) {
+                value[0] = 'a' + i % 26;
+                TEST_ASSERT_EQUAL(0, esp_welink_shadow_set(PROPERTY_BASE + i, value, sizeof(value)));
+            }
+
+            // 24字节的值每条消息最多放16个，第2条消息的结果全部失败
+            s_fake.fail_every = fail ? 2 : 0;
+            messages = report(true);
+            fake_complete();
+            printf("  full report of %u properties, results %s%s: %d messages\n", PROPERTIES, modes[mode],
+                   fail ? ", one failed" : "", messages);
+            TEST_ASSERT_EQUAL(3, messages);
+
+            for (i = 0; i < PROPERTIES; i++) {
+                TEST_ASSERT_EQUAL(1, s_fake.sent[i]);
+            }
+
+            TEST_ASSERT_EQUAL(fail ? WELINK_SHADOW_MAX_POINTS : 0, dirty());
+
+            // 差量上报只补发失败的属性，也只发一次
+            memset(s_fake.sent, 0, sizeof(s_fake.sent));
+            s_fake.sends = 0;
+            s_fake.fail_every = fail ? 1 : 0;
+            TEST_ASSERT_EQUAL(fail ? 1 : 0, report(false));
+            fake_complete();
+
+            for (i = 0; i < PROPERTIES; i++) {
+                TEST_ASSERT(s_fake.sent[i] <= 1);
+            }
+
+            TEST_ASSERT_EQUAL(fail ? WELINK_SHADOW_MAX_POINTS : 0, dirty());
+            shadow_reboot();
+        }
+    }
+}
+
+// 上报期间修改的属性留给下一次上报
+static void test_shadow_set_during_report(void)
+{
+    uint8_t value[24];
+    uint8_t out[24];
+    uint32_t len = sizeof(out);
+    esp_welink_shadow_version_t version;
+    uint32_t i = 0;
+
+    memset(value, 'v', sizeof(value));
+    host_nvs_reset();
+    fake_reset(FAKE_SYNC);
+    shadow_start(sizeof(value));
+
+    for (i = 0; i < PROPERTIES; i++) {
+        TEST_ASSERT_EQUAL(0, esp_welink_shadow_set(PROPERTY_BASE + i, value, sizeof(value)));
+    }
+
+    s_fake.set_during = 2;
+    TEST_ASSERT_EQUAL(3, report(true));
+    TEST_ASSERT_EQUAL(1, s_fake.sent[0]);
+    TEST_ASSERT_EQUAL(1, dirty());
+
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get(PROPERTY_BASE, out, &len, &version));
+    TEST_ASSERT_EQUAL(2, version.desired);
+    TEST_ASSERT_EQUAL(1, version.reported);
+
+    TEST_ASSERT_EQUAL(1, report(false));
+    TEST_ASSERT_EQUAL(2, s_fake.sent[0]);
+    TEST_ASSERT_EQUAL(0, dirty());
+
+    shadow_reboot();
+}
+
+// 等待结果的属性在ack_timeout_ms之内不重发，超时后重发
+static void test_shadow_ack_timeout(void)
+{
+    host_nvs_reset();
+    fake_reset(FAKE_DEFERRED);
+    shadow_start(24);
+
+    set_int(PROPERTY_BASE, 1);
+    TEST_ASSERT_EQUAL(1, report(false));
+    TEST_ASSERT_EQUAL(0, report(true));
+
+    host_clock_advance_ms(4999);
+    TEST_ASSERT_EQUAL(0, report(false));
+
+    // 新的取值不等待上一次的结果
+    set_int(PROPERTY_BASE, 2);
+    TEST_ASSERT_EQUAL(1, report(false));
+    TEST_ASSERT_EQUAL(2, s_fake.sent[0]);
+
+    host_clock_advance_ms(5000);
+    TEST_ASSERT_EQUAL(1, report(false));
+    TEST_ASSERT_EQUAL(3, s_fake.sent[0]);
+
+    // 迟到的旧结果找不到对应的发送，不会把新取值标记为已上报
+    s_fake.pending[0].cb(err_success, s_fake.pending[0].cookie);
+    TEST_ASSERT_EQUAL(1, dirty());
+    fake_complete();
+    TEST_ASSERT_EQUAL(0, dirty());
+
+    shadow_reboot();
+}
+
+static void test_shadow_snapshot(void)
+{
+    esp_welink_shadow_stats_t stats;
+    esp_welink_shadow_version_t version;
+    txd_datapoint_t command = { .property_id = PROPERTY_BASE + 1, .property_value = (uint8_t*)"77", .property_value_len = 2 };
+    nvs_handle handle;
+    uint8_t blob[1024];
+    size_t blob_len = sizeof(blob);
+    uint8_t out[24];
+    uint32_t len = sizeof(out);
+    uint32_t commits = 0;
+
+    host_nvs_reset();
+    fake_reset(FAKE_SYNC);
+    shadow_start(24);
+
+    set_int(PROPERTY_BASE, 1);
+    set_int(PROPERTY_BASE + 2, 3);
+    TEST_ASSERT_EQUAL(1, report(false));
+    set_int(PROPERTY_BASE, 2);
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_apply(&command));
+
+    // 延迟写入，多次修改合并为一次，定时器按10ms的刻度到期
+    commits = host_nvs_commits();
+    host_timer_run(990);
+    TEST_ASSERT_EQUAL(commits, host_nvs_commits());
+    host_timer_run(20);
+    TEST_ASSERT_EQUAL(commits + 1, host_nvs_commits());
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_save());
+    TEST_ASSERT_EQUAL(commits + 1, host_nvs_commits());
+
+    // 重启后取值和未上报的状态都恢复
+    shadow_reboot();
+    shadow_start(24);
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get_stats(&stats));
+    TEST_ASSERT_EQUAL(3, stats.entries);
+    TEST_ASSERT_EQUAL(1, stats.dirty);
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get(PROPERTY_BASE + 1, out, &len, &version));
+    TEST_ASSERT_EQUAL_MEMORY("77", out, 2);
+    TEST_ASSERT_EQUAL(version.desired, version.reported);
+
+    memset(s_fake.sent, 0, sizeof(s_fake.sent));
+    TEST_ASSERT_EQUAL(1, report(false));
+    TEST_ASSERT_EQUAL(1, s_fake.sent[0]);
+    TEST_ASSERT_EQUAL(0, s_fake.sent[1] + s_fake.sent[2]);
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_save());
+
+    // 截断的快照整个丢弃
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open("welink_shadow", NVS_READWRITE, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(handle, SHADOW_NVS_KEY, blob, &blob_len));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(handle, SHADOW_NVS_KEY, blob, blob_len - 1));
+    nvs_close(handle);
+
+    shadow_reboot();
+    shadow_start(24);
+    TEST_ASSERT_EQUAL(0, esp_welink_shadow_get_stats(&stats));
+    TEST_ASSERT_EQUAL(0, stats.entries);
+
+    shadow_reboot();
+}
+
+int main(void)
+{
+    RUN_TEST(test_shadow_periodic);
+    RUN_TEST(test_shadow_report_once);
+    RUN_TEST(test_shadow_set_during_report);
+    RUN_TEST(test_shadow_ack_timeout);
+    RUN_TEST(test_shadow_snapshot);
+
+    return 0;
+}
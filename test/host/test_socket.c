@@ -0,0 +1,278 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Socket port over loopback TCP: end-to-end report latency with and without the recv wakeup channel,
+ * the recv wait after a disconnect, and the long connection recreated by the SDK on reconnect.
+ *
+ * A thread stands in for the SDK: it waits in txd_tcp_recv() with RECV_TIMEOUT_MS and sends the queued
+ * message after each wait, like the SDK flushes its send queue between two recv calls. The main thread
+ * queues a message as txd_report_datapoints() would and measures when the server receives it.
+ */
+#include <dirent.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "txd_stdtypes.h"
+#include "txd_baseapi.h"
+#include "esp_welink_boot.h"
+#include "esp_welink_socket.h"
+
+#define RECV_TIMEOUT_MS     200
+#define WAKEUP_SAMPLES      200
+#define BASELINE_SAMPLES    20
+
+static txd_socket_handler_t* s_sock;
+static int s_server_fd = -1;
+static pthread_mutex_t s_outbox_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_outbox_full;
+static volatile bool s_sdk_stop;
+
+void esp_welink_boot_mark(esp_welink_boot_phase_t phase)
+{
+}
+
+static void* sdk_thread(void* arg)
+{
+    uint8_t buf[16];
+    uint8_t msg = 'R';
+    bool send = false;
+
+    while (!s_sdk_stop) {
+        TEST_ASSERT(txd_tcp_recv(s_sock, buf, sizeof(buf), RECV_TIMEOUT_MS) >= 0);
+
+        pthread_mutex_lock(&s_outbox_lock);
+        send = s_outbox_full;
+        s_outbox_full = false;
+        pthread_mutex_unlock(&s_outbox_lock);
+
+        if (send) {
+            TEST_ASSERT_EQUAL(1, txd_tcp_send(s_sock, &msg, 1, 1000));
+        }
+    }
+
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+// 返回排序后的延时（微秒）
+static void measure(bool wakeup, uint64_t* latency_us, uint32_t samples)
+{
+    uint32_t i = 0;
+    uint8_t msg = 0;
+    uint64_t start_ns = 0;
+
+    for (i = 0; i < samples; i++) {
+        // 不唤醒时随机错开SDK线程在recv等待中的位置；唤醒时等待会重新开始，位置不影响结果
+        usleep(rand() % (wakeup ? 5000 : RECV_TIMEOUT_MS * 1000));
+
+        start_ns = host_bench_now_ns();
+        pthread_mutex_lock(&s_outbox_lock);
+        s_outbox_full = true;
+        pthread_mutex_unlock(&s_outbox_lock);
+
+        if (wakeup) {
+            TEST_ASSERT_EQUAL(0, esp_welink_socket_wakeup());
+        }
+
+        TEST_ASSERT_EQUAL(1, recv(s_server_fd, &msg, 1, 0));
+        latency_us[i] = (host_bench_now_ns() - start_ns) / 1000;
+    }
+
+    qsort(latency_us, samples, sizeof(uint64_t), cmp_u64);
+    printf("  %-9s p50 %6.2f ms  p99 %6.2f ms  max %6.2f ms  (recv timeout %d ms, %u samples)\n",
+           wakeup ? "wakeup" : "no wakeup", latency_us[samples / 2] / 1e3, latency_us[samples * 99 / 100] / 1e3,
+           latency_us[samples - 1] / 1e3, RECV_TIMEOUT_MS, samples);
+}
+
+static void test_socket_report_latency(void)
+{
+    int listen_fd = -1;
+    struct sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(addr);
+    char port_ip[] = "127.0.0.1";
+    pthread_t sdk;
+    static uint64_t with_wakeup[WAKEUP_SAMPLES];
+    static uint64_t without_wakeup[BASELINE_SAMPLES];
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len));
+    TEST_ASSERT_EQUAL(0, listen(listen_fd, 1));
+
+    s_sock = txd_tcp_socket_create();
+    TEST_ASSERT(s_sock != NULL);
+    TEST_ASSERT_EQUAL(0, txd_tcp_connect(s_sock, (uint8_t*)port_ip, ntohs(addr.sin_port), 1000));
+    s_server_fd = accept(listen_fd, NULL, NULL);
+    TEST_ASSERT(s_server_fd >= 0);
+    close(listen_fd);
+
+    srand(1);
+    TEST_ASSERT_EQUAL(0, pthread_create(&sdk, NULL, sdk_thread, NULL));
+    measure(false, without_wakeup, BASELINE_SAMPLES);
+    measure(true, with_wakeup, WAKEUP_SAMPLES);
+
+    // 不唤醒时平均要等半个recv超时，唤醒后与超时无关
+    TEST_ASSERT(with_wakeup[WAKEUP_SAMPLES / 2] * 10 < without_wakeup[BASELINE_SAMPLES / 2]);
+    TEST_ASSERT(with_wakeup[WAKEUP_SAMPLES * 99 / 100] < RECV_TIMEOUT_MS * 1000 / 4);
+
+    s_sdk_stop = true;
+    esp_welink_socket_wakeup();
+    pthread_join(sdk, NULL);
+    close(s_server_fd);
+}
+
+static void* delayed_wakeup(void* arg)
+{
+    usleep(50 * 1000);
+    esp_welink_socket_wakeup();
+
+    return NULL;
+}
+
+static void test_socket_recv_after_disconnect(void)
+{
+    uint8_t buf[16];
+    uint64_t start_ns = 0;
+    uint64_t elapsed_ms = 0;
+    pthread_t waker;
+    txd_socket_handler_t* other = NULL;
+
+    // 长连接断开后fd为-1，recv只等待唤醒通道，被唤醒时返回0（没有数据）
+    TEST_ASSERT_EQUAL(0, txd_tcp_disconnect(s_sock));
+    TEST_ASSERT_EQUAL(0, txd_tcp_recv(s_sock, buf, sizeof(buf), 0));
+
+    start_ns = host_bench_now_ns();
+    TEST_ASSERT_EQUAL(0, pthread_create(&waker, NULL, delayed_wakeup, NULL));
+    TEST_ASSERT_EQUAL(0, txd_tcp_recv(s_sock, buf, sizeof(buf), 5000));
+    elapsed_ms = (host_bench_now_ns() - start_ns) / 1000000;
+    pthread_join(waker, NULL);
+    TEST_ASSERT(elapsed_ms >= 40);
+    TEST_ASSERT(elapsed_ms < 2000);
+
+    // 其它socket没有唤醒通道，未连接时没有可以等待的fd
+    other = txd_tcp_socket_create();
+    TEST_ASSERT_EQUAL(-1, txd_tcp_recv(other, buf, sizeof(buf), 10));
+    txd_tcp_socket_destroy(other);
+    txd_tcp_socket_destroy(s_sock);
+}
+
+static uint32_t open_fds(void)
+{
+    DIR* dir = opendir("/proc/self/fd");
+    uint32_t count = 0;
+
+    TEST_ASSERT(dir != NULL);
+
+    while (readdir(dir) != NULL) {
+        count++;
+    }
+
+    closedir(dir);
+
+    return count;
+}
+
+static void test_socket_recreate(void)
+{
+    uint8_t buf[16];
+    int listen_fd = -1;
+    int server_fd = -1;
+    int conn_fd = -1;
+    int wakeup_fd = -1;
+    int first_wakeup_fd = -1;
+    struct sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(addr);
+    char port_ip[] = "127.0.0.1";
+    txd_socket_handler_t* other = NULL;
+    uint64_t start_ns = 0;
+    uint32_t fds = 0;
+    uint32_t cycle = 0;
+    pthread_t waker;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len));
+    TEST_ASSERT_EQUAL(0, listen(listen_fd, 1));
+    esp_welink_socket_get_fds(NULL, &first_wakeup_fd);
+    TEST_ASSERT(first_wakeup_fd >= 0);
+    fds = open_fds();
+
+    // SDK重连：销毁长连接socket后重新创建，每次都应监听同一个唤醒通道
+    for (cycle = 0; cycle < 5; cycle++) {
+        s_sock = txd_tcp_socket_create();
+        TEST_ASSERT(s_sock != NULL);
+        TEST_ASSERT_EQUAL(0, txd_tcp_connect(s_sock, (uint8_t*)port_ip, ntohs(addr.sin_port), 1000));
+        server_fd = accept(listen_fd, NULL, NULL);
+        TEST_ASSERT(server_fd >= 0);
+
+        // 长连接存在时创建的socket不是长连接
+        other = txd_tcp_socket_create();
+        esp_welink_socket_get_fds(&conn_fd, &wakeup_fd);
+        TEST_ASSERT_EQUAL(first_wakeup_fd, wakeup_fd);
+        TEST_ASSERT_EQUAL(1, send(conn_fd, "x", 1, 0));
+        TEST_ASSERT_EQUAL(1, recv(server_fd, buf, sizeof(buf), 0));
+        txd_tcp_socket_destroy(other);
+
+        // 唤醒让等待中的recv立即返回，没有数据
+        start_ns = host_bench_now_ns();
+        TEST_ASSERT_EQUAL(0, pthread_create(&waker, NULL, delayed_wakeup, NULL));
+        TEST_ASSERT_EQUAL(0, txd_tcp_recv(s_sock, buf, sizeof(buf), 5000));
+        pthread_join(waker, NULL);
+        TEST_ASSERT((host_bench_now_ns() - start_ns) / 1000000 < 2000);
+
+        txd_tcp_disconnect(s_sock);
+        txd_tcp_socket_destroy(s_sock);
+        close(server_fd);
+        esp_welink_socket_get_fds(&conn_fd, NULL);
+        TEST_ASSERT_EQUAL(-1, conn_fd);
+    }
+
+    printf("  %u destroy/create cycles, %u fds open before and %u after\n", cycle, fds, open_fds());
+    TEST_ASSERT_EQUAL(fds, open_fds());
+    close(listen_fd);
+}
+
+int main(void)
+{
+    RUN_TEST(test_socket_report_latency);
+    RUN_TEST(test_socket_recv_after_disconnect);
+    RUN_TEST(test_socket_recreate);
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * txd_timer wheel driven by txd_timer_process() on the simulated clock, and the wakeup hook used when
+ * no service task runs.
+ */
+#include "host_test.h"
+#include "txd_stdtypes.h"
+#include "txd_thread.h"
+
+#define TICK_MS         10
+#define WHEEL_TICKS     ((1UL << 24) - 1)
+#define RANDOM_TIMERS   20000
+
+typedef struct {
+    txd_timer_handler_t* timer;
+    uint32_t due;
+    uint32_t period;
+    uint32_t fired;
+    bool stopped;
+} timer_rec_t;
+
+static timer_rec_t s_recs[RANDOM_TIMERS];
+static int32_t s_max_late_ms;
+
+static void timer_rec_cb(void* arg)
+{
+    timer_rec_t* rec = (timer_rec_t*)arg;
+    int32_t late = (int32_t)(host_clock_ms() - rec->due);
+
+    TEST_ASSERT(late >= 0);
+    TEST_ASSERT(!rec->stopped);
+
+    if (late > s_max_late_ms) {
+        s_max_late_ms = late;
+    }
+
+    rec->fired++;
+
+    if (rec->period != 0) {
+        rec->due += rec->period;
+    }
+}
+
+// 与服务线程相同的驱动方式，返回调用txd_timer_process的次数；没有定时器到期时等待时间不应为0
+static uint32_t run_until(uint32_t end_ms)
+{
+    uint32_t calls = 0;
+    uint32_t next_ms = 0;
+    int32_t count = 0;
+    int32_t left = 0;
+
+    for (;;) {
+        count = txd_timer_process(&next_ms);
+        calls++;
+        TEST_ASSERT(count >= 0);
+        TEST_ASSERT(next_ms != 0);
+        left = (int32_t)(end_ms - host_clock_ms());
+
+        if (left <= 0) {
+            return calls;
+        }
+
+        host_clock_advance_ms((next_ms < (uint32_t)left) ? next_ms : (uint32_t)left);
+    }
+}
+
+// 高层的槽正好是当前槽（转了一整圈）时，不能把它当成马上要cascade而忙等
+static void test_timer_full_revolution_slot(void)
+{
+    static const uint32_t levels[] = {1, 2};
+    timer_rec_t rec = {0};
+    uint32_t i = 0;
+    uint32_t span = 0;
+    uint32_t calls = 0;
+
+    rec.timer = txd_timer_create(timer_rec_cb, &rec);
+    TEST_ASSERT(rec.timer != NULL);
+
+    for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        // 第level层一圈是64^(level+1)个刻度，先让当前刻度不在槽边界上，再启动一个几乎一整圈后到期的定时器
+        span = 1UL << (6 * (levels[i] + 1));
+        host_clock_advance_ms(TICK_MS * 5 + 3);
+        txd_timer_process(NULL);
+
+        rec.fired = 0;
+        rec.due = host_clock_ms() + (span - 3) * TICK_MS;
+        TEST_ASSERT_EQUAL(0, txd_timer_start(rec.timer, (span - 3) * TICK_MS, 0, 0));
+
+        calls = run_until(rec.due + TICK_MS);
+        TEST_ASSERT_EQUAL(1, rec.fired);
+        TEST_ASSERT(calls < 16);
+    }
+
+    txd_timer_destroy(rec.timer);
+}
+
+static void test_timer_out_of_range(void)
+{
+    timer_rec_t rec = {0};
+
+    rec.timer = txd_timer_create(timer_rec_cb, &rec);
+    rec.due = host_clock_ms() + 1000;
+    TEST_ASSERT_EQUAL(0, txd_timer_start(rec.timer, 1000, 0, 0));
+
+    // 超出时间轮范围时拒绝，已启动的定时器不受影响
+    TEST_ASSERT_EQUAL(-1, txd_timer_start(rec.timer, WHEEL_TICKS * TICK_MS + TICK_MS, 0, 0));
+    TEST_ASSERT_EQUAL(-1, txd_timer_start(rec.timer, 0xFFFFFFFF, 0, 0));
+    TEST_ASSERT_EQUAL(-1, txd_timer_start(rec.timer, 1000, WHEEL_TICKS * TICK_MS + TICK_MS, 0));
+    run_until(rec.due + TICK_MS);
+    TEST_ASSERT_EQUAL(1, rec.fired);
+
+    rec.fired = 0;
+    rec.due = host_clock_ms() + (WHEEL_TICKS - 1) * TICK_MS;
+    TEST_ASSERT_EQUAL(0, txd_timer_start(rec.timer, (WHEEL_TICKS - 1) * TICK_MS, 0, 0));
+    TEST_ASSERT(txd_timer_next_deadline() >= (WHEEL_TICKS - 2) * TICK_MS);
+    run_until(rec.due + TICK_MS);
+    TEST_ASSERT_EQUAL(1, rec.fired);
+
+    txd_timer_destroy(rec.timer);
+}
+
+static uint32_t s_batch_fired;
+static uint32_t s_batch_wakeups;
+static uint32_t s_batch_last_ms;
+
+static void batch_cb(void* arg)
+{
+    if ((s_batch_fired == 0) || (host_clock_ms() != s_batch_last_ms)) {
+        s_batch_wakeups++;
+        s_batch_last_ms = host_clock_ms();
+    }
+
+    s_batch_fired++;
+}
+
+static void test_timer_slack_alignment(void)
+{
+    uint32_t i = 0;
+    txd_timer_handler_t* timers[8];
+
+    // slack为640毫秒时到期时间对齐到64个刻度，相近的定时器合并到同一次唤醒
+    for (i = 0; i < 8; i++) {
+        timers[i] = txd_timer_create(batch_cb, NULL);
+        TEST_ASSERT_EQUAL(0, txd_timer_start(timers[i], 1000 + i * 20, 0, 640));
+    }
+
+    run_until(host_clock_ms() + 2000);
+    TEST_ASSERT_EQUAL(8, s_batch_fired);
+    TEST_ASSERT(s_batch_wakeups <= 2);
+
+    for (i = 0; i < 8; i++) {
+        txd_timer_destroy(timers[i]);
+    }
+}
+
+static void test_timer_random(void)
+{
+    uint32_t i = 0;
+    uint32_t timeout = 0;
+    uint32_t total = 0;
+    uint32_t end = 0;
+
+    // 时钟接近32位毫秒回绕，运行过程中会回绕一次
+    host_clock_set_us((uint64_t)0xFFFF0000 * 1000);
+    srand(1);
+
+    for (i = 0; i < RANDOM_TIMERS; i++) {
+        s_recs[i].timer = txd_timer_create(timer_rec_cb, &s_recs[i]);
+        TEST_ASSERT(s_recs[i].timer != NULL);
+        timeout = rand() % ((i % 10 == 0) ? 3000000 : 20000);
+        s_recs[i].period = (i % 7 == 0) ? TICK_MS * (100 + rand() % 500) : 0;
+        s_recs[i].due = host_clock_ms() + timeout;
+        TEST_ASSERT_EQUAL(0, txd_timer_start(s_recs[i].timer, timeout, s_recs[i].period, 0));
+    }
+
+    for (i = 0; i < RANDOM_TIMERS; i += 3) {
+        txd_timer_stop(s_recs[i].timer);
+        s_recs[i].stopped = true;
+    }
+
+    end = host_clock_ms() + 3100000;
+    run_until(end);
+
+    for (i = 0; i < RANDOM_TIMERS; i++) {
+        if (s_recs[i].stopped) {
+            TEST_ASSERT_EQUAL(0, s_recs[i].fired);
+        } else if (s_recs[i].period == 0) {
+            TEST_ASSERT_EQUAL(1, s_recs[i].fired);
+        } else {
+            // 周期定时器不补发错过的周期，下一次到期时间在end之后
+            TEST_ASSERT(s_recs[i].fired >= 1);
+            TEST_ASSERT((int32_t)(s_recs[i].due - end) >= 0);
+        }
+
+        total += s_recs[i].fired;
+        txd_timer_destroy(s_recs[i].timer);
+    }
+
+    // 到期时间向上取整到刻度，最多晚一个刻度
+    TEST_ASSERT(s_max_late_ms <= TICK_MS);
+    TEST_ASSERT_EQUAL(TXD_TIMER_WAIT_FOREVER, txd_timer_next_deadline());
+    printf("  %u callbacks, max late %d ms\n", total, s_max_late_ms);
+}
+
+static uint32_t s_hook_calls;
+
+static void count_hook(void)
+{
+    s_hook_calls++;
+}
+
+static void noop_cb(void* arg)
+{
+}
+
+// 没有服务线程也没有设置唤醒函数时（线程版SDK不启动服务线程），启动定时器不能打断SDK的recv等待
+static void test_timer_wakeup_hook(void)
+{
+    txd_timer_handler_t* early = txd_timer_create(noop_cb, NULL);
+    txd_timer_handler_t* late = txd_timer_create(noop_cb, NULL);
+    uint32_t wakeups = host_socket_wakeups();
+
+    TEST_ASSERT_EQUAL(0, txd_timer_start(late, 5000, 0, 0));
+    TEST_ASSERT_EQUAL(0, txd_timer_start(early, 1000, 0, 0));
+    TEST_ASSERT_EQUAL(wakeups, host_socket_wakeups());
+    txd_timer_stop(early);
+    txd_timer_stop(late);
+    run_until(host_clock_ms() + 100);
+
+    // 设置唤醒函数后，只有早于下一次到期时间的定时器才唤醒
+    txd_timer_set_wakeup_hook(count_hook);
+    TEST_ASSERT_EQUAL(0, txd_timer_start(late, 5000, 0, 0));
+    TEST_ASSERT_EQUAL(1, s_hook_calls);
+    TEST_ASSERT_EQUAL(0, txd_timer_start(early, 1000, 0, 0));
+    TEST_ASSERT_EQUAL(2, s_hook_calls);
+    TEST_ASSERT_EQUAL(0, txd_timer_start(late, 6000, 0, 0));
+    TEST_ASSERT_EQUAL(2, s_hook_calls);
+    TEST_ASSERT_EQUAL(wakeups, host_socket_wakeups());
+
+    txd_timer_set_wakeup_hook(NULL);
+    txd_timer_destroy(early);
+    txd_timer_destroy(late);
+    run_until(host_clock_ms() + 100);
+}
+
+int main(void)
+{
+    RUN_TEST(test_timer_full_revolution_slot);
+    RUN_TEST(test_timer_out_of_range);
+    RUN_TEST(test_timer_slack_alignment);
+    RUN_TEST(test_timer_random);
+    RUN_TEST(test_timer_wakeup_hook);
+
+    return 0;
+}
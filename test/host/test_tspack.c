@@ -0,0 +1,269 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * esp_welink_tspack: the bit layout of a small block, a full block left unchanged, blocks of random
+ * edge cases and of regular series written out for tools/welink_tspack_decode.py (the tspack_decode
+ * test decodes them and compares every sample), and packing compared with CSV text.
+ */
+#include <math.h>
+
+#include "host_test.h"
+#include "esp_welink_base64.h"
+#include "esp_welink_tspack.h"
+
+#define BLOCKS_FILE     "tspack_blocks.txt"
+#define SAMPLES_FILE    "tspack_samples.csv"
+#define EDGE_BLOCKS     300
+#define SERIES_BLOCKS   3
+#define BENCH_SAMPLES   200000
+
+typedef enum {
+    SERIES_FLAT,
+    SERIES_SINE,
+    SERIES_NOISY,
+    SERIES_MAX,
+} series_t;
+
+static const char* const s_series_names[] = { "flat", "sine", "noisy" };
+
+static FILE* s_blocks;
+static FILE* s_samples;
+
+static void series_sample(series_t series, uint32_t i, uint32_t* timestamp, int32_t* value)
+{
+    static uint32_t now;
+
+    // 每秒一个样本，noisy的采样时间有±10ms的抖动
+    now = (i == 0) ? 1700000000u : now + 1000 + ((series == SERIES_NOISY) ? rand() % 21 - 10 : 0);
+    *timestamp = now;
+
+    if (series == SERIES_FLAT) {
+        *value = 2500;
+    } else if (series == SERIES_SINE) {
+        *value = (int32_t)(2500 + 300 * sin(i / 20.0));
+    } else {
+        *value = rand() % 100000 - 50000;
+    }
+}
+
+static void write_block(esp_welink_tspack_t* pack, uint32_t max_len)
+{
+    char text[WELINK_TSPACK_MAX_LEN + 1];
+    int32_t len = esp_welink_tspack_finish(pack, text, sizeof(text));
+
+    TEST_ASSERT(len > 0 && (uint32_t)len <= max_len);
+    fprintf(s_blocks, "%.*s\n", (int)len, text);
+}
+
+static void test_tspack_layout(void)
+{
+    esp_welink_tspack_t pack;
+    char text[64];
+    uint8_t block[48];
+    int32_t len = 0;
+
+    esp_welink_tspack_init(&pack, WELINK_TSPACK_MAX_LEN);
+    TEST_ASSERT_EQUAL(-1, esp_welink_tspack_finish(&pack, text, sizeof(text)));
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_ratio(&pack));
+
+    // 第一个delta的dod为1000，用'1110'+12位；之后dod和XOR都是0，各1位
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, 1000, -5));
+    TEST_ASSERT_EQUAL(WELINK_TSPACK_HEADER_BITS, pack.bits);
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, 2000, -5));
+    TEST_ASSERT_EQUAL(WELINK_TSPACK_HEADER_BITS + 16 + 1, pack.bits);
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, 3000, -5));
+    TEST_ASSERT_EQUAL(WELINK_TSPACK_HEADER_BITS + 16 + 1 + 2, pack.bits);
+
+    // 只改变最低位：'11' + leading 31 + length-1 0 + 1位；再次落在窗口内：'10' + 1位
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, 4000, -6));
+    TEST_ASSERT_EQUAL(WELINK_TSPACK_HEADER_BITS + 16 + 1 + 2 + 1 + 13, pack.bits);
+    TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, 5000, -5));
+    TEST_ASSERT_EQUAL(WELINK_TSPACK_HEADER_BITS + 16 + 1 + 2 + 1 + 13 + 1 + 3, pack.bits);
+
+    len = esp_welink_tspack_finish(&pack, text, sizeof(text));
+    TEST_ASSERT_EQUAL(ESP_WELINK_BASE64_LEN((pack.bits + 7) / 8), len);
+    TEST_ASSERT_EQUAL((pack.bits + 7) / 8, esp_welink_base64_decode(block, sizeof(block), (const uint8_t*)text, len));
+    TEST_ASSERT_EQUAL_MEMORY("\x01\x00\x05\x00\x00\x03\xe8\xff\xff\xff\xfb", block, 11);
+
+    // 输出缓冲区不够时不写
+    TEST_ASSERT_EQUAL(-1, esp_welink_tspack_finish(&pack, text, len - 1));
+    TEST_ASSERT_EQUAL(-1, esp_welink_tspack_finish(&pack, NULL, sizeof(text)));
+    TEST_ASSERT_EQUAL(5 * 64 * 100 / pack.bits, esp_welink_tspack_ratio(&pack));
+}
+
+// 随机的时间跳变、回退、回绕和取值的单bit翻转、整体变化、极值，块大小随机
+static void test_tspack_edge_blocks(void)
+{
+    esp_welink_tspack_t pack;
+    esp_welink_tspack_t before;
+    uint32_t max_len = 0;
+    uint32_t timestamp = 0;
+    uint32_t samples = 0;
+    uint32_t blocks = 0;
+    uint32_t b = 0;
+    int32_t value = 0;
+    int32_t step = 0;
+
+    srand(7);
+
+    for (b = 0; b < EDGE_BLOCKS; b++) {
+        max_len = 8 + rand() % (WELINK_TSPACK_MAX_LEN - 7);
+        esp_welink_tspack_init(&pack, max_len);
+        timestamp = (uint32_t)rand() * 2654435761u;
+        value = rand();
+
+        for (;;) {
+            step = rand() % 4;
+            timestamp += (step == 0) ? 0 : (step == 1) ? (uint32_t)(rand() % 3000)
+                         : (step == 2) ? (uint32_t)rand() * 7u : -(uint32_t)(rand() % 5000);
+            value = (rand() % 3) ? (int32_t)((uint32_t)value ^ (1u << (rand() % 32))) : (int32_t)((uint32_t)rand() * 2654435761u);
+
+            if (rand() % 20 == 0) {
+                value = (rand() & 1) ? INT32_MAX : INT32_MIN;
+            }
+
+            // 放不下的样本不改变块
+            memcpy(&before, &pack, sizeof(pack));
+
+            if (esp_welink_tspack_add(&pack, timestamp, value) < 0) {
+                TEST_ASSERT_EQUAL_MEMORY(&before, &pack, sizeof(pack));
+                break;
+            }
+
+            fprintf(s_samples, "%u,%d\n", timestamp, value);
+            samples++;
+        }
+
+        // 8字节的文本放不下头部
+        if (pack.count == 0) {
+            TEST_ASSERT(max_len < ESP_WELINK_BASE64_LEN(WELINK_TSPACK_HEADER_BITS / 8));
+            continue;
+        }
+
+        write_block(&pack, max_len);
+        blocks++;
+    }
+
+    printf("  %u edge blocks, %u samples\n", blocks, samples);
+}
+
+// 真实的序列打包后也交给Python解码器，并与CSV文本比较每条上报能带的样本数
+static void test_tspack_series(void)
+{
+    esp_welink_tspack_t pack;
+    char csv[WELINK_TSPACK_MAX_LEN + 1];
+    char item[32];
+    uint64_t start = 0;
+    double packed_ns = 0;
+    double csv_ns = 0;
+    uint32_t series = 0;
+    uint32_t timestamp = 0;
+    uint32_t blocks = 0;
+    uint32_t packed = 0;
+    uint32_t ratio = 0;
+    uint32_t csv_blocks = 0;
+    uint32_t csv_count = 0;
+    uint32_t csv_total = 0;
+    uint32_t len = 0;
+    uint32_t i = 0;
+    int32_t value = 0;
+    int32_t n = 0;
+
+    for (series = 0; series < SERIES_MAX; series++) {
+        srand(1);
+        blocks = packed = ratio = 0;
+        esp_welink_tspack_init(&pack, WELINK_TSPACK_MAX_LEN);
+        start = host_bench_now_ns();
+
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+            series_sample(series, i, &timestamp, &value);
+
+            if (esp_welink_tspack_add(&pack, timestamp, value) < 0) {
+                ratio += esp_welink_tspack_ratio(&pack);
+                packed += pack.count;
+
+                if (blocks < SERIES_BLOCKS) {
+                    write_block(&pack, WELINK_TSPACK_MAX_LEN);
+                } else {
+                    TEST_ASSERT(esp_welink_tspack_finish(&pack, csv, sizeof(csv)) > 0);
+                }
+
+                blocks++;
+                esp_welink_tspack_init(&pack, WELINK_TSPACK_MAX_LEN);
+                TEST_ASSERT_EQUAL(0, esp_welink_tspack_add(&pack, timestamp, value));
+            }
+
+            if (blocks < SERIES_BLOCKS) {
+                fprintf(s_samples, "%u,%d\n", timestamp, value);
+            }
+        }
+
+        packed_ns = (double)(host_bench_now_ns() - start) / BENCH_SAMPLES;
+
+        // 同样的样本写成"timestamp,value;"的CSV
+        srand(1);
+        csv_blocks = csv_total = csv_count = len = 0;
+        start = host_bench_now_ns();
+
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+            series_sample(series, i, &timestamp, &value);
+            n = snprintf(item, sizeof(item), "%s%u,%d", (len != 0) ? ";" : "", timestamp, value);
+
+            if (len + n > WELINK_TSPACK_MAX_LEN) {
+                csv_blocks++;
+                csv_total += csv_count;
+                len = csv_count = 0;
+                n = snprintf(item, sizeof(item), "%u,%d", timestamp, value);
+            }
+
+            memcpy(csv + len, item, n);
+            len += n;
+            csv_count++;
+        }
+
+        csv_ns = (double)(host_bench_now_ns() - start) / BENCH_SAMPLES;
+
+        printf("  %-5s tspack %6.1f samples per report, ratio %4.1fx, %5.1f ns per sample | csv %5.1f samples per report, %5.1f ns per sample\n",
+               s_series_names[series], (double)packed / blocks, ratio / 100.0 / blocks, packed_ns,
+               (double)csv_total / csv_blocks, csv_ns);
+        TEST_ASSERT(packed / blocks > csv_total / csv_blocks);
+    }
+}
+
+int main(void)
+{
+    s_blocks = fopen(BLOCKS_FILE, "w");
+    s_samples = fopen(SAMPLES_FILE, "w");
+    TEST_ASSERT(s_blocks != NULL && s_samples != NULL);
+
+    RUN_TEST(test_tspack_layout);
+    RUN_TEST(test_tspack_edge_blocks);
+    RUN_TEST(test_tspack_series);
+
+    fclose(s_blocks);
+    fclose(s_samples);
+
+    return 0;
+}
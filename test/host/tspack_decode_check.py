@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+
+"""Decode the blocks written by test_tspack with tools/welink_tspack_decode.py and compare them
+with the samples that were packed.
+
+Usage:
+    tspack_decode_check.py blocks_file samples_file
+"""
+
+from __future__ import print_function
+
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'tools'))
+
+import welink_tspack_decode  # noqa: E402
+
+
+def main():
+    with open(sys.argv[1]) as f:
+        blocks = [line.strip() for line in f if line.strip()]
+
+    with open(sys.argv[2]) as f:
+        expected = [line.strip() for line in f if line.strip()]
+
+    decoded = []
+
+    for block in blocks:
+        decoded.extend('%u,%d' % sample for sample in welink_tspack_decode.decode(block))
+
+    for i, (got, want) in enumerate(zip(decoded, expected)):
+        if got != want:
+            print('sample %d: decoded %s, packed %s' % (i, got, want))
+            return 1
+
+    if len(decoded) != len(expected):
+        print('decoded %d samples, packed %d' % (len(decoded), len(expected)))
+        return 1
+
+    print('%d blocks, %d samples decoded' % (len(blocks), len(decoded)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
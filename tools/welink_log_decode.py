@@ -0,0 +1,231 @@
+#!/usr/bin/env python
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+"""Decode the "#WL:" binary log records written with CONFIG_WELINK_LOG_BINARY.
+
+Usage:
+    welink_log_decode.py build/app.elf [console.log]
+
+The console log is read from stdin when no file is given, e.g.
+    make monitor | python tools/welink_log_decode.py build/app.elf
+Lines which are not binary records are passed through unchanged.
+"""
+
+from __future__ import print_function
+
+import re
+import struct
+import sys
+
+LOGFMT_SECTION = '.welink_logfmt'
+RECORD_PREFIX = '#WL:'
+SHF_ALLOC = 0x2
+
+# printf conversion specification, same subset as the device newlib printf
+FORMAT_SPEC = re.compile(r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(hh|h|ll|l|z|j|t)?([diouxXcspfFeEgG%])')
+
+
+class ElfFile(object):
+    """Minimal ELF32/ELF64 section reader, enough to look up the format strings"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+
+        if self.data[:4] != b'\x7fELF':
+            raise ValueError('%s is not an ELF file' % path)
+
+        self.is64 = self.data[4:5] == b'\x02'
+        self.endian = '<' if self.data[5:6] == b'\x01' else '>'
+        self.sections = self._read_sections()
+
+    def _unpack(self, fmt, offset):
+        return struct.unpack_from(self.endian + fmt, self.data, offset)
+
+    def _read_sections(self):
+        if self.is64:
+            shoff, = self._unpack('Q', 0x28)
+            shentsize, shnum, shstrndx = self._unpack('HHH', 0x3A)
+            header = 'IIQQQQIIQQ'
+        else:
+            shoff, = self._unpack('I', 0x20)
+            shentsize, shnum, shstrndx = self._unpack('HHH', 0x2E)
+            header = 'IIIIIIIIII'
+
+        raw = []
+
+        for i in range(shnum):
+            name, _, flags, addr, offset, size = self._unpack(header, shoff + i * shentsize)[:6]
+            raw.append((name, flags, addr, offset, size))
+
+        strtab = raw[shstrndx][3]
+        sections = []
+
+        for name, flags, addr, offset, size in raw:
+            end = self.data.index(b'\x00', strtab + name)
+            sections.append({
+                'name': self.data[strtab + name:end].decode('ascii', 'replace'),
+                'flags': flags,
+                'addr': addr,
+                'offset': offset,
+                'size': size,
+            })
+
+        return sections
+
+    def section(self, name):
+        for s in self.sections:
+            if s['name'] == name:
+                return s
+        return None
+
+    def c_string(self, section, addr):
+        """Read a NUL terminated string at addr of the section, None if out of range"""
+        if not section['addr'] <= addr < section['addr'] + section['size']:
+            return None
+
+        start = section['offset'] + addr - section['addr']
+        end = self.data.find(b'\x00', start, section['offset'] + section['size'])
+
+        if end < 0:
+            return None
+
+        return self.data[start:end].decode('utf-8', 'replace')
+
+    def string_at(self, addr):
+        """Resolve a %s argument, only constant strings in loaded sections can be found"""
+        for s in self.sections:
+            if s['flags'] & SHF_ALLOC and s['size'] and s['name'] not in ('.bss', '.noinit'):
+                text = self.c_string(s, addr)
+                if text is not None:
+                    return text
+
+        return '<0x%08x>' % addr
+
+
+def format_args(elf, fmt, args):
+    out = []
+    pos = 0
+    index = 0
+
+    for m in FORMAT_SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, _, conv = m.groups()
+
+        if conv == '%':
+            out.append('%')
+            continue
+
+        # '*' takes its value from the argument list
+        if width == '*':
+            width = str(struct.unpack('<i', struct.pack('<I', args[index]))[0]) if index < len(args) else ''
+            index += 1
+
+        if precision == '*':
+            precision = str(args[index]) if index < len(args) else ''
+            index += 1
+
+        if index >= len(args):
+            out.append('<missing>')
+            continue
+
+        value = args[index]
+        index += 1
+        spec = '%' + flags + (width or '') + ('.' + precision if precision else '')
+
+        if conv in 'di':
+            out.append((spec + 'd') % struct.unpack('<i', struct.pack('<I', value))[0])
+        elif conv == 'c':
+            out.append((spec + 'c') % chr(value & 0xFF))
+        elif conv == 's':
+            out.append((spec + 's') % elf.string_at(value))
+        elif conv == 'p':
+            out.append((spec + 's') % ('0x%x' % value))
+        elif conv in 'fFeEgG':
+            # float is promoted to double and does not fit in a 32-bit record
+            out.append('<float>')
+        else:
+            out.append((spec + conv) % value)
+
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode_record(elf, logfmt, hex_data):
+    try:
+        raw = bytearray.fromhex(hex_data)
+    except ValueError:
+        return None
+
+    if len(raw) < 8 or len(raw) % 4:
+        return None
+
+    words = struct.unpack('<%dI' % (len(raw) // 4), bytes(raw))
+    site = elf.c_string(logfmt, words[0])
+
+    if site is None:
+        return 'W (%u) welink_log_decode: unknown call site 0x%08x' % (words[1], words[0])
+
+    # "level:file:line:format", the file name itself contains no ':' on the build host
+    level, path, line, fmt = site.split(':', 3)
+    message = format_args(elf, fmt, words[2:]).rstrip('\n')
+
+    return '%s (%u) %s:%s: %s' % (level, words[1], path.split('/')[-1], line, message)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+
+    elf = ElfFile(sys.argv[1])
+    logfmt = elf.section(LOGFMT_SECTION)
+
+    if logfmt is None:
+        print('%s has no %s section, was it built with CONFIG_WELINK_LOG_BINARY?'
+              % (sys.argv[1], LOGFMT_SECTION), file=sys.stderr)
+        return 1
+
+    source = open(sys.argv[2], 'r') if len(sys.argv) > 2 else sys.stdin
+
+    for line in source:
+        index = line.find(RECORD_PREFIX)
+        text = None
+
+        if index >= 0:
+            text = decode_record(elf, logfmt, line[index + len(RECORD_PREFIX):].strip())
+
+        if text is None:
+            sys.stdout.write(line)
+        else:
+            sys.stdout.write(line[:index] + text + '\n')
+
+        sys.stdout.flush()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
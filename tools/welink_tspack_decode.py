@@ -0,0 +1,133 @@
+#!/usr/bin/env python
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS chips only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+
+"""Decode the base64 time series blocks written by esp_welink_tspack.
+
+Usage:
+    welink_tspack_decode.py [block ...]
+
+Each block is printed as "timestamp_ms,value" lines. Blocks are read one per line from stdin
+when none is given on the command line. decode() is the reference decoder for the cloud side.
+"""
+
+from __future__ import print_function
+
+import base64
+import struct
+import sys
+
+VERSION = 1
+
+
+class BitReader(object):
+    """Reads bits most significant first"""
+
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.pos = 0
+
+    def read(self, nbits):
+        value = 0
+
+        for _ in range(nbits):
+            byte = self.pos >> 3
+
+            if byte >= len(self.data):
+                raise ValueError('truncated block')
+
+            value = (value << 1) | ((self.data[byte] >> (7 - (self.pos & 7))) & 1)
+            self.pos += 1
+
+        return value
+
+    def read_signed(self, nbits):
+        value = self.read(nbits)
+        return value - (1 << nbits) if value & (1 << (nbits - 1)) else value
+
+
+def to_int32(value):
+    return struct.unpack('<i', struct.pack('<I', value & 0xFFFFFFFF))[0]
+
+
+def decode(text):
+    """Return the (timestamp_ms, value) samples of a block"""
+    reader = BitReader(base64.b64decode(text))
+
+    if reader.read(8) != VERSION:
+        raise ValueError('unsupported block version')
+
+    count = reader.read(16)
+    timestamp = reader.read(32)
+    value = reader.read(32)
+    delta = 0
+    leading = trailing = None
+    samples = [(timestamp, to_int32(value))]
+
+    for _ in range(count - 1):
+        # delta-of-delta of the timestamp
+        if reader.read(1) == 0:
+            dod = 0
+        elif reader.read(1) == 0:
+            dod = reader.read(7) - 63
+        elif reader.read(1) == 0:
+            dod = reader.read(9) - 255
+        elif reader.read(1) == 0:
+            dod = reader.read(12) - 2047
+        else:
+            dod = reader.read_signed(32)
+
+        delta = to_int32(delta + dod)
+        timestamp = (timestamp + delta) & 0xFFFFFFFF
+
+        # XOR with the previous value
+        if reader.read(1) == 1:
+            if reader.read(1) == 1:
+                leading = reader.read(5)
+                trailing = 32 - leading - (reader.read(5) + 1)
+            elif leading is None:
+                raise ValueError('window reused before it was set')
+
+            value ^= reader.read(32 - leading - trailing) << trailing
+
+        samples.append((timestamp, to_int32(value)))
+
+    return samples
+
+
+def main():
+    blocks = sys.argv[1:] or (line.strip() for line in sys.stdin)
+
+    for block in blocks:
+        if not block:
+            continue
+
+        for timestamp, value in decode(block):
+            print('%u,%d' % (timestamp, value))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -81,6 +81,170 @@ SDK_API extern int32_t txd_mutex_unlock(txd_mutex_handler_t *mutex);
 SDK_API extern int32_t txd_mutex_destroy(txd_mutex_handler_t *mutex);
 
 
+
+/************************* ringbuf 接口 **********************************/
+/*
+ * 无锁单生产者/单消费者环形队列，用于中断或高频采样任务向上报任务传递数据，
+ * 读写两端都不需要加锁，也不会为每个元素申请内存或拷贝到系统队列中。
+ * 注意：同一时刻只能有一个生产者调用txd_ringbuf_push，只能有一个消费者调用txd_ringbuf_pop
+ */
+typedef struct txd_ringbuf_handler_t txd_ringbuf_handler_t;
+
+
+/**  创建环形队列
+ * @param item_size 每个元素的大小（字节数）
+ * @param item_count 队列能容纳的元素个数，内部会向上取整为2的幂
+ *
+ * @return 环形队列（句柄）标记，失败返回NULL
+ */
+SDK_API extern txd_ringbuf_handler_t* txd_ringbuf_create(uint32_t item_size, uint32_t item_count);
+
+
+/**  写入一个元素（生产者）
+ * @note 不加锁、不申请内存，可以在中断中调用
+ * @param ringbuf 环形队列
+ * @param item 待写入元素的首地址，长度为创建时的item_size
+ *
+ * @return 0 表示成功
+ *         -1 表示队列已满或参数错误
+ */
+SDK_API extern int32_t txd_ringbuf_push(txd_ringbuf_handler_t *ringbuf, const void *item);
+
+
+/**  批量读取元素（消费者）
+ * @param ringbuf 环形队列
+ * @param items 接收缓冲区的首地址，大小至少为 max_count * item_size
+ * @param max_count 最多读取的元素个数
+ *
+ * @return 实际读取的元素个数，队列为空时返回0
+ */
+SDK_API extern uint32_t txd_ringbuf_pop(txd_ringbuf_handler_t *ringbuf, void *items, uint32_t max_count);
+
+
+/**  获取队列中待读取的元素个数
+ * @param ringbuf 环形队列
+ *
+ * @return 元素个数
+ */
+SDK_API extern uint32_t txd_ringbuf_count(txd_ringbuf_handler_t *ringbuf);
+
+
+/**  获取因队列已满而被丢弃的元素个数
+ * @param ringbuf 环形队列
+ *
+ * @return 丢弃的元素个数
+ */
+SDK_API extern uint32_t txd_ringbuf_dropped(txd_ringbuf_handler_t *ringbuf);
+
+
+/**  销毁环形队列
+ * @note 调用前需保证生产者和消费者都已停止访问该队列
+ * @param ringbuf 环形队列
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+SDK_API extern int32_t txd_ringbuf_destroy(txd_ringbuf_handler_t *ringbuf);
+
+
+
+/************************* timer 接口 **********************************/
+/*
+ * 分层时间轮定时器，所有定时器共用一个服务线程（或由开发者在自己的事件循环中调用txd_timer_process驱动），
+ * 启动和停止定时器的开销都是O(1)。定时器的精度为一个时间轮刻度（默认10毫秒），
+ * 到期时间相同的定时器会在同一次处理中依次回调。
+ */
+typedef struct txd_timer_handler_t txd_timer_handler_t;
+
+typedef void (*txd_timer_callback)(void *);
+
+#define TXD_TIMER_WAIT_FOREVER  0xFFFFFFFF
+
+
+/**  创建定时器
+ * @param callback 定时器到期时的回调函数，在服务线程（或调用txd_timer_process的线程）中执行
+ * @param arg callback的参数
+ *
+ * @return 定时器（句柄）标记，失败返回NULL
+ */
+SDK_API extern txd_timer_handler_t* txd_timer_create(txd_timer_callback callback, void* arg);
+
+
+/**  启动定时器，若定时器已启动则按新的参数重新启动
+ * @note 时间轮最多覆盖2^24-1个刻度（默认10毫秒刻度时约46.6小时），timeout_ms（加上slack对齐）或period_ms超出时返回-1，
+ *       定时器保持原来的状态；更长的延时需要由回调分段重新启动
+ * @param timer 定时器
+ * @param timeout_ms 首次到期时间，单位：毫秒
+ * @param period_ms 周期，单位：毫秒，0表示单次定时器
+ * @param slack_ms 允许推迟的时间，单位：毫秒，到期时间会在该范围内对齐，使相近的定时器合并到同一次唤醒中，0表示不对齐
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+SDK_API extern int32_t txd_timer_start(txd_timer_handler_t *timer, uint32_t timeout_ms, uint32_t period_ms, uint32_t slack_ms);
+
+
+/**  停止定时器
+ * @param timer 定时器
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+SDK_API extern int32_t txd_timer_stop(txd_timer_handler_t *timer);
+
+
+/**  销毁定时器
+ * @note 不能在其它线程中销毁回调正在执行的定时器，可以在定时器自己的回调中销毁
+ * @param timer 定时器
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+SDK_API extern int32_t txd_timer_destroy(txd_timer_handler_t *timer);
+
+
+/**  处理所有已到期的定时器
+ * @remarks 使用txd_timer_service_start时由服务线程调用；不使用服务线程时，开发者可在自己的事件循环中调用
+ * @param next_ms 出参，距离下一次需要处理的时间，单位：毫秒，没有待处理的定时器时为TXD_TIMER_WAIT_FOREVER
+ *
+ * @return 本次回调的定时器个数
+ */
+SDK_API extern int32_t txd_timer_process(uint32_t *next_ms);
+
+
+/**  获取距离下一个定时器到期的时间
+ * @note 不加锁，可以在空闲钩子中调用，用于决定系统可以休眠多长时间
+ *
+ * @return 距离下一次到期的时间，单位：毫秒，没有待处理的定时器时为TXD_TIMER_WAIT_FOREVER
+ */
+SDK_API extern uint32_t txd_timer_next_deadline();
+
+
+/**  没有服务线程时的唤醒函数
+ * @note 在调用txd_timer_start的线程中执行（不持有定时器的锁），不能阻塞
+ */
+typedef void (*txd_timer_wakeup_hook)(void);
+
+
+/**  设置没有服务线程时的唤醒函数
+ * @remarks 不使用服务线程、由事件循环调用txd_timer_process时，新启动的定时器早于下一次到期时间，
+ *          会调用此函数让事件循环重新计算等待时间；默认为NULL，不唤醒
+ * @param hook 唤醒函数，NULL表示不唤醒
+ */
+SDK_API extern void txd_timer_set_wakeup_hook(txd_timer_wakeup_hook hook);
+
+
+/**  启动定时器服务线程
+ * @note 只需调用一次，重复调用直接返回成功
+ * @param priority 线程优先级
+ * @param stack_size 线程需要使用的栈大小
+ *
+ * @return 0 表示成功
+ *         -1 表示失败
+ */
+SDK_API extern int32_t txd_timer_service_start(uint8_t priority, uint32_t stack_size);
+
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif